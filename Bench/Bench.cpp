@@ -0,0 +1,166 @@
+/*
+ * JOpt.Bench: microbenchmarks for the parse, convert and descriptor paths.
+ *
+ *   JOpt.Bench [--min-time=MS] [FILTER]
+ *
+ * Each case is repeated until it has run for at least MS milliseconds (default 200); cases whose name
+ * does not contain FILTER are skipped. Results are per item, where an op may cover several items.
+ */
+
+#include <chrono>
+#include <string>
+#include "Util/u.h"
+#include "Util/mutf8.h"
+#include "Parse/Parser.h"
+#include "Javalib/Basic.h"
+#include "Javalib/Class.h"
+#include "Parse/Convert.h"
+#include "Corpus.h"
+
+using namespace Parse;
+
+static const char* filter = nullptr;
+static double min_time_ns = 200e6;
+
+// keeps the optimizer from discarding the result
+static void keep(const void* p) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(p) : "memory");
+#else
+    static const void* volatile sink;
+    sink = p;
+#endif
+}
+
+static double now_ns() {
+    using namespace std::chrono;
+    return (double) duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// bytes and items are per op
+template <class F>
+static void bench(const std::string& name, size_t bytes, int items, F&& op) {
+    if (filter && name.find(filter) == std::string::npos) return;
+    op(); // warm up
+    long n = 1;
+    double t;
+    for (;;) {
+        double t0 = now_ns();
+        for (long i = 0; i < n; i++) op();
+        t = now_ns() - t0;
+        if (t >= min_time_ns) break;
+        n = t < 1e3 ? n * 100 : (long) (n * (min_time_ns / t) * 1.1) + 1;
+    }
+    printf("%-32s %12.1f ns/item %10.1f MB/s %10ld ops\n", name.c_str(), t / ((double) n * items),
+           (double) bytes * n / t * 1e3, n);
+}
+
+static void usage() {
+    fprintf(stderr, "usage: JOpt.Bench [--min-time=MS] [FILTER]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--min-time=", 0) == 0) {
+            min_time_ns = atof(arg.c_str() + 11) * 1e6;
+            if (min_time_ns <= 0) usage();
+        } else if (arg[0] == '-' || filter) {
+            usage();
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    const auto corpus = Bench::MakeCorpus();
+    Parser parser;
+    for (auto& c : corpus) {
+        bench("parse/" + c.Name, c.Bytes.size(), 1, [&] {
+            ClassFile cf;
+            parser.ParseOnto(c.Bytes, cf);
+            keep(&cf);
+        });
+    }
+
+    Region r;
+    rinit(&r);
+    for (auto& c : corpus) {
+        ClassFile cf;
+        parser.ParseOnto(c.Bytes, cf);
+        char* mark = r.cur;
+        bench("convert/" + c.Name, c.Bytes.size(), 1, [&] {
+            keep(ConvertClassFile(&cf, r));
+            rfree(&r, mark);
+        });
+    }
+
+    std::vector<const std::vector<U1>*> utf8s;
+    size_t utf8_bytes = 0;
+    ClassFile pool_file;
+    parser.ParseOnto(corpus[0].Bytes, pool_file);
+    for (auto& e : pool_file.ConstantPool) {
+        if (e && e->Tag == CPoolTags::Utf8) {
+            utf8s.push_back(&ConstantUtf8Info::Reference(e).Bytes);
+            utf8_bytes += utf8s.back()->size();
+        }
+    }
+    bench("mutf8/valid", utf8_bytes, (int) utf8s.size(), [&] {
+        for (auto s : utf8s) keep((const void*) (intptr_t) mutf8_valid(s->data(), s->size()));
+    });
+    std::vector<char> utf8_out(0x10000);
+    bench("mutf8/to-utf8", utf8_bytes, (int) utf8s.size(), [&] {
+        for (auto s : utf8s) mutf8_to_utf8(s->data(), s->size(), utf8_out.data());
+        keep(utf8_out.data());
+    });
+    std::vector<uint16_t> utf16_out(0x10000);
+    bench("mutf8/to-utf16", utf8_bytes, (int) utf8s.size(), [&] {
+        for (auto s : utf8s) mutf8_to_utf16(s->data(), s->size(), utf16_out.data());
+        keep(utf16_out.data());
+    });
+
+    const auto fields = Bench::FieldDescriptors();
+    const auto methods = Bench::MethodDescriptors();
+    size_t field_bytes = 0, method_bytes = 0;
+    for (auto& s : fields) field_bytes += s.size();
+    for (auto& s : methods) method_bytes += s.size();
+    char* mark = r.cur;
+    bench("descriptor/field", field_bytes, (int) fields.size(), [&] {
+        for (auto& s : fields) keep((const void*) (uintptr_t) ParseFieldDescriptor(s.c_str()));
+    });
+    bench("descriptor/method", method_bytes, (int) methods.size(), [&] {
+        for (auto& s : methods) keep(ParseMethodDescriptor(s.c_str(), r).ArgTypes);
+        rfree(&r, mark);
+    });
+
+    bench("descriptor/tokenize", method_bytes, (int) methods.size(), [&] {
+        DescriptorToken tokens[256];
+        for (auto& s : methods) keep((const void*) (intptr_t) TokenizeMethodDescriptor(s.c_str(), s.size(), tokens, 256));
+    });
+    const char* const names[] = {"java/lang/String", "Foo", "com/example/very/deep/pkg/Outer$Inner", "a/b"};
+    bench("names/split", 0, (int) NELEM(names), [&] {
+        for (auto name : names) keep(SplitClassName(name).SimpleName.data());
+    });
+
+    for (int size : {16, 256}) {
+        bench("ralloc/" + std::to_string(size), (size_t) size * 1024, 1024, [&] {
+            for (int i = 0; i < 1024; i++) keep(ralloc(&r, size, 8));
+            rfree(&r, mark);
+        });
+    }
+    rfreeall(&r);
+
+    HeapBuf hb;
+    init_heapbuf(&hb);
+    bprintf(&hb.buf, "%s.%s:%d %x %lld\n", "java/lang/Object", "hashCode", 1234, 0xcafe, -(1LL << 40));
+    size_t line = hb.cur - hb.start;
+    bench("bprintf/mixed", line * 64, 64, [&] {
+        hb.cur = hb.start;
+        for (int i = 0; i < 64; i++) {
+            bprintf(&hb.buf, "%s.%s:%d %x %lld\n", "java/lang/Object", "hashCode", 1234, 0xcafe, -(1LL << 40));
+        }
+        keep(hb.start);
+    });
+    free(finish_heapbuf(&hb));
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "Generate.h"
+#include "Corpus.h"
+
+namespace Bench {
+    static std::string array_of(const std::string& elem, const int dims) { return std::string(dims, '[') + elem; }
+
+    std::vector<CorpusClass> MakeCorpus() {
+        GenParams huge_pool;
+        huge_pool.PoolEntries = 0xffff;
+        huge_pool.Methods = 8;
+        huge_pool.CodeLength = 0xffff;
+
+        GenParams many_methods;
+        many_methods.Methods = 5000;
+        many_methods.CodeLength = 16;
+        many_methods.Fields = 500;
+        many_methods.MaxArgs = 6;
+
+        GenParams deep_arrays;
+        deep_arrays.Methods = 1000;
+        deep_arrays.CodeLength = 8;
+        deep_arrays.Fields = 1000;
+        deep_arrays.ArrayDepth = 255;
+        deep_arrays.MaxArgs = 8;
+
+        return {{"huge-pool", GenerateClass("bench/HugePool", huge_pool)},
+                {"many-methods", GenerateClass("bench/ManyMethods", many_methods)},
+                {"deep-arrays", GenerateClass("bench/DeepArrays", deep_arrays)}};
+    }
+
+    std::vector<std::string> FieldDescriptors() {
+        std::vector<std::string> v = {"I", "J", "Z", "Ljava/lang/String;", "[B", "[[I", "Ljava/util/Map;"};
+        for (int dims = 1; dims <= 255; dims *= 2) { v.push_back(array_of("Ljava/lang/Object;", dims)); }
+        v.push_back(array_of("D", 255));
+        return v;
+    }
+
+    std::vector<std::string> MethodDescriptors() {
+        std::vector<std::string> v = {
+            "()V", "(II)I", "(Ljava/lang/String;)V", "(Ljava/lang/Object;Ljava/lang/Object;)Z",
+            "(Ljava/lang/String;I[BLjava/util/Map;)Ljava/lang/Object;", "([Ljava/lang/String;)V",
+        };
+        std::string wide = "(";
+        for (int i = 0; i < 255; i++) { wide += i & 1 ? "I" : "Ljava/lang/Object;"; }
+        v.push_back(wide + ")V");
+        v.push_back("(" + array_of("I", 255) + array_of("Ljava/lang/Object;", 128) + ")" + array_of("J", 64));
+        return v;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Bench {
+    struct CorpusClass {
+        std::string Name; // names the benchmark case
+        std::vector<std::byte> Bytes;
+    };
+
+    // Synthetic classes stressing one dimension each: a full constant pool, thousands of methods, and
+    // deeply nested array descriptors. Generated in memory, the same on every run.
+    std::vector<CorpusClass> MakeCorpus();
+
+    // from "I" and "(II)V" up to 255-dimensional arrays and 255-slot argument lists
+    std::vector<std::string> FieldDescriptors();
+    std::vector<std::string> MethodDescriptors();
+}
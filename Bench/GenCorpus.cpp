@@ -0,0 +1,96 @@
+/*
+ * JOpt.GenCorpus: writes synthetic class files for scale testing.
+ *
+ *   JOpt.GenCorpus -d DIR [options]
+ *
+ * Classes are named PACKAGE/C0 .. PACKAGE/C<N-1> and laid out under DIR by their internal name, so the
+ * output can be fed straight back to JOpt.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include "Generate.h"
+
+struct Options {
+    const char* OutDir = nullptr;
+    std::string Package = "gen";
+    int Classes = 1;
+    Bench::GenParams Params;
+};
+
+[[noreturn]] static void usage() {
+    fprintf(stderr,
+            "usage: JOpt.GenCorpus -d DIR [options]\n"
+            "  --classes=N      number of classes (default 1)\n"
+            "  --package=P      internal package name (default gen)\n"
+            "  --pool=N         constant_pool_count to reach, up to 65535\n"
+            "  --methods=N      static methods per class (default 16)\n"
+            "  --code=N         bytecode bytes per method, 2..65535 (default 64)\n"
+            "  --fields=N       static fields per class (default 0)\n"
+            "  --array-depth=N  deepest array dimension in descriptors, 0..255 (default 1)\n"
+            "  --max-args=N     arguments per method, 0..127 (default 4)\n"
+            "  --seed=N         (default 1)\n");
+    exit(2);
+}
+
+static long long number(const std::string& arg, size_t eq) {
+    size_t end;
+    long long v;
+    try {
+        v = std::stoll(arg.substr(eq + 1), &end);
+    } catch (const std::exception&) {
+        usage();
+    }
+    if (end != arg.size() - eq - 1 || v < 0 || v > 0x7fffffff) usage();
+    return v;
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        if (arg == "-d" && i + 1 < argc) opts.OutDir = argv[++i];
+        else if (eq == std::string::npos) usage();
+        else if (key == "--package") opts.Package = arg.substr(eq + 1);
+        else if (key == "--classes") opts.Classes = (int) number(arg, eq);
+        else if (key == "--pool") opts.Params.PoolEntries = (int) number(arg, eq);
+        else if (key == "--methods") opts.Params.Methods = (int) number(arg, eq);
+        else if (key == "--code") opts.Params.CodeLength = (int) number(arg, eq);
+        else if (key == "--fields") opts.Params.Fields = (int) number(arg, eq);
+        else if (key == "--array-depth") opts.Params.ArrayDepth = (int) number(arg, eq);
+        else if (key == "--max-args") opts.Params.MaxArgs = (int) number(arg, eq);
+        else if (key == "--seed") opts.Params.Seed = (uint64_t) number(arg, eq);
+        else usage();
+    }
+    if (!opts.OutDir || opts.Package.empty()) usage();
+    return opts;
+}
+
+int main(int argc, char** argv) {
+    const Options opts = parse_options(argc, argv);
+    size_t total = 0;
+    try {
+        for (int i = 0; i < opts.Classes; i++) {
+            const std::string name = opts.Package + "/C" + std::to_string(i);
+            const auto bytes = Bench::GenerateClass(name, opts.Params);
+            std::filesystem::path path(opts.OutDir);
+            path /= name + ".class";
+            std::filesystem::create_directories(path.parent_path());
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize) bytes.size());
+            if (!out) throw std::runtime_error("cannot write " + path.string());
+            total += bytes.size();
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+    printf("%d classes, %zu bytes\n", opts.Classes, total);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <stdexcept>
+#include "Util/hash.h"
+#include "ClassBuilder.h"
+#include "Generate.h"
+
+namespace Bench {
+    using namespace Parse;
+    using Support::ClassBuilder;
+
+    namespace {
+        class Rng { // splitmix64
+        public:
+            explicit Rng(const uint64_t seed) : State(seed) {}
+
+            uint64_t Next() {
+                uint64_t z = State += 0x9e3779b97f4a7c15;
+                z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9;
+                z = (z ^ z >> 27) * 0x94d049bb133111eb;
+                return z ^ z >> 31;
+            }
+
+            int Below(const int n) { return static_cast<int>(Next() % static_cast<uint64_t>(n)); }
+
+        private:
+            uint64_t State;
+        };
+
+        const char* const object_types[] = {
+            "Ljava/lang/Object;", "Ljava/lang/String;", "Ljava/util/List;", "Ljava/util/Map;",
+        };
+
+        struct Signature {
+            std::string Name, Desc;
+            U2 ArgSlots;
+        };
+
+        class Generator {
+        public:
+            Generator(const std::string& name, const GenParams& params)
+                : Params(params), Random(hash64(name.data(), name.size(), params.Seed)), Builder(name, "java/lang/Object") {}
+
+            std::vector<std::byte> Run() {
+                const U2 init = Builder.MethodRef("java/lang/Object", "<init>", "()V");
+                Builder.AddMethod(0x1, "<init>", "()V", {Builder.Code(1, 1, {0x2a, 0xb7, High(init), Low(init), 0xb1})});
+
+                // members take their utf8 entries first, so that filling the pool cannot starve them
+                std::vector<Signature> fields, methods;
+                for (int i = 0; i < Params.Fields; i++) {
+                    fields.push_back({"f" + std::to_string(i), Type(), 0});
+                }
+                for (int i = 0; i < Params.Methods; i++) { methods.push_back(Method("m" + std::to_string(i))); }
+                for (auto* list : {&fields, &methods}) {
+                    for (auto& s : *list) {
+                        Builder.Utf8(s.Name);
+                        Builder.Utf8(s.Desc);
+                    }
+                }
+                Builder.Utf8("Code");
+
+                for (auto& s : fields) { Builder.AddField(0x9, s.Name, s.Desc); }
+                for (auto& s : methods) {
+                    Builder.AddMethod(0x9, s.Name, s.Desc, {Builder.Code(2, s.ArgSlots, Body(s.Desc))});
+                }
+                while (Builder.PoolSize() < static_cast<size_t>(Params.PoolEntries)) {
+                    Builder.Integer(static_cast<U4>(Random.Next()));
+                }
+                return Builder.Build();
+            }
+
+        private:
+            static U1 High(const U2 v) { return static_cast<U1>(v >> 8); }
+            static U1 Low(const U2 v) { return static_cast<U1>(v); }
+
+            std::string Type() {
+                static const char basic[] = "BCDFIJSZ";
+                const int dims = Params.ArrayDepth && Random.Below(2) ? 1 + Random.Below(Params.ArrayDepth) : 0;
+                return std::string(dims, '[') + (Random.Below(2) ? std::string(1, basic[Random.Below(8)])
+                                                                 : object_types[Random.Below(4)]);
+            }
+
+            Signature Method(std::string name) {
+                std::string desc = "(";
+                U2 slots = 0;
+                for (int n = Random.Below(Params.MaxArgs + 1); n; n--) {
+                    const auto t = Type();
+                    slots += t == "J" || t == "D" ? 2 : 1;
+                    desc += t;
+                }
+                desc += ")" + (Random.Below(4) ? Type() : "V");
+                return {std::move(name), std::move(desc), slots};
+            }
+
+            // loads and pops constants up to CodeLength, then returns a default value
+            std::vector<U1> Body(const std::string& desc) {
+                std::vector<U1> tail;
+                switch (desc[desc.find(')') + 1]) {
+                case 'V': tail = {0xb1}; break;                   // return
+                case 'L': case '[': tail = {0x01, 0xb0}; break;   // aconst_null areturn
+                case 'J': tail = {0x09, 0xad}; break;             // lconst_0 lreturn
+                case 'F': tail = {0x0b, 0xae}; break;             // fconst_0 freturn
+                case 'D': tail = {0x0e, 0xaf}; break;             // dconst_0 dreturn
+                default: tail = {0x03, 0xac}; break;              // iconst_0 ireturn
+                }
+                const size_t body = Params.CodeLength - tail.size();
+                std::vector<U1> code;
+                code.reserve(Params.CodeLength);
+                while (code.size() + 4 <= body) { Load(code); }
+                code.resize(body, 0x00); // nop
+                code.insert(code.end(), tail.begin(), tail.end());
+                return code;
+            }
+
+            // ldc_w/ldc2_w of a new constant while the pool has room, else of an earlier one
+            void Load(std::vector<U1>& code) {
+                const bool fresh = Builder.PoolSize() + 2 <= static_cast<size_t>(Params.PoolEntries);
+                const int kind = Random.Below(4);
+                if (kind == 3 && (fresh || !Wide.empty())) {
+                    const U2 c = fresh ? Builder.Long(Random.Next()) : Wide[Random.Below(static_cast<int>(Wide.size()))];
+                    if (fresh) { Wide.push_back(c); }
+                    code.insert(code.end(), {0x14, High(c), Low(c), 0x58}); // ldc2_w pop2
+                } else if (fresh || !Narrow.empty()) {
+                    U2 c;
+                    if (!fresh) {
+                        c = Narrow[Random.Below(static_cast<int>(Narrow.size()))];
+                    } else {
+                        c = kind == 0 ? Builder.String("s" + std::to_string(Narrow.size()))
+                          : kind == 1 ? Builder.Integer(static_cast<U4>(Random.Next()))
+                                      : Builder.Float(static_cast<U4>(Random.Next()));
+                        Narrow.push_back(c);
+                    }
+                    code.insert(code.end(), {0x13, High(c), Low(c), 0x57}); // ldc_w pop
+                } else {
+                    const auto v = static_cast<U2>(Random.Next());
+                    code.insert(code.end(), {0x11, High(v), Low(v), 0x57}); // sipush pop
+                }
+            }
+
+            const GenParams& Params;
+            Rng Random;
+            ClassBuilder Builder;
+            std::vector<U2> Narrow, Wide; // loadable by ldc_w, by ldc2_w
+        };
+    }
+
+    static void check(const bool ok, const char* what) {
+        if (!ok) { throw std::invalid_argument(what); }
+    }
+
+    std::vector<std::byte> GenerateClass(const std::string& name, const GenParams& params) {
+        check(params.PoolEntries >= 0 && params.PoolEntries <= 0xffff, "pool entries must be in 0..65535");
+        check(params.Methods >= 0 && params.Fields >= 0 && params.Methods + params.Fields < 0xffff,
+              "too many members");
+        check(params.CodeLength >= 2 && params.CodeLength <= 0xffff, "code length must be in 2..65535");
+        check(params.ArrayDepth >= 0 && params.ArrayDepth <= 255, "array depth must be in 0..255");
+        check(params.MaxArgs >= 0 && params.MaxArgs <= 127, "max args must be in 0..127");
+        return Generator(name, params).Run();
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Bench {
+    // Shape of a synthetic class. Limits are the JVMS ones; GenerateClass throws std::invalid_argument
+    // outside them.
+    struct GenParams {
+        int PoolEntries = 0;  // constant_pool_count to reach, up to 65535; the pool may end up larger if
+                              // the members alone need more
+        int Methods = 16;     // besides <init>
+        int CodeLength = 64;  // bytecode bytes per method, 2..65535
+        int Fields = 0;
+        int ArrayDepth = 1;   // deepest array dimension in descriptors, 0..255
+        int MaxArgs = 4;      // per method, 0..127 so that longs and doubles stay under 255 slots
+        uint64_t Seed = 1;
+    };
+
+    // A valid, verifiable class: straight-line static methods loading constants from the pool, fields
+    // and signatures with random (possibly deep array) types. The same name and params give the same bytes.
+    std::vector<std::byte> GenerateClass(const std::string& name, const GenParams& params);
+}
@@ -0,0 +1,217 @@
+#include "Util/hash.h"
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "ValueFlow.h"
+#include "Escape.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        constexpr U2 ACC_STATIC = 0x0008;
+        constexpr U2 ACC_INTERFACE = 0x0200;
+        constexpr U2 ACC_ABSTRACT = 0x0400;
+
+        bool is_reference(const char desc) { return desc == 'L' || desc == '['; }
+
+        // whether a constant may go in a field as it is, without the narrowing a putfield does
+        bool fits(const Insn& c, const char field) {
+            int value;
+            switch (c.Op) {
+            case OP_ACONST_NULL: return is_reference(field);
+            case OP_LCONST_0: case OP_LCONST_1: return field == 'J';
+            case OP_FCONST_0: case OP_FCONST_1: case OP_FCONST_2: return field == 'F';
+            case OP_DCONST_0: case OP_DCONST_1: return field == 'D';
+            case OP_BIPUSH: case OP_SIPUSH: value = c.Value; break;
+            default:
+                if (c.Op < OP_ICONST_M1 || c.Op > OP_ICONST_5) { return false; }
+                value = c.Op - OP_ICONST_0;
+            }
+            switch (field) {
+            case 'I': return true;
+            case 'Z': return value == 0 || value == 1;
+            case 'B': return value >= -128 && value < 128;
+            case 'C': return value >= 0 && value < 65536;
+            case 'S': return value >= -32768 && value < 32768;
+            default: return false;
+            }
+        }
+
+        // aload_0; invokespecial Object.<init>()V; (aload_0; load of a parameter or constant; putfield)*; return
+        bool read_constructor(const ClassFile& f, const MethodInfo& m, ScalarClass& cls, ScalarConstructor& ctor) {
+            const AttributeInfo* attr = nullptr;
+            for (const auto& a : m.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) == "Code") { attr = &a; }
+            }
+            if (!attr) { return false; }
+            CodeAttribute code;
+            Parser{}.ParseCodeOnto(attr->Info, code);
+            DecodedCode d;
+            try {
+                d = DecodeCode(f, code);
+            } catch (const InvalidBytecode&) {
+                return false;
+            }
+            const auto& insns = d.Insns;
+            const size_t n = insns.size();
+            if (!d.Handlers.empty() || n < 3 || (n - 3) % 3 || insns[0].Op != OP_ALOAD || insns[0].Local != 0 ||
+                insns[1].Op != OP_INVOKESPECIAL || insns[n - 1].Op != OP_RETURN) {
+                return false;
+            }
+            const auto super = MemberRefAt(f, static_cast<U2>(insns[1].Value));
+            if (super.Owner != "java/lang/Object" || super.Name != "<init>" || super.Descriptor != "()V") { return false; }
+
+            // the parameter that starts at each local
+            std::vector<std::pair<int, char>> params; // (number, descriptor) by local
+            const std::string_view desc = ctor.Descriptor;
+            params.emplace_back(-1, 0);
+            size_t i = 1;
+            for (int number = 0; i < desc.size() && desc[i] != ')'; number++) {
+                const char type = desc[i];
+                while (i < desc.size() && desc[i] == '[') { i++; }
+                i = i < desc.size() && desc[i] == 'L' ? desc.find(';', i) : i;
+                if (i >= desc.size()) { return false; }
+                i++;
+                params.emplace_back(number, type);
+                if (TypeSlots(type) == 2) { params.emplace_back(-1, 0); }
+            }
+            if (i >= desc.size()) { return false; }
+
+            ctor.Fields.assign(cls.Fields.size(), FieldSource{});
+            for (i = 2; i + 1 < n; i += 3) {
+                const Insn& value = insns[i + 1];
+                if (insns[i].Op != OP_ALOAD || insns[i].Local != 0 || insns[i + 2].Op != OP_PUTFIELD) { return false; }
+                const auto ref = MemberRefAt(f, static_cast<U2>(insns[i + 2].Value));
+                const int field = ref.Owner == cls.Name ? cls.Field(ref.Name, ref.Descriptor) : -1;
+                if (field < 0) { return false; }
+                const char type = ref.Descriptor[0];
+                FieldSource source;
+                if (value.Op >= OP_ILOAD && value.Op <= OP_ALOAD) {
+                    if (value.Local >= static_cast<int>(params.size()) || params[value.Local].first < 0) { return false; }
+                    const char param = params[value.Local].second;
+                    if (LoadInsn(param, 0).Op != value.Op ||
+                        (is_reference(type) ? !is_reference(param) : type != param)) {
+                        return false;
+                    }
+                    source.From = FieldSource::Kind::Param;
+                    source.Param = params[value.Local].first;
+                } else if (fits(value, type)) {
+                    source.From = FieldSource::Kind::Const;
+                    source.Const = value;
+                    source.Const.Pc = -1;
+                } else {
+                    return false;
+                }
+                ctor.Fields[field] = source;
+            }
+            return true;
+        }
+
+        bool allowed_use(const ClassFile& f, const Insn& in, const size_t slot, const ScalarClass& cls) {
+            if (slot || (in.Op != OP_INVOKESPECIAL && in.Op != OP_GETFIELD && in.Op != OP_PUTFIELD)) { return false; }
+            const auto ref = MemberRefAt(f, static_cast<U2>(in.Value));
+            if (ref.Owner != cls.Name) { return false; }
+            if (in.Op == OP_INVOKESPECIAL) { return ref.Name == "<init>" && cls.Constructor(ref.Descriptor); }
+            return cls.Field(ref.Name, ref.Descriptor) >= 0;
+        }
+    }
+
+    int ScalarClass::Field(const std::string_view name, const std::string_view desc) const {
+        for (size_t i = 0; i < Fields.size(); i++) {
+            if (Fields[i].first == name && Fields[i].second == desc) { return static_cast<int>(i); }
+        }
+        return -1;
+    }
+
+    const ScalarConstructor* ScalarClass::Constructor(const std::string_view desc) const {
+        for (const auto& c : Constructors) {
+            if (c.Descriptor == desc) { return &c; }
+        }
+        return nullptr;
+    }
+
+    void ScalarClasses::Add(const ClassFile& f) {
+        const auto name = ClassNameAt(f, f.ThisClass);
+        // of a name added twice, there is no telling which class is loaded
+        if (!Seen.emplace(name).second) {
+            if (const auto it = Classes.find(name); it != Classes.end()) { Classes.erase(it); }
+            return;
+        }
+        if ((f.AccessFlags & (ACC_INTERFACE | ACC_ABSTRACT)) || !f.SuperClass ||
+            ClassNameAt(f, f.SuperClass) != "java/lang/Object") {
+            return;
+        }
+        ScalarClass cls;
+        cls.Name = std::string(name);
+        for (const auto& field : f.Fields) {
+            if (field.AccessFlags & ACC_STATIC) { continue; }
+            cls.Fields.emplace_back(Utf8At(f, field.NameIndex), Utf8At(f, field.DescriptorIndex));
+        }
+        for (const auto& m : f.Methods) {
+            const auto method = Utf8At(f, m.NameIndex);
+            const auto desc = Utf8At(f, m.DescriptorIndex);
+            // creating an object would run these
+            if (method == "<clinit>" || (method == "finalize" && desc == "()V")) { return; }
+            if (method != "<init>") { continue; }
+            ScalarConstructor ctor;
+            ctor.Descriptor = std::string(desc);
+            if (read_constructor(f, m, cls, ctor)) { cls.Constructors.push_back(std::move(ctor)); }
+        }
+        if (!cls.Constructors.empty()) { Classes.emplace(cls.Name, std::move(cls)); }
+    }
+
+    const ScalarClass* ScalarClasses::Find(const std::string_view name) const {
+        const auto it = Classes.find(name);
+        return it == Classes.end() ? nullptr : &it->second;
+    }
+
+    uint64_t ScalarClasses::Hash() const {
+        std::string s;
+        for (const auto& [name, cls] : Classes) {
+            s += name;
+            for (const auto& [field, desc] : cls.Fields) { s += ' ' + field + ':' + desc; }
+            for (const auto& ctor : cls.Constructors) {
+                s += ' ' + ctor.Descriptor;
+                for (const auto& source : ctor.Fields) {
+                    s += ',' + std::to_string(static_cast<int>(source.From)) + '.' + std::to_string(source.Param) + '.' +
+                         std::to_string(source.Const.Op) + '.' + std::to_string(source.Const.Value);
+                }
+            }
+            s += '\n';
+        }
+        return hash64(s.data(), s.size(), 0);
+    }
+
+    std::vector<ScalarAllocation> FindScalarAllocations(const ClassFile& f, const DecodedCode& code,
+                                                        const ScalarClasses& classes) {
+        const int n = static_cast<int>(code.Insns.size());
+        std::vector<int> sources(n, -1);
+        std::vector<const ScalarClass*> class_of(n);
+        bool any = false;
+        for (int i = 0; i < n; i++) {
+            if (code.Insns[i].Op != OP_NEW) { continue; }
+            class_of[i] = classes.Find(ClassNameAt(f, static_cast<U2>(code.Insns[i].Value)));
+            if (class_of[i]) { sources[i] = i, any = true; }
+        }
+        if (!any) { return {}; }
+
+        const ValueFlow flow(f, code, sources);
+        std::vector<bool> escapes(n);
+        std::vector<std::vector<int>> uses(n);
+        for (int i = 0; i < n; i++) {
+            const auto& inputs = flow.Inputs(i);
+            for (size_t k = 0; k < inputs.size(); k++) {
+                const int s = inputs[k];
+                if (s < 0) { continue; }
+                if (!allowed_use(f, code.Insns[i], k, *class_of[s])) { escapes[s] = true; }
+                else { uses[s].push_back(i); }
+            }
+        }
+        std::vector<ScalarAllocation> result;
+        for (int s = 0; s < n; s++) {
+            if (sources[s] < 0 || escapes[s] || flow.Ambiguous(s) || flow.Depth(s) < 0) { continue; }
+            result.push_back({s, flow.Depth(s), class_of[s], std::move(uses[s])});
+        }
+        return result;
+    }
+}
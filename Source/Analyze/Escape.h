@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Insns.h"
+
+/*
+ * Allocations that never leave the method that makes them, so that their fields can live in locals.
+ *
+ * Only objects whose construction has no effect but setting their fields qualify: a concrete class
+ * that extends java/lang/Object, has no static initializer and no finalizer, and whose constructor
+ * does nothing but call Object.<init>() and store parameters and constants in its own fields. Such an
+ * object escapes unless every use of it (see ValueFlow) is its constructor call, or a getfield or
+ * putfield of one of its fields on it.
+ */
+
+namespace Analyze {
+    // what a constructor leaves in a field
+    struct FieldSource {
+        enum class Kind : uint8_t { Default, Param, Const };
+        Kind From = Kind::Default;
+        int Param = 0; // argument, counted from 0 without the receiver
+        Insn Const;    // aconst_null, iconst_<n>, lconst_<n>, fconst_<n>, dconst_<n>, bipush or sipush
+    };
+
+    struct ScalarConstructor {
+        std::string Descriptor;
+        std::vector<FieldSource> Fields; // by field of the class
+    };
+
+    struct ScalarClass {
+        std::string Name;
+        std::vector<std::pair<std::string, std::string>> Fields; // instance fields, name and descriptor
+        std::vector<ScalarConstructor> Constructors;              // only those that qualify
+
+        int Field(std::string_view name, std::string_view desc) const; // -1 if not there
+        const ScalarConstructor* Constructor(std::string_view desc) const;
+    };
+
+    // The classes of a batch whose objects may be replaced by their fields. Add every class first;
+    // lookups may then run on any number of threads.
+    class ScalarClasses {
+    public:
+        void Add(const Parse::ClassFile& f);
+        const ScalarClass* Find(std::string_view name) const;
+        bool Empty() const { return Classes.empty(); }
+        // of everything the transform goes by, for the output cache
+        uint64_t Hash() const;
+
+    private:
+        std::map<std::string, ScalarClass, std::less<>> Classes;
+        std::set<std::string, std::less<>> Seen;
+    };
+
+    struct ScalarAllocation {
+        int New;                  // the new instruction
+        int Depth;                // stack slots before it
+        const ScalarClass* Class;
+        std::vector<int> Uses;    // the <init>, getfield and putfield instructions on the object
+    };
+
+    // The allocations of classes in the index that do not escape the code, in code order. Throws like
+    // ValueFlow.
+    std::vector<ScalarAllocation> FindScalarAllocations(const Parse::ClassFile& f, const DecodedCode& code,
+                                                        const ScalarClasses& classes);
+}
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <tuple>
+#include "Util/hash.h"
+#include "Util/mapfile.h"
+#include "Parse/CpRefs.h"
+#include "ExecutionProfile.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        uint64_t method_key(const std::string_view cls, const std::string_view name, const std::string_view desc) {
+            return hash64(desc.data(), desc.size(), hash64(name.data(), name.size(), hash64(cls.data(), cls.size(), 0)));
+        }
+
+        // the instructions of the Code attribute of m; empty if it has none that holds them
+        std::vector<U1> code_of(const ClassFile& f, const MethodInfo& m) {
+            for (const auto& a : m.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) != "Code" || a.Info.size() < 8) { continue; }
+                const auto& info = a.Info;
+                const size_t length = size_t(info[4]) << 24 | size_t(info[5]) << 16 | size_t(info[6]) << 8 | info[7];
+                if (length > info.size() - 8) { continue; }
+                return {info.begin() + 8, info.begin() + 8 + length};
+            }
+            return {};
+        }
+
+        struct BadRecord {
+            const char* What;
+        };
+
+        // the fields of a record
+        std::vector<std::string_view> split(const std::string_view line) {
+            std::vector<std::string_view> fields;
+            size_t at = 0;
+            while (at < line.size()) {
+                at = line.find_first_not_of(" \t\r", at);
+                if (at == std::string_view::npos) { break; }
+                const size_t end = std::min(line.find_first_of(" \t\r", at), line.size());
+                fields.push_back(line.substr(at, end - at));
+                at = end;
+            }
+            return fields;
+        }
+
+        uint64_t count(const std::string_view field) {
+            uint64_t n;
+            const auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), n);
+            if (error != std::errc() || end != field.data() + field.size()) { throw BadRecord{"bad count"}; }
+            return n;
+        }
+    }
+
+    void ExecutionProfile::add(const std::string_view line) {
+        const auto fields = split(line);
+        if (fields.empty() || fields[0][0] == '#') { return; }
+        const bool branch = fields[0] == "branch";
+        if (!branch && fields[0] != "method") { throw BadRecord{"unknown record"}; }
+        if (fields.size() != (branch ? 7 : 5)) { throw BadRecord{"wrong number of fields"}; }
+
+        const uint64_t hash = method_key(fields[1], fields[2], fields[3]);
+        int id = Find(hash, fields[1], fields[2], fields[3]);
+        if (id < 0) {
+            id = static_cast<int>(Methods.size());
+            Ids.emplace(hash, id);
+            Keys.push_back({std::string(fields[1]), std::string(fields[2]), std::string(fields[3])});
+            Methods.emplace_back();
+            ByClass[Keys.back().Class].push_back(id);
+        }
+        auto& m = Methods[id];
+        if (!branch) {
+            m.Invocations += count(fields[4]);
+            MostInvoked = std::max(MostInvoked, m.Invocations);
+            return;
+        }
+        const uint64_t pc = count(fields[4]);
+        if (pc > 0xffff) { throw BadRecord{"bad bytecode offset"}; }
+        m.Branches.push_back({static_cast<int>(pc), count(fields[5]), count(fields[6])});
+    }
+
+    void ExecutionProfile::Load(const char* path) {
+        size_t size;
+        const auto data = static_cast<const char*>(map_file(path, &size));
+        if (!data) {
+            const int err = errno;
+            std::error_code ec;
+            if (std::filesystem::is_regular_file(path, ec) && std::filesystem::file_size(path, ec) == 0 && !ec) {
+                return; // nothing to map, and nothing to add
+            }
+            throw InvalidProfile(std::string(path) + ": " + strerror(err));
+        }
+        const std::string_view text(data, size);
+        int line = 1;
+        try {
+            for (size_t at = 0; at < text.size(); line++) {
+                const size_t end = std::min(text.find('\n', at), text.size());
+                add(text.substr(at, end - at));
+                at = end + 1;
+            }
+        } catch (const BadRecord& e) {
+            unmap_file(data, size);
+            throw InvalidProfile(std::string(path) + ":" + std::to_string(line) + ": " + e.What);
+        }
+        unmap_file(data, size);
+
+        // records of a branch add up too
+        for (auto& m : Methods) {
+            auto& branches = m.Branches;
+            std::stable_sort(branches.begin(), branches.end(), [](const BranchCounts& a, const BranchCounts& b) {
+                return a.Pc < b.Pc;
+            });
+            size_t kept = 0;
+            for (size_t k = 0; k < branches.size(); k++) {
+                if (kept && branches[kept - 1].Pc == branches[k].Pc) {
+                    branches[kept - 1].Taken += branches[k].Taken;
+                    branches[kept - 1].NotTaken += branches[k].NotTaken;
+                } else {
+                    branches[kept++] = branches[k];
+                }
+            }
+            branches.resize(kept);
+        }
+    }
+
+    int ExecutionProfile::Find(const uint64_t hash, const std::string_view cls, const std::string_view name,
+                               const std::string_view desc) const {
+        const auto [begin, end] = Ids.equal_range(hash);
+        for (auto at = begin; at != end; ++at) {
+            const auto& key = Keys[at->second];
+            if (key.Class == cls && key.Name == name && key.Descriptor == desc) { return at->second; }
+        }
+        return -1;
+    }
+
+    int ExecutionProfile::Id(const std::string_view cls, const std::string_view name, const std::string_view desc) const {
+        return Find(method_key(cls, name, desc), cls, name, desc);
+    }
+
+    int ExecutionProfile::Id(const ClassFile& f, const MethodInfo& m) const {
+        if (Ids.empty()) { return -1; }
+        return Id(ClassNameAt(f, f.ThisClass), Utf8At(f, m.NameIndex), Utf8At(f, m.DescriptorIndex));
+    }
+
+    const BranchCounts* ExecutionProfile::Branch(const int id, const int pc) const {
+        const auto& branches = Methods[id].Branches;
+        const auto at = std::lower_bound(branches.begin(), branches.end(), pc, [](const BranchCounts& b, const int pc) {
+            return b.Pc < pc;
+        });
+        return at != branches.end() && at->Pc == pc ? &*at : nullptr;
+    }
+
+    uint64_t ExecutionProfile::Hash(const std::string_view cls) const {
+        const auto at = ByClass.find(std::string(cls));
+        if (at == ByClass.end()) { return 0; }
+        // in an order that does not depend on the order of the records
+        auto ids = at->second;
+        std::sort(ids.begin(), ids.end(), [&](const int a, const int b) {
+            return std::tie(Keys[a].Name, Keys[a].Descriptor) < std::tie(Keys[b].Name, Keys[b].Descriptor);
+        });
+        uint64_t h = 0;
+        for (const int id : ids) {
+            const auto& key = Keys[id];
+            h = hash64(key.Name.data(), key.Name.size() + 1, h);
+            h = hash64(key.Descriptor.data(), key.Descriptor.size() + 1, h);
+            std::vector<uint64_t> words{Methods[id].Invocations};
+            for (const auto& b : Methods[id].Branches) {
+                words.push_back(b.Pc);
+                words.push_back(b.Taken);
+                words.push_back(b.NotTaken);
+            }
+            h = hash64(words.data(), words.size() * sizeof(uint64_t), h);
+        }
+        return h;
+    }
+
+    ProfiledCode::ProfiledCode(const ClassFile& f) {
+        for (const auto& m : f.Methods) {
+            auto code = code_of(f, m);
+            if (!code.empty()) {
+                Code.emplace(std::make_pair(std::string(Utf8At(f, m.NameIndex)), std::string(Utf8At(f, m.DescriptorIndex))),
+                             std::move(code));
+            }
+        }
+    }
+
+    bool ProfiledCode::Unchanged(const ClassFile& f, const MethodInfo& m) const {
+        const auto at = Code.find(std::make_pair(std::string(Utf8At(f, m.NameIndex)), std::string(Utf8At(f, m.DescriptorIndex))));
+        if (at == Code.end()) { return false; }
+        return code_of(f, m) == at->second;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Parse/ClassFile.h"
+
+/*
+ * Counts from runs of the program, for the passes that decide what is worth optimizing (inlining, block
+ * layout, outlining) by what actually runs.
+ *
+ * A profile is a text file of one record per line, its fields separated by blanks; empty lines and
+ * lines starting with `#' are skipped:
+ *
+ *   method CLASS NAME DESCRIPTOR INVOCATIONS
+ *   branch CLASS NAME DESCRIPTOR PC TAKEN NOT-TAKEN
+ *
+ * CLASS is an internal name and PC the bytecode offset of a conditional branch in the input class, so
+ * a pass that goes by branch counts either runs before anything rewrites code or checks with a
+ * ProfiledCode that the code of the method is still that of the input. Counts of records for the same
+ * method or branch add up, so profiles of several runs can simply be concatenated; an empty file is a
+ * profile without records. Whatever a profiler gives (JFR method and branch statistics, say) is turned
+ * into this by a script of a few lines.
+ *
+ * Methods are interned on loading: a method is looked up once by its class, name and descriptor, and
+ * its counts are then reached by id.
+ */
+
+namespace Analyze {
+    struct InvalidProfile : std::exception {
+        explicit InvalidProfile(std::string msg): Message(std::move(msg)) {}
+        const char* what() const noexcept override { return Message.c_str(); }
+        std::string Message;
+    };
+
+    struct BranchCounts {
+        int Pc;
+        uint64_t Taken, NotTaken;
+    };
+
+    struct MethodCounts {
+        uint64_t Invocations = 0;
+        std::vector<BranchCounts> Branches; // ascending Pc
+    };
+
+    // Load every profile first; lookups may then run on any number of threads.
+    class ExecutionProfile {
+    public:
+        // Adds the counts of a profile file to those loaded before. Throws InvalidProfile for a file that
+        // cannot be read or a malformed record.
+        void Load(const char* path);
+
+        bool Empty() const { return Methods.empty(); }
+        int MethodCount() const { return static_cast<int>(Methods.size()); }
+        // -1 for a method the profile has no counts for
+        int Id(std::string_view cls, std::string_view name, std::string_view desc) const;
+        int Id(const Parse::ClassFile& f, const Parse::MethodInfo& m) const;
+        const MethodCounts& Counts(int id) const { return Methods[id]; }
+        // of the branch at pc of a method; null if there are none
+        const BranchCounts* Branch(int id, int pc) const;
+        // of the method invoked most, for passes that judge how hot a method is against it
+        uint64_t MaxInvocations() const { return MostInvoked; }
+        // of the counts of the methods of cls, for the output cache entry of that class; 0 if there are none
+        uint64_t Hash(std::string_view cls) const;
+
+    private:
+        void add(std::string_view line);
+
+        struct MethodKey {
+            std::string Class, Name, Descriptor;
+        };
+
+        // -1 if there is none
+        int Find(uint64_t hash, std::string_view cls, std::string_view name, std::string_view desc) const;
+
+        std::unordered_multimap<uint64_t, int> Ids; // by the hash of class, name and descriptor
+        std::vector<MethodKey> Keys;                // by id, compared on every lookup
+        std::vector<MethodCounts> Methods;          // by id
+        std::unordered_map<std::string, std::vector<int>> ByClass; // ids of the methods of each class
+        uint64_t MostInvoked = 0;
+    };
+
+    // The bytecode of the methods of a class as it was input, taken before any pass runs: the branch
+    // counts of a method only hold while its code is that of the input. Only the instructions are
+    // compared, so dropping attributes within Code (--strip) keeps the counts.
+    class ProfiledCode {
+    public:
+        ProfiledCode() = default; // of no method
+        explicit ProfiledCode(const Parse::ClassFile& f);
+
+        // whether m has code that is still what was input
+        bool Unchanged(const Parse::ClassFile& f, const Parse::MethodInfo& m) const;
+
+    private:
+        std::map<std::pair<std::string, std::string>, std::vector<Parse::U1>> Code; // by name and descriptor
+    };
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <string>
+#include "Util/hash.h"
+#include "Parse/CpRefs.h"
+#include "Hierarchy.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        constexpr U2 ACC_INTERFACE = 0x0200;
+        constexpr int MAX_DEPTH = 64; // superclass chains are cut off here
+
+        // class, superclass ("" for interfaces)
+        const char* const core_classes[][2] = {
+            {"java/lang/String", "java/lang/Object"},
+            {"java/lang/Class", "java/lang/Object"},
+            {"java/lang/Number", "java/lang/Object"},
+            {"java/lang/Boolean", "java/lang/Object"},
+            {"java/lang/Character", "java/lang/Object"},
+            {"java/lang/Byte", "java/lang/Number"},
+            {"java/lang/Short", "java/lang/Number"},
+            {"java/lang/Integer", "java/lang/Number"},
+            {"java/lang/Long", "java/lang/Number"},
+            {"java/lang/Float", "java/lang/Number"},
+            {"java/lang/Double", "java/lang/Number"},
+            {"java/lang/AbstractStringBuilder", "java/lang/Object"},
+            {"java/lang/StringBuilder", "java/lang/AbstractStringBuilder"},
+            {"java/lang/StringBuffer", "java/lang/AbstractStringBuilder"},
+            {"java/lang/Enum", "java/lang/Object"},
+            {"java/lang/Record", "java/lang/Object"},
+            {"java/lang/Throwable", "java/lang/Object"},
+            {"java/lang/Exception", "java/lang/Throwable"},
+            {"java/lang/Error", "java/lang/Throwable"},
+            {"java/lang/AssertionError", "java/lang/Error"},
+            {"java/lang/LinkageError", "java/lang/Error"},
+            {"java/lang/RuntimeException", "java/lang/Exception"},
+            {"java/lang/ReflectiveOperationException", "java/lang/Exception"},
+            {"java/lang/ClassNotFoundException", "java/lang/ReflectiveOperationException"},
+            {"java/lang/InterruptedException", "java/lang/Exception"},
+            {"java/lang/CloneNotSupportedException", "java/lang/Exception"},
+            {"java/io/IOException", "java/lang/Exception"},
+            {"java/lang/ArithmeticException", "java/lang/RuntimeException"},
+            {"java/lang/ClassCastException", "java/lang/RuntimeException"},
+            {"java/lang/NullPointerException", "java/lang/RuntimeException"},
+            {"java/lang/IllegalStateException", "java/lang/RuntimeException"},
+            {"java/lang/IllegalArgumentException", "java/lang/RuntimeException"},
+            {"java/lang/NumberFormatException", "java/lang/IllegalArgumentException"},
+            {"java/lang/UnsupportedOperationException", "java/lang/RuntimeException"},
+            {"java/lang/IndexOutOfBoundsException", "java/lang/RuntimeException"},
+            {"java/lang/ArrayIndexOutOfBoundsException", "java/lang/IndexOutOfBoundsException"},
+            {"java/lang/StringIndexOutOfBoundsException", "java/lang/IndexOutOfBoundsException"},
+            {"java/lang/invoke/MethodHandle", "java/lang/Object"},
+            {"java/lang/invoke/MethodType", "java/lang/Object"},
+            {"java/lang/Cloneable", ""},
+            {"java/io/Serializable", ""},
+            {"java/lang/Comparable", ""},
+            {"java/lang/CharSequence", ""},
+            {"java/lang/Runnable", ""},
+            {"java/lang/Iterable", ""},
+            {"java/lang/AutoCloseable", ""},
+            {"java/util/Collection", ""},
+            {"java/util/List", ""},
+            {"java/util/Set", ""},
+            {"java/util/Map", ""},
+            {"java/util/Iterator", ""},
+        };
+
+        bool is_reference(JType t) {
+            return !(JTypeKind(t) & 1);
+        }
+    }
+
+    ClassHierarchy::ClassHierarchy(): Object(ClassType("java/lang/Object")) {
+        Add(Object, 0, false);
+        for (auto& c : core_classes) {
+            const bool interface = !*c[1];
+            Add(ClassType(c[0]), interface ? Object : ClassType(c[1]), interface);
+        }
+    }
+
+    void ClassHierarchy::Add(const JType cls, const JType super, const bool is_interface) {
+        Classes[cls] = Entry{super, is_interface};
+    }
+
+    void ClassHierarchy::AddClassFile(const ClassFile& f) {
+        const auto super = f.SuperClass ? ClassType(ClassNameAt(f, f.SuperClass)) : 0;
+        Add(ClassType(ClassNameAt(f, f.ThisClass)), super, (f.AccessFlags & ACC_INTERFACE) != 0);
+    }
+
+    void ClassHierarchy::AddClassHeader(const ClassHeader& h) {
+        const auto super = h.SuperClass.empty() ? 0 : ClassType(h.SuperClass);
+        Add(ClassType(h.ThisClass), super, (h.AccessFlags & ACC_INTERFACE) != 0);
+    }
+
+    bool ClassHierarchy::IsInterface(const JType cls) const {
+        const auto it = Classes.find(cls);
+        return it != Classes.end() && it->second.Interface;
+    }
+
+    JType ClassHierarchy::Super(const JType cls) const {
+        const auto it = Classes.find(cls);
+        return it == Classes.end() ? 0 : it->second.Super;
+    }
+
+    bool ClassHierarchy::IsAssignable(const JType from, const JType to) const {
+        if (from == to || to == Object) { return true; }
+        if (ArrayDims(to)) {
+            if (!ArrayDims(from)) { return false; }
+            const auto ef = ElemType(from), et = ElemType(to);
+            if (is_reference(ef) && is_reference(et)) { return IsAssignable(ef, et); }
+            return ef == et;
+        }
+        if (IsInterface(to)) { return true; } // also takes care of Cloneable and Serializable for arrays
+        if (ArrayDims(from)) { return false; }
+        int depth = 0; // a malformed input may have a cycle
+        for (auto t = Super(from); t && depth++ < MAX_DEPTH; t = Super(t)) {
+            if (t == to) { return true; }
+        }
+        return false;
+    }
+
+    JType ClassHierarchy::CommonSuperclass(const JType a, const JType b) const {
+        if (a == b) { return a; }
+        if (ArrayDims(a) && ArrayDims(b)) {
+            const auto ea = ElemType(a), eb = ElemType(b);
+            if (is_reference(ea) && is_reference(eb)) {
+                const auto common = CommonSuperclass(ea, eb);
+                return common ? ArrayOf(common) : 0;
+            }
+            return Object;
+        }
+        if (ArrayDims(a) || ArrayDims(b) || IsInterface(a) || IsInterface(b)) { return Object; }
+        JType chain[MAX_DEPTH];
+        int n = 0, depth = 0;
+        for (auto t = a; t && n < MAX_DEPTH; t = Super(t)) { chain[n++] = t; }
+        for (auto t = b; t && depth++ < MAX_DEPTH; t = Super(t)) {
+            if (std::find(chain, chain + n, t) != chain + n) { return t; }
+        }
+        return 0; // both chains would have ended at java/lang/Object had they been complete
+    }
+
+    uint64_t ClassHierarchy::ChainHash(JType cls) const {
+        while (ArrayDims(cls)) { cls = ElemType(cls); }
+        if (!is_reference(cls)) { return 0; }
+        std::string chain;
+        int depth = 0;
+        for (auto t = cls; t && depth++ < MAX_DEPTH; t = Super(t)) {
+            chain += ClassName(t);
+            const auto it = Classes.find(t);
+            chain += it == Classes.end() ? " unknown\n" : it->second.Interface ? " interface\n" : "\n";
+        }
+        return hash64(chain.data(), chain.size(), 0);
+    }
+}
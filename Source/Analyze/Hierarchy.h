@@ -0,0 +1,46 @@
+#pragma once
+
+#include <unordered_map>
+#include "Util/u.h"
+#include "Javalib/Basic.h"
+#include "Parse/ClassFile.h"
+#include "Parse/Visitor.h"
+
+namespace Analyze {
+    // Superclasses of the classes being optimized plus the core java.lang ones, enough to merge types
+    // the way the verifier does without loading anything. Types are class JTypes (or arrays of them).
+    //
+    // Like the verifier, an interface is treated as java/lang/Object: everything is assignable to it.
+    // A class missing from the index is taken to be a class. Its superclasses are not known, so a merge
+    // that would have to look at them gives 0 rather than a guess.
+    class ClassHierarchy {
+    public:
+        ClassHierarchy(); // seeded with the core classes
+
+        // super 0 for java/lang/Object itself
+        void Add(JType cls, JType super, bool is_interface);
+        void AddClassFile(const Parse::ClassFile& f);
+        void AddClassHeader(const Parse::ClassHeader& h);
+
+        bool Known(JType cls) const { return Classes.count(cls) != 0; }
+        bool IsInterface(JType cls) const;
+        bool IsAssignable(JType from, JType to) const;
+        // 0 if that depends on the superclasses of a class missing from the index
+        JType CommonSuperclass(JType a, JType b) const;
+
+        // of what a merge meeting cls can see of the index: the names and kinds of cls and of its
+        // superclasses, as far as they are known
+        uint64_t ChainHash(JType cls) const;
+
+    private:
+        struct Entry {
+            JType Super;
+            bool Interface;
+        };
+
+        JType Super(JType cls) const; // 0 if unknown
+
+        std::unordered_map<JType, Entry> Classes;
+        JType Object;
+    };
+}
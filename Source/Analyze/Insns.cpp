@@ -0,0 +1,764 @@
+#include <algorithm>
+#include <stdexcept>
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/PoolEditor.h"
+#include "Parse/Writer.h"
+#include "StackMap.h"
+#include "ValueFlow.h"
+#include "Insns.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        int get_u2(const U1* p) {
+            return p[0] << 8 | p[1];
+        }
+
+        int get_s2(const U1* p) {
+            return static_cast<int16_t>(p[0] << 8 | p[1]);
+        }
+
+        int get_s4(const U1* p) {
+            return static_cast<int32_t>(static_cast<U4>(p[0]) << 24 | static_cast<U4>(p[1]) << 16 | p[2] << 8 | p[3]);
+        }
+
+        void put_u2(std::vector<U1>& out, const int v) {
+            out.push_back(static_cast<U1>(v >> 8));
+            out.push_back(static_cast<U1>(v));
+        }
+
+        void put_s4(std::vector<U1>& out, const int v) {
+            put_u2(out, static_cast<int>(static_cast<U4>(v) >> 16));
+            put_u2(out, v & 0xffff);
+        }
+
+        bool is_load(const int op) { return op >= OP_ILOAD && op <= OP_ALOAD; }
+        bool is_store(const int op) { return op >= OP_ISTORE && op <= OP_ASTORE; }
+        bool is_conditional(const int op) { return IsBranch(static_cast<uint8_t>(op)) && op != OP_GOTO && op != OP_JSR; }
+
+        // the branch taken when op is not
+        int inverted(const int op) {
+            if (op == OP_IFNULL || op == OP_IFNONNULL) { return op ^ OP_IFNULL ^ OP_IFNONNULL; }
+            return OP_IFEQ + ((op - OP_IFEQ) ^ 1);
+        }
+
+        int switch_base(const int pc) {
+            return (pc + 4) & -4;
+        }
+
+        int insn_size(const DecodedCode& d, const Insn& in, const int pc, const bool wide) {
+            const int op = in.Op;
+            if (is_load(op) || is_store(op)) { return in.Local < 4 ? 1 : in.Local < 256 ? 2 : 4; }
+            switch (op) {
+            case OP_IINC: return in.Local < 256 && in.Value >= -128 && in.Value < 128 ? 3 : 6;
+            case OP_RET: return in.Local < 256 ? 2 : 4;
+            case OP_LDC: return in.Value < 256 ? 2 : 3;
+            case OP_GOTO: case OP_JSR: return wide ? 5 : 3;
+            case OP_TABLESWITCH: return switch_base(pc) - pc + 12 + 4 * static_cast<int>(d.Switches[in.Value].Keys.size());
+            case OP_LOOKUPSWITCH: return switch_base(pc) - pc + 8 + 8 * static_cast<int>(d.Switches[in.Value].Keys.size());
+            default:
+                if (is_conditional(op)) { return wide ? 8 : 3; }
+                if (OpcodeTable[op].Length <= 0 || !OpcodeTable[op].Name) { throw InvalidBytecode(); }
+                return OpcodeTable[op].Length;
+            }
+        }
+
+        // the offset of every instruction and of the end, with the branches in wide that need four-byte offsets
+        std::vector<int> lay_out(const DecodedCode& d, std::vector<bool>& wide) {
+            const auto& insns = d.Insns;
+            std::vector<int> pcs(insns.size() + 1);
+            wide.assign(insns.size(), false);
+            for (bool grew = true; grew;) {
+                int pc = 0;
+                for (size_t i = 0; i < insns.size(); i++) {
+                    pcs[i] = pc;
+                    pc += insn_size(d, insns[i], pc, wide[i]);
+                }
+                pcs[insns.size()] = pc;
+                // widening only moves code further apart, so this ends
+                grew = false;
+                for (size_t i = 0; i < insns.size(); i++) {
+                    if (!IsBranch(insns[i].Op) || wide[i]) { continue; }
+                    const int offset = pcs[insns[i].Target] - pcs[i];
+                    if (offset < -32768 || offset > 32767) { wide[i] = grew = true; }
+                }
+            }
+            if (pcs.back() > 65535) { throw std::length_error("code longer than 65535 bytes"); }
+            return pcs;
+        }
+
+        void emit(const DecodedCode& d, const Insn& in, const int pc, const bool wide, const std::vector<int>& pcs,
+                  std::vector<U1>& out) {
+            const int op = in.Op;
+            if (is_load(op) || is_store(op)) {
+                const int short_base = is_load(op) ? OP_ILOAD_0 + 4 * (op - OP_ILOAD) : OP_ISTORE_0 + 4 * (op - OP_ISTORE);
+                if (in.Local < 4) {
+                    out.push_back(static_cast<U1>(short_base + in.Local));
+                } else if (in.Local < 256) {
+                    out.push_back(static_cast<U1>(op));
+                    out.push_back(static_cast<U1>(in.Local));
+                } else {
+                    out.push_back(OP_WIDE);
+                    out.push_back(static_cast<U1>(op));
+                    put_u2(out, in.Local);
+                }
+                return;
+            }
+            switch (op) {
+            case OP_IINC:
+                if (insn_size(d, in, pc, false) == 3) {
+                    out.push_back(OP_IINC);
+                    out.push_back(static_cast<U1>(in.Local));
+                    out.push_back(static_cast<U1>(in.Value));
+                } else {
+                    out.push_back(OP_WIDE);
+                    out.push_back(OP_IINC);
+                    put_u2(out, in.Local);
+                    put_u2(out, in.Value & 0xffff);
+                }
+                return;
+            case OP_RET:
+                if (in.Local >= 256) { out.push_back(OP_WIDE); }
+                out.push_back(OP_RET);
+                if (in.Local >= 256) { put_u2(out, in.Local); }
+                else { out.push_back(static_cast<U1>(in.Local)); }
+                return;
+            case OP_LDC:
+                if (in.Value < 256) {
+                    out.push_back(OP_LDC);
+                    out.push_back(static_cast<U1>(in.Value));
+                } else {
+                    out.push_back(OP_LDC_W);
+                    put_u2(out, in.Value);
+                }
+                return;
+            case OP_BIPUSH: case OP_NEWARRAY:
+                out.push_back(static_cast<U1>(op));
+                out.push_back(static_cast<U1>(in.Value));
+                return;
+            case OP_SIPUSH:
+                out.push_back(OP_SIPUSH);
+                put_u2(out, in.Value & 0xffff);
+                return;
+            case OP_TABLESWITCH: case OP_LOOKUPSWITCH: {
+                const auto& table = d.Switches[in.Value];
+                out.push_back(static_cast<U1>(op));
+                out.resize(out.size() + (switch_base(pc) - pc - 1));
+                put_s4(out, pcs[in.Target] - pc);
+                if (op == OP_TABLESWITCH) {
+                    put_s4(out, table.Keys.empty() ? 0 : table.Keys.front());
+                    put_s4(out, table.Keys.empty() ? -1 : table.Keys.back());
+                    for (const int t : table.Targets) { put_s4(out, pcs[t] - pc); }
+                } else {
+                    put_s4(out, static_cast<int>(table.Keys.size()));
+                    for (size_t k = 0; k < table.Keys.size(); k++) {
+                        put_s4(out, table.Keys[k]);
+                        put_s4(out, pcs[table.Targets[k]] - pc);
+                    }
+                }
+            }
+            return;
+            default: ;
+            }
+            if (IsBranch(in.Op)) {
+                const int offset = pcs[in.Target] - pc;
+                if (!wide) {
+                    out.push_back(static_cast<U1>(op));
+                    put_u2(out, offset & 0xffff);
+                } else if (op == OP_GOTO || op == OP_JSR) {
+                    out.push_back(op == OP_GOTO ? OP_GOTO_W : OP_JSR_W);
+                    put_s4(out, offset);
+                } else {
+                    // if not, jump over a goto_w to the target
+                    out.push_back(static_cast<U1>(inverted(op)));
+                    put_u2(out, 8);
+                    out.push_back(OP_GOTO_W);
+                    put_s4(out, offset - 3);
+                }
+                return;
+            }
+            out.push_back(static_cast<U1>(op));
+            if (OpcodeTable[op].Flags & OPF_CP2) { put_u2(out, in.Value); }
+            if (op == OP_INVOKEINTERFACE || op == OP_MULTIANEWARRAY) { out.push_back(static_cast<U1>(in.Local)); }
+            if (op == OP_INVOKEINTERFACE || op == OP_INVOKEDYNAMIC) { out.push_back(0); }
+            if (op == OP_INVOKEDYNAMIC) { out.push_back(0); }
+        }
+
+        int descriptor_slots(std::string_view desc, size_t& i) {
+            if (i >= desc.size()) { throw InvalidClassFile("invalid descriptor"); }
+            const char c = desc[i];
+            if (c == '[') {
+                while (i < desc.size() && desc[i] == '[') { i++; }
+                descriptor_slots(desc, i);
+                return 1;
+            }
+            if (c == 'L') {
+                i = desc.find(';', i);
+                if (i == std::string_view::npos) { throw InvalidClassFile("invalid descriptor"); }
+                i++;
+                return 1;
+            }
+            i++;
+            return c == 'V' ? 0 : TypeSlots(c);
+        }
+    }
+
+    int ArgumentSlots(const std::string_view desc) {
+        int n = 0;
+        for (size_t i = 1; i < desc.size() && desc[i] != ')';) { n += descriptor_slots(desc, i); }
+        return n;
+    }
+
+    int ReturnSlots(const std::string_view desc) {
+        const auto close = desc.find(')');
+        if (close == std::string_view::npos || close + 1 >= desc.size()) { throw InvalidClassFile("invalid method descriptor"); }
+        const char c = desc[close + 1];
+        return c == 'V' ? 0 : TypeSlots(c);
+    }
+
+    Insn LoadInsn(const char desc, const int local) {
+        Insn in;
+        switch (desc) {
+        case 'J': in.Op = OP_LLOAD; break;
+        case 'F': in.Op = OP_FLOAD; break;
+        case 'D': in.Op = OP_DLOAD; break;
+        case 'L': case '[': in.Op = OP_ALOAD; break;
+        default: in.Op = OP_ILOAD;
+        }
+        in.Local = local;
+        return in;
+    }
+
+    Insn StoreInsn(const char desc, const int local) {
+        Insn in = LoadInsn(desc, local);
+        in.Op = static_cast<uint8_t>(in.Op - OP_ILOAD + OP_ISTORE);
+        return in;
+    }
+
+    Insn DefaultValue(const char desc) {
+        Insn in;
+        switch (desc) {
+        case 'J': in.Op = OP_LCONST_0; break;
+        case 'F': in.Op = OP_FCONST_0; break;
+        case 'D': in.Op = OP_DCONST_0; break;
+        case 'L': case '[': in.Op = OP_ACONST_NULL; break;
+        default: in.Op = OP_ICONST_0;
+        }
+        return in;
+    }
+
+    StackEffect EffectOf(const ClassFile& f, const Insn& in) {
+        const int op = in.Op;
+        switch (op) {
+        case OP_NOP: case OP_IINC: case OP_GOTO: case OP_RET: case OP_RETURN: return {0, 0};
+        case OP_ACONST_NULL: case OP_ICONST_M1: case OP_ICONST_0: case OP_ICONST_1: case OP_ICONST_2:
+        case OP_ICONST_3: case OP_ICONST_4: case OP_ICONST_5: case OP_FCONST_0: case OP_FCONST_1: case OP_FCONST_2:
+        case OP_BIPUSH: case OP_SIPUSH: case OP_JSR: case OP_NEW:
+            return {0, 1};
+        case OP_LCONST_0: case OP_LCONST_1: case OP_DCONST_0: case OP_DCONST_1: case OP_LDC2_W: return {0, 2};
+        case OP_LDC: {
+            const auto& pool = f.ConstantPool;
+            if (in.Value <= 0 || in.Value >= static_cast<int>(pool.size()) || !pool[in.Value]) {
+                throw InvalidClassFile("invalid constant pool index");
+            }
+            if (pool[in.Value]->Tag != CPoolTags::Dynamic) { return {0, 1}; }
+            const auto desc = MemberRefAt(f, static_cast<U2>(in.Value)).Descriptor;
+            return {0, desc.empty() ? 1 : TypeSlots(desc[0])};
+        }
+        case OP_ILOAD: case OP_FLOAD: case OP_ALOAD: return {0, 1};
+        case OP_LLOAD: case OP_DLOAD: return {0, 2};
+        case OP_ISTORE: case OP_FSTORE: case OP_ASTORE: return {1, 0};
+        case OP_LSTORE: case OP_DSTORE: return {2, 0};
+        case OP_IALOAD: case OP_FALOAD: case OP_AALOAD: case OP_BALOAD: case OP_CALOAD: case OP_SALOAD: return {2, 1};
+        case OP_LALOAD: case OP_DALOAD: return {2, 2};
+        case OP_IASTORE: case OP_FASTORE: case OP_AASTORE: case OP_BASTORE: case OP_CASTORE: case OP_SASTORE: return {3, 0};
+        case OP_LASTORE: case OP_DASTORE: return {4, 0};
+        case OP_POP: return {1, 0};
+        case OP_POP2: return {2, 0};
+        case OP_DUP: return {1, 2};
+        case OP_DUP_X1: return {2, 3};
+        case OP_DUP_X2: return {3, 4};
+        case OP_DUP2: return {2, 4};
+        case OP_DUP2_X1: return {3, 5};
+        case OP_DUP2_X2: return {4, 6};
+        case OP_SWAP: return {2, 2};
+        case OP_ISHL: case OP_ISHR: case OP_IUSHR: return {2, 1};
+        case OP_LSHL: case OP_LSHR: case OP_LUSHR: return {3, 2};
+        case OP_IAND: case OP_IOR: case OP_IXOR: return {2, 1};
+        case OP_LAND: case OP_LOR: case OP_LXOR: return {4, 2};
+        case OP_INEG: case OP_FNEG: return {1, 1};
+        case OP_LNEG: case OP_DNEG: return {2, 2};
+        case OP_I2L: case OP_I2D: case OP_F2L: case OP_F2D: return {1, 2};
+        case OP_I2F: case OP_F2I: case OP_I2B: case OP_I2C: case OP_I2S: return {1, 1};
+        case OP_L2I: case OP_L2F: case OP_D2I: case OP_D2F: return {2, 1};
+        case OP_L2D: case OP_D2L: return {2, 2};
+        case OP_LCMP: case OP_DCMPL: case OP_DCMPG: return {4, 1};
+        case OP_FCMPL: case OP_FCMPG: return {2, 1};
+        case OP_IFEQ: case OP_IFNE: case OP_IFLT: case OP_IFGE: case OP_IFGT: case OP_IFLE: case OP_IFNULL:
+        case OP_IFNONNULL: case OP_TABLESWITCH: case OP_LOOKUPSWITCH: case OP_IRETURN: case OP_FRETURN:
+        case OP_ARETURN: case OP_ATHROW: case OP_MONITORENTER: case OP_MONITOREXIT:
+            return {1, 0};
+        case OP_IF_ICMPEQ: case OP_IF_ICMPNE: case OP_IF_ICMPLT: case OP_IF_ICMPGE: case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE: case OP_IF_ACMPEQ: case OP_IF_ACMPNE: case OP_LRETURN: case OP_DRETURN:
+            return {2, 0};
+        case OP_NEWARRAY: case OP_ANEWARRAY: case OP_ARRAYLENGTH: case OP_CHECKCAST: case OP_INSTANCEOF: return {1, 1};
+        case OP_MULTIANEWARRAY: return {in.Local, 1};
+        case OP_GETSTATIC: case OP_PUTSTATIC: case OP_GETFIELD: case OP_PUTFIELD: {
+            const int n = TypeSlots(MemberRefAt(f, static_cast<U2>(in.Value)).Descriptor[0]);
+            if (op == OP_GETSTATIC) { return {0, n}; }
+            if (op == OP_PUTSTATIC) { return {n, 0}; }
+            return op == OP_GETFIELD ? StackEffect{1, n} : StackEffect{1 + n, 0};
+        }
+        case OP_INVOKEVIRTUAL: case OP_INVOKESPECIAL: case OP_INVOKESTATIC: case OP_INVOKEINTERFACE:
+        case OP_INVOKEDYNAMIC: {
+            const auto desc = MemberRefAt(f, static_cast<U2>(in.Value)).Descriptor;
+            const int receiver = op == OP_INVOKESTATIC || op == OP_INVOKEDYNAMIC ? 0 : 1;
+            return {ArgumentSlots(desc) + receiver, ReturnSlots(desc)};
+        }
+        default:
+            if (op >= OP_IADD && op <= OP_DREM) {
+                const int n = (op - OP_IADD) % 4 == 1 || (op - OP_IADD) % 4 == 3 ? 2 : 1;
+                return {2 * n, n};
+            }
+            throw InvalidBytecode();
+        }
+    }
+
+    DecodedCode DecodeCode(const ClassFile& f, const CodeAttribute& code) {
+        DecodedCode d;
+        d.MaxStack = code.MaxStack;
+        d.MaxLocals = code.MaxLocals;
+        const U1* c = code.Code.data();
+        const int len = static_cast<int>(code.Code.size());
+        if (!len) { throw InvalidBytecode(); }
+
+        std::vector<int> at(len + 1, -1); // instruction at each offset
+        for (int pc = 0, n; pc < len; pc += n) {
+            n = InsnLength(c, pc, len);
+            at[pc] = static_cast<int>(d.Insns.size());
+            d.DecodedPcs.push_back(pc);
+            Insn in;
+            in.Pc = pc;
+            const int op = c[pc];
+            const int flags = OpcodeTable[op].Flags;
+            in.Op = static_cast<uint8_t>(op);
+            if (op == OP_WIDE) {
+                in.Op = c[pc + 1];
+                in.Local = get_u2(c + pc + 2);
+                if (in.Op == OP_IINC) { in.Value = get_s2(c + pc + 4); }
+                else if (!(OpcodeTable[in.Op].Flags & OPF_LOCAL)) { throw InvalidBytecode(); }
+            } else if (op >= OP_ILOAD_0 && op <= OP_ALOAD_3) {
+                in.Op = static_cast<uint8_t>(OP_ILOAD + (op - OP_ILOAD_0) / 4);
+                in.Local = (op - OP_ILOAD_0) % 4;
+            } else if (op >= OP_ISTORE_0 && op <= OP_ASTORE_3) {
+                in.Op = static_cast<uint8_t>(OP_ISTORE + (op - OP_ISTORE_0) / 4);
+                in.Local = (op - OP_ISTORE_0) % 4;
+            } else if (flags & OPF_LOCAL) {
+                in.Local = c[pc + 1];
+                if (op == OP_IINC) { in.Value = static_cast<int8_t>(c[pc + 2]); }
+            } else if (flags & OPF_SWITCH) {
+                const U1* p = c + switch_base(pc);
+                SwitchTable table;
+                in.Target = pc + get_s4(p);
+                if (op == OP_TABLESWITCH) {
+                    const int low = get_s4(p + 4), count = get_s4(p + 8) - low + 1;
+                    for (int k = 0; k < count; k++) {
+                        table.Keys.push_back(low + k);
+                        table.Targets.push_back(pc + get_s4(p + 12 + 4 * k));
+                    }
+                } else {
+                    for (int k = 0, count = get_s4(p + 4); k < count; k++) {
+                        table.Keys.push_back(get_s4(p + 8 + 8 * k));
+                        table.Targets.push_back(pc + get_s4(p + 12 + 8 * k));
+                    }
+                }
+                in.Value = static_cast<int>(d.Switches.size());
+                d.Switches.push_back(std::move(table));
+            } else {
+                switch (op) {
+                case OP_BIPUSH: in.Value = static_cast<int8_t>(c[pc + 1]); break;
+                case OP_SIPUSH: in.Value = get_s2(c + pc + 1); break;
+                case OP_LDC: case OP_NEWARRAY: in.Value = c[pc + 1]; break;
+                case OP_LDC_W: in.Op = OP_LDC, in.Value = get_u2(c + pc + 1); break;
+                case OP_GOTO_W: case OP_JSR_W:
+                    in.Op = op == OP_GOTO_W ? OP_GOTO : OP_JSR;
+                    in.Target = pc + get_s4(c + pc + 1);
+                    break;
+                default:
+                    if (flags & OPF_CP2) { in.Value = get_u2(c + pc + 1); }
+                    if (op == OP_INVOKEINTERFACE || op == OP_MULTIANEWARRAY) { in.Local = c[pc + 3]; }
+                    if (flags & OPF_BRANCH) { in.Target = pc + get_s2(c + pc + 1); }
+                }
+            }
+            d.Insns.push_back(in);
+        }
+        at[len] = static_cast<int>(d.Insns.size());
+        d.DecodedPcs.push_back(len);
+
+        auto insn_at = [&](const int pc) {
+            if (pc < 0 || pc >= len || at[pc] < 0) { throw InvalidBytecode(); }
+            return at[pc];
+        };
+        for (auto& in : d.Insns) {
+            if (in.Target >= 0 || IsBranch(in.Op)) { in.Target = insn_at(in.Target); }
+        }
+        for (auto& table : d.Switches) {
+            for (auto& t : table.Targets) { t = insn_at(t); }
+        }
+        for (const auto& e : code.ExceptionTable) {
+            if (e.EndPc > len || at[e.EndPc] < 0) { throw InvalidBytecode(); }
+            d.Handlers.push_back({insn_at(e.StartPc), at[e.EndPc], insn_at(e.HandlerPc), e.CatchType});
+        }
+
+        // entries that do not line up with the code are dropped, as the JVM would ignore them
+        for (const auto& a : code.Attributes) {
+            d.Attributes.push_back(a);
+            const auto name = Utf8At(f, a.AttributeNameIndex);
+            const bool lines = name == "LineNumberTable";
+            const bool generic = name == "LocalVariableTypeTable";
+            if (!lines && !generic && name != "LocalVariableTable") { continue; }
+            const U1* p = a.Info.data();
+            const size_t size = a.Info.size();
+            const size_t entry = lines ? 4 : 10;
+            const size_t count = size >= 2 ? get_u2(p) : 0;
+            if (size < 2 + count * entry) { throw InvalidClassFile("truncated debug attribute"); }
+            for (size_t k = 0; k < count; k++) {
+                const U1* e = p + 2 + k * entry;
+                const int start = get_u2(e);
+                if (start >= len || at[start] < 0) { continue; }
+                if (lines) {
+                    d.Lines.push_back({at[start], static_cast<U2>(get_u2(e + 2))});
+                    continue;
+                }
+                const int end = start + get_u2(e + 2);
+                if (end > len || at[end] < 0) { continue; }
+                d.Locals.push_back({at[start], at[end], static_cast<U2>(get_u2(e + 4)), static_cast<U2>(get_u2(e + 6)),
+                                    static_cast<U2>(get_u2(e + 8)), generic});
+            }
+        }
+        return d;
+    }
+
+    void EncodeCode(ClassFile& f, const MethodInfo& m, const DecodedCode& d, CodeAttribute& code,
+                    const ClassHierarchy& h) {
+        std::vector<bool> wide;
+        const auto pcs = lay_out(d, wide);
+        const auto& insns = d.Insns;
+
+        CodeAttribute c;
+        c.MaxStack = d.MaxStack;
+        c.MaxLocals = d.MaxLocals;
+        c.Code.reserve(pcs.back());
+        CodeEdit edit;
+        edit.Relocation.assign(d.DecodedPcs.back(), -1);
+        int expected = 0; // old offset that follows the previous instruction, -1 after a new one
+        for (size_t i = 0; i < insns.size(); i++) {
+            const auto& in = insns[i];
+            emit(d, in, pcs[i], wide[i], pcs, c.Code);
+            if (in.Pc >= 0) { edit.Relocation[in.Pc] = pcs[i]; }
+            // new, changed or moved code, or a branch that had to be widened
+            if (in.Pc < 0 || in.Pc != expected || wide[i]) {
+                if (!edit.Patched.empty() && edit.Patched.back().second == pcs[i]) { edit.Patched.back().second = pcs[i + 1]; }
+                else { edit.Patched.emplace_back(pcs[i], pcs[i + 1]); }
+            }
+            if (in.Pc < 0) {
+                expected = -1;
+            } else {
+                const auto next = std::upper_bound(d.DecodedPcs.begin(), d.DecodedPcs.end(), in.Pc);
+                expected = next == d.DecodedPcs.end() ? -1 : *next;
+            }
+        }
+        // an instruction removed from the end
+        if (expected != -1 && expected != d.DecodedPcs.back() && !insns.empty()) {
+            edit.Patched.emplace_back(pcs[insns.size() - 1], pcs[insns.size()]);
+        }
+        c.CodeLength = static_cast<U4>(c.Code.size());
+
+        for (const auto& e : d.Handlers) {
+            if (e.Start >= e.End) { continue; }
+            c.ExceptionTable.push_back({static_cast<U2>(pcs[e.Start]), static_cast<U2>(pcs[e.End]),
+                                        static_cast<U2>(pcs[e.Target]), e.CatchType});
+        }
+        c.ExceptionTableLength = static_cast<U2>(c.ExceptionTable.size());
+
+        bool lines_done = false, locals_done = false, types_done = false;
+        for (const auto& a : d.Attributes) {
+            const auto name = Utf8At(f, a.AttributeNameIndex);
+            if (name == "RuntimeVisibleTypeAnnotations" || name == "RuntimeInvisibleTypeAnnotations") { continue; }
+            const bool lines = name == "LineNumberTable";
+            const bool generic = name == "LocalVariableTypeTable";
+            if (!lines && !generic && name != "LocalVariableTable") {
+                c.Attributes.push_back(a);
+                continue;
+            }
+            // all entries go to the first table of a kind
+            bool& done = lines ? lines_done : generic ? types_done : locals_done;
+            if (done) { continue; }
+            done = true;
+            AttributeInfo t{a.AttributeNameIndex, 0, {}};
+            put_u2(t.Info, 0);
+            int count = 0;
+            if (lines) {
+                for (const auto& e : d.Lines) {
+                    if (e.Start >= static_cast<int>(insns.size())) { continue; }
+                    put_u2(t.Info, pcs[e.Start]);
+                    put_u2(t.Info, e.Line);
+                    count++;
+                }
+            } else {
+                for (const auto& e : d.Locals) {
+                    if (e.Generic != generic || e.Start >= e.End) { continue; }
+                    put_u2(t.Info, pcs[e.Start]);
+                    put_u2(t.Info, pcs[e.End] - pcs[e.Start]);
+                    put_u2(t.Info, e.Name);
+                    put_u2(t.Info, e.Descriptor);
+                    put_u2(t.Info, e.Index);
+                    count++;
+                }
+            }
+            if (!count) { continue; }
+            t.Info[0] = static_cast<U1>(count >> 8);
+            t.Info[1] = static_cast<U1>(count);
+            t.AttributeLength = static_cast<U4>(t.Info.size());
+            c.Attributes.push_back(std::move(t));
+        }
+        c.AttributesCount = static_cast<U2>(c.Attributes.size());
+
+        RegenerateStackMap(f, m, c, h, &edit);
+        code = std::move(c);
+    }
+
+    int MaxStackOf(const ClassFile& f, const DecodedCode& code) {
+        const ValueFlow flow(f, code, std::vector<int>(code.Insns.size(), -1));
+        int max_stack = 0;
+        for (size_t i = 0; i < code.Insns.size(); i++) {
+            const int depth = flow.Depth(static_cast<int>(i));
+            if (depth < 0) { continue; }
+            const auto effect = EffectOf(f, code.Insns[i]);
+            max_stack = std::max({max_stack, depth, depth - effect.Pops + effect.Pushes});
+        }
+        return max_stack;
+    }
+
+    AttributeInfo AssembleCode(ClassFile& f, const MethodInfo& m, std::vector<Insn> insns, const int max_locals,
+                               const ClassHierarchy& h) {
+        DecodedCode d;
+        d.MaxLocals = static_cast<U2>(max_locals);
+        d.Insns = std::move(insns);
+        d.DecodedPcs = {0};
+        const int max_stack = MaxStackOf(f, d);
+        if (max_stack > 0xffff) { throw std::length_error("operand stack too deep"); }
+        d.MaxStack = static_cast<U2>(max_stack);
+
+        AttributeInfo a{PoolEditor(f).Utf8("Code"), 0, {}};
+        CodeAttribute code;
+        EncodeCode(f, m, d, code, h);
+        Writer{}.WriteCodeOnto(code, a.Info);
+        a.AttributeLength = static_cast<U4>(a.Info.size());
+        return a;
+    }
+
+    int PatchMethods(ClassFile& f, const ClassHierarchy& h,
+                     const std::function<bool(const MethodInfo&, DecodedCode&)>& patch, const std::vector<int>& order) {
+        int changed = 0;
+        const int count = order.empty() ? static_cast<int>(f.Methods.size()) : static_cast<int>(order.size());
+        for (int k = 0; k < count; k++) {
+            auto& m = f.Methods[order.empty() ? k : order[k]];
+            for (auto& a : m.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) != "Code") { continue; }
+                CodeAttribute code;
+                Parser{}.ParseCodeOnto(a.Info, code);
+                DecodedCode d;
+                try {
+                    d = DecodeCode(f, code);
+                } catch (const InvalidBytecode&) {
+                    continue;
+                }
+                if (std::any_of(d.Insns.begin(), d.Insns.end(), [](const Insn& in) {
+                    return in.Op == OP_JSR || in.Op == OP_RET;
+                })) {
+                    continue;
+                }
+                if (!patch(m, d)) { continue; }
+                try {
+                    EncodeCode(f, m, d, code, h);
+                } catch (const FrameError&) {
+                    continue;
+                } catch (const std::length_error&) {
+                    continue;
+                }
+                Writer{}.WriteCodeOnto(code, a.Info);
+                a.AttributeLength = static_cast<U4>(a.Info.size());
+                changed++;
+            }
+        }
+        return changed;
+    }
+
+    void ForgetFramesWhereLive(DecodedCode& code, const int first) {
+        const int n = static_cast<int>(code.Insns.size());
+        // predecessors of each instruction; ~i for an instruction a handler catches, as the handler
+        // may see the local before the instruction writes it
+        std::vector<std::vector<int>> from(n);
+        for (int i = 0; i < n; i++) {
+            const auto& in = code.Insns[i];
+            const auto flags = OpcodeTable[in.Op].Flags;
+            if (in.Target >= 0) { from[in.Target].push_back(i); }
+            if (flags & OPF_SWITCH) {
+                for (const int t : code.Switches[in.Value].Targets) { from[t].push_back(i); }
+            }
+            if (!(flags & OPF_END) && i + 1 < n) { from[i + 1].push_back(i); }
+        }
+        for (const auto& h : code.Handlers) {
+            for (int i = h.Start; i < h.End; i++) { from[h.Target].push_back(~i); }
+        }
+
+        auto wide = [](const int op) {
+            return op == OP_LLOAD || op == OP_DLOAD || op == OP_LSTORE || op == OP_DSTORE;
+        };
+        auto touches = [&](const Insn& in, const int local) {
+            return in.Local == local || (wide(in.Op) && in.Local + 1 == local);
+        };
+        std::vector<bool> live(n);
+        std::vector<int> work;
+        for (int local = first; local < code.MaxLocals; local++) {
+            std::vector<bool> seen(n);
+            for (int i = 0; i < n; i++) {
+                const auto& in = code.Insns[i];
+                if ((is_load(in.Op) || in.Op == OP_IINC) && touches(in, local)) {
+                    seen[i] = true;
+                    work.push_back(i);
+                }
+            }
+            while (!work.empty()) {
+                const int i = work.back();
+                work.pop_back();
+                live[i] = true;
+                for (const int edge : from[i]) {
+                    const int p = edge < 0 ? ~edge : edge;
+                    if (seen[p] || (edge >= 0 && is_store(code.Insns[p].Op) && touches(code.Insns[p], local))) { continue; }
+                    seen[p] = true;
+                    work.push_back(p);
+                }
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            if (live[i]) { code.Insns[i].Pc = -1; }
+        }
+    }
+
+    void ReorderCode(DecodedCode& code, const std::vector<int>& order) {
+        const int n = static_cast<int>(code.Insns.size());
+        std::vector<int> at(n + 1, n); // new index of each instruction, and of the end
+        for (int k = 0; k < n; k++) { at[order[k]] = k; }
+        // the runs of the new order that [start, end) of the old one went to
+        auto runs = [&](const int start, const int end, const std::function<void(int, int)>& run) {
+            for (int k = 0; k < n;) {
+                if (order[k] < start || order[k] >= end) {
+                    k++;
+                    continue;
+                }
+                const int first = k;
+                while (k < n && order[k] >= start && order[k] < end) { k++; }
+                run(first, k);
+            }
+        };
+
+        std::vector<Insn> insns(n);
+        for (int k = 0; k < n; k++) {
+            insns[k] = code.Insns[order[k]];
+            if (insns[k].Target >= 0) { insns[k].Target = at[insns[k].Target]; }
+        }
+        code.Insns = std::move(insns);
+        for (auto& table : code.Switches) {
+            for (auto& t : table.Targets) { t = at[t]; }
+        }
+
+        std::vector<Handler> handlers;
+        for (const auto& e : code.Handlers) {
+            runs(e.Start, e.End, [&](const int start, const int end) {
+                handlers.push_back({start, end, at[e.Target], e.CatchType});
+            });
+        }
+        code.Handlers = std::move(handlers);
+
+        std::vector<LocalEntry> locals;
+        for (const auto& e : code.Locals) {
+            runs(e.Start, e.End, [&](const int start, const int end) {
+                locals.push_back({start, end, e.Name, e.Descriptor, e.Index, e.Generic});
+            });
+        }
+        code.Locals = std::move(locals);
+
+        // the line each instruction was on, and whether an entry starts there
+        std::vector<int> line(n, -1);
+        std::vector<bool> starts(n);
+        auto lines = code.Lines;
+        std::stable_sort(lines.begin(), lines.end(), [](const LineEntry& a, const LineEntry& b) { return a.Start < b.Start; });
+        for (size_t k = 0; k < lines.size(); k++) {
+            if (lines[k].Start >= n) { continue; }
+            const int end = k + 1 < lines.size() ? std::min(lines[k + 1].Start, n) : n;
+            for (int i = lines[k].Start; i < end; i++) { line[i] = lines[k].Line; }
+            starts[lines[k].Start] = true;
+        }
+        code.Lines.clear();
+        for (int k = 0; k < n; k++) {
+            const int i = order[k];
+            if (line[i] >= 0 && (starts[i] || k == 0 || line[order[k - 1]] != line[i])) {
+                code.Lines.push_back({k, static_cast<U2>(line[i])});
+            }
+        }
+    }
+
+    void CodeRewriter::Replace(const int i, std::vector<Insn> with) {
+        if (!With[i].Replaced && With[i].Before.empty()) { Changed.push_back(i); }
+        With[i].Replaced = true;
+        With[i].Insns = std::move(with);
+    }
+
+    void CodeRewriter::InsertBefore(const int i, std::vector<Insn> insns) {
+        if (!With[i].Replaced && With[i].Before.empty()) { Changed.push_back(i); }
+        auto& before = With[i].Before;
+        before.insert(before.end(), insns.begin(), insns.end());
+    }
+
+    void CodeRewriter::Apply() {
+        if (Changed.empty()) { return; }
+        const int n = static_cast<int>(Code.Insns.size());
+        std::vector<Insn> out;
+        out.reserve(n + Changed.size() * 4);
+        std::vector<int> first(n + 1); // where what stands for each old instruction begins
+        for (int i = 0; i < n; i++) {
+            first[i] = static_cast<int>(out.size());
+            auto& change = With[i];
+            out.insert(out.end(), change.Before.begin(), change.Before.end());
+            if (change.Replaced) { out.insert(out.end(), change.Insns.begin(), change.Insns.end()); }
+            else { out.push_back(Code.Insns[i]); }
+        }
+        first[n] = static_cast<int>(out.size());
+        // a removed instruction at the end leaves nothing to jump to; only unreachable code may do that
+        auto map = [&](const int i) { return first[i] < static_cast<int>(out.size()) || i == n ? first[i] : first[i] - 1; };
+
+        for (auto& in : out) {
+            if (in.Target >= 0) { in.Target = map(in.Target); }
+        }
+        for (auto& table : Code.Switches) {
+            for (auto& t : table.Targets) { t = map(t); }
+        }
+        for (auto& e : Code.Handlers) {
+            e.Start = first[e.Start];
+            e.End = first[e.End];
+            e.Target = map(e.Target);
+        }
+        for (auto& e : Code.Lines) { e.Start = first[e.Start]; }
+        for (auto& e : Code.Locals) {
+            e.Start = first[e.Start];
+            e.End = first[e.End];
+        }
+        Code.Insns = std::move(out);
+        With.assign(Code.Insns.size(), {});
+        Changed.clear();
+    }
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "Javalib/Opcodes.h"
+#include "Parse/ClassFile.h"
+#include "Hierarchy.h"
+
+/*
+ * The code of a method as an array of decoded instructions, for patches that rewrite it. Branch targets,
+ * exception ranges, line numbers and local variable ranges refer to instructions instead of offsets, so
+ * instructions can be inserted, removed and moved without keeping track of offsets. Encoding lays the
+ * code out again, widening branches that no longer reach, and brings the StackMapTable up to date for
+ * the instructions that changed (see RegenerateStackMap).
+ */
+
+namespace Analyze {
+    // Decoding normalizes: xload_<n> and xstore_<n> become xLOAD and xSTORE, wide is folded into the
+    // instruction it widens, ldc_w becomes LDC, goto_w and jsr_w become GOTO and JSR. Encoding picks the
+    // shortest form again.
+    struct Insn {
+        uint8_t Op = OP_NOP;
+        int Pc = -1;     // offset in the decoded code; -1 for an instruction a patch added or changed
+        int Local = 0;   // local variable of loads, stores, iinc and ret; the count of invokeinterface
+                         // and the dimensions of multianewarray
+        int Value = 0;   // constant pool index, constant of bipush, sipush and iinc, type of newarray,
+                         // or the index of the table of a switch
+        int Target = -1; // instruction a branch goes to; the default of a switch
+    };
+
+    struct SwitchTable {
+        std::vector<int> Keys;    // ascending; consecutive for a tableswitch
+        std::vector<int> Targets; // instruction per key
+    };
+
+    // the catch of instructions [Start, End)
+    struct Handler {
+        int Start, End, Target;
+        Parse::U2 CatchType;
+    };
+
+    struct LineEntry {
+        int Start;
+        Parse::U2 Line;
+    };
+
+    // an entry of LocalVariableTable, or of LocalVariableTypeTable if Generic (Descriptor is then the
+    // signature); instructions [Start, End)
+    struct LocalEntry {
+        int Start, End;
+        Parse::U2 Name, Descriptor, Index;
+        bool Generic;
+    };
+
+    struct DecodedCode {
+        Parse::U2 MaxStack = 0;
+        Parse::U2 MaxLocals = 0;
+        std::vector<Insn> Insns;
+        std::vector<SwitchTable> Switches;
+        std::vector<Handler> Handlers;
+        std::vector<LineEntry> Lines;
+        std::vector<LocalEntry> Locals;
+        // the attributes of the Code as they were; encoding rewrites LineNumberTable and
+        // LocalVariable(Type)Table from Lines and Locals
+        std::vector<Parse::AttributeInfo> Attributes;
+        std::vector<int> DecodedPcs; // offsets of the decoded instructions, and the code length last
+    };
+
+    // Throws InvalidBytecode for code that does not decode, or jumps into the middle of an instruction.
+    DecodedCode DecodeCode(const Parse::ClassFile& f, const Parse::CodeAttribute& code);
+
+    // Replaces code with what was decoded and patched. Type annotations on the code are dropped, as they
+    // refer to offsets a patch cannot update. Throws FrameError if the frames cannot be computed and
+    // std::length_error if the code no longer fits; code is then left as it was.
+    void EncodeCode(Parse::ClassFile& f, const Parse::MethodInfo& m, const DecodedCode& decoded,
+                    Parse::CodeAttribute& code, const ClassHierarchy& h);
+
+    // The deepest the operand stack of code gets, reachable instructions only. Throws InvalidBytecode for
+    // code whose stack does not add up.
+    int MaxStackOf(const Parse::ClassFile& f, const DecodedCode& code);
+
+    // The Code attribute of a method written from scratch: insns alone, their branch targets indices into
+    // insns, with no handlers or debug attributes. MaxStack is worked out from the code. Throws like
+    // EncodeCode, and InvalidBytecode for code whose stack does not add up.
+    Parse::AttributeInfo AssembleCode(Parse::ClassFile& f, const Parse::MethodInfo& m, std::vector<Insn> insns,
+                                      int max_locals, const ClassHierarchy& h);
+
+    // Decodes the code of every method of f and calls patch on it; the methods patch returns true for
+    // are encoded again. Methods that use jsr or ret, whose code does not decode, or whose frames cannot
+    // be computed after the patch are left as they were (constant pool entries the patch added stay
+    // until the pool is compacted). order lists the methods to patch, by index, in the order to patch
+    // them, so a patch may look at the code of methods patched before; empty is all of them in the
+    // order of f. Returns the number of methods changed.
+    int PatchMethods(Parse::ClassFile& f, const ClassHierarchy& h,
+                     const std::function<bool(const Parse::MethodInfo&, DecodedCode&)>& patch,
+                     const std::vector<int>& order = {});
+
+    // Marks every instruction where a local from first on may be read before it is written again as
+    // changed (Pc -1), so that the frames there are computed afresh. A patch that gives values to locals
+    // past those of the old code calls it: an old frame has Top for them, and kept where one of them is
+    // live it would leave it unusable.
+    void ForgetFramesWhereLive(DecodedCode& code, int first);
+
+    // Lays the instructions of code out in a new order: order lists each instruction once, by its index.
+    // Every instruction that may go on to the next must still be followed by it. Handler and local
+    // variable ranges are split where the new order breaks them up (the pieces of a handler keep its
+    // place in the table), and line numbers follow their instructions.
+    void ReorderCode(DecodedCode& code, const std::vector<int>& order);
+
+    // Collects changes to code and then makes them all at once, so that instruction indices stay valid
+    // until Apply. A branch, handler, line or local range that referred to a replaced instruction refers
+    // to the first instruction put in its place, or to the one after it if it was removed. Targets of
+    // the instructions put in refer to instructions of the code before Apply.
+    class CodeRewriter {
+    public:
+        explicit CodeRewriter(DecodedCode& code): Code(code), With(code.Insns.size()) {}
+
+        // with empty removes insn i
+        void Replace(int i, std::vector<Insn> with);
+        void InsertBefore(int i, std::vector<Insn> insns);
+        bool Empty() const { return Changed.empty(); }
+        void Apply();
+
+    private:
+        struct Change {
+            bool Replaced = false;
+            std::vector<Insn> Before, Insns;
+        };
+
+        DecodedCode& Code;
+        std::vector<Change> With;
+        std::vector<int> Changed;
+    };
+
+    // Slots an instruction takes off the operand stack and puts on it; a long or double is two.
+    struct StackEffect {
+        int Pops, Pushes;
+    };
+    // jsr counts as pushing its return address. Throws InvalidClassFile for a bad constant pool reference.
+    StackEffect EffectOf(const Parse::ClassFile& f, const Insn& insn);
+
+    // slots of the arguments of a method descriptor, and of its return type
+    int ArgumentSlots(std::string_view desc);
+    int ReturnSlots(std::string_view desc);
+
+    // the load or store of a local, or the default value, of a type given by the first character of its
+    // field descriptor
+    Insn LoadInsn(char desc, int local);
+    Insn StoreInsn(char desc, int local);
+    Insn DefaultValue(char desc);
+    inline int TypeSlots(const char desc) { return desc == 'J' || desc == 'D' ? 2 : 1; }
+
+    inline bool IsBranch(const uint8_t op) {
+        return OpcodeTable[op].Flags & (OPF_BRANCH | OPF_BRANCH_W);
+    }
+}
@@ -0,0 +1,512 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "Util/mutf8.h"
+#include "Parse/CpInfo.h"
+#include "Parse/CpRefs.h"
+#include "Interpreter.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        constexpr U2 ACC_STATIC = 0x0008;
+        constexpr U2 ACC_FINAL = 0x0010;
+
+        constexpr long STEP_LIMIT = 1L << 20;
+        constexpr size_t HEAP_LIMIT = 1u << 16; // array elements
+
+        using Kind = Constant::Kind;
+
+        Constant make_int(const int32_t v) { return {Kind::Int, v, 0}; }
+        Constant make_long(const int64_t v) { return {Kind::Long, v, 0}; }
+        Constant make_float(const float v) { return {Kind::Float, 0, v}; }
+        Constant make_double(const double v) { return {Kind::Double, 0, v}; }
+
+        uint64_t bits_of(const double v) {
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof bits);
+            return bits;
+        }
+
+        float float_of(const U4 bits) {
+            float v;
+            std::memcpy(&v, &bits, sizeof v);
+            return v;
+        }
+
+        double double_of(const uint64_t bits) {
+            double v;
+            std::memcpy(&v, &bits, sizeof v);
+            return v;
+        }
+
+        // the conversions of the JVM: NaN is 0, out of range the nearest bound
+        template<typename T>
+        T to_integer(const double v) {
+            if (std::isnan(v)) { return 0; }
+            if (v <= static_cast<double>(std::numeric_limits<T>::min())) { return std::numeric_limits<T>::min(); }
+            if (v >= static_cast<double>(std::numeric_limits<T>::max())) { return std::numeric_limits<T>::max(); }
+            return static_cast<T>(v);
+        }
+
+        // fcmpl and dcmpl give -1 for NaN, fcmpg and dcmpg 1
+        int compare(const double a, const double b, const int nan) {
+            if (std::isnan(a) || std::isnan(b)) { return nan; }
+            return a < b ? -1 : a > b ? 1 : 0;
+        }
+
+        // the element type newarray creates
+        char array_type(const int atype) {
+            static constexpr char types[] = {'Z', 'C', 'F', 'D', 'B', 'S', 'I', 'J'};
+            return atype >= 4 && atype <= 11 ? types[atype - 4] : 0;
+        }
+
+        // whether a value of type from passes checkcast to, for the values the interpreter has
+        bool is_instance(const Constant& v, const std::string_view to, const char array) {
+            if (v.Type == Kind::Null) { return true; }
+            if (to == "java/lang/Object" || to == "java/io/Serializable") { return true; }
+            if (v.Type == Kind::String) { return to == "java/lang/String" || to == "java/lang/CharSequence" ||
+                                                 to == "java/lang/Comparable"; }
+            if (to == "java/lang/Cloneable") { return true; }
+            return array == 'L' ? to == "[Ljava/lang/String;" : to.size() == 2 && to[0] == '[' && to[1] == array;
+        }
+    }
+
+    bool Constant::operator==(const Constant& other) const {
+        if (Type != other.Type) { return false; }
+        if (Type == Kind::Float || Type == Kind::Double) { return bits_of(Real) == bits_of(other.Real); }
+        return Bits == other.Bits;
+    }
+
+    Constant Interpreter::Default(const char desc) {
+        switch (desc) {
+        case 'J': return make_long(0);
+        case 'F': return make_float(0);
+        case 'D': return make_double(0);
+        case 'L': case '[': return {Kind::Null, 0, 0};
+        default: return make_int(0);
+        }
+    }
+
+    Interpreter::Interpreter(const ClassFile& f): File(f), ThisClass(ClassNameAt(f, f.ThisClass)) {
+        for (size_t i = 0; i < f.Fields.size(); i++) {
+            const auto& field = f.Fields[i];
+            if (!(field.AccessFlags & ACC_STATIC)) { continue; }
+            const auto desc = Utf8At(f, field.DescriptorIndex);
+            Static s{static_cast<int>(i), (field.AccessFlags & ACC_FINAL) != 0, Default(desc[0]), {}};
+            for (const auto& a : field.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) != "ConstantValue") { continue; }
+                if (a.Info.size() != 2) {
+                    Unusable = true;
+                    continue;
+                }
+                try {
+                    const Constant c = Ldc(a.Info[0] << 8 | a.Info[1]);
+                    const char type = desc[0] == 'Z' || desc[0] == 'B' || desc[0] == 'C' || desc[0] == 'S' ? 'I' : desc[0];
+                    if (c.Type != Default(type).Type && !(c.Type == Kind::String && desc == "Ljava/lang/String;")) {
+                        Unusable = true;
+                    }
+                    s.Initial = c;
+                } catch (const Stop&) {
+                    Unusable = true;
+                }
+            }
+            s.Current = s.Initial;
+            StaticFields.push_back(s);
+        }
+    }
+
+    Constant Interpreter::Intern(std::u16string s) {
+        const auto [it, added] = Interned.emplace(std::move(s), static_cast<int>(Strings.size()));
+        if (added) { Strings.push_back(it->first); }
+        return {Kind::String, it->second, 0};
+    }
+
+    // of an entry ldc, ldc2_w or a ConstantValue may refer to
+    Constant Interpreter::Ldc(const int index) {
+        if (index <= 0 || index >= static_cast<int>(File.ConstantPool.size()) || !File.ConstantPool[index]) { throw Stop(); }
+        const auto& e = File.ConstantPool[index];
+        switch (e->Tag) {
+        case CPoolTags::Integer: return make_int(static_cast<int32_t>(ConstantIntegerInfo::Reference(e).Bytes));
+        case CPoolTags::Float: return make_float(float_of(ConstantFloatInfo::Reference(e).Bytes));
+        case CPoolTags::Long: {
+            const auto& l = ConstantLongInfo::Reference(e);
+            return make_long(static_cast<int64_t>(static_cast<uint64_t>(l.HighBytes) << 32 | l.LowBytes));
+        }
+        case CPoolTags::Double: {
+            const auto& d = ConstantDoubleInfo::Reference(e);
+            return make_double(double_of(static_cast<uint64_t>(d.HighBytes) << 32 | d.LowBytes));
+        }
+        case CPoolTags::String: {
+            const auto s = Utf8At(File, ConstantStringInfo::Reference(e).StringIndex);
+            std::u16string utf16(s.size(), u'\0');
+            utf16.resize(mutf8_to_utf16(reinterpret_cast<const uint8_t*>(s.data()), s.size(),
+                                        reinterpret_cast<uint16_t*>(utf16.data())));
+            return Intern(std::move(utf16));
+        }
+        default: throw Stop(); // Class, MethodType, MethodHandle and Dynamic need resolving
+        }
+    }
+
+    Constant Interpreter::NewArray(const char type, const int32_t length) {
+        if (length < 0 || HeapSize + length > HEAP_LIMIT) { throw Stop(); }
+        HeapSize += length;
+        Arrays.push_back({type, std::vector<Constant>(length, Default(type))});
+        return {Kind::Array, static_cast<int64_t>(Arrays.size() - 1), 0};
+    }
+
+    Interpreter::Static& Interpreter::StaticAt(const int index) {
+        const auto ref = MemberRefAt(File, static_cast<U2>(index));
+        if (ref.Owner != ThisClass) { throw Stop(); }
+        for (auto& s : StaticFields) {
+            const auto& field = File.Fields[s.Field];
+            if (Utf8At(File, field.NameIndex) == ref.Name && Utf8At(File, field.DescriptorIndex) == ref.Descriptor) {
+                return s;
+            }
+        }
+        throw Stop(); // a field of a superclass, or no field at all
+    }
+
+    // the String methods that cannot have effects
+    void Interpreter::Invoke(const Insn& in, std::vector<Constant>& stack) {
+        const auto ref = MemberRefAt(File, static_cast<U2>(in.Value));
+        if (ref.Owner != "java/lang/String") { throw Stop(); }
+        const bool char_at = ref.Name == "charAt" && ref.Descriptor == "(I)C";
+        if (stack.size() < (char_at ? 2u : 1u)) { throw Stop(); }
+        Constant index;
+        if (char_at) {
+            index = stack.back();
+            stack.pop_back();
+        }
+        const Constant self = stack.back();
+        stack.pop_back();
+        if (self.Type != Kind::String) { throw Stop(); } // null, or not verified
+        const auto& s = Strings[self.Bits];
+        if (char_at) {
+            if (index.Type != Kind::Int || index.Bits < 0 || index.Bits >= static_cast<int64_t>(s.size())) { throw Stop(); }
+            stack.push_back(make_int(s[index.Bits]));
+        } else if (ref.Name == "length" && ref.Descriptor == "()I") {
+            stack.push_back(make_int(static_cast<int32_t>(s.size())));
+        } else if (ref.Name == "hashCode" && ref.Descriptor == "()I") {
+            uint32_t h = 0;
+            for (const char16_t c : s) { h = 31 * h + c; }
+            stack.push_back(make_int(static_cast<int32_t>(h)));
+        } else if (ref.Name == "toCharArray" && ref.Descriptor == "()[C") {
+            const auto array = NewArray('C', static_cast<int32_t>(s.size()));
+            for (size_t k = 0; k < s.size(); k++) { Arrays[array.Bits].Elements[k] = make_int(s[k]); }
+            stack.push_back(array);
+        } else {
+            throw Stop();
+        }
+    }
+
+    bool Interpreter::Run(const DecodedCode& code) {
+        if (Unusable) { return false; }
+        std::vector<Constant> stack, locals(code.MaxLocals);
+        const int n = static_cast<int>(code.Insns.size());
+
+        auto pop = [&]() {
+            if (stack.empty()) { throw Stop(); }
+            const Constant v = stack.back();
+            stack.pop_back();
+            return v;
+        };
+        auto pop_as = [&](const Kind type) {
+            if (type == Kind::Long || type == Kind::Double) { pop(); }
+            const Constant v = pop();
+            if (v.Type != type) { throw Stop(); }
+            return v;
+        };
+        auto pop_int = [&]() { return static_cast<int32_t>(pop_as(Kind::Int).Bits); };
+        auto pop_long = [&]() { return pop_as(Kind::Long).Bits; };
+        auto pop_float = [&]() { return static_cast<float>(pop_as(Kind::Float).Real); };
+        auto pop_double = [&]() { return pop_as(Kind::Double).Real; };
+        auto pop_ref = [&]() {
+            const Constant v = pop();
+            if (v.Type != Kind::Null && v.Type != Kind::String && v.Type != Kind::Array) { throw Stop(); }
+            return v;
+        };
+        auto push = [&](const Constant& v) {
+            stack.push_back(v);
+            if (v.Type == Kind::Long || v.Type == Kind::Double) { stack.emplace_back(); }
+        };
+        auto local = [&](const int k) -> Constant& {
+            if (k < 0 || k >= static_cast<int>(locals.size())) { throw Stop(); }
+            return locals[k];
+        };
+        // the array and element of an xaload or xastore
+        auto element = [&](const int32_t index, const Constant& array, const char type) -> Constant& {
+            if (array.Type != Kind::Array) { throw Stop(); } // null
+            auto& a = Arrays[array.Bits];
+            // baload and bastore are for both byte and boolean arrays
+            if (a.Type != type && !(type == 'B' && a.Type == 'Z')) { throw Stop(); }
+            if (index < 0 || index >= static_cast<int32_t>(a.Elements.size())) { throw Stop(); }
+            return a.Elements[index];
+        };
+
+        try {
+            int pc = 0;
+            for (long steps = 0; steps < STEP_LIMIT; steps++) {
+                if (pc < 0 || pc >= n) { throw Stop(); }
+                const Insn& in = code.Insns[pc];
+                int next = pc + 1;
+                const uint8_t op = in.Op;
+                switch (op) {
+                case OP_NOP: break;
+                case OP_ACONST_NULL: push({Kind::Null, 0, 0}); break;
+                case OP_ICONST_M1: case OP_ICONST_0: case OP_ICONST_1: case OP_ICONST_2: case OP_ICONST_3:
+                case OP_ICONST_4: case OP_ICONST_5:
+                    push(make_int(op - OP_ICONST_0));
+                    break;
+                case OP_LCONST_0: case OP_LCONST_1: push(make_long(op - OP_LCONST_0)); break;
+                case OP_FCONST_0: case OP_FCONST_1: case OP_FCONST_2: push(make_float(static_cast<float>(op - OP_FCONST_0))); break;
+                case OP_DCONST_0: case OP_DCONST_1: push(make_double(op - OP_DCONST_0)); break;
+                case OP_BIPUSH: case OP_SIPUSH: push(make_int(in.Value)); break;
+                case OP_LDC: case OP_LDC2_W: push(Ldc(in.Value)); break;
+
+                case OP_ILOAD: case OP_LLOAD: case OP_FLOAD: case OP_DLOAD: case OP_ALOAD: {
+                    const Constant& v = local(in.Local);
+                    static constexpr Kind kinds[] = {Kind::Int, Kind::Long, Kind::Float, Kind::Double};
+                    if (op == OP_ALOAD ? v.Type < Kind::Null : v.Type != kinds[op - OP_ILOAD]) { throw Stop(); }
+                    push(v);
+                }
+                break;
+                case OP_ISTORE: case OP_LSTORE: case OP_FSTORE: case OP_DSTORE: case OP_ASTORE: {
+                    static constexpr Kind kinds[] = {Kind::Int, Kind::Long, Kind::Float, Kind::Double};
+                    const Constant v = op == OP_ASTORE ? pop_ref() : pop_as(kinds[op - OP_ISTORE]);
+                    local(in.Local) = v;
+                    if (op == OP_LSTORE || op == OP_DSTORE) { local(in.Local + 1) = {}; }
+                }
+                break;
+                case OP_IINC: {
+                    auto& v = local(in.Local);
+                    if (v.Type != Kind::Int) { throw Stop(); }
+                    v.Bits = static_cast<int32_t>(static_cast<uint32_t>(v.Bits) + static_cast<uint32_t>(in.Value));
+                }
+                break;
+
+                case OP_IALOAD: case OP_BALOAD: case OP_CALOAD: case OP_SALOAD: case OP_LALOAD: case OP_FALOAD:
+                case OP_DALOAD: case OP_AALOAD: {
+                    static constexpr char types[] = {'I', 'J', 'F', 'D', 'L', 'B', 'C', 'S'};
+                    const int32_t index = pop_int();
+                    const Constant array = pop_ref();
+                    push(element(index, array, types[op - OP_IALOAD]));
+                }
+                break;
+                case OP_IASTORE: case OP_BASTORE: case OP_CASTORE: case OP_SASTORE: case OP_LASTORE: case OP_FASTORE:
+                case OP_DASTORE: case OP_AASTORE: {
+                    static constexpr char types[] = {'I', 'J', 'F', 'D', 'L', 'B', 'C', 'S'};
+                    const char type = types[op - OP_IASTORE];
+                    Constant v;
+                    if (type == 'L') {
+                        v = pop_ref();
+                        if (v.Type == Kind::Array) { throw Stop(); } // only String[] are made
+                    } else {
+                        v = pop_as(Interpreter::Default(type).Type);
+                    }
+                    const int32_t index = pop_int();
+                    const Constant array = pop_ref();
+                    auto& e = element(index, array, type);
+                    const char actual = Arrays[array.Bits].Type;
+                    if (actual == 'Z') { v.Bits &= 1; }
+                    else if (actual == 'B') { v.Bits = static_cast<int8_t>(v.Bits); }
+                    else if (actual == 'C') { v.Bits = static_cast<uint16_t>(v.Bits); }
+                    else if (actual == 'S') { v.Bits = static_cast<int16_t>(v.Bits); }
+                    e = v;
+                }
+                break;
+
+                case OP_POP: pop(); break;
+                case OP_POP2: pop(), pop(); break;
+                case OP_DUP: { const auto a = pop(); stack.insert(stack.end(), {a, a}); } break;
+                case OP_DUP_X1: { const auto a = pop(), b = pop(); stack.insert(stack.end(), {a, b, a}); } break;
+                case OP_DUP_X2: { const auto a = pop(), b = pop(), c = pop(); stack.insert(stack.end(), {a, c, b, a}); } break;
+                case OP_DUP2: { const auto a = pop(), b = pop(); stack.insert(stack.end(), {b, a, b, a}); } break;
+                case OP_DUP2_X1: { const auto a = pop(), b = pop(), c = pop(); stack.insert(stack.end(), {b, a, c, b, a}); } break;
+                case OP_DUP2_X2: {
+                    const auto a = pop(), b = pop(), c = pop(), d = pop();
+                    stack.insert(stack.end(), {b, a, d, c, b, a});
+                }
+                break;
+                case OP_SWAP: { const auto a = pop(), b = pop(); stack.insert(stack.end(), {a, b}); } break;
+
+                case OP_IADD: case OP_ISUB: case OP_IMUL: case OP_IDIV: case OP_IREM: case OP_ISHL: case OP_ISHR:
+                case OP_IUSHR: case OP_IAND: case OP_IOR: case OP_IXOR: {
+                    const int32_t b = pop_int(), a = pop_int();
+                    const auto ua = static_cast<uint32_t>(a), ub = static_cast<uint32_t>(b);
+                    uint32_t r = 0;
+                    switch (op) {
+                    case OP_IADD: r = ua + ub; break;
+                    case OP_ISUB: r = ua - ub; break;
+                    case OP_IMUL: r = ua * ub; break;
+                    case OP_IDIV: case OP_IREM:
+                        if (!b) { throw Stop(); } // ArithmeticException
+                        if (b == -1) { r = op == OP_IDIV ? 0 - ua : 0; }
+                        else { r = static_cast<uint32_t>(op == OP_IDIV ? a / b : a % b); }
+                        break;
+                    case OP_ISHL: r = ua << (b & 31); break;
+                    case OP_ISHR: r = static_cast<uint32_t>(a >> (b & 31)); break;
+                    case OP_IUSHR: r = ua >> (b & 31); break;
+                    case OP_IAND: r = ua & ub; break;
+                    case OP_IOR: r = ua | ub; break;
+                    default: r = ua ^ ub;
+                    }
+                    push(make_int(static_cast<int32_t>(r)));
+                }
+                break;
+                case OP_LADD: case OP_LSUB: case OP_LMUL: case OP_LDIV: case OP_LREM: case OP_LAND: case OP_LOR:
+                case OP_LXOR: {
+                    const int64_t b = pop_long(), a = pop_long();
+                    const auto ua = static_cast<uint64_t>(a), ub = static_cast<uint64_t>(b);
+                    uint64_t r = 0;
+                    switch (op) {
+                    case OP_LADD: r = ua + ub; break;
+                    case OP_LSUB: r = ua - ub; break;
+                    case OP_LMUL: r = ua * ub; break;
+                    case OP_LDIV: case OP_LREM:
+                        if (!b) { throw Stop(); }
+                        if (b == -1) { r = op == OP_LDIV ? 0 - ua : 0; }
+                        else { r = static_cast<uint64_t>(op == OP_LDIV ? a / b : a % b); }
+                        break;
+                    case OP_LAND: r = ua & ub; break;
+                    case OP_LOR: r = ua | ub; break;
+                    default: r = ua ^ ub;
+                    }
+                    push(make_long(static_cast<int64_t>(r)));
+                }
+                break;
+                case OP_LSHL: case OP_LSHR: case OP_LUSHR: {
+                    const int32_t b = pop_int();
+                    const int64_t a = pop_long();
+                    const auto ua = static_cast<uint64_t>(a);
+                    push(make_long(op == OP_LSHL ? static_cast<int64_t>(ua << (b & 63)) :
+                                   op == OP_LSHR ? a >> (b & 63) : static_cast<int64_t>(ua >> (b & 63))));
+                }
+                break;
+                case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV: case OP_FREM: {
+                    const float b = pop_float(), a = pop_float();
+                    push(make_float(op == OP_FADD ? a + b : op == OP_FSUB ? a - b : op == OP_FMUL ? a * b :
+                                    op == OP_FDIV ? a / b : std::fmod(a, b)));
+                }
+                break;
+                case OP_DADD: case OP_DSUB: case OP_DMUL: case OP_DDIV: case OP_DREM: {
+                    const double b = pop_double(), a = pop_double();
+                    push(make_double(op == OP_DADD ? a + b : op == OP_DSUB ? a - b : op == OP_DMUL ? a * b :
+                                     op == OP_DDIV ? a / b : std::fmod(a, b)));
+                }
+                break;
+                case OP_INEG: push(make_int(static_cast<int32_t>(0 - static_cast<uint32_t>(pop_int())))); break;
+                case OP_LNEG: push(make_long(static_cast<int64_t>(0 - static_cast<uint64_t>(pop_long())))); break;
+                case OP_FNEG: push(make_float(-pop_float())); break;
+                case OP_DNEG: push(make_double(-pop_double())); break;
+
+                case OP_I2L: push(make_long(pop_int())); break;
+                case OP_I2F: push(make_float(static_cast<float>(pop_int()))); break;
+                case OP_I2D: push(make_double(pop_int())); break;
+                case OP_L2I: push(make_int(static_cast<int32_t>(pop_long()))); break;
+                case OP_L2F: push(make_float(static_cast<float>(pop_long()))); break;
+                case OP_L2D: push(make_double(static_cast<double>(pop_long()))); break;
+                case OP_F2I: push(make_int(to_integer<int32_t>(pop_float()))); break;
+                case OP_F2L: push(make_long(to_integer<int64_t>(pop_float()))); break;
+                case OP_F2D: push(make_double(pop_float())); break;
+                case OP_D2I: push(make_int(to_integer<int32_t>(pop_double()))); break;
+                case OP_D2L: push(make_long(to_integer<int64_t>(pop_double()))); break;
+                case OP_D2F: push(make_float(static_cast<float>(pop_double()))); break;
+                case OP_I2B: push(make_int(static_cast<int8_t>(pop_int()))); break;
+                case OP_I2C: push(make_int(static_cast<uint16_t>(pop_int()))); break;
+                case OP_I2S: push(make_int(static_cast<int16_t>(pop_int()))); break;
+
+                case OP_LCMP: {
+                    const int64_t b = pop_long(), a = pop_long();
+                    push(make_int(a < b ? -1 : a > b ? 1 : 0));
+                }
+                break;
+                case OP_FCMPL: case OP_FCMPG: {
+                    const float b = pop_float(), a = pop_float();
+                    push(make_int(compare(a, b, op == OP_FCMPL ? -1 : 1)));
+                }
+                break;
+                case OP_DCMPL: case OP_DCMPG: {
+                    const double b = pop_double(), a = pop_double();
+                    push(make_int(compare(a, b, op == OP_DCMPL ? -1 : 1)));
+                }
+                break;
+
+                case OP_IFEQ: case OP_IFNE: case OP_IFLT: case OP_IFGE: case OP_IFGT: case OP_IFLE:
+                case OP_IF_ICMPEQ: case OP_IF_ICMPNE: case OP_IF_ICMPLT: case OP_IF_ICMPGE: case OP_IF_ICMPGT:
+                case OP_IF_ICMPLE: {
+                    const int32_t b = op >= OP_IF_ICMPEQ ? pop_int() : 0, a = pop_int();
+                    bool taken;
+                    switch ((op - OP_IFEQ) % 6) {
+                    case 0: taken = a == b; break;
+                    case 1: taken = a != b; break;
+                    case 2: taken = a < b; break;
+                    case 3: taken = a >= b; break;
+                    case 4: taken = a > b; break;
+                    default: taken = a <= b;
+                    }
+                    if (taken) { next = in.Target; }
+                }
+                break;
+                case OP_IF_ACMPEQ: case OP_IF_ACMPNE: {
+                    const Constant b = pop_ref(), a = pop_ref();
+                    if ((a == b) == (op == OP_IF_ACMPEQ)) { next = in.Target; }
+                }
+                break;
+                case OP_IFNULL: case OP_IFNONNULL:
+                    if ((pop_ref().Type == Kind::Null) == (op == OP_IFNULL)) { next = in.Target; }
+                    break;
+                case OP_GOTO: next = in.Target; break;
+                case OP_TABLESWITCH: case OP_LOOKUPSWITCH: {
+                    const int32_t key = pop_int();
+                    const auto& table = code.Switches[in.Value];
+                    next = in.Target;
+                    for (size_t k = 0; k < table.Keys.size(); k++) {
+                        if (table.Keys[k] == key) { next = table.Targets[k]; }
+                    }
+                }
+                break;
+                case OP_RETURN: return true;
+
+                case OP_GETSTATIC: push(StaticAt(in.Value).Current); break;
+                case OP_PUTSTATIC: {
+                    auto& s = StaticAt(in.Value);
+                    const char desc = Utf8At(File, File.Fields[s.Field].DescriptorIndex)[0];
+                    s.Current = desc == 'L' || desc == '[' ? pop_ref() : pop_as(Default(desc).Type);
+                }
+                break;
+                case OP_INVOKEVIRTUAL: Invoke(in, stack); break;
+                case OP_NEWARRAY: {
+                    const char type = array_type(in.Value);
+                    if (!type) { throw Stop(); }
+                    push(NewArray(type, pop_int()));
+                }
+                break;
+                case OP_ANEWARRAY:
+                    if (ClassNameAt(File, static_cast<U2>(in.Value)) != "java/lang/String") { throw Stop(); }
+                    push(NewArray('L', pop_int()));
+                    break;
+                case OP_ARRAYLENGTH: {
+                    const Constant array = pop_ref();
+                    if (array.Type != Kind::Array) { throw Stop(); }
+                    push(make_int(static_cast<int32_t>(Arrays[array.Bits].Elements.size())));
+                }
+                break;
+                case OP_CHECKCAST: {
+                    const Constant v = pop_ref();
+                    const char array = v.Type == Kind::Array ? Arrays[v.Bits].Type : 0;
+                    if (!is_instance(v, ClassNameAt(File, static_cast<U2>(in.Value)), array)) { throw Stop(); }
+                    push(v);
+                }
+                break;
+                default: throw Stop(); // calls, objects, monitors, exceptions, jsr
+                }
+                pc = next;
+            }
+        } catch (const Stop&) {
+        } catch (const InvalidClassFile&) {
+        }
+        return false;
+    }
+}
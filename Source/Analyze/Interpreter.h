@@ -0,0 +1,77 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Insns.h"
+
+/*
+ * Runs a static initializer at build time. Only what has no effect outside of the class and no way of
+ * failing is run: constants, locals, arithmetic, branches, the static fields of the class itself,
+ * arrays of primitives or strings, and String.length, charAt, toCharArray and hashCode. Anything else
+ * (another class, an allocation of an object, a call, an exception, a run that goes on too long) stops
+ * the run. A run that gets to the return has done all the JVM would have, so the statics it leaves are
+ * what initialization leaves.
+ *
+ * Strings only come from ldc, so they are all interned and two strings are the same object exactly if
+ * they are equal.
+ */
+
+namespace Analyze {
+    // a value as the JVM holds it: a long or double takes two slots, the second Top
+    struct Constant {
+        enum class Kind : uint8_t { Top, Int, Long, Float, Double, Null, String, Array };
+        Kind Type = Kind::Top;
+        int64_t Bits = 0; // Int and Long; the index of a String or Array on the heap
+        double Real = 0;  // Float (exactly) and Double
+
+        // the same value, or object; floating point by bits
+        bool operator==(const Constant& other) const;
+        bool operator!=(const Constant& other) const { return !(*this == other); }
+    };
+
+    struct HeapArray {
+        char Type; // descriptor of the elements: Z B C S I J F D, or L for java/lang/String
+        std::vector<Constant> Elements;
+    };
+
+    class Interpreter {
+    public:
+        struct Static {
+            int Field;       // index in the fields of the class
+            bool Final;
+            Constant Initial; // of its ConstantValue, or the default of its type
+            Constant Current;
+        };
+
+        explicit Interpreter(const Parse::ClassFile& f);
+
+        // false if the code did something that cannot be run; the statics are then of no use
+        bool Run(const DecodedCode& code);
+
+        const std::vector<Static>& Statics() const { return StaticFields; }
+        const std::u16string& StringAt(const Constant& c) const { return Strings[c.Bits]; }
+        const HeapArray& ArrayAt(const Constant& c) const { return Arrays[c.Bits]; }
+
+        // the default value of a field of a type given by the first character of its descriptor
+        static Constant Default(char desc);
+
+    private:
+        struct Stop {}; // thrown where the run cannot go on
+
+        Constant Ldc(int index);
+        Constant Intern(std::u16string s);
+        Constant NewArray(char type, int32_t length);
+        Static& StaticAt(int index);
+        void Invoke(const Insn& in, std::vector<Constant>& stack);
+
+        const Parse::ClassFile& File;
+        std::string_view ThisClass;
+        std::vector<Static> StaticFields;
+        std::vector<std::u16string> Strings;
+        std::map<std::u16string, int> Interned;
+        std::vector<HeapArray> Arrays;
+        size_t HeapSize = 0; // array elements in all
+        bool Unusable = false; // a ConstantValue that does not fit its field
+    };
+}
@@ -0,0 +1,512 @@
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include "Javalib/Opcodes.h"
+#include "Parse/CpInfo.h"
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Util/WorkPool.h"
+#include "Reachability.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        constexpr U2 ACC_PRIVATE = 0x0002;
+        constexpr U2 ACC_STATIC = 0x0008;
+        constexpr U2 ACC_ANNOTATION = 0x2000;
+        constexpr U2 ACC_ENUM = 0x4000;
+        constexpr int MAX_DEPTH = 64; // supertype walks are cut off here, as in ClassHierarchy
+
+        // methods the JVM or the class library call on any class that has them
+        const char* const hook_methods[] = {
+            "<clinit>()V",
+            "toString()Ljava/lang/String;",
+            "hashCode()I",
+            "equals(Ljava/lang/Object;)Z",
+            "clone()Ljava/lang/Object;",
+            "finalize()V",
+            "writeObject(Ljava/io/ObjectOutputStream;)V",
+            "readObject(Ljava/io/ObjectInputStream;)V",
+            "readObjectNoData()V",
+            "writeReplace()Ljava/lang/Object;",
+            "readResolve()Ljava/lang/Object;",
+        };
+        const char* const hook_fields[] = {
+            "serialVersionUID:J",
+            "serialPersistentFields:[Ljava/io/ObjectStreamField;",
+        };
+
+        // bits that threads set at the same time; Set says whether the caller was the one to set it
+        class AtomicBits {
+        public:
+            explicit AtomicBits(const size_t n): Words(new std::atomic<uint64_t>[(n + 63) / 64]), N(n) {
+                for (size_t i = 0; i < (n + 63) / 64; i++) { Words[i].store(0, std::memory_order_relaxed); }
+            }
+
+            bool Set(const size_t i) {
+                const uint64_t bit = 1ull << (i & 63);
+                return !(Words[i >> 6].fetch_or(bit) & bit);
+            }
+
+            bool Test(const size_t i) const { return Words[i >> 6].load() >> (i & 63) & 1; }
+
+            std::vector<uint64_t> Take() const {
+                std::vector<uint64_t> out((N + 63) / 64);
+                for (size_t i = 0; i < out.size(); i++) { out[i] = Words[i].load(std::memory_order_relaxed); }
+                return out;
+            }
+
+        private:
+            std::unique_ptr<std::atomic<uint64_t>[]> Words;
+            size_t N;
+        };
+
+        bool test_bit(const std::vector<uint64_t>& bits, const size_t i) {
+            return i >> 6 < bits.size() && bits[i >> 6] >> (i & 63) & 1;
+        }
+
+        uint64_t member_key(const int cls, const int sig) {
+            return static_cast<uint64_t>(cls) << 32 | static_cast<uint32_t>(sig);
+        }
+
+        // the classes named in a descriptor
+        template<class F>
+        void descriptor_classes(const std::string_view desc, F&& f) {
+            for (size_t i = 0; i < desc.size(); i++) {
+                if (desc[i] != 'L') { continue; }
+                const size_t end = desc.find(';', i);
+                if (end == std::string_view::npos) { return; }
+                f(desc.substr(i + 1, end - i - 1));
+                i = end;
+            }
+        }
+
+        bool matches(const std::string& pattern, const char* name) {
+            if (!pattern.empty() && pattern.back() == '*') { return !strncmp(name, pattern.data(), pattern.size() - 1); }
+            return pattern == name;
+        }
+    }
+
+    KeepRule KeepRule::Parse(const std::string_view rule) {
+        const auto hash = rule.find('#');
+        if (hash == std::string_view::npos) { return {std::string(rule), {}}; }
+        return {std::string(rule.substr(0, hash)), std::string(rule.substr(hash + 1))};
+    }
+
+    KeepRule KeepRule::Main(const std::string_view cls) {
+        return {std::string(cls), "main([Ljava/lang/String;)V"};
+    }
+
+    int Reachability::Intern(std::string key) {
+        const auto it = Sigs.find(key);
+        if (it != Sigs.end()) { return it->second; }
+        const int id = static_cast<int>(SigNames.size());
+        SigNames.push_back(key);
+        Sigs.emplace(std::move(key), id);
+        return id;
+    }
+
+    int Reachability::Node(const JType cls) const {
+        return cls < NodeOf.size() ? NodeOf[cls] : -1;
+    }
+
+    int Reachability::Add(const ClassFile& f) {
+        const int id = static_cast<int>(Classes.size());
+        ClassNode c;
+        c.Name = ClassType(ClassNameAt(f, f.ThisClass));
+        c.Super = f.SuperClass ? ClassType(ClassNameAt(f, f.SuperClass)) : 0;
+        for (const auto i : f.Interfaces) { c.Interfaces.push_back(ClassType(ClassNameAt(f, i))); }
+        c.AccessFlags = f.AccessFlags;
+        c.FirstField = static_cast<int>(Fields.size());
+        c.FieldCount = static_cast<int>(f.Fields.size());
+        c.FirstMethod = static_cast<int>(Methods.size());
+        c.MethodCount = static_cast<int>(f.Methods.size());
+        if (NodeOf.size() <= c.Name) { NodeOf.resize(c.Name + 1, -1); }
+        if (NodeOf[c.Name] >= 0) {
+            c.Original = NodeOf[c.Name];
+            Classes.push_back(std::move(c));
+            return id;
+        }
+        NodeOf[c.Name] = id;
+
+        const auto& pool = f.ConstantPool;
+        auto has = [&](const U2 index, const CPoolTags tag) {
+            return index != 0 && index < pool.size() && pool[index] && pool[index]->Tag == tag;
+        };
+        auto class_use = [&](std::vector<Use>& uses, std::string_view name) {
+            while (!name.empty() && name[0] == '[') { name.remove_prefix(1); }
+            if (name.size() >= 2 && name[0] == 'L' && name.back() == ';') { name = name.substr(1, name.size() - 2); }
+            else if (name.size() == 1) { return; } // an array of a primitive type
+            uses.push_back({UseKind::Class, ClassType(name), -1});
+        };
+        auto descriptor_uses = [&](std::vector<Use>& uses, const std::string_view desc) {
+            descriptor_classes(desc, [&](const std::string_view name) { class_use(uses, name); });
+        };
+        auto member_use = [&](std::vector<Use>& uses, const U2 index, const UseKind kind) {
+            U2 owner_index, nat_index;
+            if (has(index, CPoolTags::FieldRef)) {
+                const auto& r = ConstantFieldRefInfo::Reference(pool[index]);
+                owner_index = r.ClassIndex, nat_index = r.NameAndTypeIndex;
+            } else if (has(index, CPoolTags::MethodRef)) {
+                const auto& r = ConstantMethodRefInfo::Reference(pool[index]);
+                owner_index = r.ClassIndex, nat_index = r.NameAndTypeIndex;
+            } else if (has(index, CPoolTags::InterfaceMethodRef)) {
+                const auto& r = ConstantInterfaceMethodRefInfo::Reference(pool[index]);
+                owner_index = r.ClassIndex, nat_index = r.NameAndTypeIndex;
+            } else {
+                return;
+            }
+            if (!has(nat_index, CPoolTags::NameAndType)) { return; }
+            const auto& nat = ConstantNameAndTypeInfo::Reference(pool[nat_index]);
+            const auto owner = ClassNameAt(f, owner_index);
+            const auto name = Utf8At(f, nat.NameIndex), desc = Utf8At(f, nat.DescriptorIndex);
+            descriptor_uses(uses, desc);
+            class_use(uses, owner);
+            if (owner[0] == '[') { return; } // clone of an array
+            std::string key(name);
+            if (kind != UseKind::Field) { key += desc; }
+            else { (key += ':') += desc; }
+            uses.push_back({kind, ClassType(owner), Intern(std::move(key))});
+        };
+
+        // the constants each bootstrap method gets: the method handle and the static arguments
+        std::vector<std::vector<U2>> bootstrap;
+        for (const auto& a : f.Attributes) {
+            if (Utf8At(f, a.AttributeNameIndex) != "BootstrapMethods" || a.Info.size() < 2) { continue; }
+            const U1* p = a.Info.data();
+            const U1* end = p + a.Info.size();
+            auto u2 = [&]() -> U2 {
+                if (end - p < 2) { throw InvalidClassFile("truncated BootstrapMethods"); }
+                p += 2;
+                return static_cast<U2>(p[-2] << 8 | p[-1]);
+            };
+            for (int n = u2(); n > 0; n--) {
+                std::vector<U2> refs{u2()};
+                for (int k = u2(); k > 0; k--) { refs.push_back(u2()); }
+                bootstrap.push_back(std::move(refs));
+            }
+        }
+
+        // what loading the constant at index needs, for ldc and bootstrap arguments
+        std::function<void(std::vector<Use>&, U2, int)> constant_uses = [&](std::vector<Use>& uses, const U2 index,
+                                                                            const int depth) {
+            if (index == 0 || index >= pool.size() || !pool[index] || depth > 4) { return; }
+            const auto& e = pool[index];
+            switch (e->Tag) {
+            case CPoolTags::Class: class_use(uses, ClassNameAt(f, index)); break;
+            case CPoolTags::MethodType:
+                descriptor_uses(uses, Utf8At(f, ConstantMethodTypeInfo::Reference(e).DescriptorIndex));
+                break;
+            case CPoolTags::MethodHandle: {
+                const auto& h = ConstantMethodHandleInfo::Reference(e);
+                // 1-4 get/put a field, 5 and 9 dispatch virtually, 6-8 do not
+                const auto kind = h.ReferenceKind <= 4 ? UseKind::Field
+                                : h.ReferenceKind == 5 || h.ReferenceKind == 9 ? UseKind::Virtual : UseKind::Direct;
+                member_use(uses, h.ReferenceIndex, kind);
+            }
+            break;
+            case CPoolTags::Dynamic:
+            case CPoolTags::InvokeDynamic: {
+                U2 bsm, nat_index;
+                if (e->Tag == CPoolTags::Dynamic) {
+                    const auto& d = ConstantDynamicInfo::Reference(e);
+                    bsm = d.BootstrapMethodAttrIndex, nat_index = d.NameAndTypeIndex;
+                } else {
+                    const auto& d = ConstantInvokeDynamicInfo::Reference(e);
+                    bsm = d.BootstrapMethodAttrIndex, nat_index = d.NameAndTypeIndex;
+                }
+                if (has(nat_index, CPoolTags::NameAndType)) {
+                    descriptor_uses(uses, Utf8At(f, ConstantNameAndTypeInfo::Reference(pool[nat_index]).DescriptorIndex));
+                }
+                if (bsm < bootstrap.size()) {
+                    for (const auto ref : bootstrap[bsm]) { constant_uses(uses, ref, depth + 1); }
+                }
+            }
+            break;
+            default: ;
+            }
+        };
+
+        for (const auto& fi : f.Fields) {
+            MemberNode m{id, Intern(std::string(Utf8At(f, fi.NameIndex)) + ':' + std::string(Utf8At(f, fi.DescriptorIndex))),
+                         fi.AccessFlags, {}};
+            descriptor_uses(m.Uses, Utf8At(f, fi.DescriptorIndex));
+            FieldAt[member_key(id, m.Sig)] = static_cast<int>(Fields.size());
+            Fields.push_back(std::move(m));
+        }
+        for (const auto& mi : f.Methods) {
+            const auto desc = Utf8At(f, mi.DescriptorIndex);
+            MemberNode m{id, Intern(std::string(Utf8At(f, mi.NameIndex)) + std::string(desc)), mi.AccessFlags, {}};
+            descriptor_uses(m.Uses, desc);
+            for (const auto& a : mi.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) != "Code") { continue; }
+                CodeAttribute code;
+                Parser{}.ParseCodeOnto(a.Info, code);
+                for (const auto& e : code.ExceptionTable) {
+                    if (e.CatchType) { class_use(m.Uses, ClassNameAt(f, e.CatchType)); }
+                }
+                const U1* bc = code.Code.data();
+                const int len = static_cast<int>(code.Code.size());
+                for (int pc = 0, n; pc < len; pc += n) {
+                    n = InsnLength(bc, pc, len); // checks that the instruction fits in the code
+                    const int op = bc[pc];
+                    const U2 index = OpcodeTable[op].Flags & OPF_CP2 ? static_cast<U2>(bc[pc + 1] << 8 | bc[pc + 2]) : 0;
+                    switch (op) {
+                    case OP_LDC: constant_uses(m.Uses, bc[pc + 1], 0); break;
+                    case OP_LDC_W:
+                    case OP_LDC2_W:
+                    case OP_INVOKEDYNAMIC: constant_uses(m.Uses, index, 0); break;
+                    case OP_GETSTATIC:
+                    case OP_PUTSTATIC:
+                    case OP_GETFIELD:
+                    case OP_PUTFIELD: member_use(m.Uses, index, UseKind::Field); break;
+                    case OP_INVOKEVIRTUAL:
+                    case OP_INVOKEINTERFACE: member_use(m.Uses, index, UseKind::Virtual); break;
+                    case OP_INVOKESPECIAL:
+                    case OP_INVOKESTATIC: member_use(m.Uses, index, UseKind::Direct); break;
+                    case OP_NEW:
+                    case OP_ANEWARRAY:
+                    case OP_CHECKCAST:
+                    case OP_INSTANCEOF:
+                    case OP_MULTIANEWARRAY: class_use(m.Uses, ClassNameAt(f, index)); break;
+                    default: ;
+                    }
+                }
+            }
+            MethodAt[member_key(id, m.Sig)] = static_cast<int>(Methods.size());
+            Methods.push_back(std::move(m));
+        }
+        Classes.push_back(std::move(c));
+        return id;
+    }
+
+    void Reachability::Keep(const KeepRule& rule) {
+        Rules.push_back(rule);
+    }
+
+    // the declaration a reference resolves to: the class and its superclasses, then the superinterfaces
+    int Reachability::FindMethod(const int cls, const int sig) const {
+        std::vector<int> interfaces;
+        int depth = 0;
+        for (int c = cls; c >= 0 && depth++ < MAX_DEPTH; c = Node(Classes[c].Super)) {
+            const auto it = MethodAt.find(member_key(c, sig));
+            if (it != MethodAt.end()) { return it->second; }
+            for (const auto i : Classes[c].Interfaces) {
+                if (Node(i) >= 0) { interfaces.push_back(Node(i)); }
+            }
+        }
+        for (size_t k = 0; k < interfaces.size() && k < MAX_DEPTH * 4; k++) {
+            const int c = interfaces[k];
+            const auto it = MethodAt.find(member_key(c, sig));
+            if (it != MethodAt.end()) { return it->second; }
+            for (const auto i : Classes[c].Interfaces) {
+                if (Node(i) >= 0) { interfaces.push_back(Node(i)); }
+            }
+        }
+        return -1;
+    }
+
+    // JVMS 5.4.3.2: the class, its superinterfaces, then its superclass
+    int Reachability::FindField(const int cls, const int sig) const {
+        std::vector<int> todo;
+        int depth = 0;
+        for (int c = cls; c >= 0 && depth++ < MAX_DEPTH; c = Node(Classes[c].Super)) {
+            todo.assign(1, c);
+            for (size_t k = 0; k < todo.size() && k < MAX_DEPTH * 4; k++) {
+                const auto it = FieldAt.find(member_key(todo[k], sig));
+                if (it != FieldAt.end()) { return it->second; }
+                for (const auto i : Classes[todo[k]].Interfaces) {
+                    if (Node(i) >= 0) { todo.push_back(Node(i)); }
+                }
+            }
+        }
+        return -1;
+    }
+
+    bool Reachability::Implicit(const ClassNode& c, const MemberNode& m, const bool is_method) const {
+        const auto& sig = SigNames[m.Sig];
+        if (!is_method) {
+            for (const char* hook : hook_fields) {
+                if (sig == hook) { return true; }
+            }
+            return false;
+        }
+        for (const char* hook : hook_methods) {
+            if (sig == hook) { return true; }
+        }
+        if (c.AccessFlags & ACC_ANNOTATION) { return true; } // read reflectively
+        if ((c.AccessFlags & ACC_ENUM) && (!sig.compare(0, 7, "values(") || !sig.compare(0, 8, "valueOf("))) {
+            return true;
+        }
+        // may override a method the library calls
+        return c.External && !(m.AccessFlags & (ACC_STATIC | ACC_PRIVATE)) && sig[0] != '<';
+    }
+
+    void Reachability::Run() {
+        const JType object = ClassType("java/lang/Object");
+        // a supertype outside of the batch may call back into any method; a fixed point over the chains
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto& c : Classes) {
+                if (c.External || c.Original >= 0) { continue; }
+                bool external = c.Super && c.Super != object && (Node(c.Super) < 0 || Classes[Node(c.Super)].External);
+                for (const auto i : c.Interfaces) { external |= Node(i) < 0 || Classes[Node(i)].External; }
+                if (external) { c.External = changed = true; }
+            }
+        }
+
+        // instance methods by signature, for virtual calls
+        std::vector<std::vector<int>> overriders(SigNames.size());
+        for (size_t i = 0; i < Methods.size(); i++) {
+            const auto& m = Methods[i];
+            if (!(m.AccessFlags & (ACC_STATIC | ACC_PRIVATE)) && SigNames[m.Sig][0] != '<') {
+                overriders[m.Sig].push_back(static_cast<int>(i));
+            }
+        }
+
+        // Work items are an id and what it is the id of. Class bits are indexed by JType, so that classes
+        // outside of the batch are marked too and looked at only once.
+        enum { CLASS, METHOD, FIELD, SIG };
+        AtomicBits classes(NodeOf.size()), methods(Methods.size()), fields(Fields.size()), sigs(SigNames.size());
+        using Items = std::vector<uint32_t>;
+        auto item = [](const int kind, const size_t id) { return static_cast<uint32_t>(id << 2 | kind); };
+        auto mark_class = [&](const JType t, Items& out) {
+            if (t && t < NodeOf.size() && classes.Set(t)) { out.push_back(item(CLASS, t)); }
+        };
+        auto mark_method = [&](const int m, Items& out) {
+            if (m >= 0 && methods.Set(m)) { out.push_back(item(METHOD, m)); }
+        };
+        auto mark_field = [&](const int f, Items& out) {
+            if (f >= 0 && fields.Set(f)) { out.push_back(item(FIELD, f)); }
+        };
+        auto uses = [&](const std::vector<Use>& list, Items& out) {
+            for (const auto& u : list) {
+                const int owner = u.Kind == UseKind::Class ? -1 : Node(u.Owner);
+                switch (u.Kind) {
+                case UseKind::Class: mark_class(u.Owner, out); break;
+                case UseKind::Field: if (owner >= 0) { mark_field(FindField(owner, u.Sig), out); } break;
+                case UseKind::Direct: if (owner >= 0) { mark_method(FindMethod(owner, u.Sig), out); } break;
+                case UseKind::Virtual:
+                    if (owner >= 0) { mark_method(FindMethod(owner, u.Sig), out); }
+                    if (sigs.Set(u.Sig)) { out.push_back(item(SIG, u.Sig)); }
+                    break;
+                }
+            }
+        };
+        auto visit = [&](const uint32_t it, Items& out) {
+            const size_t id = it >> 2;
+            switch (it & 3) {
+            case CLASS: {
+                const int n = Node(static_cast<JType>(id));
+                if (n < 0) { break; }
+                const auto& c = Classes[n];
+                mark_class(c.Super, out);
+                for (const auto i : c.Interfaces) { mark_class(i, out); }
+                for (int m = c.FirstMethod; m < c.FirstMethod + c.MethodCount; m++) {
+                    // seq_cst bits: of this test and the one in SIG, at least one sees the other's mark
+                    if (Implicit(c, Methods[m], true) || sigs.Test(Methods[m].Sig)) { mark_method(m, out); }
+                }
+                for (int f = c.FirstField; f < c.FirstField + c.FieldCount; f++) {
+                    if (Implicit(c, Fields[f], false)) { mark_field(f, out); }
+                }
+            }
+            break;
+            case METHOD:
+                mark_class(Classes[Methods[id].Class].Name, out);
+                uses(Methods[id].Uses, out);
+                break;
+            case FIELD:
+                mark_class(Classes[Fields[id].Class].Name, out);
+                uses(Fields[id].Uses, out);
+                break;
+            case SIG:
+                for (const int m : overriders[id]) {
+                    if (classes.Test(Classes[Methods[m].Class].Name)) { mark_method(m, out); }
+                }
+                break;
+            }
+        };
+
+        Items frontier;
+        for (const auto& rule : Rules) {
+            for (const auto& c : Classes) {
+                if (c.Original >= 0 || !matches(rule.Class, ClassName(c.Name))) { continue; }
+                mark_class(c.Name, frontier);
+                auto wanted = [&](const MemberNode& m) {
+                    if (rule.Member.empty()) { return true; }
+                    const auto& sig = SigNames[m.Sig];
+                    if (sig.compare(0, rule.Member.size(), rule.Member)) { return false; }
+                    const char next = sig.c_str()[rule.Member.size()];
+                    return next == 0 || next == '(' || next == ':';
+                };
+                for (int m = c.FirstMethod; m < c.FirstMethod + c.MethodCount; m++) {
+                    if (wanted(Methods[m])) { mark_method(m, frontier); }
+                }
+                for (int f = c.FirstField; f < c.FirstField + c.FieldCount; f++) {
+                    if (wanted(Fields[f])) { mark_field(f, frontier); }
+                }
+            }
+        }
+
+        auto& pool = Utils::WorkPool::Shared();
+        std::vector<Items> next(pool.Threads());
+        while (!frontier.empty()) {
+            pool.ParallelFor(static_cast<int>(frontier.size()), [&](const int i, const int worker) {
+                visit(frontier[i], next[worker]);
+            });
+            frontier.clear();
+            for (auto& out : next) {
+                frontier.insert(frontier.end(), out.begin(), out.end());
+                out.clear();
+            }
+        }
+        ClassBits = classes.Take();
+        MethodBits = methods.Take();
+        FieldBits = fields.Take();
+    }
+
+    bool Reachability::IsReachable(const int cls) const {
+        return test_bit(ClassBits, Classes[cls].Name);
+    }
+
+    std::vector<bool> Reachability::KeptFields(const int cls) const {
+        const auto& c = Classes[cls];
+        std::vector<bool> kept(c.FieldCount, true);
+        if (c.Original < 0) {
+            for (int i = 0; i < c.FieldCount; i++) { kept[i] = test_bit(FieldBits, c.FirstField + i); }
+        }
+        return kept;
+    }
+
+    std::vector<bool> Reachability::KeptMethods(const int cls) const {
+        const auto& c = Classes[cls];
+        std::vector<bool> kept(c.MethodCount, true);
+        if (c.Original < 0) {
+            for (int i = 0; i < c.MethodCount; i++) { kept[i] = test_bit(MethodBits, c.FirstMethod + i); }
+        }
+        return kept;
+    }
+
+    Reachability::Counts Reachability::Total() const {
+        Counts n;
+        for (const auto& c : Classes) {
+            n.Classes++;
+            n.Methods += c.MethodCount;
+            n.Fields += c.FieldCount;
+        }
+        return n;
+    }
+
+    Reachability::Counts Reachability::Kept() const {
+        Counts n;
+        for (int i = 0; i < static_cast<int>(Classes.size()); i++) {
+            if (!IsReachable(i)) { continue; }
+            n.Classes++;
+            for (const bool b : KeptMethods(i)) { n.Methods += b; }
+            for (const bool b : KeptFields(i)) { n.Fields += b; }
+        }
+        return n;
+    }
+}
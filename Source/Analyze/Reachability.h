@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Util/u.h"
+#include "Javalib/Basic.h"
+#include "Parse/ClassFile.h"
+
+/*
+ * Whole-program reachability over the classes of a batch, for dropping the classes, methods and fields
+ * nothing can reach from the entry points.
+ *
+ * A method is reachable when it is an entry point, when reachable code calls it (resolved the way the
+ * JVM resolves the reference), or when it overrides a signature reachable code calls virtually in a
+ * class that is itself reachable. Fields go by the references reachable code makes. Anything the JVM
+ * or the class library may call without a reference in the batch is kept with its class: <clinit>, the
+ * java.lang.Object and serialization hooks, values/valueOf of enums, and every method of a class that
+ * extends or implements a type outside of the batch. Reflection cannot be seen; keep rules cover it.
+ */
+
+namespace Analyze {
+    // CLASS[#MEMBER]: CLASS is an internal name, or a prefix ending in `*'. Without a member, the class
+    // is kept with all of its members; MEMBER is a name, and for a method may be followed by its
+    // descriptor.
+    struct KeepRule {
+        std::string Class;
+        std::string Member;
+
+        static KeepRule Parse(std::string_view rule);
+        // public static void main(String[]) of cls
+        static KeepRule Main(std::string_view cls);
+    };
+
+    class Reachability {
+    public:
+        // Records what the class declares and refers to; the ClassFile is not kept. Returns the id
+        // of the class for the queries below. A class whose name was added before is only recorded
+        // as a copy: it is reachable when the first one is, and keeps all of its members.
+        int Add(const Parse::ClassFile& f);
+        void Keep(const KeepRule& rule);
+
+        // Walks the references from the entry points, one level of the walk at a time over the shared
+        // WorkPool. Call once, after every Add and Keep.
+        void Run();
+
+        bool IsReachable(int cls) const;
+        // in the order of the class file; all true for a copy
+        std::vector<bool> KeptFields(int cls) const;
+        std::vector<bool> KeptMethods(int cls) const;
+
+        struct Counts {
+            int Classes = 0, Methods = 0, Fields = 0;
+        };
+        Counts Total() const;
+        Counts Kept() const;
+
+    private:
+        enum class UseKind : uint8_t { Class, Field, Direct, Virtual };
+
+        struct Use {
+            UseKind Kind;
+            JType Owner;
+            int Sig; // field or method signature, -1 for Class
+        };
+
+        struct ClassNode {
+            JType Name;
+            JType Super; // 0 for java/lang/Object
+            std::vector<JType> Interfaces;
+            uint16_t AccessFlags;
+            int FirstField, FieldCount, FirstMethod, MethodCount;
+            int Original = -1; // for a copy, the first class of the name
+            bool External = false; // has a supertype outside of the batch besides java/lang/Object
+        };
+
+        struct MemberNode {
+            int Class;
+            int Sig;
+            uint16_t AccessFlags;
+            std::vector<Use> Uses;
+        };
+
+        int Intern(std::string key);
+        int Node(JType cls) const; // -1 if not in the batch
+        int FindMethod(int cls, int sig) const;
+        int FindField(int cls, int sig) const;
+        bool Implicit(const ClassNode& c, const MemberNode& m, bool is_method) const;
+
+        std::vector<ClassNode> Classes;
+        std::vector<MemberNode> Fields, Methods;
+        std::unordered_map<std::string, int> Sigs; // "name(desc)" for methods, "name:desc" for fields
+        std::vector<std::string> SigNames;
+        std::unordered_map<uint64_t, int> MethodAt, FieldAt; // (class << 32 | sig) -> member
+        std::vector<int> NodeOf; // by JType id, -1 if not in the batch
+        std::vector<KeepRule> Rules;
+
+        std::vector<uint64_t> ClassBits, MethodBits, FieldBits; // the result of Run
+    };
+}
@@ -0,0 +1,1070 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include "Util/u.h"
+#include "Util/WorkPool.h"
+#include "Javalib/Opcodes.h"
+#include "Parse/CpInfo.h"
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/PoolEditor.h"
+#include "Parse/Writer.h"
+#include "StackMap.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        constexpr U2 ACC_STATIC = 0x0008;
+
+        struct WellKnown {
+            JType Object = ClassType("java/lang/Object");
+            JType String = ClassType("java/lang/String");
+            JType Class = ClassType("java/lang/Class");
+            JType Throwable = ClassType("java/lang/Throwable");
+            JType MethodHandle = ClassType("java/lang/invoke/MethodHandle");
+            JType MethodType = ClassType("java/lang/invoke/MethodType");
+        };
+
+        const WellKnown& well_known() {
+            static const WellKnown types;
+            return types;
+        }
+
+        VType object(const JType t) {
+            return {VTag::Object, t};
+        }
+
+        // appends the one or two slots of a value of descriptor type t
+        void push_type(std::vector<VType>& v, const JType t) {
+            switch (t) {
+            case BOOL: case BYTE: case CHAR: case SHORT: case INT: v.push_back({VTag::Integer}); break;
+            case FLOAT: v.push_back({VTag::Float}); break;
+            case LONG: v.push_back({VTag::Long}); v.push_back({}); break;
+            case DOUBLE: v.push_back({VTag::Double}); v.push_back({}); break;
+            default: v.push_back(object(t));
+            }
+        }
+
+        int slots(const JType t) {
+            return t == LONG || t == DOUBLE ? 2 : t ? 1 : 0;
+        }
+
+        // Class entries name array classes by their descriptor
+        JType class_entry_type(const ClassFile& f, const U2 index) {
+            const auto name = ClassNameAt(f, index);
+            if (!name.empty() && name[0] == '[') { return ParseFieldDescriptor(std::string(name).c_str()); }
+            return ClassType(name);
+        }
+
+        std::string class_entry_name(const JType t) {
+            if (!ArrayDims(t)) { return ClassName(t); }
+            std::string name(ArrayDims(t), '[');
+            switch (const auto elem = t & JTYPE_ELEM_MASK) {
+            case BOOL: name += 'Z'; break;
+            case BYTE: name += 'B'; break;
+            case CHAR: name += 'C'; break;
+            case SHORT: name += 'S'; break;
+            case INT: name += 'I'; break;
+            case LONG: name += 'J'; break;
+            case FLOAT: name += 'F'; break;
+            case DOUBLE: name += 'D'; break;
+            default: name += 'L', name += ClassName(elem), name += ';';
+            }
+            return name;
+        }
+
+        int get_u2(const U1* p) {
+            return p[0] << 8 | p[1];
+        }
+
+        int get_s2(const U1* p) {
+            return static_cast<int16_t>(p[0] << 8 | p[1]);
+        }
+
+        int get_s4(const U1* p) {
+            return static_cast<int32_t>(static_cast<U4>(p[0]) << 24 | static_cast<U4>(p[1]) << 16 | p[2] << 8 | p[3]);
+        }
+
+        void put_u2(std::vector<U1>& out, const int v) {
+            out.push_back(static_cast<U1>(v >> 8));
+            out.push_back(static_cast<U1>(v));
+        }
+
+        // f(target) for every target of the switch at code[pc]; InsnLength has checked its bounds
+        template <class F>
+        void switch_targets(const U1* code, const int pc, F&& f) {
+            const U1* p = code + ((pc + 4) & -4);
+            f(pc + get_s4(p));
+            if (code[pc] == OP_TABLESWITCH) {
+                const int n = get_s4(p + 8) - get_s4(p + 4) + 1;
+                for (int i = 0; i < n; i++) { f(pc + get_s4(p + 12 + 4 * i)); }
+            } else {
+                const int n = get_s4(p + 4);
+                for (int i = 0; i < n; i++) { f(pc + get_s4(p + 12 + 8 * i)); }
+            }
+        }
+
+        // drops the local slots of the last verification type
+        void chop_one(std::vector<VType>& locals) {
+            if (locals.empty()) { throw InvalidClassFile("chop_frame removes more locals than there are"); }
+            const auto last = locals.back();
+            locals.pop_back();
+            if (last.Tag == VTag::Top && !locals.empty() && locals.back().Wide()) { locals.pop_back(); }
+        }
+
+        // one entry per verification type, as the table has them
+        std::vector<VType> compress(const std::vector<VType>& v) {
+            std::vector<VType> out;
+            out.reserve(v.size());
+            for (size_t i = 0; i < v.size(); i++) {
+                out.push_back(v[i]);
+                if (v[i].Wide()) { i++; }
+            }
+            return out;
+        }
+
+        // the second slot of a trailing Long or Double stays
+        void trim_locals(std::vector<VType>& locals) {
+            auto n = locals.size();
+            while (n && locals[n - 1].Tag == VTag::Top && !(n >= 2 && locals[n - 2].Wide())) { n--; }
+            locals.resize(n);
+        }
+
+        class Reader {
+        public:
+            explicit Reader(const std::vector<U1>& info): Cur(info.data()), Bound(info.data() + info.size()) {}
+
+            int GetU1() {
+                Need(1);
+                return *Cur++;
+            }
+
+            int GetU2() {
+                Need(2);
+                Cur += 2;
+                return get_u2(Cur - 2);
+            }
+
+            bool AtEnd() const { return Cur == Bound; }
+
+        private:
+            void Need(const size_t n) const {
+                if (static_cast<size_t>(Bound - Cur) < n) { throw InvalidClassFile("StackMapTable truncated"); }
+            }
+
+            const U1* Cur;
+            const U1* Bound;
+        };
+
+        void read_types(const ClassFile& f, Reader& in, int n, std::vector<VType>& out) {
+            while (n-- > 0) {
+                const int tag = in.GetU1();
+                VType t{static_cast<VTag>(tag)};
+                if (tag == static_cast<int>(VTag::Object)) { t.Data = class_entry_type(f, static_cast<U2>(in.GetU2())); }
+                else if (tag == static_cast<int>(VTag::Uninitialized)) { t.Data = static_cast<uint32_t>(in.GetU2()); }
+                else if (tag > static_cast<int>(VTag::Uninitialized)) { throw InvalidClassFile("invalid verification type"); }
+                out.push_back(t);
+                if (t.Wide()) { out.push_back({}); }
+            }
+        }
+
+        void write_types(PoolEditor& pool, const std::vector<VType>& types, size_t from, std::vector<U1>& out) {
+            for (; from < types.size(); from++) {
+                const auto t = types[from];
+                out.push_back(static_cast<U1>(t.Tag));
+                if (t.Tag == VTag::Object) { put_u2(out, pool.Class(class_entry_name(t.Data))); }
+                else if (t.Tag == VTag::Uninitialized) { put_u2(out, static_cast<int>(t.Data)); }
+            }
+        }
+
+        struct State {
+            std::vector<VType> Locals; // always max_locals long
+            std::vector<VType> Stack;
+        };
+
+        // Code between two frame offsets. Only the first instruction of a block can be jumped to, so
+        // a block is interpreted as a whole.
+        struct Block {
+            int Start = 0, End = 0;
+            bool Target = false; // jumped to, so it needs a frame
+            bool Dirty = true;   // overlaps patched code
+            bool Has = false;    // In is set
+            bool Fixed = false;  // In is the old frame, kept while everything flowing in fits it
+            bool Queued = false;
+            State In;
+            std::vector<int> Successors;
+            std::vector<int> Handlers; // exception table entries covering some of the block
+        };
+
+        // what an instruction needs to know about a member reference
+        struct Signature {
+            int ArgSlots = 0;
+            JType Type = 0; // of the field, or the return type; 0 for void
+            bool Init = false;
+        };
+
+        class Analyzer {
+        public:
+            // frames are also made at the offsets in extra, as if something jumped there
+            Analyzer(const ClassFile& f, const CodeAttribute& code, const ClassHierarchy& h,
+                     const std::vector<int>& extra = {}):
+                File(f), Code(code), Hierarchy(h), C(code.Code.data()), Len(static_cast<int>(code.Code.size())),
+                ThisType(ClassType(ClassNameAt(f, f.ThisClass))) {
+                Scan(extra);
+            }
+
+            std::vector<Frame> Run(const Frame& initial, const std::vector<Frame>& hints,
+                                   const std::vector<std::pair<int, int>>* patched) {
+                for (auto& h : hints) {
+                    if (h.Offset >= Len || BlockAt[h.Offset] < 0 || h.Locals.size() > Code.MaxLocals) {
+                        if (Strict) { Fail(h.Offset, "stack map frame out of place or with too many locals"); }
+                        continue;
+                    }
+                    auto& b = Blocks[BlockAt[h.Offset]];
+                    b.In.Locals = h.Locals;
+                    b.In.Locals.resize(Code.MaxLocals);
+                    b.In.Stack = h.Stack;
+                    b.Has = b.Fixed = true;
+                }
+                if (patched) {
+                    for (auto& b : Blocks) {
+                        b.Dirty = std::any_of(patched->begin(), patched->end(), [&](const std::pair<int, int>& r) {
+                            return r.first < b.End && b.Start < r.second;
+                        });
+                    }
+                }
+                if (Strict) {
+                    for (auto& b : Blocks) {
+                        if (b.Target && !b.Fixed) { Fail(b.Start, "no stack map frame at a branch target"); }
+                    }
+                }
+
+                if (initial.Locals.size() > Code.MaxLocals) { throw FrameError("max_locals is too small for the arguments"); }
+                Start = initial.Locals;
+                Start.resize(Code.MaxLocals);
+                if (Blocks[0].Has) {
+                    Flow(0, Start, nullptr, 0);
+                } else {
+                    Blocks[0].In = {Start, {}};
+                    Blocks[0].Has = true;
+                }
+                for (size_t i = 0; i < Blocks.size(); i++) {
+                    auto& b = Blocks[i];
+                    if (b.Has && (b.Dirty || std::any_of(b.Successors.begin(), b.Successors.end(), [&](int s) {
+                        return !Blocks[s].Fixed;
+                    }))) {
+                        Enqueue(static_cast<int>(i));
+                    }
+                }
+
+                while (!Queue.empty()) {
+                    const int b = Queue.top();
+                    Queue.pop();
+                    Blocks[b].Queued = false;
+                    Interpret(b);
+                    Interpreted++;
+                }
+
+                std::vector<Frame> frames;
+                for (auto& b : Blocks) {
+                    if (!b.Has) { Fail(b.Start, "unreachable code"); }
+                    if (!b.Target) { continue; }
+                    frames.push_back({b.Start, b.In.Locals, b.In.Stack});
+                    trim_locals(frames.back().Locals);
+                }
+                return frames;
+            }
+
+            int Interpreted = 0;
+            bool Strict = false; // the hints are the frames to check against, not to be kept while they fit
+
+        private:
+            [[noreturn]] static void Fail(const int pc, const char* what) {
+                throw FrameError("offset " + std::to_string(pc) + ": " + what);
+            }
+
+            void Scan(const std::vector<int>& extra) {
+                if (!Len) { throw FrameError("empty code"); }
+                enum { INSN = 1, START = 2, TARGET = 4 };
+                std::vector<U1> mark(Len);
+                std::vector<int> targets;
+                for (int pc = 0, len; pc < Len; pc += len) {
+                    len = InsnLength(C, pc, Len);
+                    mark[pc] |= INSN;
+                    const int op = C[pc];
+                    const int flags = OpcodeTable[op].Flags;
+                    if (op == OP_JSR || op == OP_JSR_W || op == OP_RET || (op == OP_WIDE && C[pc + 1] == OP_RET)) {
+                        Fail(pc, "jsr and ret have no stack map frames");
+                    }
+                    if (flags & OPF_BRANCH) { targets.push_back(pc + get_s2(C + pc + 1)); }
+                    if (flags & OPF_BRANCH_W) { targets.push_back(pc + get_s4(C + pc + 1)); }
+                    if (flags & OPF_SWITCH) { switch_targets(C, pc, [&](int t) { targets.push_back(t); }); }
+                    if (flags & OPF_END && pc + len < Len) { mark[pc + len] |= START; }
+                }
+                for (auto& e : Code.ExceptionTable) {
+                    if (e.StartPc >= e.EndPc || e.EndPc > Len || !(mark[e.StartPc] & INSN) ||
+                        (e.EndPc < Len && !(mark[e.EndPc] & INSN))) {
+                        throw FrameError("invalid exception table range");
+                    }
+                    targets.push_back(e.HandlerPc);
+                }
+                targets.insert(targets.end(), extra.begin(), extra.end());
+                for (const int t : targets) {
+                    if (t < 0 || t >= Len || !(mark[t] & INSN)) { Fail(t, "jump into the middle of an instruction"); }
+                    mark[t] |= TARGET;
+                }
+                mark[0] |= START;
+
+                BlockAt.assign(Len, -1);
+                for (int pc = 0; pc < Len; pc++) {
+                    if (!(mark[pc] & (START | TARGET))) { continue; }
+                    if (!Blocks.empty()) { Blocks.back().End = pc; }
+                    BlockAt[pc] = static_cast<int>(Blocks.size());
+                    Blocks.emplace_back();
+                    Blocks.back().Start = pc;
+                    Blocks.back().Target = (mark[pc] & TARGET) != 0;
+                }
+                Blocks.back().End = Len;
+
+                for (auto& b : Blocks) {
+                    int last = b.Start;
+                    for (int pc = b.Start; pc < b.End; pc += InsnLength(C, pc, Len)) {
+                        last = pc;
+                        const int flags = OpcodeTable[C[pc]].Flags;
+                        if (flags & OPF_BRANCH) { b.Successors.push_back(BlockAt[pc + get_s2(C + pc + 1)]); }
+                        if (flags & OPF_BRANCH_W) { b.Successors.push_back(BlockAt[pc + get_s4(C + pc + 1)]); }
+                        if (flags & OPF_SWITCH) {
+                            switch_targets(C, pc, [&](int t) { b.Successors.push_back(BlockAt[t]); });
+                        }
+                    }
+                    if (!(OpcodeTable[C[last]].Flags & OPF_END) && b.End < Len) { b.Successors.push_back(BlockAt[b.End]); }
+                    for (size_t i = 0; i < Code.ExceptionTable.size(); i++) {
+                        const auto& e = Code.ExceptionTable[i];
+                        if (e.StartPc < b.End && b.Start < e.EndPc) {
+                            b.Handlers.push_back(static_cast<int>(i));
+                            b.Successors.push_back(BlockAt[e.HandlerPc]);
+                        }
+                    }
+                }
+            }
+
+            void Enqueue(const int b) {
+                if (!Blocks[b].Queued) {
+                    Blocks[b].Queued = true;
+                    Queue.push(b);
+                }
+            }
+
+            // the same value, or a reference the frame widens
+            bool Widens(const VType to, const VType from) const {
+                if (from == to) { return true; }
+                if (to.Tag != VTag::Object) { return false; }
+                return from.Tag == VTag::Null || (from.Tag == VTag::Object && Hierarchy.IsAssignable(from.Data, to.Data));
+            }
+
+            // Top where the two cannot be merged, including classes whose superclasses the hierarchy does
+            // not know: the local cannot be loaded then, which fails the method rather than have the
+            // verifier see java/lang/Object where it expects the class
+            VType Merge(const VType a, const VType b) const {
+                if (a.Tag == VTag::Top || Widens(a, b)) { return a; }
+                if (b.Tag == VTag::Top || Widens(b, a)) { return b; }
+                if (a.Tag == VTag::Object && b.Tag == VTag::Object) {
+                    if (const auto common = Hierarchy.CommonSuperclass(a.Data, b.Data)) { return object(common); }
+                }
+                return {};
+            }
+
+            // An old frame is kept only if it loses nothing of what flows in: a Top in it where the
+            // patch made a local live would leave the local unusable. The verifier lets anything into a
+            // Top, which is what checking against the frames goes by.
+            bool Fits(const Block& b, const std::vector<VType>& locals, const VType* stack, const size_t n) const {
+                if (b.In.Stack.size() != n) { return false; }
+                for (size_t i = 0; i < locals.size(); i++) {
+                    const auto to = b.In.Locals[i];
+                    if (!(Strict && to.Tag == VTag::Top) && !Widens(to, locals[i])) { return false; }
+                }
+                for (size_t i = 0; i < n; i++) {
+                    if (!Widens(b.In.Stack[i], stack[i])) { return false; }
+                }
+                return true;
+            }
+
+            // the state at the end of a block, or at an instruction a handler covers, reaches block b
+            void Flow(const int b, const std::vector<VType>& locals, const VType* stack, const size_t n) {
+                auto& in = Blocks[b].In;
+                if (Blocks[b].Fixed) {
+                    if (Fits(Blocks[b], locals, stack, n)) { return; }
+                    if (Strict) { Fail(Blocks[b].Start, "what flows in does not fit the stack map frame"); }
+                    // What flows in changed with the patch, so the old frame goes. Whatever flowed in
+                    // before and fit it is merged again, from the blocks it came from.
+                    Blocks[b].Fixed = Blocks[b].Has = false;
+                    for (size_t p = 0; p < Blocks.size(); p++) {
+                        const auto& s = Blocks[p].Successors;
+                        if (Blocks[p].Has && std::find(s.begin(), s.end(), b) != s.end()) { Enqueue(static_cast<int>(p)); }
+                    }
+                    if (b == 0) {
+                        Flow(0, locals, stack, n);
+                        Flow(0, Start, nullptr, 0);
+                        return;
+                    }
+                }
+                if (!Blocks[b].Has) {
+                    in.Locals = locals;
+                    in.Stack.assign(stack, stack + n);
+                    Blocks[b].Has = true;
+                    Enqueue(b);
+                    return;
+                }
+                if (in.Stack.size() != n) { Fail(Blocks[b].Start, "stack heights differ"); }
+                bool changed = false;
+                for (size_t i = 0; i < locals.size(); i++) {
+                    const auto m = Merge(in.Locals[i], locals[i]);
+                    changed |= m != in.Locals[i];
+                    in.Locals[i] = m;
+                }
+                for (size_t i = 0; i < n; i++) {
+                    const auto m = Merge(in.Stack[i], stack[i]);
+                    if (m.Tag == VTag::Top && (in.Stack[i].Tag != VTag::Top || stack[i].Tag != VTag::Top)) {
+                        Fail(Blocks[b].Start, "incompatible types on the stack");
+                    }
+                    changed |= m != in.Stack[i];
+                    in.Stack[i] = m;
+                }
+                if (changed) { Enqueue(b); }
+            }
+
+            void FlowToHandlers(const Block& b, const int pc) {
+                for (const int i : b.Handlers) {
+                    const auto& e = Code.ExceptionTable[i];
+                    if (pc < e.StartPc || pc >= e.EndPc) { continue; }
+                    const auto caught = object(e.CatchType ? class_entry_type(File, e.CatchType) : well_known().Throwable);
+                    Flow(BlockAt[e.HandlerPc], Cur.Locals, &caught, 1);
+                }
+            }
+
+            void Interpret(const int index) {
+                const auto& b = Blocks[index];
+                Cur = b.In;
+                int pc = b.Start, len = 0;
+                for (; pc < b.End; pc += len) {
+                    len = InsnLength(C, pc, Len);
+                    Pc = pc;
+                    if (!b.Handlers.empty()) { FlowToHandlers(b, pc); }
+                    const bool stored = Execute(pc);
+                    if (Strict && Cur.Stack.size() > Code.MaxStack) { Fail(pc, "max_stack exceeded"); }
+                    // a handler may also be entered after the store, with the new type in the local
+                    if (stored && !b.Handlers.empty()) { FlowToHandlers(b, pc); }
+                }
+                if (!(OpcodeTable[C[pc - len]].Flags & OPF_END)) {
+                    if (b.End == Len) { Fail(pc - len, "execution falls off the end of the code"); }
+                    Flow(BlockAt[b.End], Cur.Locals, Cur.Stack.data(), Cur.Stack.size());
+                }
+            }
+
+            VType Pop() {
+                if (Cur.Stack.empty()) { Fail(Pc, "stack underflow"); }
+                const auto t = Cur.Stack.back();
+                Cur.Stack.pop_back();
+                return t;
+            }
+
+            void Pop(const int n) {
+                if (Cur.Stack.size() < static_cast<size_t>(n)) { Fail(Pc, "stack underflow"); }
+                Cur.Stack.resize(Cur.Stack.size() - n);
+            }
+
+            void Push(const VType t) {
+                Cur.Stack.push_back(t);
+            }
+
+            void Push(const VTag tag) {
+                Cur.Stack.push_back({tag});
+                if (tag == VTag::Long || tag == VTag::Double) { Cur.Stack.push_back({}); }
+            }
+
+            VType Load(const int i) const {
+                if (i >= static_cast<int>(Cur.Locals.size())) { Fail(Pc, "local variable index out of range"); }
+                const auto t = Cur.Locals[i];
+                switch (t.Tag) {
+                case VTag::Top: Fail(Pc, "load of a local that holds no value");
+                case VTag::Integer: case VTag::Float: case VTag::Double: case VTag::Long:
+                    Fail(Pc, "aload of a local that holds no reference");
+                default: return t;
+                }
+            }
+
+            // iload, lload, fload, dload and iinc
+            void Load(const int i, const VTag tag) const {
+                if (i >= static_cast<int>(Cur.Locals.size())) { Fail(Pc, "local variable index out of range"); }
+                const auto t = Cur.Locals[i];
+                if (t.Tag == VTag::Top) { Fail(Pc, "load of a local that holds no value"); }
+                if (t.Tag != tag) { Fail(Pc, "load of a local that holds a value of another type"); }
+            }
+
+            void Store(const int i, const VType t) {
+                auto& locals = Cur.Locals;
+                if (i + (t.Wide() ? 2 : 1) > static_cast<int>(locals.size())) { Fail(Pc, "local variable index out of range"); }
+                if (i > 0 && locals[i - 1].Wide()) { locals[i - 1] = {}; }
+                locals[i] = t;
+                if (t.Wide()) { locals[i + 1] = {}; }
+            }
+
+            void Jump(const int target) {
+                Flow(BlockAt[target], Cur.Locals, Cur.Stack.data(), Cur.Stack.size());
+            }
+
+            const CpInfo& Entry(const int index) const {
+                if (index <= 0 || index >= static_cast<int>(File.ConstantPool.size()) || !File.ConstantPool[index]) {
+                    throw InvalidClassFile("invalid constant pool index");
+                }
+                return File.ConstantPool[index];
+            }
+
+            const ConstantNameAndTypeInfo& NameAndType(const CpInfo& e) const {
+                U2 nat;
+                switch (e->Tag) {
+                case CPoolTags::FieldRef: nat = ConstantFieldRefInfo::Reference(e).NameAndTypeIndex; break;
+                case CPoolTags::MethodRef: nat = ConstantMethodRefInfo::Reference(e).NameAndTypeIndex; break;
+                case CPoolTags::InterfaceMethodRef: nat = ConstantInterfaceMethodRefInfo::Reference(e).NameAndTypeIndex; break;
+                case CPoolTags::Dynamic: nat = ConstantDynamicInfo::Reference(e).NameAndTypeIndex; break;
+                case CPoolTags::InvokeDynamic: nat = ConstantInvokeDynamicInfo::Reference(e).NameAndTypeIndex; break;
+                default: throw InvalidClassFile("expected a member reference");
+                }
+                return ConstantNameAndTypeInfo::Reference(Entry(nat));
+            }
+
+            const Signature& Member(const int index) {
+                const auto& e = Entry(index);
+                if (Signatures.empty()) { Signatures.resize(File.ConstantPool.size()); }
+                auto& sig = Signatures[index];
+                if (sig.first) { return sig.second; }
+                const auto& nat = NameAndType(e);
+                const auto desc = Utf8At(File, nat.DescriptorIndex);
+                if (e->Tag == CPoolTags::FieldRef || e->Tag == CPoolTags::Dynamic) {
+                    sig.second.Type = ParseFieldDescriptor(std::string(desc).c_str());
+                } else {
+                    DescriptorToken small[32];
+                    std::vector<DescriptorToken> big;
+                    auto tokens = small;
+                    int n = TokenizeMethodDescriptor(desc.data(), desc.size(), small, NELEM(small));
+                    if (n > static_cast<int>(NELEM(small))) {
+                        big.resize(n);
+                        tokens = big.data();
+                        TokenizeMethodDescriptor(desc.data(), desc.size(), tokens, n);
+                    }
+                    if (n < 1) { throw InvalidDescriptor(); }
+                    for (int i = 0; i < n - 1; i++) { sig.second.ArgSlots += !tokens[i].Dims && (tokens[i].Kind == 'J' || tokens[i].Kind == 'D') ? 2 : 1; }
+                    sig.second.Type = DescriptorTokenType(desc.data(), tokens[n - 1]);
+                    sig.second.Init = Utf8At(File, nat.NameIndex) == "<init>";
+                }
+                sig.first = true;
+                return sig.second;
+            }
+
+            void Ldc(const int index) {
+                const auto& e = Entry(index);
+                switch (e->Tag) {
+                case CPoolTags::Integer: Push(VTag::Integer); break;
+                case CPoolTags::Float: Push(VTag::Float); break;
+                case CPoolTags::Long: Push(VTag::Long); break;
+                case CPoolTags::Double: Push(VTag::Double); break;
+                case CPoolTags::String: Push(object(well_known().String)); break;
+                case CPoolTags::Class: Push(object(well_known().Class)); break;
+                case CPoolTags::MethodType: Push(object(well_known().MethodType)); break;
+                case CPoolTags::MethodHandle: Push(object(well_known().MethodHandle)); break;
+                case CPoolTags::Dynamic: push_type(Cur.Stack, Member(index).Type); break;
+                default: Fail(Pc, "ldc of a constant that cannot be loaded");
+                }
+            }
+
+            // after <init>, every copy of the receiver is initialized
+            void Initialize(const VType receiver) {
+                VType done;
+                if (receiver.Tag == VTag::UninitializedThis) {
+                    done = object(ThisType);
+                } else if (receiver.Tag == VTag::Uninitialized) {
+                    const int at = static_cast<int>(receiver.Data);
+                    if (at + 3 > Len || C[at] != OP_NEW) { Fail(Pc, "uninitialized type does not refer to a new"); }
+                    done = object(class_entry_type(File, static_cast<U2>(get_u2(C + at + 1))));
+                } else {
+                    return;
+                }
+                std::replace(Cur.Locals.begin(), Cur.Locals.end(), receiver, done);
+                std::replace(Cur.Stack.begin(), Cur.Stack.end(), receiver, done);
+            }
+
+            // returns whether a local was stored to
+            bool Execute(const int pc) {
+                static const VTag by_kind[] = {VTag::Integer, VTag::Long, VTag::Float, VTag::Double};
+                static const int size_of_kind[] = {1, 2, 1, 2};
+                int op = C[pc], local = 0;
+                if (op == OP_WIDE) {
+                    op = C[pc + 1];
+                    local = get_u2(C + pc + 2);
+                } else if (OpcodeTable[op].Flags & OPF_LOCAL) {
+                    local = C[pc + 1];
+                }
+
+                switch (op) {
+                case OP_NOP: break;
+                case OP_ACONST_NULL: Push(VTag::Null); break;
+                case OP_ICONST_M1: case OP_ICONST_0: case OP_ICONST_1: case OP_ICONST_2: case OP_ICONST_3:
+                case OP_ICONST_4: case OP_ICONST_5: case OP_BIPUSH: case OP_SIPUSH:
+                    Push(VTag::Integer);
+                    break;
+                case OP_LCONST_0: case OP_LCONST_1: Push(VTag::Long); break;
+                case OP_FCONST_0: case OP_FCONST_1: case OP_FCONST_2: Push(VTag::Float); break;
+                case OP_DCONST_0: case OP_DCONST_1: Push(VTag::Double); break;
+                case OP_LDC: Ldc(C[pc + 1]); break;
+                case OP_LDC_W: case OP_LDC2_W: Ldc(get_u2(C + pc + 1)); break;
+
+                case OP_ILOAD: case OP_LLOAD: case OP_FLOAD: case OP_DLOAD:
+                    Load(local, by_kind[op - OP_ILOAD]);
+                    Push(by_kind[op - OP_ILOAD]);
+                    break;
+                case OP_ALOAD: Push(Load(local)); break;
+                case OP_ILOAD_0: case OP_ILOAD_1: case OP_ILOAD_2: case OP_ILOAD_3:
+                case OP_LLOAD_0: case OP_LLOAD_1: case OP_LLOAD_2: case OP_LLOAD_3:
+                case OP_FLOAD_0: case OP_FLOAD_1: case OP_FLOAD_2: case OP_FLOAD_3:
+                case OP_DLOAD_0: case OP_DLOAD_1: case OP_DLOAD_2: case OP_DLOAD_3:
+                    Load((op - OP_ILOAD_0) % 4, by_kind[(op - OP_ILOAD_0) / 4]);
+                    Push(by_kind[(op - OP_ILOAD_0) / 4]);
+                    break;
+                case OP_ALOAD_0: case OP_ALOAD_1: case OP_ALOAD_2: case OP_ALOAD_3: Push(Load(op - OP_ALOAD_0)); break;
+
+                case OP_IALOAD: case OP_BALOAD: case OP_CALOAD: case OP_SALOAD: Pop(2), Push(VTag::Integer); break;
+                case OP_LALOAD: Pop(2), Push(VTag::Long); break;
+                case OP_FALOAD: Pop(2), Push(VTag::Float); break;
+                case OP_DALOAD: Pop(2), Push(VTag::Double); break;
+                case OP_AALOAD: {
+                    Pop(1);
+                    const auto array = Pop();
+                    if (array.Tag == VTag::Object && ArrayDims(array.Data) && !(JTypeKind(ElemType(array.Data)) & 1)) {
+                        Push(object(ElemType(array.Data)));
+                    } else if (array.Tag == VTag::Null) {
+                        Push(VTag::Null);
+                    } else {
+                        Fail(pc, "aaload from something that is not an array of references");
+                    }
+                }
+                break;
+
+                case OP_ISTORE: case OP_LSTORE: case OP_FSTORE: case OP_DSTORE:
+                    Pop(size_of_kind[op - OP_ISTORE]);
+                    Store(local, {by_kind[op - OP_ISTORE]});
+                    return true;
+                case OP_ASTORE: Store(local, Pop()); return true;
+                case OP_ISTORE_0: case OP_ISTORE_1: case OP_ISTORE_2: case OP_ISTORE_3:
+                case OP_LSTORE_0: case OP_LSTORE_1: case OP_LSTORE_2: case OP_LSTORE_3:
+                case OP_FSTORE_0: case OP_FSTORE_1: case OP_FSTORE_2: case OP_FSTORE_3:
+                case OP_DSTORE_0: case OP_DSTORE_1: case OP_DSTORE_2: case OP_DSTORE_3: {
+                    const int kind = (op - OP_ISTORE_0) / 4;
+                    Pop(size_of_kind[kind]);
+                    Store((op - OP_ISTORE_0) % 4, {by_kind[kind]});
+                }
+                return true;
+                case OP_ASTORE_0: case OP_ASTORE_1: case OP_ASTORE_2: case OP_ASTORE_3:
+                    Store(op - OP_ASTORE_0, Pop());
+                    return true;
+
+                case OP_IASTORE: case OP_FASTORE: case OP_AASTORE: case OP_BASTORE: case OP_CASTORE: case OP_SASTORE:
+                    Pop(3);
+                    break;
+                case OP_LASTORE: case OP_DASTORE: Pop(4); break;
+
+                case OP_POP: Pop(1); break;
+                case OP_POP2: Pop(2); break;
+                case OP_DUP: {
+                    const auto a = Pop();
+                    Push(a), Push(a);
+                }
+                break;
+                case OP_DUP_X1: {
+                    const auto a = Pop(), b = Pop();
+                    Push(a), Push(b), Push(a);
+                }
+                break;
+                case OP_DUP_X2: {
+                    const auto a = Pop(), b = Pop(), c = Pop();
+                    Push(a), Push(c), Push(b), Push(a);
+                }
+                break;
+                case OP_DUP2: {
+                    const auto a = Pop(), b = Pop();
+                    Push(b), Push(a), Push(b), Push(a);
+                }
+                break;
+                case OP_DUP2_X1: {
+                    const auto a = Pop(), b = Pop(), c = Pop();
+                    Push(b), Push(a), Push(c), Push(b), Push(a);
+                }
+                break;
+                case OP_DUP2_X2: {
+                    const auto a = Pop(), b = Pop(), c = Pop(), d = Pop();
+                    Push(b), Push(a), Push(d), Push(c), Push(b), Push(a);
+                }
+                break;
+                case OP_SWAP: {
+                    const auto a = Pop(), b = Pop();
+                    Push(a), Push(b);
+                }
+                break;
+
+                case OP_IADD: case OP_LADD: case OP_FADD: case OP_DADD: case OP_ISUB: case OP_LSUB: case OP_FSUB:
+                case OP_DSUB: case OP_IMUL: case OP_LMUL: case OP_FMUL: case OP_DMUL: case OP_IDIV: case OP_LDIV:
+                case OP_FDIV: case OP_DDIV: case OP_IREM: case OP_LREM: case OP_FREM: case OP_DREM:
+                    Pop(2 * size_of_kind[(op - OP_IADD) % 4]);
+                    Push(by_kind[(op - OP_IADD) % 4]);
+                    break;
+                case OP_INEG: case OP_LNEG: case OP_FNEG: case OP_DNEG:
+                    Pop(size_of_kind[op - OP_INEG]);
+                    Push(by_kind[op - OP_INEG]);
+                    break;
+                case OP_ISHL: case OP_ISHR: case OP_IUSHR: Pop(2), Push(VTag::Integer); break;
+                case OP_LSHL: case OP_LSHR: case OP_LUSHR: Pop(3), Push(VTag::Long); break;
+                case OP_IAND: case OP_IOR: case OP_IXOR: Pop(2), Push(VTag::Integer); break;
+                case OP_LAND: case OP_LOR: case OP_LXOR: Pop(4), Push(VTag::Long); break;
+                case OP_IINC: Load(local, VTag::Integer); break;
+
+                case OP_I2L: Pop(1), Push(VTag::Long); break;
+                case OP_I2F: Pop(1), Push(VTag::Float); break;
+                case OP_I2D: Pop(1), Push(VTag::Double); break;
+                case OP_L2I: Pop(2), Push(VTag::Integer); break;
+                case OP_L2F: Pop(2), Push(VTag::Float); break;
+                case OP_L2D: Pop(2), Push(VTag::Double); break;
+                case OP_F2I: Pop(1), Push(VTag::Integer); break;
+                case OP_F2L: Pop(1), Push(VTag::Long); break;
+                case OP_F2D: Pop(1), Push(VTag::Double); break;
+                case OP_D2I: Pop(2), Push(VTag::Integer); break;
+                case OP_D2L: Pop(2), Push(VTag::Long); break;
+                case OP_D2F: Pop(2), Push(VTag::Float); break;
+                case OP_I2B: case OP_I2C: case OP_I2S: Pop(1), Push(VTag::Integer); break;
+                case OP_LCMP: case OP_DCMPL: case OP_DCMPG: Pop(4), Push(VTag::Integer); break;
+                case OP_FCMPL: case OP_FCMPG: Pop(2), Push(VTag::Integer); break;
+
+                case OP_IFEQ: case OP_IFNE: case OP_IFLT: case OP_IFGE: case OP_IFGT: case OP_IFLE:
+                case OP_IFNULL: case OP_IFNONNULL:
+                    Pop(1);
+                    Jump(pc + get_s2(C + pc + 1));
+                    break;
+                case OP_IF_ICMPEQ: case OP_IF_ICMPNE: case OP_IF_ICMPLT: case OP_IF_ICMPGE: case OP_IF_ICMPGT:
+                case OP_IF_ICMPLE: case OP_IF_ACMPEQ: case OP_IF_ACMPNE:
+                    Pop(2);
+                    Jump(pc + get_s2(C + pc + 1));
+                    break;
+                case OP_GOTO: Jump(pc + get_s2(C + pc + 1)); break;
+                case OP_GOTO_W: Jump(pc + get_s4(C + pc + 1)); break;
+                case OP_TABLESWITCH: case OP_LOOKUPSWITCH:
+                    Pop(1);
+                    switch_targets(C, pc, [this](int t) { Jump(t); });
+                    break;
+                case OP_IRETURN: case OP_LRETURN: case OP_FRETURN: case OP_DRETURN: case OP_ARETURN: case OP_RETURN:
+                case OP_ATHROW:
+                    break;
+
+                case OP_GETSTATIC: push_type(Cur.Stack, Member(get_u2(C + pc + 1)).Type); break;
+                case OP_PUTSTATIC: Pop(slots(Member(get_u2(C + pc + 1)).Type)); break;
+                case OP_GETFIELD:
+                    Pop(1);
+                    push_type(Cur.Stack, Member(get_u2(C + pc + 1)).Type);
+                    break;
+                case OP_PUTFIELD: Pop(slots(Member(get_u2(C + pc + 1)).Type) + 1); break;
+                case OP_INVOKEVIRTUAL: case OP_INVOKESPECIAL: case OP_INVOKESTATIC: case OP_INVOKEINTERFACE:
+                case OP_INVOKEDYNAMIC: {
+                    const auto& sig = Member(get_u2(C + pc + 1));
+                    Pop(sig.ArgSlots);
+                    if (op != OP_INVOKESTATIC && op != OP_INVOKEDYNAMIC) {
+                        const auto receiver = Pop();
+                        if (op == OP_INVOKESPECIAL && sig.Init) { Initialize(receiver); }
+                    }
+                    if (sig.Type) { push_type(Cur.Stack, sig.Type); }
+                }
+                break;
+
+                case OP_NEW: Push({VTag::Uninitialized, static_cast<uint32_t>(pc)}); break;
+                case OP_NEWARRAY: {
+                    static const JType element[] = {BOOL, CHAR, FLOAT, DOUBLE, BYTE, SHORT, INT, LONG};
+                    const int atype = C[pc + 1];
+                    if (atype < 4 || atype > 11) { Fail(pc, "invalid newarray type"); }
+                    Pop(1);
+                    Push(object(ArrayOf(element[atype - 4])));
+                }
+                break;
+                case OP_ANEWARRAY:
+                    Pop(1);
+                    Push(object(ArrayOf(class_entry_type(File, static_cast<U2>(get_u2(C + pc + 1))))));
+                    break;
+                case OP_MULTIANEWARRAY:
+                    Pop(C[pc + 3]);
+                    Push(object(class_entry_type(File, static_cast<U2>(get_u2(C + pc + 1)))));
+                    break;
+                case OP_ARRAYLENGTH: case OP_INSTANCEOF: Pop(1), Push(VTag::Integer); break;
+                case OP_CHECKCAST:
+                    Pop(1);
+                    Push(object(class_entry_type(File, static_cast<U2>(get_u2(C + pc + 1)))));
+                    break;
+                case OP_MONITORENTER: case OP_MONITOREXIT: Pop(1); break;
+                default: Fail(pc, "unexpected opcode");
+                }
+                return false;
+            }
+
+            const ClassFile& File;
+            const CodeAttribute& Code;
+            const ClassHierarchy& Hierarchy;
+            const U1* C;
+            const int Len;
+            const JType ThisType;
+            std::vector<Block> Blocks;
+            std::vector<int> BlockAt; // block starting at each offset, or -1
+            std::priority_queue<int, std::vector<int>, std::greater<>> Queue; // in code order
+            std::vector<std::pair<bool, Signature>> Signatures; // by constant pool index
+            std::vector<VType> Start; // the initial frame, max_locals long
+            State Cur;
+            int Pc = 0;
+        };
+
+        // moves an old frame to the new code; false if something it refers to was removed
+        bool relocate(Frame& f, const std::vector<int>& relocation) {
+            auto moved = [&](uint32_t& offset) {
+                if (offset >= relocation.size() || relocation[offset] < 0) { return false; }
+                offset = static_cast<uint32_t>(relocation[offset]);
+                return true;
+            };
+            auto offset = static_cast<uint32_t>(f.Offset);
+            if (!moved(offset)) { return false; }
+            f.Offset = static_cast<int>(offset);
+            for (auto* types : {&f.Locals, &f.Stack}) {
+                for (auto& t : *types) {
+                    if (t.Tag == VTag::Uninitialized && !moved(t.Data)) { return false; }
+                }
+            }
+            return true;
+        }
+
+        std::vector<AttributeInfo>::iterator find_table(const ClassFile& f, CodeAttribute& code) {
+            return std::find_if(code.Attributes.begin(), code.Attributes.end(), [&](const AttributeInfo& a) {
+                return Utf8At(f, a.AttributeNameIndex) == "StackMapTable";
+            });
+        }
+
+        // replaces the StackMapTable of code, adds one, or drops it if no frames are needed
+        void install_frames(ClassFile& f, CodeAttribute& code, const std::vector<Frame>& frames,
+                            const Frame& initial) {
+            auto table = find_table(f, code);
+            if (frames.empty()) {
+                if (table != code.Attributes.end()) { code.Attributes.erase(table); }
+            } else {
+                auto info = EncodeStackMapTable(f, frames, initial);
+                if (table == code.Attributes.end()) {
+                    code.Attributes.push_back({PoolEditor(f).Utf8("StackMapTable"), 0, {}});
+                    table = code.Attributes.end() - 1;
+                }
+                table->Info = std::move(info);
+                table->AttributeLength = static_cast<U4>(table->Info.size());
+            }
+            code.AttributesCount = static_cast<U2>(code.Attributes.size());
+        }
+    }
+
+    Frame InitialFrame(const ClassFile& f, const MethodInfo& m) {
+        Frame frame;
+        if (!(m.AccessFlags & ACC_STATIC)) {
+            const auto name = ClassNameAt(f, f.ThisClass);
+            if (Utf8At(f, m.NameIndex) == "<init>" && name != "java/lang/Object") {
+                frame.Locals.push_back({VTag::UninitializedThis});
+            } else {
+                frame.Locals.push_back(object(ClassType(name)));
+            }
+        }
+        Region r;
+        rinit(&r);
+        try {
+            const auto t = ParseMethodDescriptor(std::string(Utf8At(f, m.DescriptorIndex)).c_str(), r);
+            for (int i = 0; i < t.NumArg; i++) { push_type(frame.Locals, t.ArgTypes[i]); }
+        } catch (...) {
+            rfreeall(&r);
+            throw;
+        }
+        rfreeall(&r);
+        return frame;
+    }
+
+    std::vector<Frame> DecodeStackMapTable(const ClassFile& f, const std::vector<U1>& info, const Frame& initial) {
+        Reader in(info);
+        std::vector<Frame> frames(in.GetU2());
+        const Frame* prev = &initial;
+        int offset = -1;
+        for (auto& frame : frames) {
+            const int type = in.GetU1();
+            int delta;
+            if (type == 255) {
+                delta = in.GetU2();
+                read_types(f, in, in.GetU2(), frame.Locals);
+                read_types(f, in, in.GetU2(), frame.Stack);
+            } else {
+                frame.Locals = prev->Locals;
+                if (type < 64) {
+                    delta = type;
+                } else if (type < 128) {
+                    delta = type - 64;
+                    read_types(f, in, 1, frame.Stack);
+                } else if (type < 247) {
+                    throw InvalidClassFile("reserved stack map frame type");
+                } else {
+                    delta = in.GetU2();
+                    if (type == 247) { read_types(f, in, 1, frame.Stack); }
+                    else if (type < 251) { for (int k = 251 - type; k > 0; k--) { chop_one(frame.Locals); } }
+                    else if (type > 251) { read_types(f, in, type - 251, frame.Locals); }
+                }
+            }
+            offset += delta + 1;
+            frame.Offset = offset;
+            prev = &frame;
+        }
+        if (!in.AtEnd()) { throw InvalidClassFile("StackMapTable has trailing bytes"); }
+        return frames;
+    }
+
+    std::vector<U1> EncodeStackMapTable(ClassFile& f, const std::vector<Frame>& frames, const Frame& initial) {
+        PoolEditor pool(f);
+        std::vector<U1> out;
+        put_u2(out, static_cast<int>(frames.size()));
+        auto prev = compress(initial.Locals);
+        int prev_offset = -1;
+        for (auto& frame : frames) {
+            const int delta = frame.Offset - prev_offset - 1;
+            if (delta < 0 || delta > 0xffff) { throw FrameError("frames out of order"); }
+            auto locals = compress(frame.Locals);
+            const auto stack = compress(frame.Stack);
+            const bool same_locals = locals == prev;
+            const bool prefix = std::equal(locals.begin(), locals.begin() + std::min(locals.size(), prev.size()), prev.begin());
+            const int change = static_cast<int>(locals.size()) - static_cast<int>(prev.size());
+            if (same_locals && stack.size() <= 1) {
+                if (delta < 64) {
+                    out.push_back(static_cast<U1>(stack.empty() ? delta : 64 + delta));
+                } else {
+                    out.push_back(stack.empty() ? 251 : 247);
+                    put_u2(out, delta);
+                }
+                write_types(pool, stack, 0, out);
+            } else if (stack.empty() && prefix && change && change >= -3 && change <= 3) {
+                out.push_back(static_cast<U1>(251 + change)); // chop or append
+                put_u2(out, delta);
+                if (change > 0) { write_types(pool, locals, prev.size(), out); }
+            } else {
+                out.push_back(255);
+                put_u2(out, delta);
+                put_u2(out, static_cast<int>(locals.size()));
+                write_types(pool, locals, 0, out);
+                put_u2(out, static_cast<int>(stack.size()));
+                write_types(pool, stack, 0, out);
+            }
+            prev = std::move(locals);
+            prev_offset = frame.Offset;
+        }
+        return out;
+    }
+
+    std::vector<Frame> ComputeFrames(const ClassFile& f, const MethodInfo& m, const CodeAttribute& code,
+                                     const ClassHierarchy& h, const std::vector<int>& at) {
+        return Analyzer(f, code, h, at).Run(InitialFrame(f, m), {}, nullptr);
+    }
+
+    std::string TypeDescriptor(const VType& t) {
+        switch (t.Tag) {
+        case VTag::Integer: return "I";
+        case VTag::Float: return "F";
+        case VTag::Long: return "J";
+        case VTag::Double: return "D";
+        case VTag::Null: return "Ljava/lang/Object;";
+        case VTag::Object: return ArrayDims(t.Data) ? class_entry_name(t.Data) : "L" + class_entry_name(t.Data) + ";";
+        default: return {};
+        }
+    }
+
+    void VerifyStackMap(const ClassFile& f, const MethodInfo& m, const CodeAttribute& code, const ClassHierarchy& h) {
+        if (f.MajorVersion < 50) { return; }
+        const auto initial = InitialFrame(f, m);
+        std::vector<Frame> frames;
+        for (auto& a : code.Attributes) {
+            if (Utf8At(f, a.AttributeNameIndex) == "StackMapTable") { frames = DecodeStackMapTable(f, a.Info, initial); }
+        }
+        std::vector<int> at;
+        for (auto& frame : frames) { at.push_back(frame.Offset); }
+        Analyzer analyzer(f, code, h, at);
+        analyzer.Strict = true;
+        analyzer.Run(initial, frames, nullptr);
+    }
+
+    int RegenerateStackMap(ClassFile& f, const MethodInfo& m, CodeAttribute& code, const ClassHierarchy& h,
+                           const CodeEdit* edit) {
+        if (f.MajorVersion < 50) { return 0; }
+        const auto initial = InitialFrame(f, m);
+        const auto table = find_table(f, code);
+        std::vector<Frame> hints;
+        if (edit && table != code.Attributes.end()) {
+            for (auto& frame : DecodeStackMapTable(f, table->Info, initial)) {
+                if (relocate(frame, edit->Relocation)) { hints.push_back(std::move(frame)); }
+            }
+        }
+
+        Analyzer analyzer(f, code, h);
+        install_frames(f, code, analyzer.Run(initial, hints, edit ? &edit->Patched : nullptr), initial);
+        return analyzer.Interpreted;
+    }
+
+    // The frames of the methods are computed in parallel, since that only reads the class; encoding them
+    // adds to the pool, so they are installed one method after another.
+    int RecomputeStackMaps(ClassFile& f, const ClassHierarchy& h) {
+        if (f.MajorVersion < 50) { return 0; }
+        struct Job {
+            const MethodInfo* Method;
+            AttributeInfo* Attribute;
+            CodeAttribute Code;
+            Frame Initial;
+            std::vector<Frame> Frames;
+            bool Failed = false;
+        };
+        std::vector<Job> jobs;
+        for (auto& m : f.Methods) {
+            for (auto& a : m.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) == "Code") { jobs.push_back({&m, &a, {}, {}, {}, false}); }
+            }
+        }
+
+        const ClassFile& cf = f;
+        Utils::WorkPool::Shared().ParallelFor(static_cast<int>(jobs.size()), [&](int i, int) {
+            auto& job = jobs[i];
+            // whatever goes wrong stays with its method: nothing may escape the pool
+            try {
+                Parser{}.ParseCodeOnto(job.Attribute->Info, job.Code);
+                job.Initial = InitialFrame(cf, *job.Method);
+                job.Frames = Analyzer(cf, job.Code, h).Run(job.Initial, {}, nullptr);
+            } catch (const FrameError&) {
+                job.Failed = true;
+            } catch (const InvalidClassFile&) {
+                job.Failed = true;
+            } catch (const std::range_error&) { // Code cut short
+                job.Failed = true;
+            } catch (const InvalidDescriptor&) {
+                job.Failed = true;
+            } catch (const InvalidBytecode&) {
+                job.Failed = true;
+            }
+        });
+
+        int failed = 0;
+        for (auto& job : jobs) {
+            if (job.Failed) {
+                failed++;
+                continue;
+            }
+            install_frames(f, job.Code, job.Frames, job.Initial);
+            Writer{}.WriteCodeOnto(job.Code, job.Attribute->Info);
+            job.Attribute->AttributeLength = static_cast<U4>(job.Attribute->Info.size());
+        }
+        return failed;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "Parse/ClassFile.h"
+#include "Hierarchy.h"
+
+/*
+ * StackMapTable (JVMS 4.7.4): decoding, encoding and computing the frames the verifier checks a
+ * method against.
+ *
+ * A patch that rewrites part of a method hands RegenerateStackMap what it did (CodeEdit); the old
+ * frames are then kept for every block the patch did not touch, as long as what flows into the block
+ * still fits them, and only the patched blocks and whatever their new types reach are interpreted.
+ * Methods no patch touched keep their StackMapTable bytes as they are.
+ */
+
+namespace Analyze {
+    // the item tags of verification_type_info
+    enum class VTag : uint8_t {
+        Top,
+        Integer,
+        Float,
+        Double,
+        Long,
+        Null,
+        UninitializedThis,
+        Object,
+        Uninitialized,
+    };
+
+    struct VType {
+        VTag Tag = VTag::Top;
+        uint32_t Data = 0; // Object: the JType; Uninitialized: offset of the `new'
+
+        bool operator == (const VType& o) const { return Tag == o.Tag && Data == o.Data; }
+        bool operator != (const VType& o) const { return !(*this == o); }
+        bool Wide() const { return Tag == VTag::Long || Tag == VTag::Double; }
+    };
+
+    // Indices are JVM slots: a Long or Double is followed by a Top, in the stack as well as the locals.
+    struct Frame {
+        int Offset = 0;
+        std::vector<VType> Locals;
+        std::vector<VType> Stack;
+    };
+
+    struct FrameError : std::exception {
+        explicit FrameError(std::string msg): Message(std::move(msg)) {}
+        const char* what() const noexcept override { return Message.c_str(); }
+        std::string Message;
+    };
+
+    // What a patch did to the code of a method
+    struct CodeEdit {
+        // new offset of each instruction of the old code, -1 if it was removed; indexed by old offset
+        std::vector<int> Relocation;
+        // [begin, end) ranges of the new code that were inserted or rewritten
+        std::vector<std::pair<int, int>> Patched;
+    };
+
+    // the implicit frame at offset 0
+    Frame InitialFrame(const Parse::ClassFile& f, const Parse::MethodInfo& m);
+
+    // Locals are exactly as the table has them, so trailing Tops are kept.
+    std::vector<Frame> DecodeStackMapTable(const Parse::ClassFile& f, const std::vector<Parse::U1>& info,
+                                           const Frame& initial);
+    // Picks the shortest frame type for each frame. Adds the Class entries it needs to the pool.
+    std::vector<Parse::U1> EncodeStackMapTable(Parse::ClassFile& f, const std::vector<Frame>& frames,
+                                               const Frame& initial);
+
+    // Frames for every branch target and exception handler of the code, and for the offsets in at, from
+    // scratch. Throws FrameError for code the verifier would reject anyway (unreachable code, jsr,
+    // mismatched stacks).
+    std::vector<Frame> ComputeFrames(const Parse::ClassFile& f, const Parse::MethodInfo& m,
+                                     const Parse::CodeAttribute& code, const ClassHierarchy& h,
+                                     const std::vector<int>& at = {});
+
+    // the field descriptor of a value of type t (int for Integer, Object for Null); empty for Top and
+    // the uninitialized types
+    std::string TypeDescriptor(const VType& t);
+
+    // Checks code against its StackMapTable the way the type-checking verifier does: every branch target
+    // and handler has a frame, what flows into a frame fits it, locals are loaded as what they hold and
+    // the stack stays within max_stack. Argument and return types are not checked, and a class missing
+    // from h is only taken to be assignable to itself and java/lang/Object. Throws FrameError
+    // (or InvalidClassFile for a malformed table); classes older than version 50 pass as they are.
+    void VerifyStackMap(const Parse::ClassFile& f, const Parse::MethodInfo& m, const Parse::CodeAttribute& code,
+                        const ClassHierarchy& h);
+
+    // Brings the StackMapTable of code up to date after its bytecode was patched; edit null means from
+    // scratch. The attribute is replaced, added, or dropped if no frames are needed; classes older
+    // than version 50 are left alone. Returns the number of blocks that had to be interpreted.
+    int RegenerateStackMap(Parse::ClassFile& f, const Parse::MethodInfo& m, Parse::CodeAttribute& code,
+                           const ClassHierarchy& h, const CodeEdit* edit);
+
+    // RegenerateStackMap from scratch for every method with code. A method whose code or descriptor
+    // cannot be read, or whose frames cannot be computed, keeps its table; returns the number of such
+    // methods.
+    int RecomputeStackMaps(Parse::ClassFile& f, const ClassHierarchy& h);
+}
@@ -0,0 +1,232 @@
+#include "ValueFlow.h"
+
+using namespace Parse;
+
+namespace Analyze {
+    namespace {
+        // A slot holds NONE (nothing followed), TOP (the value of some source, no telling which), the
+        // index of the source whose latest value it is, or a stale value of a source.
+        constexpr int NONE = -1, TOP = -2;
+
+        int stale(const int source) { return -3 - source; }
+        bool is_stale(const int v) { return v <= -3; }
+        int source_of(const int v) { return v >= 0 ? v : is_stale(v) ? -3 - v : -1; }
+
+        struct State {
+            bool Reached = false;
+            std::vector<int> Stack, Locals;
+        };
+
+        class Flow {
+        public:
+            Flow(const ClassFile& f, const DecodedCode& code, const std::vector<int>& sources,
+                 std::vector<bool>& ambiguous):
+                F(f), Code(code), Sources(sources), Ambiguous(ambiguous), At(code.Insns.size()) {}
+
+            void Run(std::vector<std::vector<int>>& inputs, std::vector<int>& depths);
+
+        private:
+            int merge_value(int a, int b);
+            void merge(int insn, const std::vector<int>& stack, const std::vector<int>& locals);
+            void step(int insn, State& s, std::vector<int>* inputs);
+            void run_block(int start, std::vector<std::vector<int>>* inputs, std::vector<int>* depths);
+
+            const ClassFile& F;
+            const DecodedCode& Code;
+            const std::vector<int>& Sources;
+            std::vector<bool>& Ambiguous;
+            std::vector<State> At; // entry state of the leaders
+            std::vector<bool> Leader;
+            std::vector<int> Work;
+            std::vector<bool> Queued;
+        };
+
+        void mark(std::vector<bool>& ambiguous, const int v) {
+            if (source_of(v) >= 0) { ambiguous[source_of(v)] = true; }
+        }
+
+        int Flow::merge_value(const int a, const int b) {
+            if (a == b) { return a; }
+            if (a == TOP || b == TOP) {
+                mark(Ambiguous, a);
+                mark(Ambiguous, b);
+                return TOP;
+            }
+            const int sa = source_of(a), sb = source_of(b);
+            if (sa >= 0 && sb >= 0 && sa != sb) {
+                Ambiguous[sa] = Ambiguous[sb] = true;
+                return TOP;
+            }
+            return stale(sa >= 0 ? sa : sb);
+        }
+
+        void Flow::merge(const int insn, const std::vector<int>& stack, const std::vector<int>& locals) {
+            auto& s = At[insn];
+            bool changed = false;
+            if (!s.Reached) {
+                s.Reached = changed = true;
+                s.Stack = stack;
+                s.Locals = locals;
+            } else {
+                if (s.Stack.size() != stack.size()) { throw InvalidBytecode(); }
+                for (size_t k = 0; k < stack.size(); k++) {
+                    const int v = merge_value(s.Stack[k], stack[k]);
+                    changed |= v != s.Stack[k];
+                    s.Stack[k] = v;
+                }
+                for (size_t k = 0; k < locals.size(); k++) {
+                    const int v = merge_value(s.Locals[k], locals[k]);
+                    changed |= v != s.Locals[k];
+                    s.Locals[k] = v;
+                }
+            }
+            if (changed && !Queued[insn]) {
+                Queued[insn] = true;
+                Work.push_back(insn);
+            }
+        }
+
+        void Flow::step(const int insn, State& s, std::vector<int>* inputs) {
+            const Insn& in = Code.Insns[insn];
+            auto& stack = s.Stack;
+            auto pop = [&]() {
+                if (stack.empty()) { throw InvalidBytecode(); }
+                const int v = stack.back();
+                stack.pop_back();
+                return v;
+            };
+            auto local = [&](const int k) -> int& {
+                if (k < 0 || k >= static_cast<int>(s.Locals.size())) { throw InvalidBytecode(); }
+                return s.Locals[k];
+            };
+            switch (in.Op) {
+            case OP_ALOAD: stack.push_back(local(in.Local)); return;
+            case OP_ASTORE: { const int v = pop(); local(in.Local) = v; } return;
+            case OP_POP: pop(); return;
+            case OP_POP2: pop(), pop(); return;
+            case OP_DUP: { const int a = pop(); stack.insert(stack.end(), {a, a}); } return;
+            case OP_DUP_X1: { const int a = pop(), b = pop(); stack.insert(stack.end(), {a, b, a}); } return;
+            case OP_DUP_X2: { const int a = pop(), b = pop(), c = pop(); stack.insert(stack.end(), {a, c, b, a}); } return;
+            case OP_DUP2: { const int a = pop(), b = pop(); stack.insert(stack.end(), {b, a, b, a}); } return;
+            case OP_DUP2_X1: { const int a = pop(), b = pop(), c = pop(); stack.insert(stack.end(), {b, a, c, b, a}); } return;
+            case OP_DUP2_X2: {
+                const int a = pop(), b = pop(), c = pop(), d = pop();
+                stack.insert(stack.end(), {b, a, d, c, b, a});
+            }
+            return;
+            case OP_SWAP: { const int a = pop(), b = pop(); stack.insert(stack.end(), {a, b}); } return;
+            default: ;
+            }
+
+            const auto effect = EffectOf(F, in);
+            if (static_cast<int>(stack.size()) < effect.Pops) { throw InvalidBytecode(); }
+            if (inputs) { inputs->clear(); }
+            for (size_t k = stack.size() - effect.Pops; k < stack.size(); k++) {
+                const int v = stack[k];
+                if (is_stale(v)) { Ambiguous[source_of(v)] = true; }
+                if (inputs) { inputs->push_back(v >= 0 ? v : NONE); }
+            }
+            stack.resize(stack.size() - effect.Pops);
+            if (in.Op >= OP_ISTORE && in.Op <= OP_DSTORE) {
+                local(in.Local) = NONE;
+                if (in.Op == OP_LSTORE || in.Op == OP_DSTORE) { local(in.Local + 1) = NONE; }
+            }
+            const int source = Sources[insn];
+            if (source >= 0 && effect.Pushes == 1) {
+                // the values of an earlier execution are now stale
+                for (auto& v : stack) { if (v == source) { v = stale(source); } }
+                for (auto& v : s.Locals) { if (v == source) { v = stale(source); } }
+                stack.push_back(source);
+                return;
+            }
+            stack.insert(stack.end(), effect.Pushes, NONE);
+        }
+
+        // Runs the block starting at a leader, passing what flows out of it on to the leaders it reaches.
+        void Flow::run_block(const int start, std::vector<std::vector<int>>* inputs, std::vector<int>* depths) {
+            static const std::vector<int> caught(1, NONE);
+            State s = At[start];
+            const int n = static_cast<int>(Code.Insns.size());
+            for (int i = start; i < n; i++) {
+                if (i != start && Leader[i]) {
+                    merge(i, s.Stack, s.Locals);
+                    return;
+                }
+                const Insn& in = Code.Insns[i];
+                if (depths) { (*depths)[i] = static_cast<int>(s.Stack.size()); }
+                bool covered = false;
+                for (const auto& h : Code.Handlers) {
+                    if (i >= h.Start && i < h.End) {
+                        merge(h.Target, caught, s.Locals);
+                        covered = true;
+                    }
+                }
+                step(i, s, inputs && !ValueFlow::IsMove(in.Op) ? &(*inputs)[i] : nullptr);
+                if (covered) {
+                    for (const auto& h : Code.Handlers) {
+                        if (i >= h.Start && i < h.End) { merge(h.Target, caught, s.Locals); }
+                    }
+                }
+                if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                    merge(in.Target, s.Stack, s.Locals);
+                    for (const int t : Code.Switches[in.Value].Targets) { merge(t, s.Stack, s.Locals); }
+                } else if (IsBranch(in.Op)) {
+                    merge(in.Target, s.Stack, s.Locals);
+                }
+                if (OpcodeTable[in.Op].Flags & OPF_END) { return; }
+            }
+            throw InvalidBytecode(); // falls off the end of the code
+        }
+
+        void Flow::Run(std::vector<std::vector<int>>& inputs, std::vector<int>& depths) {
+            const int n = static_cast<int>(Code.Insns.size());
+            if (!n) { return; }
+            Leader.assign(n, false);
+            Queued.assign(n, false);
+            Leader[0] = true;
+            for (int i = 0; i < n; i++) {
+                const Insn& in = Code.Insns[i];
+                const bool branch = IsBranch(in.Op) || (OpcodeTable[in.Op].Flags & OPF_SWITCH);
+                if (branch) { Leader[in.Target] = true; }
+                if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                    for (const int t : Code.Switches[in.Value].Targets) { Leader[t] = true; }
+                }
+                if ((branch || (OpcodeTable[in.Op].Flags & OPF_END)) && i + 1 < n) { Leader[i + 1] = true; }
+            }
+            for (const auto& h : Code.Handlers) { Leader[h.Target] = true; }
+
+            merge(0, {}, std::vector<int>(Code.MaxLocals, NONE));
+            while (!Work.empty()) {
+                const int start = Work.back();
+                Work.pop_back();
+                Queued[start] = false;
+                run_block(start, nullptr, nullptr);
+            }
+            // the states are final; go over the code once more to see what each instruction takes
+            for (int i = 0; i < n; i++) {
+                if (Leader[i] && At[i].Reached) { run_block(i, &inputs, &depths); }
+            }
+        }
+    }
+
+    ValueFlow::ValueFlow(const ClassFile& f, const DecodedCode& code, const std::vector<int>& sources):
+        IsAmbiguous(code.Insns.size()), InputsOf(code.Insns.size()), DepthOf(code.Insns.size(), -1) {
+        Flow(f, code, sources, IsAmbiguous).Run(InputsOf, DepthOf);
+        // a value that is ambiguous anywhere is of no use to a patch
+        for (auto& in : InputsOf) {
+            for (auto& v : in) {
+                if (v >= 0 && IsAmbiguous[v]) { v = -1; }
+            }
+        }
+    }
+
+    bool ValueFlow::IsMove(const uint8_t op) {
+        switch (op) {
+        case OP_ALOAD: case OP_ASTORE: case OP_POP: case OP_POP2: case OP_DUP: case OP_DUP_X1: case OP_DUP_X2:
+        case OP_DUP2: case OP_DUP2_X1: case OP_DUP2_X2: case OP_SWAP:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
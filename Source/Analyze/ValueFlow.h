@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "Insns.h"
+
+/*
+ * Where the values some instructions produce end up. Each value the chosen source instructions push is
+ * followed through the operand stack and the locals (by dup, swap, pop, aload and astore) to the
+ * instructions that consume it, for patches that rewrite a value together with every use of it.
+ *
+ * A source is ambiguous when it cannot be told apart at some use: when a use may see the value of one
+ * source on one path and something else on another, or the value an earlier execution of the source
+ * produced (in a loop, say) while a later one is also around.
+ */
+
+namespace Analyze {
+    class ValueFlow {
+    public:
+        // sources has an entry per instruction of code: -1, or the instruction index the value it pushes
+        // goes by. Sources that share an index are followed as one, so the values of either may meet
+        // without being ambiguous. Throws InvalidBytecode for code whose stack does not add up, and
+        // InvalidClassFile for a bad constant pool reference; code using jsr or ret is not handled.
+        ValueFlow(const Parse::ClassFile& f, const DecodedCode& code, const std::vector<int>& sources);
+
+        bool Ambiguous(int source) const { return IsAmbiguous[source]; }
+        // For the instructions that are not moves: the slots the instruction takes off the stack, the
+        // deepest first, each the source whose value it is, or -1 for anything else or an ambiguous value.
+        const std::vector<int>& Inputs(int insn) const { return InputsOf[insn]; }
+        // stack slots before the instruction, -1 where it is unreachable
+        int Depth(int insn) const { return DepthOf[insn]; }
+
+        // dup*, swap, pop, pop2, aload and astore, which pass values on without using them
+        static bool IsMove(uint8_t op);
+
+    private:
+        std::vector<bool> IsAmbiguous;
+        std::vector<std::vector<int>> InputsOf;
+        std::vector<int> DepthOf;
+    };
+}
@@ -0,0 +1,200 @@
+#include <filesystem>
+#include <unordered_map>
+#include "Util/u.h"
+#include "Util/hash.h"
+#include "Cache.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace Driver {
+    static const char magic[4] = {'J', 'O', 'C', 3}; // bump the last byte when the layout changes
+
+    namespace {
+        // Every length read is checked against what is left of the entry before anything is sized by
+        // it; past the first failure nothing is read.
+        struct Reader {
+            FILE* Fp;
+            uint64_t Left; // bytes of the entry not read yet
+            bool Ok = true;
+
+            // whether there are n more bytes (n items of at least one byte), counting them as read
+            bool Take(const uint64_t n) {
+                if (!Ok || n > Left) {
+                    Ok = false;
+                    return false;
+                }
+                Left -= n;
+                return true;
+            }
+
+            uint64_t Get(const int n) {
+                if (!Take(n)) { return 0; }
+                uint64_t v = 0;
+                for (int i = 0; i < n; i++) {
+                    const int c = fgetc(Fp);
+                    if (c == EOF) { Ok = false; }
+                    v = v << 8 | (c & 0xff);
+                }
+                return v;
+            }
+
+            void Bytes(void* p, const size_t n) {
+                if (Take(n) && fread(p, 1, n, Fp) != n) { Ok = false; }
+            }
+
+            // a count of items of at least min bytes each; 0 if there cannot be that many
+            uint64_t Count(const int n, const uint64_t min) {
+                const uint64_t count = Get(n);
+                if (count * min > Left) {
+                    Ok = false;
+                    return 0;
+                }
+                return count;
+            }
+
+            std::string String() {
+                std::string s(Count(2, 1), '\0');
+                Bytes(s.data(), s.size());
+                return s;
+            }
+        };
+
+        struct Writer {
+            FILE* Fp;
+
+            void Put(const uint64_t v, const int n) {
+                for (int i = n - 1; i >= 0; i--) { fputc(static_cast<int>(v >> i * 8 & 0xff), Fp); }
+            }
+
+            void String(const std::string& s) {
+                Put(s.size(), 2);
+                fwrite(s.data(), 1, s.size(), Fp);
+            }
+        };
+    }
+
+    uint64_t ClassCache::Key(const std::vector<std::byte>& input) const {
+        return hash64(input.data(), input.size(), ConfigHash);
+    }
+
+    std::string ClassCache::PathOf(const uint64_t key) const {
+        char name[20];
+        snprintf(name, sizeof name, "%02x/%014llx", static_cast<unsigned>(key >> 56),
+                 static_cast<unsigned long long>(key & 0xffffffffffffffULL));
+        return Dir + "/" + name;
+    }
+
+    bool ClassCache::Load(const uint64_t key, CacheEntry& e, const bool with_output) const {
+        FILE* fp = fopen(PathOf(key).c_str(), "rb");
+        if (!fp) { return false; }
+        fseek(fp, 0, SEEK_END);
+        const long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        Reader r{fp, size < 0 ? 0 : static_cast<uint64_t>(size)};
+        char m[sizeof magic];
+        r.Bytes(m, sizeof m);
+        if (!r.Ok || memcmp(m, magic, sizeof m)) {
+            fclose(fp);
+            return false;
+        }
+        e.DepHash = r.Get(8);
+        e.ThisClass = r.String();
+        e.SuperClass = r.String();
+        e.Interfaces.resize(r.Count(2, 2));
+        for (auto& i : e.Interfaces) { i = r.String(); }
+        e.References.resize(r.Count(4, 2));
+        for (auto& c : e.References) { c = r.String(); }
+        const auto len = r.Count(4, 1);
+        if (with_output && r.Ok) {
+            e.Output.resize(len);
+            r.Bytes(e.Output.data(), len);
+            e.Generated.resize(r.Count(2, 6));
+            for (auto& [name, bytes] : e.Generated) {
+                name = r.String();
+                bytes.resize(r.Count(4, 1));
+                r.Bytes(bytes.data(), bytes.size());
+            }
+        }
+        fclose(fp);
+        return r.Ok;
+    }
+
+    void ClassCache::Store(const uint64_t key, const CacheEntry& e) const {
+        const auto path = PathOf(key);
+        const auto tmp = path + "." + std::to_string(getpid());
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        FILE* fp = fopen(tmp.c_str(), "wb");
+        if (!fp) { return; } // a cache that cannot be written is only slow
+        Writer w{fp};
+        fwrite(magic, 1, sizeof magic, fp);
+        w.Put(e.DepHash, 8);
+        w.String(e.ThisClass);
+        w.String(e.SuperClass);
+        w.Put(e.Interfaces.size(), 2);
+        for (const auto& i : e.Interfaces) { w.String(i); }
+        w.Put(e.References.size(), 4);
+        for (const auto& c : e.References) { w.String(c); }
+        w.Put(e.Output.size(), 4);
+        fwrite(e.Output.data(), 1, e.Output.size(), fp);
+        w.Put(e.Generated.size(), 2);
+        for (const auto& [name, bytes] : e.Generated) {
+            w.String(name);
+            w.Put(bytes.size(), 4);
+            fwrite(bytes.data(), 1, bytes.size(), fp);
+        }
+        const bool ok = !ferror(fp);
+        fclose(fp);
+        std::error_code ec;
+        if (ok) { std::filesystem::rename(tmp, path, ec); }
+        if (!ok || ec) { std::filesystem::remove(tmp, ec); }
+    }
+
+    namespace {
+        class DependencyHasher {
+        public:
+            DependencyHasher(const std::vector<uint64_t>& keys, const std::vector<CacheEntry>& facts):
+                Hashes(keys.size()), Keys(keys), Facts(facts), State(keys.size()) {
+                Index.reserve(facts.size());
+                for (size_t i = 0; i < facts.size(); i++) { Index.emplace(facts[i].ThisClass, i); }
+            }
+
+            uint64_t Of(const size_t i) {
+                if (State[i] == DONE) { return Hashes[i]; }
+                if (State[i] == BUSY) { return Keys[i]; } // circular hierarchy, the JVM will reject it anyway
+                State[i] = BUSY;
+                std::vector<uint64_t> parts{Keys[i]};
+                if (!Facts[i].SuperClass.empty()) { parts.push_back(OfName(Facts[i].SuperClass)); }
+                for (const auto& name : Facts[i].Interfaces) { parts.push_back(OfName(name)); }
+                Hashes[i] = hash64(parts.data(), parts.size() * sizeof parts[0], 0);
+                State[i] = DONE;
+                return Hashes[i];
+            }
+
+            std::vector<uint64_t> Hashes;
+
+        private:
+            uint64_t OfName(const std::string& name) {
+                const auto it = Index.find(name);
+                if (it != Index.end()) { return Of(it->second); }
+                return hash64(name.data(), name.size(), 0);
+            }
+
+            enum { TODO, BUSY, DONE };
+            const std::vector<uint64_t>& Keys;
+            const std::vector<CacheEntry>& Facts;
+            std::vector<uint8_t> State;
+            std::unordered_map<std::string, size_t> Index;
+        };
+    }
+
+    std::vector<uint64_t> DependencyHashes(const std::vector<uint64_t>& keys, const std::vector<CacheEntry>& facts) {
+        DependencyHasher h(keys, facts);
+        for (size_t i = 0; i < keys.size(); i++) { h.Of(i); }
+        return std::move(h.Hashes);
+    }
+}
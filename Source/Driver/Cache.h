@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Driver {
+    // classes a pass made up along with an input, by internal name
+    using GeneratedClasses = std::vector<std::pair<std::string, std::vector<std::byte>>>;
+
+    struct CacheEntry {
+        // hierarchy facts, so that an unchanged class never needs to be parsed
+        std::string ThisClass;
+        std::string SuperClass; // empty for java/lang/Object
+        std::vector<std::string> Interfaces;
+        // the classes it names, in its Class entries and descriptors, for what the entry depends on
+        // outside of the batch; sorted
+        std::vector<std::string> References;
+        uint64_t DepHash = 0; // DependencyHashes, with what the entry depends on outside of the batch folded in
+        std::vector<std::byte> Output;
+        GeneratedClasses Generated;
+    };
+
+    // On-disk cache of produced classes, keyed by the hash of the input bytes and of the configuration.
+    // Entries live in <dir>/<2 hex digits>/<14 hex digits>; a damaged entry reads as a miss.
+    class ClassCache {
+    public:
+        ClassCache(std::string dir, uint64_t config_hash): Dir(std::move(dir)), ConfigHash(config_hash) {}
+
+        uint64_t Key(const std::vector<std::byte>& input) const;
+        // false for a missing entry, and for one that is truncated or whose lengths do not fit it
+        bool Load(uint64_t key, CacheEntry& e, bool with_output) const;
+        // written to a temporary file and renamed, so concurrent runs never see half an entry
+        void Store(uint64_t key, const CacheEntry& e) const;
+
+    private:
+        std::string PathOf(uint64_t key) const;
+
+        std::string Dir;
+        uint64_t ConfigHash;
+    };
+
+    // For every class: a hash over its key and the keys of all its supertypes in the same batch, so that
+    // an entry goes stale when any of its supertypes changes. Supertypes outside of the batch contribute
+    // their name only. facts[i] only needs the hierarchy fields filled in.
+    std::vector<uint64_t> DependencyHashes(const std::vector<uint64_t>& keys, const std::vector<CacheEntry>& facts);
+}
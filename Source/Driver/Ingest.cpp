@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Ingest.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_OP_STATX and the other opcodes used here are enumerators, so the headers are checked for a
+// flag of the same release (5.6) instead; struct statx comes with glibc 2.28
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(STATX_SIZE)
+#define HAVE_IO_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace Driver {
+    namespace {
+        constexpr size_t GROUP = 64; // files per round of submissions
+
+        // errno, or 0 with the whole file in buf
+        int read_file(const char* path, std::vector<std::byte>& buf) {
+            const int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) { return errno; }
+            struct stat st;
+            int err = fstat(fd, &st) < 0 ? errno : 0;
+            if (!err) {
+                buf.resize(static_cast<size_t>(st.st_size));
+                size_t got = 0;
+                while (got < buf.size()) {
+                    const ssize_t n = pread(fd, buf.data() + got, buf.size() - got, static_cast<off_t>(got));
+                    if (n < 0 && errno == EINTR) { continue; }
+                    if (n <= 0) {
+                        err = n < 0 ? errno : EIO; // shrank while we read it
+                        break;
+                    }
+                    got += static_cast<size_t>(n);
+                }
+            }
+            close(fd);
+            return err;
+        }
+    }
+
+#ifdef HAVE_IO_URING
+    // A bare io_uring: the shared rings mapped by hand, so that no liburing is needed.
+    struct InputReader::Ring {
+        int Fd = -1;
+        void* SqMap = MAP_FAILED;
+        void* CqMap = MAP_FAILED;
+        void* SqeMap = MAP_FAILED;
+        size_t SqMapSize = 0, CqMapSize = 0, SqeMapSize = 0;
+        unsigned *SqHead = nullptr, *SqTail = nullptr, *SqMask = nullptr, *SqArray = nullptr;
+        unsigned *CqHead = nullptr, *CqTail = nullptr, *CqMask = nullptr;
+        io_uring_sqe* Sqes = nullptr;
+        io_uring_cqe* Cqes = nullptr;
+        unsigned Tail = 0, Queued = 0;
+        bool Settled = true; // nothing the kernel took is still in flight
+        // what in-flight requests of a ring that could not be settled may still write to
+        std::vector<std::vector<std::byte>> Abandoned;
+        std::vector<struct statx> AbandonedSizes;
+
+        ~Ring() {
+            if (SqeMap != MAP_FAILED) { munmap(SqeMap, SqeMapSize); }
+            if (CqMap != MAP_FAILED && CqMap != SqMap) { munmap(CqMap, CqMapSize); }
+            if (SqMap != MAP_FAILED) { munmap(SqMap, SqMapSize); }
+            if (Fd >= 0) { close(Fd); }
+        }
+
+        // null if the kernel has no io_uring or does not let us use it
+        static std::unique_ptr<Ring> Create(const unsigned entries) {
+            auto ring = std::make_unique<Ring>();
+            io_uring_params p {};
+            ring->Fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+            if (ring->Fd < 0) { return nullptr; }
+            ring->SqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            ring->CqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) { ring->SqMapSize = ring->CqMapSize = std::max(ring->SqMapSize, ring->CqMapSize); }
+            ring->SqMap = mmap(nullptr, ring->SqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->Fd,
+                               IORING_OFF_SQ_RING);
+            if (ring->SqMap == MAP_FAILED) { return nullptr; }
+            ring->CqMap = single ? ring->SqMap
+                                 : mmap(nullptr, ring->CqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ring->Fd, IORING_OFF_CQ_RING);
+            if (ring->CqMap == MAP_FAILED) { return nullptr; }
+            ring->SqeMapSize = p.sq_entries * sizeof(io_uring_sqe);
+            ring->SqeMap = mmap(nullptr, ring->SqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->Fd,
+                                IORING_OFF_SQES);
+            if (ring->SqeMap == MAP_FAILED) { return nullptr; }
+
+            auto* sq = static_cast<char*>(ring->SqMap);
+            auto* cq = static_cast<char*>(ring->CqMap);
+            ring->SqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+            ring->SqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            ring->SqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            ring->SqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            ring->CqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            ring->CqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            ring->CqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            ring->Sqes = static_cast<io_uring_sqe*>(ring->SqeMap);
+            ring->Cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+            ring->Tail = *ring->SqTail;
+            return ring;
+        }
+
+        // a cleared entry, submitted by the next Submit; at most `entries' may be queued at a time
+        io_uring_sqe& Queue(const uint8_t opcode, const int fd, const uint64_t user_data) {
+            const unsigned i = Tail++ & *SqMask;
+            auto& sqe = Sqes[i];
+            memset(&sqe, 0, sizeof sqe);
+            sqe.opcode = opcode;
+            sqe.fd = fd;
+            sqe.user_data = user_data;
+            SqArray[i] = i;
+            Queued++;
+            return sqe;
+        }
+
+        // completions there are, at most max, passed to done(user_data, res)
+        template<class F>
+        unsigned Reap(const unsigned max, F&& done) {
+            unsigned head = *CqHead, n = 0;
+            const unsigned tail = __atomic_load_n(CqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail && n < max; head++, n++) {
+                const auto& cqe = Cqes[head & *CqMask];
+                done(cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(CqHead, head, __ATOMIC_RELEASE);
+            return n;
+        }
+
+        // waits for n completions, dropping them; false if io_uring_enter fails
+        bool Drain(unsigned n) {
+            while (n) {
+                if (syscall(__NR_io_uring_enter, Fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+                    if (errno == EINTR) { continue; }
+                    return false;
+                }
+                n -= Reap(n, [](uint64_t, int) {});
+            }
+            return true;
+        }
+
+        // Submits what was queued and waits for all of it, calling done(user_data, res) for each
+        // completion. False if io_uring_enter itself fails; what the kernel had already taken is then
+        // waited for (without calling done), and Settled tells whether that worked.
+        template<class F>
+        bool Submit(F&& done) {
+            const unsigned first = Tail - Queued;
+            __atomic_store_n(SqTail, Tail, __ATOMIC_RELEASE);
+            unsigned to_submit = Queued, pending = Queued;
+            Queued = 0;
+            while (pending) {
+                const long n = syscall(__NR_io_uring_enter, Fd, to_submit, pending, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (n < 0) {
+                    if (errno == EINTR) { continue; }
+                    const unsigned taken = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) - first;
+                    const unsigned reaped = Tail - first - pending;
+                    Settled = Drain(taken > reaped ? taken - reaped : 0);
+                    return false;
+                }
+                to_submit -= std::min(to_submit, static_cast<unsigned>(n));
+                pending -= Reap(pending, done);
+            }
+            return true;
+        }
+    };
+
+    InputReader::InputReader(const std::vector<const char*>& paths, const bool use_uring): Paths(paths) {
+        if (use_uring && paths.size() > 1) { Uring = Ring::Create(2 * GROUP); }
+    }
+
+    // Three rounds for the group: open and statx every file, read each into a buffer of its size, close.
+    // A file the ring fails on is read again with read_file, which then has the last word on the error.
+    void InputReader::ReadGroup(const size_t first) {
+        const size_t m = std::min(GROUP, Paths.size() - first);
+        GroupBegin = first;
+        GroupEnd = first + m;
+        Buffers.assign(m, {});
+        Errors.assign(m, 0);
+        std::vector<int> fds(m, -1);
+        std::vector<struct statx> sizes(m);
+        std::vector<bool> sized(m), retry(m);
+
+        for (size_t k = 0; k < m; k++) {
+            auto& open = Uring->Queue(IORING_OP_OPENAT, AT_FDCWD, k << 1);
+            open.addr = reinterpret_cast<uint64_t>(Paths[first + k]);
+            open.open_flags = O_RDONLY | O_CLOEXEC;
+            auto& stat = Uring->Queue(IORING_OP_STATX, AT_FDCWD, k << 1 | 1);
+            stat.addr = reinterpret_cast<uint64_t>(Paths[first + k]);
+            stat.len = STATX_SIZE;
+            stat.off = reinterpret_cast<uint64_t>(&sizes[k]); // addr2
+        }
+        bool ok = Uring->Submit([&](const uint64_t data, const int res) {
+            const size_t k = data >> 1;
+            if (data & 1) { sized[k] = res >= 0; }
+            else if (res >= 0) { fds[k] = res; }
+            else { retry[k] = true; }
+        });
+
+        std::vector<size_t> got(m);
+        if (ok) {
+            for (size_t k = 0; k < m; k++) {
+                if (fds[k] < 0) { continue; }
+                if (!sized[k]) {
+                    retry[k] = true;
+                    continue;
+                }
+                Buffers[k].resize(static_cast<size_t>(sizes[k].stx_size));
+                if (Buffers[k].empty()) { continue; }
+                auto& read = Uring->Queue(IORING_OP_READ, fds[k], k);
+                read.addr = reinterpret_cast<uint64_t>(Buffers[k].data());
+                read.len = static_cast<uint32_t>(Buffers[k].size());
+                read.off = 0;
+            }
+            ok = Uring->Submit([&](const uint64_t k, const int res) {
+                if (res < 0) { retry[k] = true; }
+                else { got[k] = static_cast<size_t>(res); }
+            });
+        }
+
+        for (size_t k = 0; k < m; k++) {
+            if (fds[k] >= 0 && !retry[k] && got[k] < Buffers[k].size()) { retry[k] = true; } // short read
+        }
+        if (ok) {
+            for (size_t k = 0; k < m; k++) {
+                if (fds[k] >= 0) { Uring->Queue(IORING_OP_CLOSE, fds[k], k); }
+            }
+            ok = Uring->Submit([&](const uint64_t k, const int res) {
+                if (res >= 0) { fds[k] = -1; }
+            });
+        }
+        if (!ok) {
+            // The ring is in an unknown state and goes. If what it had in flight could not be waited
+            // for, the kernel may still write to the buffers: they are left to it, with the ring.
+            if (!Uring->Settled) {
+                Uring->Abandoned = std::move(Buffers);
+                Uring->AbandonedSizes = std::move(sizes);
+                (void) Uring.release(); // on purpose
+                Buffers.assign(m, {});
+            }
+            Uring.reset();
+        }
+        for (size_t k = 0; k < m; k++) {
+            if (fds[k] >= 0) { close(fds[k]); }
+            if (!ok || retry[k]) { Errors[k] = read_file(Paths[first + k], Buffers[k]); }
+        }
+    }
+#else
+    struct InputReader::Ring {};
+
+    InputReader::InputReader(const std::vector<const char*>& paths, bool): Paths(paths) {}
+
+    void InputReader::ReadGroup(size_t) {}
+#endif
+
+    InputReader::~InputReader() = default;
+
+    std::vector<std::byte> InputReader::Read(const size_t i) {
+        std::vector<std::byte> buf;
+        int err;
+        std::unique_lock<std::mutex> guard(Lock);
+        if (Uring && (i < GroupBegin || i >= GroupEnd)) { ReadGroup(i); }
+        if (i >= GroupBegin && i < GroupEnd) {
+            buf = std::move(Buffers[i - GroupBegin]);
+            err = Errors[i - GroupBegin];
+        } else {
+            guard.unlock();
+            err = read_file(Paths[i], buf);
+        }
+        if (err) { throw std::system_error(err, std::generic_category()); }
+        return buf;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Driver {
+    // Reads the input files of a batch. With io_uring, the files are read ahead in groups: one submission
+    // opens and sizes the whole group, one reads every file into a buffer of its exact size, and one
+    // closes them, instead of four system calls per file. Without io_uring (not Linux, an old kernel, or
+    // a sandbox that forbids it), each file is read with open, fstat and pread when it is asked for.
+    class InputReader {
+    public:
+        InputReader(const std::vector<const char*>& paths, bool use_uring);
+        ~InputReader();
+        InputReader(const InputReader&) = delete;
+        InputReader& operator=(const InputReader&) = delete;
+
+        // The contents of paths[i], once; throws std::system_error if the file cannot be read. Callers
+        // should go through the paths in order, as every miss reads a group starting at i.
+        std::vector<std::byte> Read(size_t i);
+
+    private:
+        struct Ring;
+
+        void ReadGroup(size_t first);
+
+        const std::vector<const char*>& Paths;
+        std::unique_ptr<Ring> Uring;
+        std::mutex Lock;
+        size_t GroupBegin = 0, GroupEnd = 0;
+        std::vector<std::vector<std::byte>> Buffers; // of the current group
+        std::vector<int> Errors;                     // errno per file of the current group, 0 if read
+    };
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "Util/WorkPool.h"
+#include "Pipeline.h"
+
+namespace Driver {
+    namespace {
+        uint64_t now_ns() {
+            using namespace std::chrono;
+            return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+        }
+
+        // A wait on a queue: yields at first, then sleeps, so that a stage stuck behind a slow disk does
+        // not keep a core busy. The time is added to the counter when the wait ends.
+        class Wait {
+        public:
+            explicit Wait(std::atomic<uint64_t>& ns): Ns(ns) {}
+            ~Wait() {
+                if (Spins) { Ns.fetch_add(now_ns() - Start, std::memory_order_relaxed); }
+            }
+
+            void Once() {
+                if (!Spins++) { Start = now_ns(); }
+                if (Spins < 64) { std::this_thread::yield(); }
+                else { std::this_thread::sleep_for(std::chrono::microseconds(50)); }
+            }
+
+        private:
+            std::atomic<uint64_t>& Ns;
+            int Spins = 0;
+            uint64_t Start = 0;
+        };
+    }
+
+    void Pipeline::AddStage(std::string name, const int threads, Work work) {
+        auto stage = std::make_unique<Stage>();
+        stage->Name = std::move(name);
+        stage->Threads = std::max(threads, 1);
+        stage->Body = std::move(work);
+        Stages.push_back(std::move(stage));
+    }
+
+    void Pipeline::Call(const Work& work, const size_t i, Stats& stats) {
+        const uint64_t start = now_ns();
+        try {
+            work(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(ErrorLock);
+            if (!Error) { Error = std::current_exception(); }
+        }
+        stats.BusyNs.fetch_add(now_ns() - start, std::memory_order_relaxed);
+        stats.Items.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the next item for stage s, false once its input is used up
+    bool Pipeline::Take(const size_t s, size_t& i) {
+        if (s == 0) {
+            Wait wait(Stages[0]->S.BlockedNs); // the window is full
+            for (;;) {
+                size_t next = Next.load(std::memory_order_relaxed);
+                if (next >= Count) { return false; }
+                if (next >= Done.load(std::memory_order_acquire) + InFlight) {
+                    wait.Once();
+                } else if (Next.compare_exchange_weak(next, next + 1, std::memory_order_relaxed)) {
+                    i = next;
+                    return true;
+                }
+            }
+        }
+        const auto& in = *Stages[s - 1];
+        Wait wait(Stages[s]->S.StarvedNs);
+        for (;;) {
+            if (in.Out->TryPop(i)) { return true; }
+            // an item pushed before the last producer left is in the queue by now
+            if (in.Closed.load(std::memory_order_acquire)) { return in.Out->TryPop(i); }
+            wait.Once();
+        }
+    }
+
+    void Pipeline::Put(const size_t s, const size_t i) {
+        auto& stage = *Stages[s];
+        Wait wait(stage.S.BlockedNs);
+        while (!stage.Out->TryPush(i)) { wait.Once(); }
+    }
+
+    void Pipeline::StageMain(const size_t s) {
+        auto& stage = *Stages[s];
+        // the threads of the stage already share the cores; one alone may still split a large item
+        if (stage.Threads > 1) { Utils::WorkPool::SerialOnThisThread(); }
+        size_t i;
+        while (Take(s, i)) {
+            Call(stage.Body, i, stage.S);
+            Put(s, i);
+        }
+        if (stage.Running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            stage.Closed.store(true, std::memory_order_release);
+        }
+    }
+
+    void Pipeline::Run(const size_t n, const Work& ordered) {
+        if (Stages.empty()) {
+            for (size_t i = 0; i < n; i++) { Call(ordered, i, Ordered); }
+        } else {
+            int threads = 1;
+            for (auto& stage : Stages) { threads += stage->Threads; }
+            Count = n;
+            InFlight = Window ? Window : 4 * static_cast<size_t>(threads);
+            Next = 0;
+            Done = 0;
+            Error = nullptr;
+            std::vector<std::thread> workers;
+            for (size_t s = 0; s < Stages.size(); s++) {
+                auto& stage = *Stages[s];
+                const int consumers = s + 1 < Stages.size() ? Stages[s + 1]->Threads : 1;
+                stage.Out = std::make_unique<Utils::BoundedQueue<size_t>>(std::min<size_t>(2 * consumers, InFlight));
+                stage.Running = stage.Threads;
+                stage.Closed = false;
+                for (int t = 0; t < stage.Threads; t++) { workers.emplace_back(&Pipeline::StageMain, this, s); }
+            }
+
+            // items arrive in any order but stay within the window, so a ring of InFlight flags holds them
+            const auto& last = *Stages.back();
+            std::vector<bool> ready(InFlight);
+            size_t done = 0;
+            while (done < n) {
+                size_t i;
+                bool got;
+                {
+                    Wait wait(Ordered.StarvedNs);
+                    while (!(got = last.Out->TryPop(i))) {
+                        if (last.Closed.load(std::memory_order_acquire) && !(got = last.Out->TryPop(i))) { break; }
+                        wait.Once();
+                    }
+                }
+                if (!got) { break; }
+                ready[i % InFlight] = true;
+                while (done < n && ready[done % InFlight]) {
+                    ready[done % InFlight] = false;
+                    Call(ordered, done, Ordered);
+                    Done.store(++done, std::memory_order_release);
+                }
+            }
+            for (auto& t : workers) { t.join(); }
+        }
+        if (Error) { std::rethrow_exception(Error); }
+    }
+
+    void Pipeline::Print(FILE* fp) const {
+        fprintf(fp, "%-10s %8s %8s %12s %12s %12s\n", "stage", "threads", "items", "busy ms", "blocked ms", "starved ms");
+        auto line = [fp](const char* name, const int threads, const Stats& s) {
+            fprintf(fp, "%-10s %8d %8llu %12.3f %12.3f %12.3f\n", name, threads, (unsigned long long) s.Items.load(),
+                    s.BusyNs / 1e6, s.BlockedNs / 1e6, s.StarvedNs / 1e6);
+        };
+        for (auto& stage : Stages) { line(stage->Name.c_str(), stage->Threads, stage->S); }
+        line("write", 1, Ordered);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Util/BoundedQueue.h"
+
+namespace Driver {
+    // Runs a batch through a chain of stages, each on threads of its own, so that reading one input
+    // overlaps parsing and optimizing others. Items are indices into the batch: the stages keep their
+    // state in arrays of the caller, and the queues between stages pass only indices. The last stage runs
+    // on the calling thread in index order, so output comes out as it would from a plain loop.
+    //
+    // At most Window items are in flight; a stage that gets ahead of a slower one waits on its full
+    // output queue (blocked) and the one after a slow stage waits on an empty input (starved). Both
+    // waits are counted, per stage, for Print. The threads of a stage with more than one run the
+    // ParallelFor calls of the work serially (see Utils::WorkPool::SerialOnThisThread).
+    class Pipeline {
+    public:
+        using Work = std::function<void(size_t)>;
+
+        // The first stage added takes the items in order. Failures belong in the item; an exception that
+        // escapes work is rethrown by Run once the batch is through.
+        void AddStage(std::string name, int threads, Work work);
+        // ordered is named "write" in Print
+        void Run(size_t n, const Work& ordered);
+
+        // items in flight, 0 = four per thread
+        size_t Window = 0;
+
+        // items, busy time and waits of every stage
+        void Print(FILE* fp) const;
+
+    private:
+        struct Stats {
+            std::atomic<uint64_t> Items{0}, BusyNs{0}, BlockedNs{0}, StarvedNs{0};
+        };
+
+        struct Stage {
+            std::string Name;
+            int Threads;
+            Work Body;
+            std::unique_ptr<Utils::BoundedQueue<size_t>> Out; // to the next stage, or to the ordered one
+            std::atomic<int> Running{0};
+            std::atomic<bool> Closed{false}; // no more pushes to Out
+            Stats S;
+        };
+
+        void StageMain(size_t s);
+        bool Take(size_t s, size_t& i);
+        void Put(size_t s, size_t i);
+        void Call(const Work& work, size_t i, Stats& stats);
+
+        std::vector<std::unique_ptr<Stage>> Stages;
+        Stats Ordered;
+        size_t Count = 0, InFlight = 0;
+        std::atomic<size_t> Next{0}, Done{0}; // items taken by the first stage; items through the ordered one
+        std::mutex ErrorLock;
+        std::exception_ptr Error;
+    };
+}
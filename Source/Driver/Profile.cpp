@@ -0,0 +1,200 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "Profile.h"
+
+namespace Driver {
+    bool Profiling = false;
+
+    namespace {
+        struct PhaseStats {
+            std::atomic<uint64_t> Calls{0}, Nanos{0}, Allocs{0}, AllocBytes{0};
+        };
+
+        struct TraceEvent {
+            Phase P;
+            const char* Subject;
+            int Thread;
+            uint64_t StartNs, Nanos;
+        };
+
+        const char* const phase_names[] = {"read", "parse", "convert", "optimize", "serialize", "output", "cache"};
+        static_assert(sizeof phase_names / sizeof *phase_names == static_cast<size_t>(Phase::Count));
+
+        PhaseStats stats[static_cast<size_t>(Phase::Count)];
+        std::atomic<uint64_t> region_classes{0}, region_bytes{0}, region_max{0};
+        bool tracing = false;
+        std::mutex trace_lock;
+        std::vector<TraceEvent> trace;
+        uint64_t epoch_ns = 0;
+        std::atomic<int> thread_count{0};
+
+        // only counted while profiling, so that the disabled path stays a branch
+        thread_local uint64_t allocs = 0, alloc_bytes = 0;
+        thread_local int thread_id = -1;
+
+        uint64_t now_ns() {
+            using namespace std::chrono;
+            return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+        }
+    }
+
+    void EnableProfiling(const bool trace_events) {
+        Profiling = true;
+        tracing = trace_events;
+        epoch_ns = now_ns();
+    }
+
+    void PhaseTimer::Start() {
+        Started = true;
+        StartAllocs = allocs;
+        StartAllocBytes = alloc_bytes;
+        StartNs = now_ns();
+    }
+
+    void PhaseTimer::Stop() {
+        const uint64_t ns = now_ns() - StartNs;
+        auto& s = stats[static_cast<size_t>(P)];
+        s.Calls.fetch_add(1, std::memory_order_relaxed);
+        s.Nanos.fetch_add(ns, std::memory_order_relaxed);
+        s.Allocs.fetch_add(allocs - StartAllocs, std::memory_order_relaxed);
+        s.AllocBytes.fetch_add(alloc_bytes - StartAllocBytes, std::memory_order_relaxed);
+        if (tracing) {
+            if (thread_id < 0) { thread_id = thread_count++; }
+            std::lock_guard<std::mutex> guard(trace_lock);
+            trace.push_back({P, Subject, thread_id, StartNs - epoch_ns, ns});
+        }
+    }
+
+    void RecordRegionBytes(const size_t n) {
+        if (!Profiling) { return; }
+        region_classes.fetch_add(1, std::memory_order_relaxed);
+        region_bytes.fetch_add(n, std::memory_order_relaxed);
+        uint64_t max = region_max.load(std::memory_order_relaxed);
+        while (n > max && !region_max.compare_exchange_weak(max, n, std::memory_order_relaxed)) {}
+    }
+
+    void PrintProfile(FILE* fp) {
+        fprintf(fp, "%-10s %8s %12s %10s %10s %12s\n", "phase", "calls", "total ms", "avg us", "allocs", "alloc KiB");
+        for (size_t i = 0; i < static_cast<size_t>(Phase::Count); i++) {
+            const auto& s = stats[i];
+            const uint64_t calls = s.Calls;
+            if (!calls) { continue; }
+            fprintf(fp, "%-10s %8llu %12.3f %10.1f %10llu %12.1f\n", phase_names[i], (unsigned long long) calls,
+                    s.Nanos / 1e6, s.Nanos / 1e3 / calls, (unsigned long long) s.Allocs.load(), s.AllocBytes / 1024.0);
+        }
+        if (const uint64_t n = region_classes) {
+            fprintf(fp, "region: %llu classes, %.1f KiB average, %.1f KiB max\n", (unsigned long long) n,
+                    region_bytes / 1024.0 / n, region_max / 1024.0);
+        }
+    }
+
+    static void write_json_string(FILE* fp, const char* s) {
+        fputc('"', fp);
+        for (; *s; s++) {
+            const auto c = static_cast<unsigned char>(*s);
+            if (c == '"' || c == '\\') { fprintf(fp, "\\%c", c); }
+            else if (c < 0x20) { fprintf(fp, "\\u%04x", c); }
+            else { fputc(c, fp); }
+        }
+        fputc('"', fp);
+    }
+
+    bool WriteTrace(const char* path) {
+        FILE* fp = fopen(path, "w");
+        if (!fp) { return false; }
+        std::lock_guard<std::mutex> guard(trace_lock);
+        fputs("{\"traceEvents\":[", fp);
+        for (size_t i = 0; i < trace.size(); i++) {
+            const auto& e = trace[i];
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    i ? "," : "", phase_names[static_cast<size_t>(e.P)], e.Thread, e.StartNs / 1e3, e.Nanos / 1e3);
+            if (e.Subject) {
+                fputs(",\"args\":{\"subject\":", fp);
+                write_json_string(fp, e.Subject);
+                fputc('}', fp);
+            }
+            fputc('}', fp);
+        }
+        fputs("\n],\"displayTimeUnit\":\"ms\"}\n", fp);
+        return fclose(fp) == 0;
+    }
+}
+
+// Counting replacements for the global allocator, which the parser reaches through std::vector and
+// std::make_unique. Every form is replaced: the array forms forward to the plain ones, and the aligned
+// and nothrow ones count as well, so that no allocation of a phase goes past the counters.
+namespace {
+    void count_alloc(const size_t n) {
+        if (Driver::Profiling) {
+            Driver::allocs++;
+            Driver::alloc_bytes += n;
+        }
+    }
+
+    void* aligned_malloc(const size_t n, const std::align_val_t al) {
+        const auto a = static_cast<size_t>(al);
+#ifdef _WIN32
+        return _aligned_malloc(n ? n : 1, a);
+#else
+        const size_t rounded = (n + a - 1) / a * a; // aligned_alloc takes a multiple of the alignment
+        return aligned_alloc(a, rounded ? rounded : a);
+#endif
+    }
+
+    void aligned_free(void* p) {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+}
+
+void* operator new(const size_t n) {
+    count_alloc(n);
+    if (void* p = malloc(n ? n : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const size_t n) { return operator new(n); }
+
+void* operator new(const size_t n, const std::nothrow_t&) noexcept {
+    count_alloc(n);
+    return malloc(n ? n : 1);
+}
+
+void* operator new[](const size_t n, const std::nothrow_t& tag) noexcept { return operator new(n, tag); }
+
+void* operator new(const size_t n, const std::align_val_t al) {
+    count_alloc(n);
+    if (void* p = aligned_malloc(n, al)) { return p; }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const size_t n, const std::align_val_t al) { return operator new(n, al); }
+
+void* operator new(const size_t n, const std::align_val_t al, const std::nothrow_t&) noexcept {
+    count_alloc(n);
+    return aligned_malloc(n, al);
+}
+
+void* operator new[](const size_t n, const std::align_val_t al, const std::nothrow_t& tag) noexcept {
+    return operator new(n, al, tag);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
@@ -0,0 +1,50 @@
+/*
+ * Profile: per-phase timers and allocation counters for a run.
+ *
+ * Off by default, when a PhaseTimer costs a single branch and operator new one more. Once enabled,
+ * every timed phase accumulates wall time and the heap allocations made while it ran; with tracing,
+ * each timing is also kept as a Chrome trace event (load the file in chrome://tracing or Perfetto).
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace Driver {
+    enum class Phase { Read, Parse, Convert, Optimize, Serialize, Output, Cache, Count };
+
+    extern bool Profiling;
+
+    void EnableProfiling(bool trace);
+
+    class PhaseTimer {
+    public:
+        // subject (usually the input path) is only used for trace events and must outlive the run
+        explicit PhaseTimer(Phase phase, const char* subject = nullptr): P(phase), Subject(subject) {
+            if (Profiling) { Start(); }
+        }
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+        ~PhaseTimer() {
+            if (Started) { Stop(); }
+        }
+
+    private:
+        void Start();
+        void Stop();
+
+        Phase P;
+        const char* Subject;
+        bool Started = false;
+        uint64_t StartNs = 0, StartAllocs = 0, StartAllocBytes = 0;
+    };
+
+    // Region bytes used for one class (see rused)
+    void RecordRegionBytes(size_t n);
+
+    void PrintProfile(FILE* fp);
+    // false if the file cannot be written
+    bool WriteTrace(const char* path);
+}
@@ -1,105 +1,218 @@
 #include "Util/u.h"
+#include "Util/bytescan.h"
+#include <atomic>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 #include "Javalib/Basic.h"
 
-JType
-make_array_type(JType elem_type, Region& r) {
-    auto p = new(r) ObjectTypeB;
-    p->elem_type = elem_type;
-    return (uintptr_t)p | 2;
+namespace {
+    // Class names by id. Names are copied once and never freed; pages never move once published, so
+    // lookups take no lock.
+    class ClassNameTable {
+    public:
+        JType Intern(std::string_view name) {
+            std::lock_guard<std::mutex> guard(Lock);
+            auto it = Ids.find(name);
+            if (it != Ids.end()) return it->second;
+            if (Next > JTYPE_ELEM_MASK) throw std::length_error("too many class types");
+            char* copy = (char*) xmalloc(name.size() + 1);
+            memcpy(copy, name.data(), name.size());
+            copy[name.size()] = 0;
+            JType id = Next++;
+            const char** page = Pages[id >> PAGE_BITS].load(std::memory_order_relaxed);
+            if (!page) {
+                page = (const char**) calloc(PAGE_SIZE, sizeof *page);
+                if (!page) throw std::bad_alloc();
+                Pages[id >> PAGE_BITS].store(page, std::memory_order_release);
+            }
+            page[id & (PAGE_SIZE - 1)] = copy;
+            Ids.emplace(std::string_view(copy, name.size()), id);
+            return id;
+        }
+
+        const char* Name(JType id) const {
+            assert(id >= FIRST_CLASS_ID && id < Next);
+            return Pages[id >> PAGE_BITS].load(std::memory_order_acquire)[id & (PAGE_SIZE - 1)];
+        }
+
+    private:
+        static constexpr int PAGE_BITS = 12;
+        static constexpr JType PAGE_SIZE = 1u << PAGE_BITS;
+
+        std::atomic<const char**> Pages[(JTYPE_ELEM_MASK + 1) >> PAGE_BITS] = {};
+        std::mutex Lock;
+        std::unordered_map<std::string_view, JType> Ids;
+        JType Next = FIRST_CLASS_ID;
+    };
+
+    ClassNameTable& class_names() {
+        static ClassNameTable table;
+        return table;
+    }
 }
 
 JType
-make_class_type(const char* class_name, Region& r) {
-    auto p = new(r) ObjectTypeB;
-    p->class_name = class_name;
-    return (uintptr_t)p;
+ClassType(std::string_view name) {
+    return class_names().Intern(name);
+}
+
+const char*
+ClassName(JType t) {
+    assert(JTypeKind(t) == OBJECT);
+    return class_names().Name(t);
 }
 
 JType
-parse_type(const char** ps, Region& r) {
-    JType result;
-    const char* s = *ps;
-    switch (*s++) {
-    case 'Z':
-        result = BOOL;
-        break;
-    case 'B':
-        result = BYTE;
-        break;
-    case 'C':
-        result = CHAR;
-        break;
-    case 'S':
-        result = SHORT;
-        break;
-    case 'I':
-        result = INT;
-        break;
-    case 'J':
-        result = LONG;
-        break;
-    case 'F':
-        result = FLOAT;
-        break;
-    case 'D':
-        result = DOUBLE;
-        break;
-    case '[':
-        result = make_array_type(parse_type(&s, r), r);
-        break;
-    case 'L': {
-        /* s -> end of 'L' */
-        const char* psemi = strchr(s, ';');
-        if (!psemi) throw InvalidDescriptor();
-        int len = psemi - s;
-        char* class_name = new_string(len+1, r);
-        memcpy(class_name, s, len);
-        s = psemi + 1;
-        class_name[len] = 0;
-        result = make_class_type(class_name, r);
-    }
-    break;
-    default:
-        throw InvalidDescriptor();
+ArrayOf(JType elem) {
+    if (ArrayDims(elem) == MAX_ARRAY_DIMS) throw InvalidDescriptor();
+    return elem + (1u << JTYPE_DIMS_SHIFT);
+}
+
+static JType
+basic_type(char c) {
+    switch (c) {
+    case 'Z': return BOOL;
+    case 'B': return BYTE;
+    case 'C': return CHAR;
+    case 'S': return SHORT;
+    case 'I': return INT;
+    case 'J': return LONG;
+    case 'F': return FLOAT;
+    case 'D': return DOUBLE;
+    default: return 0;
     }
-    *ps = s;
-    return result;
+}
+
+namespace {
+    // Bitmaps of the '[' and ';' in a descriptor, so that array prefixes and class names are skipped
+    // a word at a time instead of a byte at a time
+    class DescriptorScanner {
+    public:
+        DescriptorScanner(const char* s, size_t len): S(s), Len(len), Words((len + 63) / 64) {
+            if (Words > NELEM(SmallSemis)) {
+                Big.resize(2 * Words);
+                Semis = Big.data();
+                Brackets = Semis + Words;
+            }
+            bytemask2(s, len, ';', '[', Semis, Brackets);
+        }
+
+        // the field type at p; p is left just after it
+        bool Next(size_t& p, DescriptorToken& t) const {
+            const size_t start = p;
+            p = Find(Brackets, p, true);
+            const size_t dims = p - start;
+            if (p >= Len || dims > MAX_ARRAY_DIMS) return false;
+            const char kind = S[p];
+            if (kind == 'L') {
+                p = Find(Semis, p, false);
+                if (p++ >= Len) return false;
+            }
+            else if (basic_type(kind)) { p++; }
+            else { return false; }
+            t = {(uint16_t) start, (uint16_t) (p - start), (uint8_t) dims, kind};
+            return true;
+        }
+
+    private:
+        // first position from p whose bit is set (clear if inverted), at least Len if none
+        size_t Find(const uint64_t* mask, size_t p, bool inverted) const {
+            if (p >= Len) return p;
+            size_t w = p / 64;
+            const uint64_t flip = inverted ? ~0ull : 0;
+            uint64_t bits = (mask[w] ^ flip) & ~0ull << p % 64;
+            while (!bits) {
+                if (++w == Words) return Len;
+                bits = mask[w] ^ flip;
+            }
+            return w * 64 + ctz64(bits);
+        }
+
+        const char* S;
+        size_t Len, Words;
+        uint64_t SmallSemis[4], SmallBrackets[4]; // enough for 256 bytes
+        uint64_t* Semis = SmallSemis;
+        uint64_t* Brackets = SmallBrackets;
+        std::vector<uint64_t> Big;
+    };
 }
 
 JType
-ParseFieldDescriptor(const char* s, Region& r) {
-    JType result = parse_type(&s, r);
-    if (*s) throw InvalidDescriptor(); // trailing characters
-    return result;
+DescriptorTokenType(const char* s, const DescriptorToken& t) {
+    if (t.Kind == 'V') return 0;
+    JType elem = t.Kind == 'L' ? ClassType({s + t.Start + t.Dims + 1, (size_t) t.Length - t.Dims - 2})
+                               : basic_type(t.Kind);
+    return elem | (JType) t.Dims << JTYPE_DIMS_SHIFT; // the scanner keeps Dims <= MAX_ARRAY_DIMS
+}
+
+JType
+ParseFieldDescriptor(const char* s) {
+    size_t len = strlen(s);
+    if (len > 0xffff) throw InvalidDescriptor();
+    DescriptorScanner scanner(s, len);
+    size_t p = 0;
+    DescriptorToken t;
+    if (!scanner.Next(p, t) || p != len) throw InvalidDescriptor(); // or trailing characters
+    return DescriptorTokenType(s, t);
+}
+
+int
+TokenizeMethodDescriptor(const char* s, size_t len, DescriptorToken* out, int cap) {
+    if (len < 3 || len > 0xffff || s[0] != '(') return -1;
+    DescriptorScanner scanner(s, len);
+    size_t p = 1;
+    int n = 0;
+    DescriptorToken t;
+    while (p < len && s[p] != ')') {
+        if (!scanner.Next(p, t)) return -1;
+        if (n < cap) out[n] = t;
+        n++;
+    }
+    // s[p] == ')', skip it
+    if (++p >= len) return -1;
+    if (s[p] == 'V') { t = {(uint16_t) p++, 1, 0, 'V'}; }
+    else if (!scanner.Next(p, t)) { return -1; }
+    if (p != len) return -1; // trailing characters
+    if (n < cap) out[n] = t;
+    return n + 1;
 }
 
 MethodType
 ParseMethodDescriptor(const char* s, Region& r) {
-    MethodType result;
-    if (*s++ != '(') throw InvalidDescriptor();
-    std::vector<JType> v;
-    while (*s != ')') { v.push_back(parse_type(&s, r)); }
-    // *s == ')', skip it
-    s++;
-    if (*s == 'V') {
-        result.ReturnType_opt = 0;
-        s++;
-    }
-    else { result.ReturnType_opt = parse_type(&s, r); }
-    if (*s) throw InvalidDescriptor(); // trailing characters
-    auto size = v.size();
-    result.NumArg = size;
-    if (size) {
-        JType* a = new(r) JType[size];
-        memcpy(a, v.data(), size * sizeof *a);
-        result.ArgTypes = a;
+    size_t len = strlen(s);
+    DescriptorToken small[32];
+    std::vector<DescriptorToken> big;
+    DescriptorToken* t = small;
+    int n = TokenizeMethodDescriptor(s, len, small, NELEM(small));
+    if (n > (int) NELEM(small)) {
+        big.resize(n);
+        t = big.data();
+        TokenizeMethodDescriptor(s, len, t, n);
     }
-    else { result.ArgTypes = nullptr; }
+    if (n < 0) throw InvalidDescriptor();
+    MethodType result;
+    result.NumArg = n - 1;
+    result.ArgTypes = n > 1 ? new(r) JType[n - 1] : nullptr;
+    for (int i = 0; i < n - 1; i++) { result.ArgTypes[i] = DescriptorTokenType(s, t[i]); }
+    result.ReturnType_opt = DescriptorTokenType(s, t[n - 1]);
     return result;
 }
 
+ClassNameParts
+SplitClassName(std::string_view name) {
+    const char* slash = last_byte(name.data(), name.size(), '/');
+    if (!slash) return {name.substr(0, 0), name};
+    size_t i = slash - name.data();
+    return {name.substr(0, i), name.substr(i + 1)};
+}
+
+bool
+SamePackage(std::string_view a, std::string_view b) {
+    return SplitClassName(a).Package == SplitClassName(b).Package;
+}
+
 void
 PP_JType(Buf* b, JType t) {
     static const char* basic_type_name_table[8] = {
@@ -114,7 +227,8 @@ PP_JType(Buf* b, JType t) {
     }
     switch (k) {
     case ARRAY:
-        bprintf(b, "%a[]", PP_JType, ElemType(t));
+        PP_JType(b, ElemType(t));
+        bputs(b, "[]");
         break;
     case OBJECT:
         bputs(b, ClassName(t));
@@ -1,3 +1,8 @@
+#pragma once
+
+#include <exception>
+#include <string_view>
+
 /*
  * type basic_type =
  *   | Bool
@@ -9,38 +14,35 @@
  *   | Float
  *   | Double
  *
- * type object_type =
- *   | Class of string (* bit 1 unset *)
- *   | Array of jtype  (* bit 1 set *)
- *
  * and jtype =
- *   | Basic of basic_type   (* bit 0 set *)
- *   | Object of object_type (* bit 0 unset *)
+ *   | Basic of basic_type
+ *   | Class of string
+ *   | Array of jtype
+ *
+ * A JType is a 32-bit id: the array dimension in the top 8 bits, the element type in the low 24.
+ * Elements below FIRST_CLASS_ID are the basic types; the others index the global table of class
+ * names, so equal types have equal ids in the whole process. 0 is not a type (void where allowed).
  */
 
-/* To be honest, this feels like a bit of a stunt. */
+typedef uint32_t JType;
 
-// BasicType or pointer to ObjectTypeB (valid field depends on bit 1 of ptr)
-typedef uintptr_t JType;
+constexpr JType BOOL = 1;
+constexpr JType BYTE = 3;
+constexpr JType CHAR = 5;
+constexpr JType SHORT = 7;
+constexpr JType INT = 9;
+constexpr JType LONG = 11;
+constexpr JType FLOAT = 13;
+constexpr JType DOUBLE = 15;
 
-constexpr uintptr_t BOOL = 1;
-constexpr uintptr_t BYTE = 3;
-constexpr uintptr_t CHAR = 5;
-constexpr uintptr_t SHORT = 7;
-constexpr uintptr_t INT = 9;
-constexpr uintptr_t LONG = 11;
-constexpr uintptr_t FLOAT = 13;
-constexpr uintptr_t DOUBLE = 15;
+// kinds besides the basic types, see JTypeKind
+constexpr uint32_t ARRAY = 2;
+constexpr uint32_t OBJECT = 4;
 
-constexpr uintptr_t ARRAY = 2;
-constexpr uintptr_t OBJECT = 4;
-
-union ObjectTypeB {
-    const char *class_name;
-    JType elem_type;
-};
-
-typedef ObjectTypeB *ObjectType;
+constexpr JType FIRST_CLASS_ID = 16;
+constexpr int JTYPE_DIMS_SHIFT = 24;
+constexpr JType JTYPE_ELEM_MASK = (1u << JTYPE_DIMS_SHIFT) - 1;
+constexpr int MAX_ARRAY_DIMS = 255;
 
 struct InvalidDescriptor : public std::exception {
     const char *what() const noexcept {
@@ -54,32 +56,63 @@ struct MethodType {
     JType *ArgTypes;
 };
 
-JType ParseFieldDescriptor(const char *s, Region &r);
-MethodType ParseMethodDescriptor(const char *s, Region &r);
+JType ParseFieldDescriptor(const char *s);
+MethodType ParseMethodDescriptor(const char *s, Region &r); // ArgTypes is allocated in r
+
+// One field type, or the return type, of a descriptor
+struct DescriptorToken {
+    uint16_t Start;  // offset of the first '[', or of the type letter
+    uint16_t Length;
+    uint8_t Dims;    // leading '['s
+    char Kind;       // letter after the '['s: BCDFIJSZ, L, or V for a void return
+};
+
+// Splits a method descriptor into its argument types and, last, its return type, finding every
+// '[' and ';' in one vectorized pass. Stores at most cap tokens and returns how many there are, or
+// -1 if the descriptor is malformed.
+int TokenizeMethodDescriptor(const char *s, size_t len, DescriptorToken *out, int cap);
+// the type of a token of s, 0 for a void return
+JType DescriptorTokenType(const char *s, const DescriptorToken &t);
+
+// "java/lang/String" -> "java/lang" and "String". The package of a class in the unnamed package is
+// empty. Both views point into name.
+struct ClassNameParts {
+    std::string_view Package;
+    std::string_view SimpleName;
+};
 
-JType ElemType(JType);
-const char *ClassName(JType);
+ClassNameParts SplitClassName(std::string_view name);
+bool SamePackage(std::string_view a, std::string_view b);
 
-inline uintptr_t
+// the id of a class type, interning the name on first use; safe to call from any thread
+JType ClassType(std::string_view name);
+// throws InvalidDescriptor past MAX_ARRAY_DIMS
+JType ArrayOf(JType elem);
+
+inline uint32_t
 JTypeKind(JType t)
 {
     assert(t);
-    if (t&1) return t;
-    if (t&2) return ARRAY;
+    if (t >> JTYPE_DIMS_SHIFT) return ARRAY;
+    if (t < FIRST_CLASS_ID) return t;
     return OBJECT;
 }
 
-inline JType
-ElemType(JType t)
+inline int
+ArrayDims(JType t)
 {
-    return ((ObjectType)(t&-4))->elem_type;
+    return (int) (t >> JTYPE_DIMS_SHIFT);
 }
 
-inline const char *
-ClassName(JType t)
+inline JType
+ElemType(JType t)
 {
-    return ((ObjectType)t)->class_name;
+    assert(ArrayDims(t));
+    return t - (1u << JTYPE_DIMS_SHIFT);
 }
 
+// the name of a class type; lives as long as the process
+const char *ClassName(JType t);
+
 void PP_JType(Buf *, JType);
 void PP_JType_opt(Buf *b, JType);
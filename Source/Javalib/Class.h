@@ -1,5 +1,7 @@
 /* High-level representation of Java class file */
 
+#pragma once
+
 struct Attribute {
     const char *Name;
     int Length; // of Info[]
@@ -0,0 +1,48 @@
+#include "Util/u.h"
+#include "Javalib/Opcodes.h"
+
+const OpcodeInfo OpcodeTable[256] = {
+#define X(id, name, len, flags) { #name, len, flags },
+    JVM_OPCODES(X)
+#undef X
+};
+
+static int32_t
+get_s4(const uint8_t *p) {
+    return (int32_t)((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+}
+
+int
+InsnLength(const uint8_t* code, int pc, int code_length) {
+    int op = code[pc];
+    const OpcodeInfo& info = OpcodeTable[op];
+    if (!info.Name) throw InvalidBytecode();
+    int len = info.Length;
+    if (!len) {
+        switch (op) {
+        case OP_WIDE:
+            if (pc + 1 >= code_length) throw InvalidBytecode();
+            len = code[pc+1] == OP_IINC ? 6 : 4;
+            break;
+        case OP_TABLESWITCH:
+        case OP_LOOKUPSWITCH: {
+            int base = (pc + 4) & -4; // skip 0-3 bytes of padding
+            if (base + 12 > code_length) throw InvalidBytecode();
+            if (op == OP_TABLESWITCH) {
+                int64_t n = (int64_t)get_s4(code + base + 8) - get_s4(code + base + 4) + 1;
+                if (n < 0 || n > code_length) throw InvalidBytecode();
+                len = base - pc + 12 + (int)n * 4;
+            } else {
+                int32_t n = get_s4(code + base + 4);
+                if (n < 0 || n > code_length) throw InvalidBytecode();
+                len = base - pc + 8 + n * 8;
+            }
+        }
+        break;
+        default:
+            unreachable();
+        }
+    }
+    if (len > code_length - pc) throw InvalidBytecode();
+    return len;
+}
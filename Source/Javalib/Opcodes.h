@@ -0,0 +1,245 @@
+/* JVM instruction set */
+
+#pragma once
+
+#include <stdint.h>
+#include <exception>
+
+/* X(ID, mnemonic, length, flags); length 0 = variable (tableswitch, lookupswitch, wide) */
+#define JVM_OPCODES(X) \
+    X(NOP, nop, 1, 0) \
+    X(ACONST_NULL, aconst_null, 1, 0) \
+    X(ICONST_M1, iconst_m1, 1, 0) \
+    X(ICONST_0, iconst_0, 1, 0) \
+    X(ICONST_1, iconst_1, 1, 0) \
+    X(ICONST_2, iconst_2, 1, 0) \
+    X(ICONST_3, iconst_3, 1, 0) \
+    X(ICONST_4, iconst_4, 1, 0) \
+    X(ICONST_5, iconst_5, 1, 0) \
+    X(LCONST_0, lconst_0, 1, 0) \
+    X(LCONST_1, lconst_1, 1, 0) \
+    X(FCONST_0, fconst_0, 1, 0) \
+    X(FCONST_1, fconst_1, 1, 0) \
+    X(FCONST_2, fconst_2, 1, 0) \
+    X(DCONST_0, dconst_0, 1, 0) \
+    X(DCONST_1, dconst_1, 1, 0) \
+    X(BIPUSH, bipush, 2, 0) \
+    X(SIPUSH, sipush, 3, 0) \
+    X(LDC, ldc, 2, OPF_CP1) \
+    X(LDC_W, ldc_w, 3, OPF_CP2) \
+    X(LDC2_W, ldc2_w, 3, OPF_CP2) \
+    X(ILOAD, iload, 2, OPF_LOCAL) \
+    X(LLOAD, lload, 2, OPF_LOCAL) \
+    X(FLOAD, fload, 2, OPF_LOCAL) \
+    X(DLOAD, dload, 2, OPF_LOCAL) \
+    X(ALOAD, aload, 2, OPF_LOCAL) \
+    X(ILOAD_0, iload_0, 1, 0) \
+    X(ILOAD_1, iload_1, 1, 0) \
+    X(ILOAD_2, iload_2, 1, 0) \
+    X(ILOAD_3, iload_3, 1, 0) \
+    X(LLOAD_0, lload_0, 1, 0) \
+    X(LLOAD_1, lload_1, 1, 0) \
+    X(LLOAD_2, lload_2, 1, 0) \
+    X(LLOAD_3, lload_3, 1, 0) \
+    X(FLOAD_0, fload_0, 1, 0) \
+    X(FLOAD_1, fload_1, 1, 0) \
+    X(FLOAD_2, fload_2, 1, 0) \
+    X(FLOAD_3, fload_3, 1, 0) \
+    X(DLOAD_0, dload_0, 1, 0) \
+    X(DLOAD_1, dload_1, 1, 0) \
+    X(DLOAD_2, dload_2, 1, 0) \
+    X(DLOAD_3, dload_3, 1, 0) \
+    X(ALOAD_0, aload_0, 1, 0) \
+    X(ALOAD_1, aload_1, 1, 0) \
+    X(ALOAD_2, aload_2, 1, 0) \
+    X(ALOAD_3, aload_3, 1, 0) \
+    X(IALOAD, iaload, 1, 0) \
+    X(LALOAD, laload, 1, 0) \
+    X(FALOAD, faload, 1, 0) \
+    X(DALOAD, daload, 1, 0) \
+    X(AALOAD, aaload, 1, 0) \
+    X(BALOAD, baload, 1, 0) \
+    X(CALOAD, caload, 1, 0) \
+    X(SALOAD, saload, 1, 0) \
+    X(ISTORE, istore, 2, OPF_LOCAL) \
+    X(LSTORE, lstore, 2, OPF_LOCAL) \
+    X(FSTORE, fstore, 2, OPF_LOCAL) \
+    X(DSTORE, dstore, 2, OPF_LOCAL) \
+    X(ASTORE, astore, 2, OPF_LOCAL) \
+    X(ISTORE_0, istore_0, 1, 0) \
+    X(ISTORE_1, istore_1, 1, 0) \
+    X(ISTORE_2, istore_2, 1, 0) \
+    X(ISTORE_3, istore_3, 1, 0) \
+    X(LSTORE_0, lstore_0, 1, 0) \
+    X(LSTORE_1, lstore_1, 1, 0) \
+    X(LSTORE_2, lstore_2, 1, 0) \
+    X(LSTORE_3, lstore_3, 1, 0) \
+    X(FSTORE_0, fstore_0, 1, 0) \
+    X(FSTORE_1, fstore_1, 1, 0) \
+    X(FSTORE_2, fstore_2, 1, 0) \
+    X(FSTORE_3, fstore_3, 1, 0) \
+    X(DSTORE_0, dstore_0, 1, 0) \
+    X(DSTORE_1, dstore_1, 1, 0) \
+    X(DSTORE_2, dstore_2, 1, 0) \
+    X(DSTORE_3, dstore_3, 1, 0) \
+    X(ASTORE_0, astore_0, 1, 0) \
+    X(ASTORE_1, astore_1, 1, 0) \
+    X(ASTORE_2, astore_2, 1, 0) \
+    X(ASTORE_3, astore_3, 1, 0) \
+    X(IASTORE, iastore, 1, 0) \
+    X(LASTORE, lastore, 1, 0) \
+    X(FASTORE, fastore, 1, 0) \
+    X(DASTORE, dastore, 1, 0) \
+    X(AASTORE, aastore, 1, 0) \
+    X(BASTORE, bastore, 1, 0) \
+    X(CASTORE, castore, 1, 0) \
+    X(SASTORE, sastore, 1, 0) \
+    X(POP, pop, 1, 0) \
+    X(POP2, pop2, 1, 0) \
+    X(DUP, dup, 1, 0) \
+    X(DUP_X1, dup_x1, 1, 0) \
+    X(DUP_X2, dup_x2, 1, 0) \
+    X(DUP2, dup2, 1, 0) \
+    X(DUP2_X1, dup2_x1, 1, 0) \
+    X(DUP2_X2, dup2_x2, 1, 0) \
+    X(SWAP, swap, 1, 0) \
+    X(IADD, iadd, 1, 0) \
+    X(LADD, ladd, 1, 0) \
+    X(FADD, fadd, 1, 0) \
+    X(DADD, dadd, 1, 0) \
+    X(ISUB, isub, 1, 0) \
+    X(LSUB, lsub, 1, 0) \
+    X(FSUB, fsub, 1, 0) \
+    X(DSUB, dsub, 1, 0) \
+    X(IMUL, imul, 1, 0) \
+    X(LMUL, lmul, 1, 0) \
+    X(FMUL, fmul, 1, 0) \
+    X(DMUL, dmul, 1, 0) \
+    X(IDIV, idiv, 1, 0) \
+    X(LDIV, ldiv, 1, 0) \
+    X(FDIV, fdiv, 1, 0) \
+    X(DDIV, ddiv, 1, 0) \
+    X(IREM, irem, 1, 0) \
+    X(LREM, lrem, 1, 0) \
+    X(FREM, frem, 1, 0) \
+    X(DREM, drem, 1, 0) \
+    X(INEG, ineg, 1, 0) \
+    X(LNEG, lneg, 1, 0) \
+    X(FNEG, fneg, 1, 0) \
+    X(DNEG, dneg, 1, 0) \
+    X(ISHL, ishl, 1, 0) \
+    X(LSHL, lshl, 1, 0) \
+    X(ISHR, ishr, 1, 0) \
+    X(LSHR, lshr, 1, 0) \
+    X(IUSHR, iushr, 1, 0) \
+    X(LUSHR, lushr, 1, 0) \
+    X(IAND, iand, 1, 0) \
+    X(LAND, land, 1, 0) \
+    X(IOR, ior, 1, 0) \
+    X(LOR, lor, 1, 0) \
+    X(IXOR, ixor, 1, 0) \
+    X(LXOR, lxor, 1, 0) \
+    X(IINC, iinc, 3, OPF_LOCAL) \
+    X(I2L, i2l, 1, 0) \
+    X(I2F, i2f, 1, 0) \
+    X(I2D, i2d, 1, 0) \
+    X(L2I, l2i, 1, 0) \
+    X(L2F, l2f, 1, 0) \
+    X(L2D, l2d, 1, 0) \
+    X(F2I, f2i, 1, 0) \
+    X(F2L, f2l, 1, 0) \
+    X(F2D, f2d, 1, 0) \
+    X(D2I, d2i, 1, 0) \
+    X(D2L, d2l, 1, 0) \
+    X(D2F, d2f, 1, 0) \
+    X(I2B, i2b, 1, 0) \
+    X(I2C, i2c, 1, 0) \
+    X(I2S, i2s, 1, 0) \
+    X(LCMP, lcmp, 1, 0) \
+    X(FCMPL, fcmpl, 1, 0) \
+    X(FCMPG, fcmpg, 1, 0) \
+    X(DCMPL, dcmpl, 1, 0) \
+    X(DCMPG, dcmpg, 1, 0) \
+    X(IFEQ, ifeq, 3, OPF_BRANCH) \
+    X(IFNE, ifne, 3, OPF_BRANCH) \
+    X(IFLT, iflt, 3, OPF_BRANCH) \
+    X(IFGE, ifge, 3, OPF_BRANCH) \
+    X(IFGT, ifgt, 3, OPF_BRANCH) \
+    X(IFLE, ifle, 3, OPF_BRANCH) \
+    X(IF_ICMPEQ, if_icmpeq, 3, OPF_BRANCH) \
+    X(IF_ICMPNE, if_icmpne, 3, OPF_BRANCH) \
+    X(IF_ICMPLT, if_icmplt, 3, OPF_BRANCH) \
+    X(IF_ICMPGE, if_icmpge, 3, OPF_BRANCH) \
+    X(IF_ICMPGT, if_icmpgt, 3, OPF_BRANCH) \
+    X(IF_ICMPLE, if_icmple, 3, OPF_BRANCH) \
+    X(IF_ACMPEQ, if_acmpeq, 3, OPF_BRANCH) \
+    X(IF_ACMPNE, if_acmpne, 3, OPF_BRANCH) \
+    X(GOTO, goto, 3, OPF_BRANCH | OPF_END) \
+    X(JSR, jsr, 3, OPF_BRANCH) \
+    X(RET, ret, 2, OPF_LOCAL | OPF_END) \
+    X(TABLESWITCH, tableswitch, 0, OPF_SWITCH | OPF_END) \
+    X(LOOKUPSWITCH, lookupswitch, 0, OPF_SWITCH | OPF_END) \
+    X(IRETURN, ireturn, 1, OPF_END) \
+    X(LRETURN, lreturn, 1, OPF_END) \
+    X(FRETURN, freturn, 1, OPF_END) \
+    X(DRETURN, dreturn, 1, OPF_END) \
+    X(ARETURN, areturn, 1, OPF_END) \
+    X(RETURN, return, 1, OPF_END) \
+    X(GETSTATIC, getstatic, 3, OPF_CP2) \
+    X(PUTSTATIC, putstatic, 3, OPF_CP2) \
+    X(GETFIELD, getfield, 3, OPF_CP2) \
+    X(PUTFIELD, putfield, 3, OPF_CP2) \
+    X(INVOKEVIRTUAL, invokevirtual, 3, OPF_CP2) \
+    X(INVOKESPECIAL, invokespecial, 3, OPF_CP2) \
+    X(INVOKESTATIC, invokestatic, 3, OPF_CP2) \
+    X(INVOKEINTERFACE, invokeinterface, 5, OPF_CP2) \
+    X(INVOKEDYNAMIC, invokedynamic, 5, OPF_CP2) \
+    X(NEW, new, 3, OPF_CP2) \
+    X(NEWARRAY, newarray, 2, 0) \
+    X(ANEWARRAY, anewarray, 3, OPF_CP2) \
+    X(ARRAYLENGTH, arraylength, 1, 0) \
+    X(ATHROW, athrow, 1, OPF_END) \
+    X(CHECKCAST, checkcast, 3, OPF_CP2) \
+    X(INSTANCEOF, instanceof, 3, OPF_CP2) \
+    X(MONITORENTER, monitorenter, 1, 0) \
+    X(MONITOREXIT, monitorexit, 1, 0) \
+    X(WIDE, wide, 0, 0) \
+    X(MULTIANEWARRAY, multianewarray, 4, OPF_CP2) \
+    X(IFNULL, ifnull, 3, OPF_BRANCH) \
+    X(IFNONNULL, ifnonnull, 3, OPF_BRANCH) \
+    X(GOTO_W, goto_w, 5, OPF_BRANCH_W | OPF_END) \
+    X(JSR_W, jsr_w, 5, OPF_BRANCH_W)
+
+enum {
+    OPF_CP1 = 1,       // u1 constant pool index follows the opcode (ldc)
+    OPF_CP2 = 2,       // u2 constant pool index follows the opcode
+    OPF_LOCAL = 4,     // local variable index follows the opcode (widened by `wide')
+    OPF_BRANCH = 8,    // s2 branch offset follows the opcode
+    OPF_BRANCH_W = 16, // s4 branch offset follows the opcode
+    OPF_SWITCH = 32,   // tableswitch or lookupswitch
+    OPF_END = 64,      // control never falls through to the next instruction
+};
+
+enum Opcode : uint8_t {
+#define X(id, name, len, flags) OP_##id,
+    JVM_OPCODES(X)
+#undef X
+    OP_LAST = OP_JSR_W
+};
+
+struct OpcodeInfo {
+    const char *Name; // NULL = undefined opcode
+    int Length;
+    int Flags;
+};
+
+extern const OpcodeInfo OpcodeTable[256];
+
+struct InvalidBytecode : public std::exception {
+    const char *what() const noexcept {
+        return "invalid bytecode";
+    }
+};
+
+/* length of the instruction at code[pc], throws InvalidBytecode if it is malformed or truncated */
+int InsnLength(const uint8_t *code, int pc, int code_length);
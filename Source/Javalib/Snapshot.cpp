@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "Util/mapfile.h"
+#include "Javalib/Snapshot.h"
+
+static const char snap_magic[4] = {'J', 'O', 'S', 2};
+
+namespace {
+    void member_types(const Field& f, std::vector<JType>& v) { v.assign(1, f.Type); }
+
+    void member_types(const Method& m, std::vector<JType>& v) {
+        v.assign(1, m.Type.ReturnType_opt);
+        v.insert(v.end(), m.Type.ArgTypes, m.Type.ArgTypes + m.Type.NumArg);
+    }
+
+    // Strings go right after the header, so they are interned in a first pass; the second pass lays out
+    // the structures behind them.
+    class SnapshotBuilder {
+    public:
+        void Intern(const char* s) {
+            if (Seen.emplace(s, (uint32_t) Strings.size()).second) {
+                Strings.append(s);
+                Strings.push_back(0);
+            }
+        }
+
+        void InternClass(const Class* c) {
+            Intern(c->ThisClass);
+            if (c->SuperClass_opt) Intern(c->SuperClass_opt);
+            for (int i = 0; i < c->InterfaceCount; i++) Intern(c->Interfaces[i]);
+            for (int i = 0; i < c->FieldCount; i++) InternMember(c->Fields[i]);
+            for (int i = 0; i < c->MethodCount; i++) InternMember(c->Methods[i]);
+            InternAttributes(c->AttributeCount, c->Attributes);
+        }
+
+        void StartData() {
+            StringsBase = sizeof(SnapHeader);
+            Fit(StringsBase + Strings.size());
+            Data.resize(StringsBase + Strings.size());
+            memcpy(&Data[StringsBase], Strings.data(), Strings.size());
+        }
+
+        uint32_t Str(const char* s) const { return StringsBase + Seen.at(s); }
+
+        // offset of room for n T's
+        template <class T>
+        uint32_t Reserve(size_t n) {
+            size_t off = (Data.size() + alignof(T) - 1) & -alignof(T);
+            Fit(off + n * sizeof(T));
+            Data.resize(off + n * sizeof(T));
+            return (uint32_t) off;
+        }
+
+        template <class T>
+        void Put(uint32_t off, const T& v) { memcpy(&Data[off], &v, sizeof v); }
+
+        uint32_t Attributes(int n, const Attribute* a) {
+            uint32_t off = Reserve<SnapAttribute>(n);
+            for (int i = 0; i < n; i++) {
+                uint32_t info = Reserve<uint8_t>(a[i].Length);
+                memcpy(&Data[info], a[i].Info, a[i].Length);
+                Put(off + i * sizeof(SnapAttribute), SnapAttribute{Str(a[i].Name), (uint32_t) a[i].Length, info});
+            }
+            return off;
+        }
+
+        template <class M>
+        uint32_t Members(int n, const M* m) {
+            uint32_t off = Reserve<SnapMember>(n);
+            std::vector<JType> types;
+            for (int i = 0; i < n; i++) {
+                member_types(m[i], types);
+                SnapMember sm{m[i].AccessFlags, 0, Str(m[i].Name), Str(m[i].Desc), (uint32_t) m[i].AttributeCount,
+                              Attributes(m[i].AttributeCount, m[i].Attributes), (uint32_t) types.size(),
+                              Reserve<uint32_t>(types.size())};
+                for (size_t j = 0; j < types.size(); j++) Put(sm.Types + j * sizeof(uint32_t), Type(types[j]));
+                Put(off + i * sizeof(SnapMember), sm);
+            }
+            return off;
+        }
+
+        uint32_t TypeNames() {
+            uint32_t off = Reserve<uint32_t>(ClassTypes.size());
+            for (size_t i = 0; i < ClassTypes.size(); i++) {
+                Put(off + i * sizeof(uint32_t), Str(ClassName(ClassTypes[i])));
+            }
+            return off;
+        }
+
+        std::string Strings;
+        std::vector<std::byte> Data;
+        std::vector<JType> ClassTypes; // process ids of the class elements, by snapshot index
+
+    private:
+        template <class M>
+        void InternMember(const M& m) {
+            Intern(m.Name);
+            Intern(m.Desc);
+            InternAttributes(m.AttributeCount, m.Attributes);
+            std::vector<JType> types;
+            member_types(m, types);
+            for (JType t : types) {
+                JType elem = t & JTYPE_ELEM_MASK;
+                if (elem >= FIRST_CLASS_ID && ClassIndex.emplace(elem, (uint32_t) ClassTypes.size()).second) {
+                    ClassTypes.push_back(elem);
+                    Intern(ClassName(elem));
+                }
+            }
+        }
+
+        // offsets are 32 bits
+        static void Fit(size_t size) {
+            if (size > UINT32_MAX) throw std::length_error("snapshot larger than 4 GiB");
+        }
+
+        // process id to snapshot id
+        uint32_t Type(JType t) const {
+            JType elem = t & JTYPE_ELEM_MASK;
+            if (elem < FIRST_CLASS_ID) return t;
+            return (t & ~JTYPE_ELEM_MASK) | (FIRST_CLASS_ID + ClassIndex.at(elem));
+        }
+
+        void InternAttributes(int n, const Attribute* a) {
+            for (int i = 0; i < n; i++) Intern(a[i].Name);
+        }
+
+        std::unordered_map<std::string, uint32_t> Seen;
+        std::unordered_map<JType, uint32_t> ClassIndex;
+        uint32_t StringsBase = 0;
+    };
+}
+
+void
+WriteSnapshot(const std::vector<const Class*>& classes, std::vector<std::byte>& out) {
+    SnapshotBuilder b;
+    for (auto c : classes) b.InternClass(c);
+    b.StartData();
+
+    uint32_t n = (uint32_t) classes.size();
+    uint32_t classes_off = b.Reserve<SnapClass>(n);
+    for (uint32_t i = 0; i < n; i++) {
+        const Class* c = classes[i];
+        SnapClass sc{};
+        sc.MinorVersion = c->MinorVersion;
+        sc.MajorVersion = c->MajorVersion;
+        sc.AccessFlags = c->AccessFlags;
+        sc.ThisClass = b.Str(c->ThisClass);
+        sc.SuperClass_opt = c->SuperClass_opt ? b.Str(c->SuperClass_opt) : 0;
+        sc.InterfaceCount = c->InterfaceCount;
+        sc.Interfaces = b.Reserve<uint32_t>(c->InterfaceCount);
+        for (int j = 0; j < c->InterfaceCount; j++) {
+            b.Put(sc.Interfaces + j * sizeof(uint32_t), b.Str(c->Interfaces[j]));
+        }
+        sc.FieldCount = c->FieldCount;
+        sc.Fields = b.Members(c->FieldCount, c->Fields);
+        sc.MethodCount = c->MethodCount;
+        sc.Methods = b.Members(c->MethodCount, c->Methods);
+        sc.AttributeCount = c->AttributeCount;
+        sc.Attributes = b.Attributes(c->AttributeCount, c->Attributes);
+        b.Put(classes_off + i * sizeof(SnapClass), sc);
+    }
+
+    std::vector<uint32_t> by_name(n);
+    for (uint32_t i = 0; i < n; i++) by_name[i] = i;
+    std::sort(by_name.begin(), by_name.end(), [&](uint32_t x, uint32_t y) {
+        return strcmp(classes[x]->ThisClass, classes[y]->ThisClass) < 0;
+    });
+    uint32_t by_name_off = b.Reserve<uint32_t>(n);
+    memcpy(&b.Data[by_name_off], by_name.data(), n * sizeof(uint32_t));
+    uint32_t type_names_off = b.TypeNames();
+
+    SnapHeader h;
+    memcpy(h.Magic, snap_magic, sizeof h.Magic);
+    h.ByteOrder = SNAP_BYTE_ORDER;
+    h.Size = (uint32_t) b.Data.size();
+    h.ClassCount = n;
+    h.Classes = classes_off;
+    h.ByName = by_name_off;
+    h.Strings = sizeof(SnapHeader);
+    h.StringsSize = (uint32_t) b.Strings.size();
+    h.TypeNameCount = (uint32_t) b.ClassTypes.size();
+    h.TypeNames = type_names_off;
+    b.Put(0, h);
+    out.swap(b.Data);
+}
+
+Snapshot::~Snapshot() {
+    if (Base) unmap_file(Base, Size);
+}
+
+void
+Snapshot::Open(const char* path) {
+    Base = (const char*) map_file(path, &Size);
+    if (!Base) throw InvalidSnapshot();
+    const SnapHeader* h = Header();
+    if (Size < sizeof *h || memcmp(h->Magic, snap_magic, sizeof h->Magic) || h->ByteOrder != SNAP_BYTE_ORDER ||
+        h->Size != Size || h->StringsSize == 0 || (uint64_t) h->Strings + h->StringsSize > Size ||
+        Base[h->Strings + h->StringsSize - 1]) {
+        throw InvalidSnapshot();
+    }
+    At<SnapClass>(h->Classes, h->ClassCount);
+    At<uint32_t>(h->ByName, h->ClassCount);
+    const uint32_t* names = At<uint32_t>(h->TypeNames, h->TypeNameCount);
+    if (h->TypeNameCount > JTYPE_ELEM_MASK - FIRST_CLASS_ID) throw InvalidSnapshot();
+    ClassTypes.resize(h->TypeNameCount);
+    for (uint32_t i = 0; i < h->TypeNameCount; i++) ClassTypes[i] = ClassType(Str(names[i]));
+}
+
+JType
+Snapshot::Type(uint32_t t) const {
+    JType elem = t & JTYPE_ELEM_MASK;
+    if (elem >= FIRST_CLASS_ID) {
+        if (elem - FIRST_CLASS_ID >= ClassTypes.size()) throw InvalidSnapshot();
+        return (t & ~JTYPE_ELEM_MASK) | ClassTypes[elem - FIRST_CLASS_ID];
+    }
+    if (!(elem & 1)) throw InvalidSnapshot(); // not a basic type
+    return t;
+}
+
+const char*
+Snapshot::Str(uint32_t off) const {
+    const SnapHeader* h = Header();
+    if (off < h->Strings || off >= h->Strings + h->StringsSize) throw InvalidSnapshot();
+    return Base + off;
+}
+
+const SnapClass&
+Snapshot::ClassAt(int i) const {
+    assert(i >= 0 && i < ClassCount());
+    return At<SnapClass>(Header()->Classes, Header()->ClassCount)[i];
+}
+
+int
+Snapshot::Find(const char* name) const {
+    const uint32_t* by_name = At<uint32_t>(Header()->ByName, Header()->ClassCount);
+    int lo = 0, hi = ClassCount();
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (by_name[mid] >= Header()->ClassCount) throw InvalidSnapshot();
+        int cmp = strcmp(name, Str(ClassAt(by_name[mid]).ThisClass));
+        if (!cmp) return by_name[mid];
+        if (cmp < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+static Attribute*
+load_attributes(const Snapshot& s, uint32_t n, uint32_t off, Region& r) {
+    const SnapAttribute* sa = s.At<SnapAttribute>(off, n);
+    Attribute* a = new(r) Attribute[n];
+    for (uint32_t i = 0; i < n; i++) {
+        a[i].Name = s.Str(sa[i].Name);
+        a[i].Length = sa[i].Length;
+        a[i].Info = (uint8_t*) s.At<uint8_t>(sa[i].Info, sa[i].Length); // read-only mapping
+    }
+    return a;
+}
+
+Class*
+Snapshot::Load(int i, Region& r) const {
+    const SnapClass& sc = ClassAt(i);
+    auto jc = new(r) Class;
+    jc->MinorVersion = sc.MinorVersion;
+    jc->MajorVersion = sc.MajorVersion;
+    jc->AccessFlags = sc.AccessFlags;
+    jc->ThisClass = Str(sc.ThisClass);
+    jc->SuperClass_opt = sc.SuperClass_opt ? Str(sc.SuperClass_opt) : nullptr;
+    int n = jc->InterfaceCount = sc.InterfaceCount;
+    const uint32_t* interfaces = At<uint32_t>(sc.Interfaces, n);
+    jc->Interfaces = new(r) const char*[n];
+    for (int j = 0; j < n; j++) jc->Interfaces[j] = Str(interfaces[j]);
+
+    n = jc->FieldCount = sc.FieldCount;
+    const SnapMember* sm = At<SnapMember>(sc.Fields, n);
+    jc->Fields = new(r) Field[n];
+    for (int j = 0; j < n; j++) {
+        Field& f = jc->Fields[j];
+        f.AccessFlags = sm[j].AccessFlags;
+        f.Name = Str(sm[j].Name);
+        f.Desc = Str(sm[j].Desc);
+        if (sm[j].TypeCount != 1) throw InvalidSnapshot();
+        f.Type = Type(*At<uint32_t>(sm[j].Types, 1));
+        f.AttributeCount = sm[j].AttributeCount;
+        f.Attributes = load_attributes(*this, sm[j].AttributeCount, sm[j].Attributes, r);
+    }
+
+    n = jc->MethodCount = sc.MethodCount;
+    sm = At<SnapMember>(sc.Methods, n);
+    jc->Methods = new(r) Method[n];
+    for (int j = 0; j < n; j++) {
+        Method& m = jc->Methods[j];
+        m.AccessFlags = sm[j].AccessFlags;
+        m.Name = Str(sm[j].Name);
+        m.Desc = Str(sm[j].Desc);
+        if (sm[j].TypeCount == 0) throw InvalidSnapshot();
+        const uint32_t* types = At<uint32_t>(sm[j].Types, sm[j].TypeCount);
+        m.Type.ReturnType_opt = types[0] ? Type(types[0]) : 0;
+        m.Type.NumArg = sm[j].TypeCount - 1;
+        m.Type.ArgTypes = m.Type.NumArg ? new(r) JType[m.Type.NumArg] : nullptr;
+        for (int k = 0; k < m.Type.NumArg; k++) m.Type.ArgTypes[k] = Type(types[k + 1]);
+        m.AttributeCount = sm[j].AttributeCount;
+        m.Attributes = load_attributes(*this, sm[j].AttributeCount, sm[j].Attributes, r);
+    }
+
+    jc->AttributeCount = sc.AttributeCount;
+    jc->Attributes = load_attributes(*this, sc.AttributeCount, sc.Attributes, r);
+    return jc;
+}
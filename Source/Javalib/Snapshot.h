@@ -0,0 +1,113 @@
+/*
+ * Snapshot: relocatable on-disk image of converted classes, mapped read-only.
+ *
+ * Every reference is a byte offset from the start of the file, so the image works wherever it is
+ * mapped. Strings are NUL-terminated and shared between classes. Types are stored as JType ids whose
+ * class elements index the snapshot's own table of class names; opening the snapshot maps that table
+ * to the process's ids, so loading a class parses no descriptors.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <exception>
+#include <vector>
+#include "Util/u.h"
+#include "Javalib/Basic.h"
+#include "Javalib/Class.h"
+
+struct SnapAttribute {
+    uint32_t Name;
+    uint32_t Length;
+    uint32_t Info;
+};
+
+struct SnapMember { // field or method
+    uint16_t AccessFlags;
+    uint16_t Pad;
+    uint32_t Name;
+    uint32_t Desc;
+    uint32_t AttributeCount;
+    uint32_t Attributes; // SnapAttribute[]
+    uint32_t TypeCount;
+    uint32_t Types; // JType[] in snapshot ids: a field's type, or a method's return type (0 = void)
+                    // followed by its argument types
+};
+
+struct SnapClass {
+    uint16_t MinorVersion;
+    uint16_t MajorVersion;
+    uint16_t AccessFlags;
+    uint16_t Pad;
+    uint32_t ThisClass;
+    uint32_t SuperClass_opt; // 0 = none
+    uint32_t InterfaceCount;
+    uint32_t Interfaces; // uint32_t[] of string offsets
+    uint32_t FieldCount;
+    uint32_t Fields; // SnapMember[]
+    uint32_t MethodCount;
+    uint32_t Methods; // SnapMember[]
+    uint32_t AttributeCount;
+    uint32_t Attributes; // SnapAttribute[]
+};
+
+struct SnapHeader {
+    char Magic[4];
+    uint32_t ByteOrder; // SNAP_BYTE_ORDER as written by the producing host
+    uint32_t Size;
+    uint32_t ClassCount;
+    uint32_t Classes; // SnapClass[]
+    uint32_t ByName;  // uint32_t[] of class indices, sorted by ThisClass
+    uint32_t Strings;
+    uint32_t StringsSize;
+    uint32_t TypeNameCount;
+    uint32_t TypeNames; // uint32_t[] of string offsets; class element FIRST_CLASS_ID + i is TypeNames[i]
+};
+
+constexpr uint32_t SNAP_BYTE_ORDER = 0x01020304;
+
+struct InvalidSnapshot : public std::exception {
+    const char *what() const noexcept {
+        return "invalid snapshot";
+    }
+};
+
+// throws std::length_error if the image would not fit its 32-bit offsets (4 GiB)
+void WriteSnapshot(const std::vector<const Class *> &classes, std::vector<std::byte> &out);
+
+class Snapshot {
+public:
+    Snapshot() = default;
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    ~Snapshot();
+
+    // throws InvalidSnapshot if the file cannot be mapped or was not written by a compatible host
+    void Open(const char *path);
+
+    int ClassCount() const { return Header()->ClassCount; }
+    const SnapClass &ClassAt(int i) const;
+    int Find(const char *name) const; // -1 if absent; throws InvalidSnapshot for a bad name index
+    const char *Str(uint32_t off) const;
+    // bounds-checked array of n T's at off
+    template <class T>
+    const T *At(uint32_t off, uint32_t n) const
+    {
+        if (off % alignof(T) || (uint64_t) off + (uint64_t) n * sizeof(T) > Size) throw InvalidSnapshot();
+        return (const T *) (Base + off);
+    }
+
+    // A Class whose strings and attribute bytes point into the mapping; only the arrays and parsed
+    // types are allocated in r. Valid while the snapshot stays open.
+    Class *Load(int i, Region &r) const;
+
+private:
+    const SnapHeader *Header() const { return (const SnapHeader *) Base; }
+    JType Type(uint32_t t) const; // snapshot id to process id
+
+    std::vector<JType> ClassTypes; // by TypeNames index
+
+    const char *Base = nullptr;
+    size_t Size = 0;
+};
@@ -0,0 +1,790 @@
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <string>
+#include <system_error>
+#include "Util/u.h"
+#include "Util/hash.h"
+#include "Util/WorkPool.h"
+#include "Parse/Parser.h"
+#include "Parse/Writer.h"
+#include "Parse/CpRefs.h"
+#include "Javalib/Basic.h"
+#include "Javalib/Class.h"
+#include "Javalib/Snapshot.h"
+#include "Parse/Convert.h"
+#include "Patch/CompactPool.h"
+#include "Patch/StripAttributes.h"
+#include "Patch/RemoveMembers.h"
+#include "Patch/ScalarReplace.h"
+#include "Patch/StaticInit.h"
+#include "Patch/Unboxing.h"
+#include "Patch/LowerIndy.h"
+#include "Patch/Peephole.h"
+#include "Patch/Locals.h"
+#include "Patch/Layout.h"
+#include "Patch/Inline.h"
+#include "Analyze/StackMap.h"
+#include "Analyze/Reachability.h"
+#include "Analyze/Escape.h"
+#include "Analyze/ExecutionProfile.h"
+#include "Driver/Cache.h"
+#include "Driver/Profile.h"
+#include "Driver/Pipeline.h"
+#include "Driver/Ingest.h"
+
+using namespace Parse;
+
+struct Options {
+    const char* OutPath = nullptr; // -o, single input only
+    const char* OutDir = nullptr;  // -d, classes are laid out by their internal name
+    bool CompactPool = false;
+    std::vector<std::string> Strip; // attribute names
+    bool RecomputeFrames = false;
+    bool FoldClinit = false;
+    bool ScalarReplace = false;
+    bool EliminateBoxing = false;
+    bool Peephole = false;
+    bool CompactLocals = false;
+    int LayoutBudget = 0; // --layout, 0 = off
+    int InlineBudget = 0; // --inline, per class, 0 = off
+    bool LowerIndy = false;
+    bool Report = false;
+    const char* CacheDir = nullptr;
+    const char* WriteSnapshotPath = nullptr;
+    const char* SnapshotPath = nullptr; // inputs are then names of classes in the snapshot
+    bool Profile = false;
+    const char* TracePath = nullptr;
+    int Threads = 0; // 0 = one per core
+    int StageThreads[3] = {}; // read, parse, optimize; 0 = default
+    bool IoUring = false;
+    std::vector<Analyze::KeepRule> Keep; // --keep, --main; unreachable code is dropped when there are any
+    std::vector<const char*> ProfilePaths; // --use-profile
+    std::vector<const char*> Inputs;
+};
+
+// superclasses of the inputs, for --recompute-frames and the passes that rewrite code
+static Analyze::ClassHierarchy hierarchy;
+
+// what is reachable from the keep rules, and the id of every input in it (-1 if it failed to parse)
+static Analyze::Reachability reachability;
+static std::vector<int> reachability_ids;
+
+// the input classes whose objects --scalar-replace may replace by their fields
+static Analyze::ScalarClasses scalar_classes;
+
+// invocation and branch counts of --use-profile, for the passes that favor what runs most
+static Analyze::ExecutionProfile exec_profile;
+
+struct Totals {
+    long long BytesIn = 0, BytesOut = 0;
+    int Classes = 0;
+    int CacheHits = 0;
+};
+
+// an input that cannot be read throws, and is reported for that class alone
+std::vector<std::byte> slurp(const char* path) {
+    auto fp = fopen(path, "rb");
+    if (!fp) throw std::system_error(errno, std::generic_category());
+    fseek(fp, 0, SEEK_END);
+    auto len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len < 0) {
+        const int err = errno;
+        fclose(fp);
+        throw std::system_error(err, std::generic_category());
+    }
+
+    std::vector<std::byte> result(len);
+
+    auto nread = fread(result.data(), 1, len, fp);
+    fclose(fp);
+    if (nread != static_cast<size_t>(len)) throw std::system_error(EIO, std::generic_category());
+    return result;
+}
+
+void spit(const char* path, const std::vector<std::byte>& bytes) {
+    auto fp = fopen(path, "wb");
+    if (!fp || fwrite(bytes.data(), 1, bytes.size(), fp) != bytes.size()) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    fclose(fp);
+}
+
+static void
+usage() {
+    fputs("usage: JOpt [-o out.class | -d outdir] [options] class-file...\n"
+          "       JOpt --snapshot=FILE [class-name...]\n"
+          "  without -o or -d, the classes are dumped to stdout\n"
+          "  --compact-pool        drop unused and duplicate constant pool entries\n"
+          "  --strip-debug         drop LineNumberTable, LocalVariable(Type)Table, SourceDebugExtension\n"
+          "  --strip=NAME[,NAME]   drop the named attributes\n"
+          "  --recompute-frames    rebuild every StackMapTable from the types of the input classes\n"
+          "  --fold-clinit         run static initializers at build time and keep only what they set, as\n"
+          "                        ConstantValue attributes or compact array initialization\n"
+          "  --scalar-replace      keep the fields of objects that never leave the method allocating them\n"
+          "                        in locals instead\n"
+          "  --unbox               drop the boxing of primitives that are only ever unboxed again\n"
+          "  --peephole            clean up short instruction sequences and jumps to jumps in every method\n"
+          "  --compact-locals      give locals whose lifetimes do not overlap the same slot, and set max_locals\n"
+          "                        and max_stack to what each method needs\n"
+          "  --layout[=BYTES]      move the cold paths of every method to its end; outline them from methods\n"
+          "                        the profile has run whose code is longer than BYTES (325, HotSpot's\n"
+          "                        FreqInlineSize)\n"
+          "  --inline[=BYTES]      inline calls to static, private and final methods of the same class, the\n"
+          "                        code of each class growing by BYTES (2048) at most; the methods of a\n"
+          "                        class are done one after another, callees first\n"
+          "  --lower-indy          turn string concatenation call sites into StringBuilder chains, and with\n"
+          "                        -d lambda call sites into classes of their own, so they need no bootstrap\n"
+          "  --report              print the size change of every class and the total\n"
+          "  --cache=DIR           reuse the output of unchanged classes from DIR\n"
+          "  --write-snapshot=FILE save the converted classes for fast loading with --snapshot\n"
+          "  --snapshot=FILE       dump the named classes (all by default) from a snapshot\n"
+          "  --profile             print time and allocations per phase to stderr\n"
+          "  --trace=FILE          also write the phases as Chrome trace events\n"
+          "  --threads=N           split the methods of large classes over N threads (default: one per core),\n"
+          "                        unless the classes are already done side by side\n"
+          "  --stage-threads=R,P,O threads that read, parse and optimize inputs side by side\n"
+          "                        (default: 1, then half of the cores each)\n"
+          "  --io-uring            read inputs in batches through io_uring where the kernel allows it\n"
+          "  --keep=CLASS[#MEMBER] keep a class (a `*' suffix matches a prefix) or one of its members, and\n"
+          "                        drop the classes, methods and fields the kept ones cannot reach\n"
+          "  --main=CLASS          the same as --keep=CLASS#main([Ljava/lang/String;)V\n"
+          "  --use-profile=FILE    invocation and branch counts from runs of the program (see\n"
+          "                        Analyze/ExecutionProfile.h) for the passes to favor what runs most; may be\n"
+          "                        given more than once, the counts then add up\n", stderr);
+}
+
+static bool
+parse_options(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "-o") || !strcmp(arg, "-d")) {
+            if (++i == argc) return false;
+            (arg[1] == 'o' ? opts.OutPath : opts.OutDir) = argv[i];
+        }
+        else if (!strcmp(arg, "--compact-pool")) { opts.CompactPool = true; }
+        else if (!strcmp(arg, "--strip-debug")) {
+            opts.Strip.insert(opts.Strip.end(), Patch::DebugAttributes.begin(), Patch::DebugAttributes.end());
+        }
+        else if (!strncmp(arg, "--strip=", 8)) {
+            for (const char* s = arg + 8; *s;) {
+                const char* comma = strchr(s, ',');
+                size_t len = comma ? comma - s : strlen(s);
+                std::string name(s, len);
+                if (Patch::IsProtectedAttribute(name)) {
+                    fprintf(stderr, "refusing to strip %s\n", name.c_str());
+                    return false;
+                }
+                if (len) opts.Strip.push_back(std::move(name));
+                s += comma ? len + 1 : len;
+            }
+        }
+        else if (!strcmp(arg, "--recompute-frames")) { opts.RecomputeFrames = true; }
+        else if (!strcmp(arg, "--fold-clinit")) { opts.FoldClinit = true; }
+        else if (!strcmp(arg, "--scalar-replace")) { opts.ScalarReplace = true; }
+        else if (!strcmp(arg, "--unbox")) { opts.EliminateBoxing = true; }
+        else if (!strcmp(arg, "--peephole")) { opts.Peephole = true; }
+        else if (!strcmp(arg, "--compact-locals")) { opts.CompactLocals = true; }
+        else if (!strcmp(arg, "--layout")) { opts.LayoutBudget = 325; }
+        else if (!strncmp(arg, "--layout=", 9)) {
+            char* end;
+            const long n = strtol(arg + 9, &end, 10);
+            if (end == arg + 9 || *end || n < 1 || n > 65535) return false;
+            opts.LayoutBudget = static_cast<int>(n);
+        }
+        else if (!strcmp(arg, "--inline")) { opts.InlineBudget = 2048; }
+        else if (!strncmp(arg, "--inline=", 9)) {
+            char* end;
+            const long n = strtol(arg + 9, &end, 10);
+            if (end == arg + 9 || *end || n < 1 || n > 1 << 24) return false;
+            opts.InlineBudget = static_cast<int>(n);
+        }
+        else if (!strcmp(arg, "--lower-indy")) { opts.LowerIndy = true; }
+        else if (!strcmp(arg, "--report")) { opts.Report = true; }
+        else if (!strncmp(arg, "--cache=", 8) && arg[8]) { opts.CacheDir = arg + 8; }
+        else if (!strncmp(arg, "--write-snapshot=", 17) && arg[17]) { opts.WriteSnapshotPath = arg + 17; }
+        else if (!strncmp(arg, "--snapshot=", 11) && arg[11]) { opts.SnapshotPath = arg + 11; }
+        else if (!strcmp(arg, "--profile")) { opts.Profile = true; }
+        else if (!strncmp(arg, "--trace=", 8) && arg[8]) { opts.Profile = true, opts.TracePath = arg + 8; }
+        else if (!strncmp(arg, "--threads=", 10)) {
+            char* end;
+            const long n = strtol(arg + 10, &end, 10);
+            if (end == arg + 10 || *end || n < 1 || n > 1024) return false;
+            opts.Threads = static_cast<int>(n);
+        }
+        else if (!strncmp(arg, "--stage-threads=", 16)) {
+            const char* p = arg + 16;
+            for (int k = 0; k < 3; k++) {
+                char* end;
+                const long n = strtol(p, &end, 10);
+                if (end == p || n < 1 || n > 256 || *end != (k < 2 ? ',' : '\0')) return false;
+                opts.StageThreads[k] = static_cast<int>(n);
+                p = end + 1;
+            }
+        }
+        else if (!strcmp(arg, "--io-uring")) { opts.IoUring = true; }
+        else if (!strncmp(arg, "--keep=", 7) && arg[7] && arg[7] != '#') { opts.Keep.push_back(Analyze::KeepRule::Parse(arg + 7)); }
+        else if (!strncmp(arg, "--main=", 7) && arg[7]) { opts.Keep.push_back(Analyze::KeepRule::Main(arg + 7)); }
+        else if (!strncmp(arg, "--use-profile=", 14) && arg[14]) { opts.ProfilePaths.push_back(arg + 14); }
+        else if (arg[0] == '-') { return false; }
+        else { opts.Inputs.push_back(arg); }
+    }
+    if (opts.SnapshotPath) return !opts.OutPath && !opts.OutDir && !opts.WriteSnapshotPath;
+    if (opts.Inputs.empty()) return false;
+    if (opts.WriteSnapshotPath && (opts.OutPath || opts.OutDir)) return false;
+    if (opts.OutPath && (opts.OutDir || opts.Inputs.size() > 1)) return false;
+    // the cache keys a class by its own bytes, but what is reachable depends on the whole batch
+    if (!opts.Keep.empty() && (opts.CacheDir || (!opts.OutPath && !opts.OutDir))) return false;
+    return true;
+}
+
+static void
+print_class(const Class *jclass) {
+    FileBuf fb;
+    init_filebuf(&fb, stdout);
+    printf("class name: %s\n", jclass->ThisClass);
+    const char *sc = jclass->SuperClass_opt;
+    if (!sc) sc = "(none)";
+    printf("super class: %s\n", sc);
+    puts("interfaces:");
+    for (int i=0; i<jclass->InterfaceCount; i++) {
+        printf("  %s\n", jclass->Interfaces[i]);
+    }
+    puts("fields:");
+    for (int i=0; i<jclass->FieldCount; i++) {
+        const Field &f = jclass->Fields[i];
+        bputs(&fb.buf, "  ");
+        PP_JType(&fb.buf, f.Type);
+        bprintf(&fb.buf, " %s\n", f.Name);
+    }
+    puts("methods:");
+    for (int i=0; i<jclass->MethodCount; i++) {
+        const Method &m = jclass->Methods[i];
+        bputs(&fb.buf, "  ");
+        PP_JType_opt(&fb.buf, m.Type.ReturnType_opt);
+        bprintf(&fb.buf, " %s(", m.Name);
+        for (int j=0; j<m.Type.NumArg; j++) {
+            if (j) bputs(&fb.buf, ", ");
+            PP_JType(&fb.buf, m.Type.ArgTypes[j]);
+        }
+        puts(")");
+    }
+    puts("attributes:");
+    for (int i=0; i<jclass->AttributeCount; i++) {
+        const Attribute &a = jclass->Attributes[i];
+        printf("  %s\n", a.Name);
+    }
+}
+
+static const Class*
+convert(const ClassFile& class_file, Region& r, const char* path) {
+    Driver::PhaseTimer timer(Driver::Phase::Convert, path);
+    const size_t before = Driver::Profiling ? rused(&r) : 0;
+    const Class* jclass = ConvertClassFile(&class_file, r);
+    if (Driver::Profiling) Driver::RecordRegionBytes(rused(&r) - before);
+    return jclass;
+}
+
+static std::vector<std::byte>
+read_input(const char* path) {
+    Driver::PhaseTimer timer(Driver::Phase::Read, path);
+    return slurp(path);
+}
+
+static void
+parse(const std::vector<std::byte>& data, ClassFile& class_file, const char* path) {
+    Driver::PhaseTimer timer(Driver::Phase::Parse, path);
+    Parser parser {};
+    parser.ParseOnto(data, class_file);
+}
+
+static int
+dump_snapshot(const Options& opts) {
+    Snapshot snapshot;
+    snapshot.Open(opts.SnapshotPath);
+    Region r;
+    rinit(&r);
+    int status = 0;
+    if (opts.Inputs.empty()) {
+        for (int i = 0; i < snapshot.ClassCount(); i++) print_class(snapshot.Load(i, r));
+    }
+    for (const char* name : opts.Inputs) {
+        int i = snapshot.Find(name);
+        if (i < 0) {
+            fprintf(stderr, "%s: not in snapshot\n", name);
+            status = 1;
+            continue;
+        }
+        print_class(snapshot.Load(i, r));
+    }
+    rfreeall(&r);
+    return status;
+}
+
+static int
+write_snapshot(const Options& opts) {
+    Region r;
+    rinit(&r);
+    std::vector<const Class*> classes;
+    int status = 0;
+    for (const char* path : opts.Inputs) {
+        try {
+            const auto data = read_input(path);
+            ClassFile class_file {};
+            parse(data, class_file, path);
+            classes.push_back(convert(class_file, r, path));
+        } catch (const std::exception& e) {
+            fprintf(stderr, "%s: %s\n", path, e.what());
+            status = 1;
+        }
+    }
+    std::vector<std::byte> image;
+    {
+        Driver::PhaseTimer timer(Driver::Phase::Output, opts.WriteSnapshotPath);
+        WriteSnapshot(classes, image);
+        spit(opts.WriteSnapshotPath, image);
+    }
+    rfreeall(&r);
+    return status;
+}
+
+static void
+report(const char* path, long long in, long long out) {
+    long long saved = in - out;
+    printf("%s: %lld -> %lld bytes, saved %lld (%.1f%%)\n", path, in, out, saved, in ? 100.0 * saved / in : 0.0);
+}
+
+// passes that change bytecode, and so the frames of what they change
+static bool
+rewrites_code(const Options& opts) {
+    return opts.FoldClinit || opts.ScalarReplace || opts.EliminateBoxing || opts.Peephole || opts.CompactLocals ||
+           opts.LowerIndy || opts.LayoutBudget || opts.InlineBudget;
+}
+
+// every option that changes the output must be part of this
+static uint64_t
+config_hash(const Options& opts) {
+    std::string config = "JOpt 1";
+    config += opts.CompactPool ? " compact-pool" : "";
+    for (const auto& name : opts.Strip) config += " strip=" + name;
+    if (opts.RecomputeFrames) config += " recompute-frames";
+    if (opts.FoldClinit) config += " fold-clinit";
+    if (opts.ScalarReplace) config += " scalar-replace " + std::to_string(scalar_classes.Hash());
+    if (opts.EliminateBoxing) config += " unbox";
+    if (opts.Peephole) config += " peephole";
+    if (opts.CompactLocals) config += " compact-locals";
+    if (opts.LayoutBudget) config += " layout=" + std::to_string(opts.LayoutBudget);
+    if (opts.InlineBudget) config += " inline=" + std::to_string(opts.InlineBudget);
+    if (opts.LowerIndy) config += opts.OutDir ? " lower-indy lambdas" : " lower-indy";
+    return hash64(config.data(), config.size(), 0);
+}
+
+// Classes a pass generates go to generated, serialized.
+static std::vector<std::byte>
+optimize(ClassFile& class_file, const Options& opts, const char* path, Driver::GeneratedClasses& generated,
+         int reachability_id = -1) {
+    std::vector<ClassFile> lambdas;
+    {
+        Driver::PhaseTimer timer(Driver::Phase::Optimize, path);
+        if (reachability_id >= 0) {
+            Patch::RemoveMembers(class_file, reachability.KeptFields(reachability_id),
+                                 reachability.KeptMethods(reachability_id));
+        }
+        // the code the branch counts are by, before any pass moves them
+        const auto input_code = opts.InlineBudget && !exec_profile.Empty() ? Analyze::ProfiledCode(class_file)
+                                                                           : Analyze::ProfiledCode();
+        if (!opts.Strip.empty()) Patch::StripAttributes(class_file, opts.Strip);
+        // first, while branches are where the profile counted them
+        if (opts.LayoutBudget) {
+            for (const auto& fit : Patch::LayOutColdPaths(class_file, hierarchy, exec_profile, opts.LayoutBudget)) {
+                if (opts.Report) {
+                    printf("%s: %s down from %d to %d bytes, within %s\n", path, fit.Method.c_str(), fit.Before,
+                           fit.After, fit.Limit == 35 ? "MaxInlineSize" : "FreqInlineSize");
+                }
+            }
+        }
+        if (opts.FoldClinit) Patch::FoldStaticInitializer(class_file, hierarchy);
+        // lambda classes can only go to an output directory
+        if (opts.LowerIndy) Patch::LowerInvokeDynamic(class_file, hierarchy, opts.OutDir ? &lambdas : nullptr);
+        // ahead of the passes that look within a method, which then see across the calls inlined
+        if (opts.InlineBudget) Patch::InlineCalls(class_file, hierarchy, exec_profile, input_code, opts.InlineBudget);
+        if (opts.ScalarReplace) Patch::ScalarReplace(class_file, scalar_classes, hierarchy);
+        if (opts.EliminateBoxing) Patch::EliminateBoxing(class_file, hierarchy);
+        // after the passes above, which leave loads and stores for it to clean up
+        if (opts.Peephole) Patch::Peephole(class_file, hierarchy);
+        if (opts.CompactLocals) Patch::CompactLocals(class_file, hierarchy);
+        if (opts.RecomputeFrames) {
+            int kept = Analyze::RecomputeStackMaps(class_file, hierarchy);
+            if (kept) fprintf(stderr, "%s: kept the old frames of %d method%s\n", path, kept, kept == 1 ? "" : "s");
+        }
+        if (opts.CompactPool) Patch::CompactConstantPool(class_file);
+    }
+
+    Driver::PhaseTimer timer(Driver::Phase::Serialize, path);
+    std::vector<std::byte> out;
+    Writer writer {};
+    writer.WriteOnto(class_file, out);
+    for (const auto& lambda : lambdas) {
+        generated.emplace_back(std::string(ClassNameAt(lambda, lambda.ThisClass)), std::vector<std::byte>());
+        writer.WriteOnto(lambda, generated.back().second);
+    }
+    return out;
+}
+
+// the classes generated along with an input count towards its output
+static void
+emit(const char* path, const std::string& class_name, size_t in_size, const std::vector<std::byte>& out,
+     const Driver::GeneratedClasses& generated, const Options& opts, Totals& totals) {
+    size_t out_size = out.size();
+    for (const auto& g : generated) out_size += g.second.size();
+    totals.Classes++;
+    totals.BytesIn += in_size;
+    totals.BytesOut += out_size;
+    if (opts.Report) report(path, in_size, out_size);
+    Driver::PhaseTimer timer(Driver::Phase::Output, path);
+    if (opts.OutPath) {
+        spit(opts.OutPath, out);
+        return;
+    }
+    auto write = [&](const std::string& name, const std::vector<std::byte>& bytes) {
+        std::filesystem::path out_path(opts.OutDir);
+        out_path /= name + ".class";
+        std::filesystem::create_directories(out_path.parent_path());
+        spit(out_path.string().c_str(), bytes);
+    };
+    write(class_name, out);
+    for (const auto& g : generated) write(g.first, g.second);
+}
+
+struct BatchItem {
+    std::vector<std::byte> Data;
+    ClassFile File {};
+    size_t InSize = 0;
+    std::string ClassName;
+    std::vector<std::byte> Out;
+    Driver::GeneratedClasses Generated;
+    Region R {}; // dump only
+    const Class* JClass = nullptr;
+    bool Dropped = false; // unreachable, not written
+    std::string Error;
+};
+
+/*
+ * Without a cache, inputs go through a pipeline: reading, parsing and optimizing (or converting, for a
+ * dump) run on threads of their own, and the results are written or printed in input order.
+ */
+static int
+process_batch(const Options& opts, Totals& totals) {
+    const size_t n = opts.Inputs.size();
+    std::vector<BatchItem> items(n);
+    const bool dump = !opts.OutPath && !opts.OutDir;
+    const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    auto threads = [&](int k, int fallback) { return opts.StageThreads[k] ? opts.StageThreads[k] : fallback; };
+    int status = 0;
+
+    Driver::InputReader reader(opts.Inputs, opts.IoUring);
+    Driver::Pipeline pipeline;
+    pipeline.AddStage("read", threads(0, 1), [&](size_t i) {
+        Driver::PhaseTimer timer(Driver::Phase::Read, opts.Inputs[i]);
+        try {
+            items[i].Data = reader.Read(i);
+        } catch (const std::exception& e) {
+            items[i].Error = e.what();
+        }
+    });
+    pipeline.AddStage("parse", threads(1, std::max(1, cores / 2)), [&](size_t i) {
+        auto& item = items[i];
+        if (!item.Error.empty()) return;
+        try {
+            parse(item.Data, item.File, opts.Inputs[i]);
+        } catch (const std::exception& e) {
+            item.Error = e.what();
+        }
+        item.InSize = item.Data.size();
+        item.Data = std::vector<std::byte>();
+    });
+    pipeline.AddStage(dump ? "convert" : "optimize", threads(2, std::max(1, cores / 2)), [&](size_t i) {
+        auto& item = items[i];
+        if (!item.Error.empty()) return;
+        try {
+            if (dump) {
+                rinit(&item.R);
+                item.JClass = convert(item.File, item.R, opts.Inputs[i]);
+            } else {
+                const int id = opts.Keep.empty() ? -1 : reachability_ids[i];
+                if (id >= 0 && !reachability.IsReachable(id)) {
+                    item.Dropped = true;
+                } else {
+                    item.Out = optimize(item.File, opts, opts.Inputs[i], item.Generated, id);
+                    item.ClassName = ClassNameAt(item.File, item.File.ThisClass);
+                }
+            }
+        } catch (const std::exception& e) {
+            item.Error = e.what();
+        }
+        item.File = ClassFile {};
+    });
+    pipeline.Run(n, [&](size_t i) {
+        auto& item = items[i];
+        const char* path = opts.Inputs[i];
+        if (item.Error.empty() && dump) {
+            Driver::PhaseTimer timer(Driver::Phase::Output, path);
+            print_class(item.JClass);
+        } else if (item.Error.empty() && item.Dropped) {
+            totals.Classes++;
+            totals.BytesIn += item.InSize;
+            if (opts.Report) report(path, item.InSize, 0);
+        } else if (item.Error.empty()) {
+            try {
+                emit(path, item.ClassName, item.InSize, item.Out, item.Generated, opts, totals);
+            } catch (const std::exception& e) {
+                item.Error = e.what();
+            }
+        }
+        if (!item.Error.empty()) {
+            fprintf(stderr, "%s: %s\n", path, item.Error.c_str());
+            status = 1;
+        }
+        if (item.JClass) rfreeall(&item.R);
+        item = BatchItem {};
+    });
+    if (Driver::Profiling) pipeline.Print(stderr);
+    return status;
+}
+
+static void
+read_hierarchy(const ClassFile& class_file, Driver::CacheEntry& e) {
+    e.ThisClass = ClassNameAt(class_file, class_file.ThisClass);
+    if (class_file.SuperClass) e.SuperClass = ClassNameAt(class_file, class_file.SuperClass);
+    for (const auto i : class_file.Interfaces) e.Interfaces.emplace_back(ClassNameAt(class_file, i));
+}
+
+// The classes named by the Class entries of a class and by its descriptors: those whose superclasses
+// the frames of its methods may be merged over.
+static void
+read_references(const ClassFile& class_file, Driver::CacheEntry& e) {
+    auto& names = e.References;
+    auto add_descriptor = [&](std::string_view d) {
+        for (size_t i = 0; i < d.size(); i++) {
+            if (d[i] != 'L') continue;
+            const size_t end = d.find(';', i);
+            if (end == std::string_view::npos) break;
+            names.emplace_back(d.substr(i + 1, end - i - 1));
+            i = end;
+        }
+    };
+    for (const auto& c : class_file.ConstantPool) {
+        if (!c) continue;
+        if (c->Tag == CPoolTags::Class) {
+            const auto name = Utf8At(class_file, ConstantClassInfo::Reference(c).NameIndex);
+            if (!name.empty() && name[0] == '[') add_descriptor(name);
+            else names.emplace_back(name);
+        } else if (c->Tag == CPoolTags::NameAndType) {
+            add_descriptor(Utf8At(class_file, ConstantNameAndTypeInfo::Reference(c).DescriptorIndex));
+        }
+    }
+    for (const auto& field : class_file.Fields) add_descriptor(Utf8At(class_file, field.DescriptorIndex));
+    for (const auto& m : class_file.Methods) add_descriptor(Utf8At(class_file, m.DescriptorIndex));
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+}
+
+// What an entry depends on besides its supertypes in the batch: the superclasses of the classes it
+// names, as far as the merges in the frames of its methods can see them (frames are computed again for
+// --recompute-frames and for whatever a pass rewrites), and the profile counts of its own methods.
+static uint64_t
+outside_hash(const Options& opts, const Driver::CacheEntry& e) {
+    std::vector<uint64_t> parts;
+    if (opts.RecomputeFrames || rewrites_code(opts)) {
+        for (const auto& name : e.References) parts.push_back(hierarchy.ChainHash(ClassType(name)));
+    }
+    if (opts.LayoutBudget || opts.InlineBudget) parts.push_back(exec_profile.Hash(e.ThisClass));
+    return hash64(parts.data(), parts.size() * sizeof(uint64_t), 0);
+}
+
+/*
+ * With a cache, the batch runs in three steps: look every class up (and process the ones not found),
+ * hash the hierarchy to find stale entries, then emit hits and store fresh results.
+ */
+static int
+process_cached(const Options& opts, Totals& totals) {
+    Driver::ClassCache cache(opts.CacheDir, config_hash(opts));
+    const size_t n = opts.Inputs.size();
+    std::vector<uint64_t> keys(n);
+    std::vector<Driver::CacheEntry> entries(n);
+    std::vector<size_t> in_sizes(n);
+    enum { HIT, MISS, FAILED };
+    std::vector<uint8_t> state(n, MISS);
+    int status = 0;
+
+    auto fail = [&](size_t i, const std::exception& e) {
+        fprintf(stderr, "%s: %s\n", opts.Inputs[i], e.what());
+        state[i] = FAILED;
+        status = 1;
+    };
+    auto run = [&](size_t i, const std::vector<std::byte>& data) {
+        ClassFile class_file {};
+        parse(data, class_file, opts.Inputs[i]);
+        auto& e = entries[i];
+        e = Driver::CacheEntry();
+        read_hierarchy(class_file, e);
+        read_references(class_file, e);
+        e.Output = optimize(class_file, opts, opts.Inputs[i], e.Generated);
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        try {
+            const auto data = read_input(opts.Inputs[i]);
+            bool hit;
+            {
+                Driver::PhaseTimer timer(Driver::Phase::Cache, opts.Inputs[i]);
+                keys[i] = cache.Key(data);
+                in_sizes[i] = data.size();
+                hit = cache.Load(keys[i], entries[i], false);
+            }
+            if (hit) {
+                state[i] = HIT;
+                continue;
+            }
+            run(i, data);
+        } catch (const std::exception& e) {
+            fail(i, e);
+        }
+    }
+
+    std::vector<uint64_t> dep_hashes;
+    {
+        Driver::PhaseTimer timer(Driver::Phase::Cache);
+        dep_hashes = Driver::DependencyHashes(keys, entries);
+        for (size_t i = 0; i < n; i++) {
+            if (state[i] == FAILED) continue;
+            const uint64_t outside = outside_hash(opts, entries[i]);
+            dep_hashes[i] = hash64(&outside, sizeof outside, dep_hashes[i]);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const char* path = opts.Inputs[i];
+        auto& e = entries[i];
+        try {
+            bool hit = false;
+            if (state[i] == HIT && e.DepHash == dep_hashes[i]) {
+                Driver::PhaseTimer timer(Driver::Phase::Cache, path);
+                hit = cache.Load(keys[i], e, true);
+            }
+            if (hit) {
+                totals.CacheHits++;
+            } else if (state[i] != FAILED) {
+                if (state[i] == HIT) run(i, read_input(path)); // a supertype changed
+                e.DepHash = dep_hashes[i];
+                Driver::PhaseTimer timer(Driver::Phase::Cache, path);
+                cache.Store(keys[i], e);
+            } else {
+                continue;
+            }
+            emit(path, e.ThisClass, in_sizes[i], e.Output, e.Generated, opts, totals);
+            e.Output = std::vector<std::byte>();
+            e.Generated = Driver::GeneratedClasses();
+        } catch (const std::exception& ex) {
+            fail(i, ex);
+        }
+    }
+    return status;
+}
+
+// Only the class headers are read. Inputs that fail to parse are reported when they are processed.
+static void
+read_input_hierarchy(const Options& opts) {
+    Parser parser {};
+    ClassHeader header;
+    for (const char* path : opts.Inputs) {
+        try {
+            const auto data = read_input(path);
+            Driver::PhaseTimer timer(Driver::Phase::Parse, path);
+            ScanClassHeader(parser, data, header);
+            hierarchy.AddClassHeader(header);
+        } catch (const std::exception&) {
+        }
+    }
+}
+
+// Every input is parsed in full once before the batch when a pass depends on all of them: what a class
+// may drop depends on all the others, and so do the objects it may replace by their fields. Inputs that
+// fail to parse are reported when they are processed, and are kept whole.
+static void
+read_program(const Options& opts) {
+    const bool shake = !opts.Keep.empty();
+    reachability_ids.assign(opts.Inputs.size(), -1);
+    for (size_t i = 0; i < opts.Inputs.size(); i++) {
+        try {
+            ClassFile class_file {};
+            parse(read_input(opts.Inputs[i]), class_file, opts.Inputs[i]);
+            if (shake) reachability_ids[i] = reachability.Add(class_file);
+            if (opts.ScalarReplace) scalar_classes.Add(class_file);
+        } catch (const std::exception&) {
+        }
+    }
+    if (!shake) return;
+    Driver::PhaseTimer timer(Driver::Phase::Optimize);
+    for (const auto& rule : opts.Keep) reachability.Keep(rule);
+    reachability.Run();
+}
+
+static int
+run(const Options& opts) {
+    try {
+        if (opts.SnapshotPath) return dump_snapshot(opts);
+        if (opts.WriteSnapshotPath) return write_snapshot(opts);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s: %s\n", opts.SnapshotPath ? opts.SnapshotPath : opts.WriteSnapshotPath, e.what());
+        return 1;
+    }
+    try {
+        for (const char* path : opts.ProfilePaths) exec_profile.Load(path);
+    } catch (const Analyze::InvalidProfile& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    int status = 0;
+    Totals totals;
+    const bool output = opts.OutPath || opts.OutDir;
+    if ((opts.RecomputeFrames || rewrites_code(opts)) && output) read_input_hierarchy(opts);
+    if (!opts.Keep.empty() || (opts.ScalarReplace && output)) read_program(opts);
+    if (opts.CacheDir && output) {
+        status = process_cached(opts, totals);
+    } else {
+        status = process_batch(opts, totals);
+    }
+    if (opts.Report && totals.Classes) {
+        char what[32];
+        snprintf(what, sizeof what, "total (%d classes)", totals.Classes);
+        report(what, totals.BytesIn, totals.BytesOut);
+        if (opts.CacheDir) printf("cache: %d of %d classes reused\n", totals.CacheHits, totals.Classes);
+        if (!exec_profile.Empty()) printf("profile: counts for %d methods\n", exec_profile.MethodCount());
+        if (!opts.Keep.empty()) {
+            const auto total = reachability.Total(), kept = reachability.Kept();
+            printf("shake: kept %d of %d classes, %d of %d methods, %d of %d fields\n", kept.Classes, total.Classes,
+                   kept.Methods, total.Methods, kept.Fields, total.Fields);
+        }
+    }
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parse_options(argc, argv, opts)) {
+        usage();
+        return 1;
+    }
+    if (opts.Threads) Utils::WorkPool::SetSharedThreads(opts.Threads);
+    if (opts.Profile) Driver::EnableProfiling(opts.TracePath != nullptr);
+    int status = run(opts);
+    if (opts.Profile) Driver::PrintProfile(stderr);
+    if (opts.TracePath && !Driver::WriteTrace(opts.TracePath)) {
+        fprintf(stderr, "%s: %s\n", opts.TracePath, strerror(errno));
+        status = 1;
+    }
+    return status;
+}
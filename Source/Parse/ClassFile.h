@@ -25,6 +25,13 @@ namespace Parse {
         virtual std::vector<U1> ReadBytes(int n) = 0;
     };
 
+    struct IWriter: virtual Object {
+        virtual void WriteU4(U4 v) = 0;
+        virtual void WriteU2(U2 v) = 0;
+        virtual void WriteU1(U1 v) = 0;
+        virtual void WriteBytes(const std::vector<U1>& bytes) = 0;
+    };
+
     struct IResolvable: virtual Object {
         virtual void Resolve() = 0;
     };
@@ -51,6 +58,7 @@ namespace Parse {
 
     struct CpInfoBase : virtual Object, IResolvable {
         explicit CpInfoBase(const CPoolTags tag) noexcept: Tag(tag) {}
+        virtual void Write(IWriter& writer) const = 0; // everything after the tag
         const CPoolTags Tag;
     };
 
@@ -62,6 +70,25 @@ namespace Parse {
         std::vector<U1> Info {};
     };
 
+    struct ExceptionTableEntry {
+        U2 StartPc{};
+        U2 EndPc{};
+        U2 HandlerPc{};
+        U2 CatchType{}; // 0 = any
+    };
+
+    // Info of a "Code" attribute, parsed on demand
+    struct CodeAttribute {
+        U2 MaxStack{};
+        U2 MaxLocals{};
+        U4 CodeLength{};
+        std::vector<U1> Code;
+        U2 ExceptionTableLength{};
+        std::vector<ExceptionTableEntry> ExceptionTable;
+        U2 AttributesCount{};
+        std::vector<AttributeInfo> Attributes;
+    };
+
     struct FieldInfo {
         U2 AccessFlags{};
         U2 NameIndex{};
@@ -3,6 +3,8 @@
 #include <string>
 #include <stdexcept>
 #include "Util/u.h"
+#include "Util/mutf8.h"
+#include "Util/WorkPool.h"
 #include "CpInfo.h"
 #include "Javalib/Basic.h"
 #include "Javalib/Class.h"
@@ -21,6 +23,15 @@ struct InvalidCPIndex : public std::exception {
     const char* what() const noexcept override { return msg.c_str(); }
 };
 
+struct InvalidUtf8 : public std::exception {
+    std::string msg;
+    InvalidUtf8(int index): msg("#" + std::to_string(index) + " is not valid modified UTF-8") {}
+    const char* what() const noexcept override { return msg.c_str(); }
+};
+
+// classes with fewer methods are converted on the calling thread alone
+static constexpr int PARALLEL_METHODS = 256;
+
 struct StringTableEntry {
     int key;
     char* val;
@@ -56,10 +67,11 @@ ConvertClassFile(const Parse::ClassFile* cf, Region& r) {
     int n_cpinfo = cf->ConstantPoolCount;
     for (int i = 1; i < n_cpinfo; i++) {
         const auto& cpinfo = cf->ConstantPool[i];
-        if (cpinfo->Tag == CPoolTags::Utf8) {
+        if (cpinfo && cpinfo->Tag == CPoolTags::Utf8) { // null after a long or double
             const auto& utf8info = ConstantUtf8Info::Reference(cpinfo);
             const auto& bytes = utf8info.Bytes;
             int len = bytes.size();
+            if (!mutf8_valid(bytes.data(), len)) { throw InvalidUtf8(i); }
             char* s = new_string(len+1, r);
             memcpy(s, bytes.data(), len);
             s[len] = 0;
@@ -70,12 +82,12 @@ ConvertClassFile(const Parse::ClassFile* cf, Region& r) {
     auto get_class = [cf,&strtab](uint16_t index) {
         if (index <= 0 || index >= cf->ConstantPoolCount) { throw InvalidCPIndex(std::to_string(index)); }
         const auto& cpinfo = cf->ConstantPool[index];
-        if (cpinfo->Tag != CPoolTags::Class) { throw InvalidCPIndex("#" + std::to_string(index) + " is not Class"); }
+        if (!cpinfo || cpinfo->Tag != CPoolTags::Class) { throw InvalidCPIndex("#" + std::to_string(index) + " is not Class"); }
         auto& classinfo = ConstantClassInfo::Reference(cpinfo);
         return lookup_string(strtab, classinfo.NameIndex);
     };
 
-    auto convert_attribute_info = [&strtab,&r](const AttributeInfo& ai, Attribute& a) {
+    auto convert_attribute_info = [&strtab](const AttributeInfo& ai, Attribute& a, Region& r) {
         a.Name = lookup_string(strtab, ai.AttributeNameIndex);
         a.Length = ai.AttributeLength;
         a.Info = new(r) uint8_t[a.Length];
@@ -86,14 +98,15 @@ ConvertClassFile(const Parse::ClassFile* cf, Region& r) {
         f.AccessFlags = fi.AccessFlags;
         f.Name = lookup_string(strtab, fi.NameIndex);
         f.Desc = lookup_string(strtab, fi.DescriptorIndex);
-        f.Type = ParseFieldDescriptor(f.Desc, r);
+        f.Type = ParseFieldDescriptor(f.Desc);
         f.AttributeCount = fi.AttributesCount;
         int n = f.AttributeCount;
         f.Attributes = new(r) Attribute[n];
-        for (int i = 0; i < n; i++) { convert_attribute_info(fi.Attributes[i], f.Attributes[i]); }
+        for (int i = 0; i < n; i++) { convert_attribute_info(fi.Attributes[i], f.Attributes[i], r); }
     };
 
-    auto convert_method_info = [&strtab,&r,&convert_attribute_info](const MethodInfo& mi, Method& m) {
+    // strtab is only read here, so the methods can be converted on several threads, each into a Region of its own
+    auto convert_method_info = [&strtab,&convert_attribute_info](const MethodInfo& mi, Method& m, Region& r) {
         m.AccessFlags = mi.AccessFlags;
         m.Name = lookup_string(strtab, mi.NameIndex);
         m.Desc = lookup_string(strtab, mi.DescriptorIndex);
@@ -101,7 +114,7 @@ ConvertClassFile(const Parse::ClassFile* cf, Region& r) {
         m.AttributeCount = mi.AttributesCount;
         int n = m.AttributeCount;
         m.Attributes = new(r) Attribute[n];
-        for (int i = 0; i < n; i++) { convert_attribute_info(mi.Attributes[i], m.Attributes[i]); }
+        for (int i = 0; i < n; i++) { convert_attribute_info(mi.Attributes[i], m.Attributes[i], r); }
     };
 
     jc->MinorVersion = cf->MinorVersion;
@@ -118,10 +131,25 @@ ConvertClassFile(const Parse::ClassFile* cf, Region& r) {
     for (int i = 0; i < n; i++) { convert_field_info(cf->Fields[i], jc->Fields[i]); }
     n = jc->MethodCount = cf->MethodsCount;
     jc->Methods = new(r) Method[n];
-    for (int i = 0; i < n; i++) { convert_method_info(cf->Methods[i], jc->Methods[i]); }
+    auto& pool = Utils::WorkPool::Shared();
+    if (n < PARALLEL_METHODS || pool.Threads() == 1) {
+        for (int i = 0; i < n; i++) { convert_method_info(cf->Methods[i], jc->Methods[i], r); }
+    } else {
+        std::vector<Region> worker_regions(pool.Threads());
+        for (auto& wr : worker_regions) { rinit(&wr); }
+        try {
+            pool.ParallelFor(n, [&](int i, int worker) {
+                convert_method_info(cf->Methods[i], jc->Methods[i], worker_regions[worker]);
+            });
+        } catch (...) {
+            for (auto& wr : worker_regions) { rfreeall(&wr); }
+            throw;
+        }
+        for (auto& wr : worker_regions) { rmerge(&r, &wr); }
+    }
     n = jc->AttributeCount = cf->AttributesCount;
     jc->Attributes = new(r) Attribute[n];
-    for (int i = 0; i < n; i++) { convert_attribute_info(cf->Attributes[i], jc->Attributes[i]); }
+    for (int i = 0; i < n; i++) { convert_attribute_info(cf->Attributes[i], jc->Attributes[i], r); }
 
     return jc;
 }
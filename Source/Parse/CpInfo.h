@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdexcept>
 #include "ClassFile.h"
 #include "Util/Exceptions.h"
 
@@ -19,6 +20,14 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            // Length is what was read; Bytes may have been edited since
+            if (Bytes.size() > 0xffff) { throw std::length_error("Utf8 constant longer than 65535 bytes"); }
+            writer.WriteU2(static_cast<U2>(Bytes.size()));
+            writer.WriteBytes(Bytes);
+        }
+
         U2 Length{};
         std::vector<U1> Bytes; // NOTE: Modified, not standard utf8s
     };
@@ -36,6 +45,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU4(Bytes);
+        }
+
         U4 Bytes{};
     };
 
@@ -52,6 +66,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU4(Bytes);
+        }
+
         U4 Bytes{}; // IEEE 754?
     };
 
@@ -72,6 +91,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU4(HighBytes);
+            writer.WriteU4(LowBytes);
+        }
+
         U4 HighBytes{};
         U4 LowBytes{}; // Consider Field Merging?
     };
@@ -93,6 +118,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU4(HighBytes);
+            writer.WriteU4(LowBytes);
+        }
+
         U4 HighBytes{};
         U4 LowBytes{}; // Consider Field Merging and IEEE754 double rep?	
     };
@@ -110,6 +141,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(NameIndex);
+        }
+
         U2 NameIndex; // TODO: Resolve
     };
 
@@ -126,6 +162,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(StringIndex);
+        }
+
         U2 StringIndex{}; // TODO: Resolve
     };
 
@@ -146,6 +187,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(ClassIndex);
+            writer.WriteU2(NameAndTypeIndex);
+        }
+
         U2 ClassIndex{}; // TODO: Resolve
         U2 NameAndTypeIndex{}; // TODO: Resolve
     };
@@ -167,6 +214,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(ClassIndex);
+            writer.WriteU2(NameAndTypeIndex);
+        }
+
         U2 ClassIndex{}; // TODO: Resolve
         U2 NameAndTypeIndex{}; // TODO: Resolve
     };
@@ -188,6 +241,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(ClassIndex);
+            writer.WriteU2(NameAndTypeIndex);
+        }
+
         U2 ClassIndex{}; // TODO: Resolve
         U2 NameAndTypeIndex{}; // TODO: Resolve
     };
@@ -209,6 +268,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(NameIndex);
+            writer.WriteU2(DescriptorIndex);
+        }
+
         U2 NameIndex{}; // TODO: Resolve
         U2 DescriptorIndex{}; // TODO: Resolve
     };
@@ -230,6 +295,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU1(ReferenceKind);
+            writer.WriteU2(ReferenceIndex);
+        }
+
         U1 ReferenceKind{}; // TODO: Resolve
         U2 ReferenceIndex{}; // TODO: Resolve
     };
@@ -249,6 +320,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(DescriptorIndex);
+        }
+
         U2 DescriptorIndex{}; // TODO: Resolve
     };
 
@@ -269,6 +345,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(BootstrapMethodAttrIndex);
+            writer.WriteU2(NameAndTypeIndex);
+        }
+
         U2 BootstrapMethodAttrIndex{}; // TODO: Resolve
         U2 NameAndTypeIndex{}; // TODO: Resolve
     };
@@ -290,6 +372,12 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(BootstrapMethodAttrIndex);
+            writer.WriteU2(NameAndTypeIndex);
+        }
+
         U2 BootstrapMethodAttrIndex{}; // TODO: Resolve
         U2 NameAndTypeIndex{}; // TODO: Resolve
     };
@@ -307,6 +395,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(NameIndex);
+        }
+
         U2 NameIndex{}; // TODO: Resolve
     };
 
@@ -323,6 +416,11 @@ namespace Parse {
         }
 
         void Resolve() override {}
+
+        void Write(IWriter& writer) const override {
+            writer.WriteU2(NameIndex);
+        }
+
         U2 NameIndex{}; // TODO: Resolve
     };
 }
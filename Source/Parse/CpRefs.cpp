@@ -0,0 +1,367 @@
+/* Locate constant pool references in a ClassFile, including the ones buried in attribute bytes */
+
+#include "Util/u.h"
+#include "CpRefs.h"
+#include "Javalib/Opcodes.h"
+
+namespace Parse {
+    std::string_view Utf8At(const ClassFile& f, const U2 index) {
+        if (index == 0 || index >= f.ConstantPool.size() || !f.ConstantPool[index] ||
+            f.ConstantPool[index]->Tag != CPoolTags::Utf8) {
+            throw InvalidClassFile("expected a Utf8 constant");
+        }
+        const auto& bytes = ConstantUtf8Info::Reference(f.ConstantPool[index]).Bytes;
+        return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+    }
+
+    std::string_view ClassNameAt(const ClassFile& f, const U2 index) {
+        if (index == 0 || index >= f.ConstantPool.size() || !f.ConstantPool[index] ||
+            f.ConstantPool[index]->Tag != CPoolTags::Class) {
+            throw InvalidClassFile("expected a Class constant");
+        }
+        return Utf8At(f, ConstantClassInfo::Reference(f.ConstantPool[index]).NameIndex);
+    }
+
+    MemberRef MemberRefAt(const ClassFile& f, const U2 index) {
+        if (index == 0 || index >= f.ConstantPool.size() || !f.ConstantPool[index]) {
+            throw InvalidClassFile("expected a member reference");
+        }
+        const auto& e = f.ConstantPool[index];
+        U2 owner = 0, nat;
+        switch (e->Tag) {
+        case CPoolTags::FieldRef:
+            owner = ConstantFieldRefInfo::Reference(e).ClassIndex;
+            nat = ConstantFieldRefInfo::Reference(e).NameAndTypeIndex;
+            break;
+        case CPoolTags::MethodRef:
+            owner = ConstantMethodRefInfo::Reference(e).ClassIndex;
+            nat = ConstantMethodRefInfo::Reference(e).NameAndTypeIndex;
+            break;
+        case CPoolTags::InterfaceMethodRef:
+            owner = ConstantInterfaceMethodRefInfo::Reference(e).ClassIndex;
+            nat = ConstantInterfaceMethodRefInfo::Reference(e).NameAndTypeIndex;
+            break;
+        case CPoolTags::Dynamic: nat = ConstantDynamicInfo::Reference(e).NameAndTypeIndex; break;
+        case CPoolTags::InvokeDynamic: nat = ConstantInvokeDynamicInfo::Reference(e).NameAndTypeIndex; break;
+        default: throw InvalidClassFile("expected a member reference");
+        }
+        if (nat == 0 || nat >= f.ConstantPool.size() || !f.ConstantPool[nat] ||
+            f.ConstantPool[nat]->Tag != CPoolTags::NameAndType) {
+            throw InvalidClassFile("expected a NameAndType constant");
+        }
+        const auto& nt = ConstantNameAndTypeInfo::Reference(f.ConstantPool[nat]);
+        return {owner ? ClassNameAt(f, owner) : std::string_view(), Utf8At(f, nt.NameIndex), Utf8At(f, nt.DescriptorIndex)};
+    }
+
+    static void visit(ICpRefVisitor& v, U2& index) {
+        if (index) { v.Visit(index); }
+    }
+
+    void VisitEntryRefs(CpInfoBase& e, ICpRefVisitor& v) {
+        switch (e.Tag) {
+        case CPoolTags::Class: visit(v, static_cast<ConstantClassInfo&>(e).NameIndex); break;
+        case CPoolTags::String: visit(v, static_cast<ConstantStringInfo&>(e).StringIndex); break;
+        case CPoolTags::FieldRef: {
+            auto& ref = static_cast<ConstantFieldRefInfo&>(e);
+            visit(v, ref.ClassIndex);
+            visit(v, ref.NameAndTypeIndex);
+        }
+        break;
+        case CPoolTags::MethodRef: {
+            auto& ref = static_cast<ConstantMethodRefInfo&>(e);
+            visit(v, ref.ClassIndex);
+            visit(v, ref.NameAndTypeIndex);
+        }
+        break;
+        case CPoolTags::InterfaceMethodRef: {
+            auto& ref = static_cast<ConstantInterfaceMethodRefInfo&>(e);
+            visit(v, ref.ClassIndex);
+            visit(v, ref.NameAndTypeIndex);
+        }
+        break;
+        case CPoolTags::NameAndType: {
+            auto& nat = static_cast<ConstantNameAndTypeInfo&>(e);
+            visit(v, nat.NameIndex);
+            visit(v, nat.DescriptorIndex);
+        }
+        break;
+        case CPoolTags::MethodHandle: visit(v, static_cast<ConstantMethodHandleInfo&>(e).ReferenceIndex); break;
+        case CPoolTags::MethodType: visit(v, static_cast<ConstantMethodTypeInfo&>(e).DescriptorIndex); break;
+        // BootstrapMethodAttrIndex indexes the BootstrapMethods attribute, not the constant pool
+        case CPoolTags::Dynamic: visit(v, static_cast<ConstantDynamicInfo&>(e).NameAndTypeIndex); break;
+        case CPoolTags::InvokeDynamic: visit(v, static_cast<ConstantInvokeDynamicInfo&>(e).NameAndTypeIndex); break;
+        case CPoolTags::Module: visit(v, static_cast<ConstantModuleInfo&>(e).NameIndex); break;
+        case CPoolTags::Package: visit(v, static_cast<ConstantPackageInfo&>(e).NameIndex); break;
+        default: ;
+        }
+    }
+
+    namespace {
+        struct Cursor {
+            U1 *Cur, *Bound;
+
+            U1* Take(const size_t n) {
+                if (static_cast<size_t>(Bound - Cur) < n) { throw InvalidClassFile("attribute truncated"); }
+                const auto p = Cur;
+                Cur += n;
+                return p;
+            }
+
+            U1 GetU1() { return *Take(1); }
+
+            U2 GetU2() {
+                const auto p = Take(2);
+                return static_cast<U2>(p[0] << 8 | p[1]);
+            }
+
+            U4 GetU4() {
+                const auto p = Take(4);
+                return static_cast<U4>(p[0]) << 24 | static_cast<U4>(p[1]) << 16 | p[2] << 8 | p[3];
+            }
+        };
+
+        class RefWalker {
+        public:
+            RefWalker(ClassFile& f, ICpRefVisitor& v) noexcept: File(f), Visitor(v) {}
+
+            void Class() {
+                visit(Visitor, File.ThisClass);
+                visit(Visitor, File.SuperClass);
+                for (auto& i : File.Interfaces) { visit(Visitor, i); }
+                for (auto& f : File.Fields) {
+                    visit(Visitor, f.NameIndex);
+                    visit(Visitor, f.DescriptorIndex);
+                    Attributes(f.Attributes);
+                }
+                for (auto& m : File.Methods) {
+                    visit(Visitor, m.NameIndex);
+                    visit(Visitor, m.DescriptorIndex);
+                    Attributes(m.Attributes);
+                }
+                Attributes(File.Attributes);
+            }
+
+            bool Complete = true;
+
+        private:
+            void Attributes(std::vector<AttributeInfo>& attributes) {
+                for (auto& a : attributes) {
+                    const auto name = Utf8At(File, a.AttributeNameIndex); // look up before it gets rewritten
+                    visit(Visitor, a.AttributeNameIndex);
+                    Cursor c{a.Info.data(), a.Info.data() + a.Info.size()};
+                    Body(name, c);
+                }
+            }
+
+            // attribute list nested in raw bytes (Code, Record)
+            void RawAttributes(Cursor& c) {
+                for (int n = c.GetU2(); n > 0; n--) {
+                    const auto pname = c.Take(2);
+                    const auto name = Utf8At(File, static_cast<U2>(pname[0] << 8 | pname[1]));
+                    Ref(pname);
+                    const auto len = c.GetU4();
+                    const auto p = c.Take(len);
+                    Cursor body{p, p + len};
+                    Body(name, body);
+                }
+            }
+
+            void Ref(U1* p) {
+                U2 index = static_cast<U2>(p[0] << 8 | p[1]);
+                if (!index) { return; }
+                Visitor.Visit(index);
+                p[0] = static_cast<U1>(index >> 8);
+                p[1] = static_cast<U1>(index);
+            }
+
+            void Refs(Cursor& c, int n) {
+                while (n-- > 0) { Ref(c.Take(2)); }
+            }
+
+            void Body(const std::string_view name, Cursor& c) {
+                if (name == "Code") { Code(c); }
+                else if (name == "ConstantValue" || name == "Signature" || name == "SourceFile" ||
+                    name == "NestHost" || name == "ModuleMainClass") { Ref(c.Take(2)); }
+                else if (name == "Exceptions" || name == "NestMembers" || name == "PermittedSubclasses" ||
+                    name == "ModulePackages") { Refs(c, c.GetU2()); }
+                else if (name == "StackMapTable") { StackMapTable(c); }
+                else if (name == "InnerClasses") {
+                    for (int n = c.GetU2(); n > 0; n--) {
+                        Refs(c, 3); // inner class, outer class, inner name
+                        c.Take(2);
+                    }
+                }
+                else if (name == "EnclosingMethod") { Refs(c, 2); }
+                else if (name == "LocalVariableTable" || name == "LocalVariableTypeTable") {
+                    for (int n = c.GetU2(); n > 0; n--) {
+                        c.Take(4); // start_pc, length
+                        Refs(c, 2);
+                        c.Take(2); // index
+                    }
+                }
+                else if (name == "RuntimeVisibleAnnotations" || name == "RuntimeInvisibleAnnotations") {
+                    for (int n = c.GetU2(); n > 0; n--) { Annotation(c); }
+                }
+                else if (name == "RuntimeVisibleParameterAnnotations" ||
+                    name == "RuntimeInvisibleParameterAnnotations") {
+                    for (int n = c.GetU1(); n > 0; n--) {
+                        for (int m = c.GetU2(); m > 0; m--) { Annotation(c); }
+                    }
+                }
+                else if (name == "RuntimeVisibleTypeAnnotations" || name == "RuntimeInvisibleTypeAnnotations") {
+                    for (int n = c.GetU2(); n > 0; n--) { TypeAnnotation(c); }
+                }
+                else if (name == "AnnotationDefault") { ElementValue(c); }
+                else if (name == "BootstrapMethods") {
+                    for (int n = c.GetU2(); n > 0; n--) {
+                        Ref(c.Take(2));
+                        Refs(c, c.GetU2());
+                    }
+                }
+                else if (name == "MethodParameters") {
+                    for (int n = c.GetU1(); n > 0; n--) {
+                        Ref(c.Take(2));
+                        c.Take(2);
+                    }
+                }
+                else if (name == "Module") { Module(c); }
+                else if (name == "Record") {
+                    for (int n = c.GetU2(); n > 0; n--) {
+                        Refs(c, 2); // name, descriptor
+                        RawAttributes(c);
+                    }
+                }
+                else if (name == "LineNumberTable" || name == "SourceDebugExtension" || name == "Synthetic" ||
+                    name == "Deprecated") {}
+                else { Complete = false; }
+            }
+
+            void Code(Cursor& c) {
+                c.Take(4); // max_stack, max_locals
+                const int len = static_cast<int>(c.GetU4());
+                const auto code = c.Take(len);
+                for (int pc = 0; pc < len;) {
+                    const int insn_len = InsnLength(code, pc, len);
+                    const int flags = OpcodeTable[code[pc]].Flags;
+                    if (flags & OPF_CP1) {
+                        U2 index = code[pc+1];
+                        if (index) { Visitor.Visit(index); }
+                        if (index > 0xff) { throw InvalidClassFile("ldc index out of range"); }
+                        code[pc+1] = static_cast<U1>(index);
+                    } else if (flags & OPF_CP2) { Ref(code + pc + 1); }
+                    pc += insn_len;
+                }
+                for (int n = c.GetU2(); n > 0; n--) {
+                    c.Take(6); // start_pc, end_pc, handler_pc
+                    Ref(c.Take(2));
+                }
+                RawAttributes(c);
+            }
+
+            void StackMapTable(Cursor& c) {
+                for (int n = c.GetU2(); n > 0; n--) {
+                    const int type = c.GetU1();
+                    if (type < 64) {} // same_frame
+                    else if (type < 128) { VerificationType(c); }
+                    else if (type < 247) { throw InvalidClassFile("reserved stack map frame type"); }
+                    else if (type == 247) {
+                        c.Take(2);
+                        VerificationType(c);
+                    }
+                    else if (type < 252) { c.Take(2); } // chop_frame, same_frame_extended
+                    else if (type < 255) {
+                        c.Take(2);
+                        for (int k = type - 251; k > 0; k--) { VerificationType(c); }
+                    }
+                    else {
+                        c.Take(2);
+                        for (int k = c.GetU2(); k > 0; k--) { VerificationType(c); }
+                        for (int k = c.GetU2(); k > 0; k--) { VerificationType(c); }
+                    }
+                }
+            }
+
+            void VerificationType(Cursor& c) {
+                const int tag = c.GetU1();
+                if (tag == 7) { Ref(c.Take(2)); } // Object_variable_info
+                else if (tag == 8) { c.Take(2); } // Uninitialized_variable_info
+                else if (tag > 8) { throw InvalidClassFile("invalid verification type"); }
+            }
+
+            void Annotation(Cursor& c) {
+                Ref(c.Take(2)); // type_index
+                for (int n = c.GetU2(); n > 0; n--) {
+                    Ref(c.Take(2)); // element_name_index
+                    ElementValue(c);
+                }
+            }
+
+            void ElementValue(Cursor& c) {
+                switch (c.GetU1()) {
+                case 'B': case 'C': case 'D': case 'F': case 'I': case 'J': case 'S': case 'Z': case 's':
+                case 'c':
+                    Ref(c.Take(2));
+                    break;
+                case 'e':
+                    Refs(c, 2);
+                    break;
+                case '@':
+                    Annotation(c);
+                    break;
+                case '[':
+                    for (int n = c.GetU2(); n > 0; n--) { ElementValue(c); }
+                    break;
+                default:
+                    throw InvalidClassFile("invalid element_value tag");
+                }
+            }
+
+            void TypeAnnotation(Cursor& c) {
+                const int target = c.GetU1();
+                switch (target) {
+                case 0x00: case 0x01: case 0x16: c.Take(1); break;
+                case 0x10: case 0x11: case 0x12: case 0x17: case 0x42:
+                case 0x43: case 0x44: case 0x45: case 0x46: c.Take(2); break;
+                case 0x13: case 0x14: case 0x15: break;
+                case 0x40: case 0x41: c.Take(6 * c.GetU2()); break;
+                case 0x47: case 0x48: case 0x49: case 0x4a: case 0x4b: c.Take(3); break;
+                default: throw InvalidClassFile("invalid type annotation target");
+                }
+                c.Take(2 * c.GetU1()); // type_path
+                Annotation(c);
+            }
+
+            void Module(Cursor& c) {
+                Ref(c.Take(2)); // module_name_index
+                c.Take(2);
+                Ref(c.Take(2)); // module_version_index
+                for (int n = c.GetU2(); n > 0; n--) { // requires
+                    Ref(c.Take(2));
+                    c.Take(2);
+                    Ref(c.Take(2));
+                }
+                for (int k = 0; k < 2; k++) { // exports, opens
+                    for (int n = c.GetU2(); n > 0; n--) {
+                        Ref(c.Take(2));
+                        c.Take(2);
+                        Refs(c, c.GetU2());
+                    }
+                }
+                Refs(c, c.GetU2()); // uses
+                for (int n = c.GetU2(); n > 0; n--) { // provides
+                    Ref(c.Take(2));
+                    Refs(c, c.GetU2());
+                }
+            }
+
+            ClassFile& File;
+            ICpRefVisitor& Visitor;
+        };
+    }
+
+    bool VisitClassRefs(ClassFile& f, ICpRefVisitor& visitor) {
+        RefWalker walker(f, visitor);
+        walker.Class();
+        return walker.Complete;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string_view>
+#include "ClassFile.h"
+#include "CpInfo.h"
+#include "Parser.h"
+
+namespace Parse {
+    struct ICpRefVisitor {
+        virtual ~ICpRefVisitor() = default;
+        // may rewrite the index; never called for absent (zero) indices
+        virtual void Visit(U2& index) = 0;
+    };
+
+    // throws InvalidClassFile if index is not that of a Utf8 entry
+    std::string_view Utf8At(const ClassFile& f, U2 index);
+    // internal name of a Class entry, e.g. java/lang/Object
+    std::string_view ClassNameAt(const ClassFile& f, U2 index);
+
+    struct MemberRef {
+        std::string_view Owner; // empty for Dynamic and InvokeDynamic
+        std::string_view Name;
+        std::string_view Descriptor;
+    };
+
+    // of a FieldRef, MethodRef, InterfaceMethodRef, Dynamic or InvokeDynamic entry; throws
+    // InvalidClassFile for anything else
+    MemberRef MemberRefAt(const ClassFile& f, U2 index);
+
+    // references held by a constant pool entry itself, e.g. Class -> Utf8
+    void VisitEntryRefs(CpInfoBase& entry, ICpRefVisitor& visitor);
+
+    // Every reference into the constant pool from outside of it: class header, members, attributes and
+    // the bytecode and nested attributes of Code. Attributes are rewritten in place, so a visitor must
+    // keep u1 indices (ldc) below 256.
+    // Returns false if an attribute of unknown layout was skipped, so some references may be missing.
+    bool VisitClassRefs(ClassFile& f, ICpRefVisitor& visitor);
+}
@@ -16,6 +16,8 @@ namespace Parse {
         }
     };
 
+    struct ClassVisitor;
+
     class Parser : public IParser {
     public:
         U4 ReadU4() override { return PeekU4(Vpa(4)); }
@@ -56,6 +58,29 @@ namespace Parse {
             f.Attributes = LoadAttributes(f.AttributesCount);
         }
 
+        // Calls back v instead of building a ClassFile (see Visitor.h); false if v stopped the parse.
+        // Only reads as far as v wants, so a stopped parse says nothing about the rest of the bytes.
+        bool Visit(const std::vector<std::byte>& bytes, ClassVisitor& v);
+
+        void ParseCodeOnto(const std::vector<U1>& info, CodeAttribute& c) {
+            Cur = reinterpret_cast<PByte>(info.data());
+            Bound = Cur + info.size();
+            c.MaxStack = ReadU2();
+            c.MaxLocals = ReadU2();
+            c.CodeLength = ReadU4();
+            c.Code = ReadBytes(c.CodeLength);
+            c.ExceptionTableLength = ReadU2();
+            c.ExceptionTable.resize(c.ExceptionTableLength);
+            for (auto& e : c.ExceptionTable) {
+                e.StartPc = ReadU2();
+                e.EndPc = ReadU2();
+                e.HandlerPc = ReadU2();
+                e.CatchType = ReadU2();
+            }
+            c.AttributesCount = ReadU2();
+            c.Attributes = LoadAttributes(c.AttributesCount);
+        }
+
     private:
         static uint16_t PeekU1(const PByte ptr) noexcept { return static_cast<uint8_t>(ptr[0]); }
 
@@ -93,7 +118,11 @@ namespace Parse {
 
         std::vector<CpInfo> LoadConstantPool(const U2 count) {
             std::vector<CpInfo> result(count);
-            for (U2 i = 1; i < count; i++) { result[i] = LoadConstant(static_cast<CPoolTags>(ReadU1())); }
+            for (int i = 1; i < count; i++) {
+                result[i] = LoadConstant(static_cast<CPoolTags>(ReadU1()));
+                // long and double take up two entries, the second one is left empty
+                if (result[i]->Tag == CPoolTags::Long || result[i]->Tag == CPoolTags::Double) { i++; }
+            }
             return result;
         }
 
@@ -159,5 +188,6 @@ namespace Parse {
         }
 
         PByte Cur = nullptr, Bound = nullptr;
+        std::vector<uint32_t> PoolOffsets; // for Visit, kept to be reused
     };
 }
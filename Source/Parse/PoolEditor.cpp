@@ -0,0 +1,198 @@
+#include <cstring>
+#include <stdexcept>
+#include "CpInfo.h"
+#include "PoolEditor.h"
+
+namespace Parse {
+    namespace {
+        uint64_t pair_key(const CPoolTags tag, const U2 first, const U2 second) {
+            return static_cast<uint64_t>(tag) << 32 | static_cast<uint64_t>(first) << 16 | second;
+        }
+
+        // Integer, Float, Long and Double are tags 3 to 6
+        size_t number_slot(const CPoolTags tag) {
+            return static_cast<size_t>(tag) - static_cast<size_t>(CPoolTags::Integer);
+        }
+    }
+
+    void PoolEditor::Index() {
+        Indexed = true;
+        for (size_t i = 1; i < File.ConstantPool.size(); i++) {
+            const auto& e = File.ConstantPool[i];
+            if (!e) { continue; }
+            const auto index = static_cast<U2>(i);
+            if (e->Tag == CPoolTags::Utf8) {
+                const auto& bytes = ConstantUtf8Info::Reference(e).Bytes;
+                Utf8s.emplace(std::string(bytes.begin(), bytes.end()), index); // keeps the first duplicate
+            } else if (e->Tag == CPoolTags::Class) {
+                Classes.emplace(ConstantClassInfo::Reference(e).NameIndex, index);
+            } else if (e->Tag == CPoolTags::String) {
+                Strings.emplace(ConstantStringInfo::Reference(e).StringIndex, index);
+            } else if (e->Tag == CPoolTags::NameAndType) {
+                const auto& nt = ConstantNameAndTypeInfo::Reference(e);
+                Pairs.emplace(pair_key(e->Tag, nt.NameIndex, nt.DescriptorIndex), index);
+            } else if (e->Tag == CPoolTags::FieldRef) {
+                const auto& r = ConstantFieldRefInfo::Reference(e);
+                Pairs.emplace(pair_key(e->Tag, r.ClassIndex, r.NameAndTypeIndex), index);
+            } else if (e->Tag == CPoolTags::MethodRef) {
+                const auto& r = ConstantMethodRefInfo::Reference(e);
+                Pairs.emplace(pair_key(e->Tag, r.ClassIndex, r.NameAndTypeIndex), index);
+            } else if (e->Tag == CPoolTags::InterfaceMethodRef) {
+                const auto& r = ConstantInterfaceMethodRefInfo::Reference(e);
+                Pairs.emplace(pair_key(e->Tag, r.ClassIndex, r.NameAndTypeIndex), index);
+            } else if (e->Tag == CPoolTags::Integer) {
+                Numbers[number_slot(e->Tag)].emplace(ConstantIntegerInfo::Reference(e).Bytes, index);
+            } else if (e->Tag == CPoolTags::Float) {
+                Numbers[number_slot(e->Tag)].emplace(ConstantFloatInfo::Reference(e).Bytes, index);
+            } else if (e->Tag == CPoolTags::Long) {
+                const auto& l = ConstantLongInfo::Reference(e);
+                Numbers[number_slot(e->Tag)].emplace(static_cast<uint64_t>(l.HighBytes) << 32 | l.LowBytes, index);
+            } else if (e->Tag == CPoolTags::Double) {
+                const auto& d = ConstantDoubleInfo::Reference(e);
+                Numbers[number_slot(e->Tag)].emplace(static_cast<uint64_t>(d.HighBytes) << 32 | d.LowBytes, index);
+            }
+        }
+    }
+
+    U2 PoolEditor::Append(CpInfo entry) {
+        if (File.ConstantPool.size() >= 0xffff) { throw std::length_error("constant pool full"); }
+        File.ConstantPool.push_back(std::move(entry));
+        File.ConstantPoolCount = static_cast<U2>(File.ConstantPool.size());
+        return static_cast<U2>(File.ConstantPool.size() - 1);
+    }
+
+    U2 PoolEditor::Utf8(const std::string_view s) {
+        if (!Indexed) { Index(); }
+        const auto it = Utf8s.find(std::string(s));
+        if (it != Utf8s.end()) { return it->second; }
+        if (s.size() > 0xffff) { throw std::length_error("string constant too long"); }
+        auto e = std::make_unique<ConstantUtf8Info>();
+        e->Length = static_cast<U2>(s.size());
+        e->Bytes.assign(s.begin(), s.end());
+        const auto index = Append(std::move(e));
+        Utf8s.emplace(std::string(s), index);
+        return index;
+    }
+
+    U2 PoolEditor::Class(const std::string_view name) {
+        const auto name_index = Utf8(name);
+        const auto it = Classes.find(name_index);
+        if (it != Classes.end()) { return it->second; }
+        auto e = std::make_unique<ConstantClassInfo>();
+        e->NameIndex = name_index;
+        const auto index = Append(std::move(e));
+        Classes.emplace(name_index, index);
+        return index;
+    }
+
+    U2 PoolEditor::String(const std::string_view s) {
+        const auto utf8 = Utf8(s);
+        const auto it = Strings.find(utf8);
+        if (it != Strings.end()) { return it->second; }
+        auto e = std::make_unique<ConstantStringInfo>();
+        e->StringIndex = utf8;
+        const auto index = Append(std::move(e));
+        Strings.emplace(utf8, index);
+        return index;
+    }
+
+    U2 PoolEditor::NameAndType(const std::string_view name, const std::string_view desc) {
+        const auto name_index = Utf8(name), desc_index = Utf8(desc);
+        const auto key = pair_key(CPoolTags::NameAndType, name_index, desc_index);
+        const auto it = Pairs.find(key);
+        if (it != Pairs.end()) { return it->second; }
+        auto e = std::make_unique<ConstantNameAndTypeInfo>();
+        e->NameIndex = name_index;
+        e->DescriptorIndex = desc_index;
+        const auto index = Append(std::move(e));
+        Pairs.emplace(key, index);
+        return index;
+    }
+
+    U2 PoolEditor::Ref(const CPoolTags tag, const std::string_view owner, const std::string_view name,
+                       const std::string_view desc) {
+        const auto cls = Class(owner), nat = NameAndType(name, desc);
+        const auto key = pair_key(tag, cls, nat);
+        const auto it = Pairs.find(key);
+        if (it != Pairs.end()) { return it->second; }
+        CpInfo e;
+        if (tag == CPoolTags::FieldRef) {
+            auto r = std::make_unique<ConstantFieldRefInfo>();
+            r->ClassIndex = cls, r->NameAndTypeIndex = nat;
+            e = std::move(r);
+        } else if (tag == CPoolTags::MethodRef) {
+            auto r = std::make_unique<ConstantMethodRefInfo>();
+            r->ClassIndex = cls, r->NameAndTypeIndex = nat;
+            e = std::move(r);
+        } else {
+            auto r = std::make_unique<ConstantInterfaceMethodRefInfo>();
+            r->ClassIndex = cls, r->NameAndTypeIndex = nat;
+            e = std::move(r);
+        }
+        const auto index = Append(std::move(e));
+        Pairs.emplace(key, index);
+        return index;
+    }
+
+    U2 PoolEditor::FieldRef(const std::string_view owner, const std::string_view name, const std::string_view desc) {
+        return Ref(CPoolTags::FieldRef, owner, name, desc);
+    }
+
+    U2 PoolEditor::MethodRef(const std::string_view owner, const std::string_view name, const std::string_view desc) {
+        return Ref(CPoolTags::MethodRef, owner, name, desc);
+    }
+
+    U2 PoolEditor::InterfaceMethodRef(const std::string_view owner, const std::string_view name,
+                                      const std::string_view desc) {
+        return Ref(CPoolTags::InterfaceMethodRef, owner, name, desc);
+    }
+
+    U2 PoolEditor::Number(const CPoolTags tag, const uint64_t bits) {
+        if (!Indexed) { Index(); }
+        auto& numbers = Numbers[number_slot(tag)];
+        const auto it = numbers.find(bits);
+        if (it != numbers.end()) { return it->second; }
+        CpInfo e;
+        const auto high = static_cast<U4>(bits >> 32), low = static_cast<U4>(bits);
+        if (tag == CPoolTags::Integer) {
+            auto c = std::make_unique<ConstantIntegerInfo>();
+            c->Bytes = low;
+            e = std::move(c);
+        } else if (tag == CPoolTags::Float) {
+            auto c = std::make_unique<ConstantFloatInfo>();
+            c->Bytes = low;
+            e = std::move(c);
+        } else if (tag == CPoolTags::Long) {
+            auto c = std::make_unique<ConstantLongInfo>();
+            c->HighBytes = high, c->LowBytes = low;
+            e = std::move(c);
+        } else {
+            auto c = std::make_unique<ConstantDoubleInfo>();
+            c->HighBytes = high, c->LowBytes = low;
+            e = std::move(c);
+        }
+        const bool wide = tag == CPoolTags::Long || tag == CPoolTags::Double;
+        // the second entry of a long or double must still be below the count
+        if (wide && File.ConstantPool.size() >= 0xfffe) { throw std::length_error("constant pool full"); }
+        const auto index = Append(std::move(e));
+        if (wide) { Append(nullptr); }
+        numbers.emplace(bits, index);
+        return index;
+    }
+
+    U2 PoolEditor::Integer(const int32_t value) { return Number(CPoolTags::Integer, static_cast<U4>(value)); }
+
+    U2 PoolEditor::Float(const float value) {
+        U4 bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        return Number(CPoolTags::Float, bits);
+    }
+
+    U2 PoolEditor::Long(const int64_t value) { return Number(CPoolTags::Long, static_cast<uint64_t>(value)); }
+
+    U2 PoolEditor::Double(const double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        return Number(CPoolTags::Double, bits);
+    }
+}
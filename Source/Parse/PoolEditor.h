@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "ClassFile.h"
+
+namespace Parse {
+    // Finds constant pool entries, appending them when missing. The lookup tables are built on first
+    // use, so keep one editor for all the entries added to a class; nothing else may change the pool
+    // meanwhile. Throws std::length_error once the pool is full.
+    class PoolEditor {
+    public:
+        explicit PoolEditor(ClassFile& f) noexcept: File(f) {}
+
+        U2 Utf8(std::string_view s);
+        // name is internal (java/lang/Object) or, for an array class, a descriptor ([I)
+        U2 Class(std::string_view name);
+        // s is in modified UTF-8, as the pool holds it
+        U2 String(std::string_view s);
+        U2 NameAndType(std::string_view name, std::string_view desc);
+        U2 FieldRef(std::string_view owner, std::string_view name, std::string_view desc);
+        U2 MethodRef(std::string_view owner, std::string_view name, std::string_view desc);
+        U2 InterfaceMethodRef(std::string_view owner, std::string_view name, std::string_view desc);
+        // numeric constants, told apart by their bits (so 0.0f and -0.0f are two entries)
+        U2 Integer(int32_t value);
+        U2 Float(float value);
+        U2 Long(int64_t value);
+        U2 Double(double value);
+
+    private:
+        void Index();
+        U2 Append(CpInfo entry);
+        U2 Number(CPoolTags tag, uint64_t bits);
+        U2 Ref(CPoolTags tag, std::string_view owner, std::string_view name, std::string_view desc);
+
+        ClassFile& File;
+        bool Indexed = false;
+        std::unordered_map<std::string, U2> Utf8s;
+        std::unordered_map<U2, U2> Classes; // by name index
+        std::unordered_map<U2, U2> Strings; // by Utf8 index
+        // by tag << 32 | first index << 16 | second index, for NameAndType and the member references
+        std::unordered_map<uint64_t, U2> Pairs;
+        std::unordered_map<uint64_t, U2> Numbers[4]; // Integer, Float, Long, Double by bits
+    };
+}
@@ -0,0 +1,126 @@
+/* Visit a class file without building a ClassFile */
+
+#include "Visitor.h"
+
+namespace Parse {
+    namespace {
+        // bytes after the tag, -1 for a Utf8 entry, whose length comes next
+        int entry_size(const CPoolTags tag) {
+            switch (tag) {
+            case CPoolTags::Utf8: return -1;
+            case CPoolTags::Class:
+            case CPoolTags::String:
+            case CPoolTags::MethodType:
+            case CPoolTags::Module:
+            case CPoolTags::Package: return 2;
+            case CPoolTags::MethodHandle: return 3;
+            case CPoolTags::Integer:
+            case CPoolTags::Float:
+            case CPoolTags::FieldRef:
+            case CPoolTags::MethodRef:
+            case CPoolTags::InterfaceMethodRef:
+            case CPoolTags::NameAndType:
+            case CPoolTags::Dynamic:
+            case CPoolTags::InvokeDynamic: return 4;
+            case CPoolTags::Long:
+            case CPoolTags::Double: return 8;
+            }
+            throw std::runtime_error("unexpected constant type");
+        }
+
+        U2 peek_u2(const PByte p) {
+            return static_cast<U2>(static_cast<U2>(p[0]) << 8 | static_cast<U2>(p[1]));
+        }
+    }
+
+    U1 PoolView::Tag(const U2 index) const {
+        if (index == 0 || index >= Offsets.size() || !Offsets[index]) { return 0; }
+        return static_cast<U1>(Base[Offsets[index]]);
+    }
+
+    std::string_view PoolView::Utf8(const U2 index) const {
+        if (Tag(index) != static_cast<U1>(CPoolTags::Utf8)) { throw InvalidClassFile("expected a Utf8 constant"); }
+        const auto p = Entry(index);
+        return {reinterpret_cast<const char*>(p + 2), peek_u2(p)};
+    }
+
+    std::string_view PoolView::ClassName(const U2 index) const {
+        if (Tag(index) != static_cast<U1>(CPoolTags::Class)) { throw InvalidClassFile("expected a Class constant"); }
+        return Utf8(peek_u2(Entry(index)));
+    }
+
+    bool Parser::Visit(const std::vector<std::byte>& bytes, ClassVisitor& v) {
+        Cur = bytes.data();
+        Bound = Cur + bytes.size();
+        if (ReadU4() != 0xcafebabe) {
+            throw InvalidClassFile("invalid magic");
+        }
+        const U2 minor = ReadU2();
+        if (!v.Header(minor, ReadU2())) { return false; }
+
+        // only the tags and lengths are read; entries are looked at when the visitor asks for them
+        const U2 count = ReadU2();
+        PoolOffsets.assign(count, 0);
+        for (int i = 1; i < count; i++) {
+            PoolOffsets[i] = static_cast<uint32_t>(Cur - bytes.data());
+            const auto tag = static_cast<CPoolTags>(ReadU1());
+            const int size = entry_size(tag);
+            Vpa(size < 0 ? ReadU2() : size);
+            // long and double take up two entries, the second one is left empty
+            if (tag == CPoolTags::Long || tag == CPoolTags::Double) { i++; }
+        }
+        const PoolView pool(bytes.data(), PoolOffsets);
+        if (!v.ConstantPool(pool)) { return false; }
+
+        const U2 access_flags = ReadU2();
+        const U2 this_class = ReadU2();
+        const U2 super_class = ReadU2();
+        const U2 interface_count = ReadU2();
+        const U2List interfaces{Vpa(2 * interface_count), interface_count};
+        if (!v.Class(access_flags, this_class, super_class, interfaces)) { return false; }
+
+        auto attributes = [&](const AttributeOwner owner) {
+            for (int n = ReadU2(); n > 0; n--) {
+                const U2 name = ReadU2();
+                const U4 length = ReadU4();
+                if (length > static_cast<size_t>(Bound - Cur)) { throw std::range_error("Read Out of File Bound"); }
+                const auto info = Vpa(static_cast<int>(length));
+                if (!v.Attribute(owner, name, info, length)) { return false; }
+            }
+            return true;
+        };
+        for (int n = ReadU2(); n > 0; n--) {
+            const U2 flags = ReadU2(), name = ReadU2(), descriptor = ReadU2();
+            if (!v.Field(flags, name, descriptor) || !attributes(AttributeOwner::Field)) { return false; }
+        }
+        for (int n = ReadU2(); n > 0; n--) {
+            const U2 flags = ReadU2(), name = ReadU2(), descriptor = ReadU2();
+            if (!v.Method(flags, name, descriptor) || !attributes(AttributeOwner::Method)) { return false; }
+        }
+        return attributes(AttributeOwner::Class);
+    }
+
+    void ScanClassHeader(Parser& parser, const std::vector<std::byte>& bytes, ClassHeader& header) {
+        struct HeaderVisitor : ClassVisitor {
+            ClassHeader& H;
+            const PoolView* Pool = nullptr;
+
+            explicit HeaderVisitor(ClassHeader& h): H(h) {}
+
+            bool ConstantPool(const PoolView& pool) override {
+                Pool = &pool;
+                return true;
+            }
+
+            bool Class(const U2 access_flags, const U2 this_class, const U2 super_class, const U2List interfaces) override {
+                H.AccessFlags = access_flags;
+                H.ThisClass = Pool->ClassName(this_class);
+                H.SuperClass = super_class ? Pool->ClassName(super_class) : std::string_view();
+                H.Interfaces.clear();
+                for (U2 i = 0; i < interfaces.Count; i++) { H.Interfaces.push_back(Pool->ClassName(interfaces[i])); }
+                return false;
+            }
+        } v(header);
+        parser.Visit(bytes, v);
+    }
+}
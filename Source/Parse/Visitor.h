@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include "Parser.h"
+
+/*
+ * Visiting a class file as it is read, for callers that need a small part of it: nothing is copied or
+ * allocated but the table of constant pool offsets, and a callback returning false ends the parse.
+ */
+
+namespace Parse {
+    // The constant pool in the class file bytes, indexed as the pool is.
+    class PoolView {
+    public:
+        PoolView(PByte base, const std::vector<uint32_t>& offsets): Base(base), Offsets(offsets) {}
+
+        U2 Count() const { return static_cast<U2>(Offsets.size()); }
+        // 0 for index 0, an index out of range, and the slot after a Long or Double
+        U1 Tag(U2 index) const;
+        // the bytes after the tag
+        PByte Entry(U2 index) const { return Base + Offsets[index] + 1; }
+
+        // throw InvalidClassFile, like Utf8At and ClassNameAt
+        std::string_view Utf8(U2 index) const;
+        std::string_view ClassName(U2 index) const;
+
+    private:
+        PByte Base;
+        const std::vector<uint32_t>& Offsets; // of the tag, 0 for no entry
+    };
+
+    // big-endian u2 items, such as the interfaces of the class
+    struct U2List {
+        PByte Data;
+        U2 Count;
+
+        U2 operator[](const U2 i) const { return static_cast<U2>(static_cast<U2>(Data[2 * i]) << 8 | static_cast<U2>(Data[2 * i + 1])); }
+    };
+
+    enum class AttributeOwner { Field, Method, Class };
+
+    // Callbacks in file order. Each returns false to stop the parse; the defaults go on. The pool and
+    // the bytes handed over stay valid until Parser::Visit returns.
+    struct ClassVisitor {
+        virtual ~ClassVisitor() = default;
+        virtual bool Header(U2 /*minor_version*/, U2 /*major_version*/) { return true; }
+        virtual bool ConstantPool(const PoolView& /*pool*/) { return true; }
+        virtual bool Class(U2 /*access_flags*/, U2 /*this_class*/, U2 /*super_class*/, U2List /*interfaces*/) { return true; }
+        // the attributes of a member follow it
+        virtual bool Field(U2 /*access_flags*/, U2 /*name_index*/, U2 /*descriptor_index*/) { return true; }
+        virtual bool Method(U2 /*access_flags*/, U2 /*name_index*/, U2 /*descriptor_index*/) { return true; }
+        virtual bool Attribute(AttributeOwner /*owner*/, U2 /*name_index*/, PByte /*info*/, U4 /*length*/) { return true; }
+    };
+
+    // What a hierarchy index needs. The names point into the class file bytes.
+    struct ClassHeader {
+        U2 AccessFlags = 0;
+        std::string_view ThisClass;
+        std::string_view SuperClass; // empty for java/lang/Object
+        std::vector<std::string_view> Interfaces;
+    };
+
+    // Parses up to the interfaces only.
+    void ScanClassHeader(Parser& parser, const std::vector<std::byte>& bytes, ClassHeader& header);
+}
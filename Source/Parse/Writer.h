@@ -0,0 +1,89 @@
+#pragma once
+
+#include "ClassFile.h"
+#include "CpInfo.h"
+
+namespace Parse {
+    // Serializes a ClassFile back into bytes; counts and lengths are taken from the vectors
+    class Writer : public IWriter {
+    public:
+        void WriteU4(const U4 v) override {
+            WriteU2(static_cast<U2>(v >> 16));
+            WriteU2(static_cast<U2>(v));
+        }
+
+        void WriteU2(const U2 v) override {
+            Out.push_back(static_cast<U1>(v >> 8));
+            Out.push_back(static_cast<U1>(v));
+        }
+
+        void WriteU1(const U1 v) override { Out.push_back(v); }
+
+        void WriteBytes(const std::vector<U1>& bytes) override { Out.insert(Out.end(), bytes.begin(), bytes.end()); }
+
+        void WriteOnto(const ClassFile& f, std::vector<std::byte>& bytes) {
+            Out.clear();
+            WriteU4(f.Magic);
+            WriteU2(f.MinorVersion);
+            WriteU2(f.MajorVersion);
+            StoreConstantPool(f.ConstantPool);
+            WriteU2(f.AccessFlags);
+            WriteU2(f.ThisClass);
+            WriteU2(f.SuperClass);
+            WriteU2(static_cast<U2>(f.Interfaces.size()));
+            for (const auto i : f.Interfaces) { WriteU2(i); }
+            WriteU2(static_cast<U2>(f.Fields.size()));
+            for (const auto& fi : f.Fields) { StoreMember(fi.AccessFlags, fi.NameIndex, fi.DescriptorIndex, fi.Attributes); }
+            WriteU2(static_cast<U2>(f.Methods.size()));
+            for (const auto& mi : f.Methods) { StoreMember(mi.AccessFlags, mi.NameIndex, mi.DescriptorIndex, mi.Attributes); }
+            StoreAttributes(f.Attributes);
+            const auto start = reinterpret_cast<const std::byte*>(Out.data());
+            bytes.assign(start, start + Out.size());
+        }
+
+        void WriteCodeOnto(const CodeAttribute& c, std::vector<U1>& info) {
+            Out.clear();
+            WriteU2(c.MaxStack);
+            WriteU2(c.MaxLocals);
+            WriteU4(static_cast<U4>(c.Code.size()));
+            WriteBytes(c.Code);
+            WriteU2(static_cast<U2>(c.ExceptionTable.size()));
+            for (const auto& e : c.ExceptionTable) {
+                WriteU2(e.StartPc);
+                WriteU2(e.EndPc);
+                WriteU2(e.HandlerPc);
+                WriteU2(e.CatchType);
+            }
+            StoreAttributes(c.Attributes);
+            info.swap(Out);
+        }
+
+    private:
+        void StoreConstantPool(const std::vector<CpInfo>& pool) {
+            WriteU2(static_cast<U2>(pool.size()));
+            for (size_t i = 1; i < pool.size(); i++) {
+                if (!pool[i]) { continue; } // second half of a long or double
+                WriteU1(static_cast<U1>(pool[i]->Tag));
+                pool[i]->Write(*this);
+            }
+        }
+
+        void StoreMember(const U2 flags, const U2 name, const U2 desc, const std::vector<AttributeInfo>& attributes) {
+            WriteU2(flags);
+            WriteU2(name);
+            WriteU2(desc);
+            StoreAttributes(attributes);
+        }
+
+        void StoreAttributes(const std::vector<AttributeInfo>& attributes) {
+            WriteU2(static_cast<U2>(attributes.size()));
+            for (const auto& a : attributes) {
+                WriteU2(a.AttributeNameIndex);
+                WriteU4(static_cast<U4>(a.Info.size()));
+                WriteBytes(a.Info);
+            }
+        }
+
+        std::vector<U1> Out;
+    };
+}
@@ -0,0 +1,143 @@
+/* Constant pool compaction: mark live entries, merge identical ones, renumber through a flat table */
+
+#include <string>
+#include <unordered_map>
+#include "Parse/CpRefs.h"
+#include "CompactPool.h"
+
+using namespace Parse;
+
+namespace Patch {
+    static bool is_wide(const CPoolTags tag) { return tag == CPoolTags::Long || tag == CPoolTags::Double; }
+
+    // an entry only refers to entries of a lower level
+    static int level(const CPoolTags tag) {
+        switch (tag) {
+        case CPoolTags::Utf8: case CPoolTags::Integer: case CPoolTags::Float: case CPoolTags::Long:
+        case CPoolTags::Double: return 0;
+        case CPoolTags::Class: case CPoolTags::String: case CPoolTags::NameAndType: case CPoolTags::MethodType:
+        case CPoolTags::Module: case CPoolTags::Package: return 1;
+        case CPoolTags::MethodHandle: return 3;
+        default: return 2; // member refs, (invoke)dynamic
+        }
+    }
+
+    namespace {
+        struct Marker : ICpRefVisitor {
+            explicit Marker(const std::vector<CpInfo>& pool): Pool(pool), Live(pool.size()) {}
+
+            void Visit(U2& index) override {
+                if (index >= Pool.size() || !Pool[index]) { throw InvalidClassFile("invalid constant pool index"); }
+                if (!Live[index]) {
+                    Live[index] = 1;
+                    Work.push_back(index);
+                }
+            }
+
+            const std::vector<CpInfo>& Pool;
+            std::vector<U1> Live;
+            std::vector<U2> Work;
+        };
+
+        // identity of an entry: its tag and contents, with references replaced by their canonical index
+        struct KeyBuilder : IWriter, ICpRefVisitor {
+            explicit KeyBuilder(const std::vector<U2>& canon): Canon(canon) {}
+
+            void WriteU4(const U4 v) override {
+                WriteU2(static_cast<U2>(v >> 16));
+                WriteU2(static_cast<U2>(v));
+            }
+
+            void WriteU2(const U2 v) override {
+                Key.push_back(static_cast<char>(v >> 8));
+                Key.push_back(static_cast<char>(v));
+            }
+
+            void WriteU1(const U1 v) override { Key.push_back(static_cast<char>(v)); }
+
+            void WriteBytes(const std::vector<U1>& bytes) override { Key.append(bytes.begin(), bytes.end()); }
+
+            void Visit(U2& index) override { WriteU2(Canon[index]); }
+
+            void Build(CpInfoBase& e) {
+                Key.assign(1, static_cast<char>(e.Tag));
+                if (level(e.Tag) == 0) {
+                    e.Write(*this);
+                    return;
+                }
+                VisitEntryRefs(e, *this);
+                // the only payload that is not a constant pool index
+                if (e.Tag == CPoolTags::MethodHandle) {
+                    WriteU1(static_cast<ConstantMethodHandleInfo&>(e).ReferenceKind);
+                } else if (e.Tag == CPoolTags::Dynamic) {
+                    WriteU2(static_cast<ConstantDynamicInfo&>(e).BootstrapMethodAttrIndex);
+                } else if (e.Tag == CPoolTags::InvokeDynamic) {
+                    WriteU2(static_cast<ConstantInvokeDynamicInfo&>(e).BootstrapMethodAttrIndex);
+                }
+            }
+
+            const std::vector<U2>& Canon;
+            std::string Key;
+        };
+
+        struct Renumberer : ICpRefVisitor {
+            explicit Renumberer(const std::vector<U2>& remap): Remap(remap) {}
+            void Visit(U2& index) override { index = Remap[index]; }
+            const std::vector<U2>& Remap;
+        };
+    }
+
+    int CompactConstantPool(ClassFile& f) {
+        auto& pool = f.ConstantPool;
+        const int n = static_cast<int>(pool.size());
+
+        // mark everything reachable from outside of the pool
+        Marker marker(pool);
+        if (!VisitClassRefs(f, marker)) { return 0; }
+        while (!marker.Work.empty()) {
+            const U2 i = marker.Work.back();
+            marker.Work.pop_back();
+            VisitEntryRefs(*pool[i], marker);
+        }
+        const auto& live = marker.Live;
+
+        // merge identical live entries, one level at a time so that referenced entries are merged first
+        std::vector<U2> canon(n);
+        for (int i = 0; i < n; i++) { canon[i] = static_cast<U2>(i); }
+        std::unordered_map<std::string, U2> seen;
+        seen.reserve(n);
+        KeyBuilder key(canon);
+        for (int lv = 0; lv <= 3; lv++) {
+            for (int i = 1; i < n; i++) {
+                if (!live[i] || level(pool[i]->Tag) != lv) { continue; }
+                key.Build(*pool[i]);
+                canon[i] = seen.emplace(key.Key, static_cast<U2>(i)).first->second;
+            }
+        }
+
+        // number the survivors in their original order
+        std::vector<U2> remap(n);
+        int next = 1;
+        for (int i = 1; i < n; i++) {
+            if (!live[i] || canon[i] != i) { continue; }
+            remap[i] = static_cast<U2>(next);
+            next += is_wide(pool[i]->Tag) ? 2 : 1;
+        }
+        if (next == n) { return 0; }
+        for (int i = 1; i < n; i++) {
+            if (live[i]) { remap[i] = remap[canon[i]]; }
+        }
+
+        Renumberer renumber(remap);
+        VisitClassRefs(f, renumber);
+        std::vector<CpInfo> compacted(next);
+        for (int i = 1; i < n; i++) {
+            if (!live[i] || canon[i] != i) { continue; }
+            VisitEntryRefs(*pool[i], renumber);
+            compacted[remap[i]] = std::move(pool[i]);
+        }
+        pool.swap(compacted);
+        f.ConstantPoolCount = static_cast<U2>(next);
+        return n - next;
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+
+namespace Patch {
+    // Drops unreferenced constant pool entries, merges identical ones and renumbers every reference to
+    // them. Surviving entries keep their relative order, so no index grows (ldc operands stay u1).
+    // Returns the number of pool slots freed; the class is left untouched (and 0 returned) if it has an
+    // attribute whose references cannot be located.
+    int CompactConstantPool(Parse::ClassFile& f);
+}
@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <map>
+#include <memory>
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/PoolEditor.h"
+#include "Analyze/Insns.h"
+#include "Analyze/ValueFlow.h"
+#include "Inline.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        constexpr U2 ACC_PRIVATE = 0x0002;
+        constexpr U2 ACC_STATIC = 0x0008;
+        constexpr U2 ACC_FINAL = 0x0010;
+        constexpr U2 ACC_SYNCHRONIZED = 0x0020;
+        constexpr U2 ACC_NATIVE = 0x0100;
+        constexpr U2 ACC_ABSTRACT = 0x0400;
+
+        // HotSpot's limits on the bytecode size of the methods it inlines, and of those it compiles
+        constexpr int MAX_INLINE_SIZE = 35;
+        constexpr int FREQ_INLINE_SIZE = 325;
+        constexpr int HUGE_METHOD_LIMIT = 8000;
+        // and the calls it counts as frequent: run that often, or at least once every four invocations
+        constexpr uint64_t INLINE_FREQUENCY_COUNT = 100;
+        // of an exception table entry
+        constexpr int HANDLER_BYTES = 8;
+        // dup; invokevirtual Object.getClass; pop
+        constexpr int NULL_CHECK_BYTES = 5;
+
+        bool returns(const uint8_t op) { return op >= OP_IRETURN && op <= OP_RETURN; }
+        bool reads(const Insn& in) { return (in.Op >= OP_ILOAD && in.Op <= OP_ALOAD) || in.Op == OP_IINC; }
+        bool writes(const Insn& in) { return (in.Op >= OP_ISTORE && in.Op <= OP_ASTORE) || in.Op == OP_IINC; }
+        int store_size(const int local) { return local < 4 ? 1 : local < 256 ? 2 : 4; }
+
+        Insn op(const uint8_t code, const int value = 0) {
+            Insn in;
+            in.Op = code;
+            in.Value = value;
+            return in;
+        }
+
+        // the code of a callee, as it goes in
+        struct Body {
+            DecodedCode Code;
+            std::vector<std::pair<char, int>> Params; // descriptor and local of each argument, the receiver first
+            int Bytes = 0;
+            int Returns = 0;
+            bool Branches = false; // or switches or handlers
+        };
+
+        struct Site {
+            int Insn;
+            const Body* Callee;
+            int Growth;
+            bool NullCheck; // of a receiver that may be null
+            uint64_t Count; // of runs, as the profile has it
+        };
+
+        class Inliner {
+        public:
+            Inliner(ClassFile& f, const ClassHierarchy& h, const ExecutionProfile& profile, const ProfiledCode& input,
+                    int class_budget);
+
+            bool Any() const { return AnyCalls; }
+            // methods with code, callees before their callers
+            const std::vector<int>& Order() const { return BottomUp; }
+            bool Patch(const MethodInfo& m, DecodedCode& code);
+        private:
+            // Charges what the method patched last grew by, if it was encoded; PatchMethods leaves a
+            // method it cannot encode as it was.
+            void Settle();
+            int Target(const Insn& in) const;
+            const Body* BodyOf(int method);
+            std::vector<uint64_t> Frequencies(const DecodedCode& code, int id, bool counted) const;
+            void Splice(DecodedCode& code, const std::vector<Site>& sites);
+
+            ClassFile& F;
+            const ExecutionProfile& Profile;
+            const ProfiledCode& Input;
+            const int ClassBudget;
+            int Used = 0;
+            const MethodInfo* Patched = nullptr; // not settled yet, with its code before and what it grew by
+            std::vector<U1> Unpatched;
+            int Growth = 0;
+            std::string_view ThisClass;
+            std::map<std::pair<std::string_view, std::string_view>, int> Methods; // by name and descriptor
+            std::vector<int> Component;                                             // of each method
+            std::vector<int> BottomUp;
+            std::vector<std::unique_ptr<Body>> Bodies; // of each method, once it was asked for
+            std::vector<bool> Read;
+            bool AnyCalls = false; // to anything that may be inlined
+        };
+
+        Inliner::Inliner(ClassFile& f, const ClassHierarchy&, const ExecutionProfile& profile, const ProfiledCode& input,
+                         const int class_budget):
+            F(f), Profile(profile), Input(input), ClassBudget(class_budget), ThisClass(ClassNameAt(f, f.ThisClass)) {
+            const int n = static_cast<int>(f.Methods.size());
+            for (int k = 0; k < n; k++) {
+                Methods.emplace(std::make_pair(Utf8At(f, f.Methods[k].NameIndex), Utf8At(f, f.Methods[k].DescriptorIndex)), k);
+            }
+            Bodies.resize(n);
+            Read.assign(n, false);
+
+            std::vector<std::vector<int>> calls(n);
+            std::vector<bool> has_code(n);
+            for (int k = 0; k < n; k++) {
+                for (const auto& a : f.Methods[k].Attributes) {
+                    if (Utf8At(f, a.AttributeNameIndex) != "Code") { continue; }
+                    has_code[k] = true;
+                    CodeAttribute code;
+                    Parser{}.ParseCodeOnto(a.Info, code);
+                    try {
+                        for (const auto& in : DecodeCode(f, code).Insns) {
+                            const int callee = Target(in);
+                            if (callee >= 0) { calls[k].push_back(callee); }
+                            AnyCalls = AnyCalls || callee >= 0;
+                        }
+                    } catch (const InvalidBytecode&) {
+                    } catch (const InvalidClassFile&) {
+                    }
+                }
+            }
+
+            // Tarjan's, which completes the components callees first
+            Component.assign(n, -1);
+            std::vector<int> index(n, -1), low(n), stack;
+            std::vector<bool> stacked(n);
+            int visited = 0, components = 0;
+            for (int root = 0; root < n; root++) {
+                if (index[root] >= 0) { continue; }
+                std::vector<std::pair<int, size_t>> work; // method, next call to follow
+                auto visit = [&](const int v) {
+                    index[v] = low[v] = visited++;
+                    stack.push_back(v);
+                    stacked[v] = true;
+                    work.emplace_back(v, 0);
+                };
+                visit(root);
+                while (!work.empty()) {
+                    const int v = work.back().first;
+                    if (work.back().second < calls[v].size()) {
+                        const int w = calls[v][work.back().second++];
+                        if (index[w] < 0) {
+                            visit(w);
+                        } else if (stacked[w]) {
+                            low[v] = std::min(low[v], index[w]);
+                        }
+                        continue;
+                    }
+                    work.pop_back();
+                    if (!work.empty()) { low[work.back().first] = std::min(low[work.back().first], low[v]); }
+                    if (low[v] != index[v]) { continue; }
+                    int w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        stacked[w] = false;
+                        Component[w] = components;
+                        if (has_code[w]) { BottomUp.push_back(w); }
+                    } while (w != v);
+                    components++;
+                }
+            }
+        }
+
+        // the method of the class an invocation is bound to, -1 if it is not known before run time or
+        // cannot be inlined
+        int Inliner::Target(const Insn& in) const {
+            if (in.Op != OP_INVOKESTATIC && in.Op != OP_INVOKESPECIAL && in.Op != OP_INVOKEVIRTUAL) { return -1; }
+            const auto ref = MemberRefAt(F, static_cast<U2>(in.Value));
+            if (ref.Owner != ThisClass || ref.Name[0] == '<') { return -1; }
+            const auto at = Methods.find({ref.Name, ref.Descriptor});
+            if (at == Methods.end()) { return -1; }
+            const U2 access = F.Methods[at->second].AccessFlags;
+            if (access & (ACC_SYNCHRONIZED | ACC_NATIVE | ACC_ABSTRACT)) { return -1; }
+            const bool bound = in.Op == OP_INVOKESTATIC ? (access & ACC_STATIC) :
+                               in.Op == OP_INVOKESPECIAL ? !(access & ACC_STATIC) && (access & ACC_PRIVATE) :
+                               !(access & ACC_STATIC) && ((access & (ACC_PRIVATE | ACC_FINAL)) || (F.AccessFlags & ACC_FINAL));
+            return bound ? at->second : -1;
+        }
+
+        // The code of a method as it is now, null for code that does not go in anywhere as it is: jsr and
+        // ret, monitors (which the JVM checks per frame), unreachable code, and returns with more on the
+        // stack than the result.
+        const Body* Inliner::BodyOf(const int method) {
+            if (Read[method]) { return Bodies[method].get(); }
+            Read[method] = true;
+            const auto& m = F.Methods[method];
+            const auto attr = std::find_if(m.Attributes.begin(), m.Attributes.end(), [&](const AttributeInfo& a) {
+                return Utf8At(F, a.AttributeNameIndex) == "Code";
+            });
+            if (attr == m.Attributes.end()) { return nullptr; }
+            CodeAttribute code;
+            Parser{}.ParseCodeOnto(attr->Info, code);
+            auto body = std::make_unique<Body>();
+            auto& d = body->Code;
+            try {
+                d = DecodeCode(F, code);
+                for (const auto& in : d.Insns) {
+                    if (in.Op == OP_JSR || in.Op == OP_RET || in.Op == OP_MONITORENTER || in.Op == OP_MONITOREXIT) {
+                        return nullptr;
+                    }
+                }
+                const auto desc = Utf8At(F, m.DescriptorIndex);
+                const ValueFlow flow(F, d, std::vector<int>(d.Insns.size(), -1));
+                for (size_t i = 0; i < d.Insns.size(); i++) {
+                    const uint8_t op = d.Insns[i].Op;
+                    if (flow.Depth(static_cast<int>(i)) < 0) { return nullptr; }
+                    if (returns(op)) {
+                        if (flow.Depth(static_cast<int>(i)) != ReturnSlots(desc)) { return nullptr; }
+                        body->Returns++;
+                    }
+                    if (IsBranch(op) || (OpcodeTable[op].Flags & OPF_SWITCH)) { body->Branches = true; }
+                }
+
+                int local = 0;
+                if (!(m.AccessFlags & ACC_STATIC)) { body->Params.emplace_back('L', local++); }
+                for (size_t i = 1; i < desc.size() && desc[i] != ')'; i++) {
+                    const char type = desc[i];
+                    while (desc[i] == '[') { i++; }
+                    if (desc[i] == 'L') { i = desc.find(';', i); }
+                    body->Params.emplace_back(type, local);
+                    local += TypeSlots(type);
+                }
+            } catch (const InvalidBytecode&) {
+                return nullptr;
+            } catch (const InvalidClassFile&) {
+                return nullptr;
+            }
+            body->Branches = body->Branches || !d.Handlers.empty();
+            body->Bytes = d.DecodedPcs.back();
+            Bodies[method] = std::move(body);
+            return Bodies[method].get();
+        }
+
+        // How often each instruction ran, by the profile: the invocations of the method enter it, a
+        // conditional branch with counts ran as often as they say and goes each way as often as they say,
+        // and one without splits what reaches it evenly, like a switch. Jumps back are not followed, so
+        // what a loop runs is what the branch deciding it counted. Handlers get nothing. Branch counts
+        // are by the offsets of the input, so they are only counted if the code is still that of the input
+        // (--layout, --fold-clinit or --lower-indy may have moved them); otherwise every branch splits evenly.
+        std::vector<uint64_t> Inliner::Frequencies(const DecodedCode& code, const int id, const bool counted) const {
+            const int n = static_cast<int>(code.Insns.size());
+            std::vector<uint64_t> runs(n + 1);
+            runs[0] = Profile.Counts(id).Invocations;
+            for (int i = 0; i < n; i++) {
+                const auto& in = code.Insns[i];
+                const auto flags = OpcodeTable[in.Op].Flags;
+                auto to = [&](const int target, const uint64_t count) {
+                    if (target > i) { runs[target] += count; }
+                };
+                if (flags & OPF_SWITCH) {
+                    const auto& targets = code.Switches[in.Value].Targets;
+                    for (const int t : targets) { to(t, runs[i] / targets.size()); }
+                } else if (IsBranch(in.Op) && !(flags & OPF_END)) {
+                    const BranchCounts* counts = counted && in.Pc >= 0 ? Profile.Branch(id, in.Pc) : nullptr;
+                    if (counts) { runs[i] = counts->Taken + counts->NotTaken; }
+                    to(in.Target, counts ? counts->Taken : runs[i] / 2);
+                    to(i + 1, counts ? counts->NotTaken : runs[i] - runs[i] / 2);
+                } else if (IsBranch(in.Op)) {
+                    to(in.Target, runs[i]);
+                } else if (!(flags & OPF_END)) {
+                    to(i + 1, runs[i]);
+                }
+            }
+            runs.pop_back();
+            return runs;
+        }
+
+        bool Inliner::Patch(const MethodInfo& m, DecodedCode& code) {
+            const int self = static_cast<int>(&m - F.Methods.data());
+            const int n = static_cast<int>(code.Insns.size());
+            const int id = Profile.Id(F, m);
+            const uint64_t invocations = id >= 0 ? Profile.Counts(id).Invocations : 0;
+            const auto runs = invocations ? Frequencies(code, id, Input.Unchanged(F, m)) : std::vector<uint64_t>(n);
+            Settle();
+
+            const ValueFlow flow(F, code, std::vector<int>(n, -1));
+            // a receiver that is this needs no null check, as long as nothing else goes in local 0
+            std::vector<bool> joins(n + 1); // instructions reached other than from the one before
+            const bool this_kept = !(m.AccessFlags & ACC_STATIC) &&
+                std::none_of(code.Insns.begin(), code.Insns.end(), [](const Insn& in) { return writes(in) && in.Local == 0; });
+            if (this_kept) {
+                for (const auto& in : code.Insns) {
+                    if (in.Target >= 0) { joins[in.Target] = true; }
+                    if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                        for (const int t : code.Switches[in.Value].Targets) { joins[t] = true; }
+                    }
+                }
+                for (const auto& h : code.Handlers) { joins[h.Target] = true; }
+            }
+            // whether the receiver of the call at i is pushed by an aload_0 in the straight-line code before it
+            auto receiver_is_this = [&](const int i) {
+                int above = EffectOf(F, code.Insns[i]).Pops - 1; // slots of the arguments
+                for (int k = i - 1; k >= 0 && !joins[k + 1]; k--) {
+                    const auto& in = code.Insns[k];
+                    if (OpcodeTable[in.Op].Flags & OPF_END) { return false; }
+                    const auto effect = EffectOf(F, in);
+                    if (above < effect.Pushes) { return effect.Pushes == 1 && in.Op == OP_ALOAD && in.Local == 0; }
+                    above += effect.Pops - effect.Pushes;
+                }
+                return false;
+            };
+
+            std::vector<Site> sites;
+            for (int i = 0; i < n; i++) {
+                const int callee = Target(code.Insns[i]);
+                if (callee < 0 || Component[callee] == Component[self] || flow.Depth(i) < 0) { continue; }
+                const Body* body = BodyOf(callee);
+                // a callee that always throws leaves the code after the call unreachable
+                if (!body || !body->Returns) { continue; }
+                const auto effect = EffectOf(F, code.Insns[i]);
+                // a handler clears the stack, and a frame within the code may not have to hold what the
+                // caller has on it
+                if (flow.Depth(i) > effect.Pops && body->Branches) { continue; }
+                const bool receiver = code.Insns[i].Op != OP_INVOKESTATIC;
+                const bool check = receiver && !(this_kept && receiver_is_this(i));
+
+                const auto& insns = body->Code.Insns;
+                const bool ends_in_return = returns(insns.back().Op);
+                int growth = body->Bytes - 3 - (ends_in_return ? 1 : 0) +
+                             2 * (body->Returns - (ends_in_return ? 1 : 0)) +
+                             HANDLER_BYTES * static_cast<int>(body->Code.Handlers.size()) + (check ? NULL_CHECK_BYTES : 0);
+                for (const auto& p : body->Params) { growth += store_size(code.MaxLocals + p.second); }
+                const bool frequent = runs[i] && (runs[i] >= INLINE_FREQUENCY_COUNT || runs[i] * 4 >= invocations);
+                if (growth > 0 && body->Bytes > (frequent ? FREQ_INLINE_SIZE : MAX_INLINE_SIZE)) { continue; }
+                sites.push_back({i, body, growth, check, runs[i]});
+            }
+
+            // what runs most first, then what costs least
+            std::stable_sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) {
+                return a.Count != b.Count ? a.Count > b.Count : a.Growth < b.Growth;
+            });
+            int length = code.DecodedPcs.back();
+            int growth = 0;
+            std::vector<Site> taken;
+            for (const auto& s : sites) {
+                if (s.Growth > 0 && (s.Growth > ClassBudget - Used - growth || length + s.Growth > HUGE_METHOD_LIMIT)) {
+                    continue;
+                }
+                growth += std::max(s.Growth, 0);
+                length += s.Growth;
+                taken.push_back(s);
+            }
+            if (taken.empty()) { return false; }
+            std::sort(taken.begin(), taken.end(), [](const Site& a, const Site& b) { return a.Insn < b.Insn; });
+            Splice(code, taken);
+            for (const auto& a : m.Attributes) {
+                if (Utf8At(F, a.AttributeNameIndex) == "Code") { Unpatched = a.Info; }
+            }
+            Patched = &m, Growth = growth;
+            return true;
+        }
+
+        void Inliner::Settle() {
+            if (!Patched) { return; }
+            for (const auto& a : Patched->Attributes) {
+                if (Utf8At(F, a.AttributeNameIndex) == "Code" && a.Info != Unpatched) { Used += Growth; }
+            }
+            Patched = nullptr;
+        }
+
+        // Puts the callees in place of the calls at sites, ascending. Their locals start past those of the
+        // caller; as the code of one call is done before the next starts, they all start there.
+        void Inliner::Splice(DecodedCode& code, const std::vector<Site>& sites) {
+            const int n = static_cast<int>(code.Insns.size());
+            const int base = code.MaxLocals;
+            const size_t tables = code.Switches.size();
+            PoolEditor pool(F);
+            std::vector<Insn> insns;
+            std::vector<bool> caller; // whether the target of each instruction is still an index of the caller
+            std::vector<int> at(n + 1); // index of each instruction of the caller
+            std::vector<Handler> handlers;
+            int max_locals = base;
+            auto put = [&](const Insn& in, const bool of_caller) {
+                insns.push_back(in);
+                caller.push_back(of_caller);
+            };
+
+            size_t next = 0;
+            for (int j = 0; j < n; j++) {
+                at[j] = static_cast<int>(insns.size());
+                if (next == sites.size() || sites[next].Insn != j) {
+                    put(code.Insns[j], true);
+                    continue;
+                }
+                const auto& site = sites[next++];
+                const auto& d = site.Callee->Code;
+                const auto& params = site.Callee->Params;
+                for (auto p = params.rbegin(); p != params.rend(); ++p) {
+                    if (site.NullCheck && p + 1 == params.rend()) {
+                        put(op(OP_DUP), false);
+                        put(op(OP_INVOKEVIRTUAL, pool.MethodRef("java/lang/Object", "getClass", "()Ljava/lang/Class;")), false);
+                        put(op(OP_POP), false);
+                    }
+                    put(StoreInsn(p->first, base + p->second), false);
+                }
+
+                // a return at the end falls through to what follows the call
+                const int start = static_cast<int>(insns.size());
+                const int count = static_cast<int>(d.Insns.size());
+                const int end = start + count - (returns(d.Insns.back().Op) ? 1 : 0);
+                for (int k = 0; k < count; k++) {
+                    auto in = d.Insns[k];
+                    in.Pc = -1;
+                    if (returns(in.Op)) {
+                        if (k == count - 1) { continue; }
+                        Insn go = op(OP_GOTO);
+                        go.Target = j + 1;
+                        put(go, true);
+                        continue;
+                    }
+                    if (reads(in) || writes(in)) { in.Local += base; }
+                    if (in.Target >= 0) { in.Target += start; }
+                    if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                        auto table = d.Switches[in.Value];
+                        for (auto& t : table.Targets) { t += start; }
+                        in.Value = static_cast<int>(code.Switches.size());
+                        code.Switches.push_back(std::move(table));
+                    }
+                    put(in, false);
+                }
+                for (const auto& h : d.Handlers) {
+                    const int stop = std::min(start + h.End, end);
+                    if (start + h.Start < stop) { handlers.push_back({start + h.Start, stop, start + h.Target, h.CatchType}); }
+                }
+                max_locals = std::max(max_locals, base + d.MaxLocals);
+            }
+            at[n] = static_cast<int>(insns.size());
+
+            for (size_t k = 0; k < insns.size(); k++) {
+                if (caller[k] && insns[k].Target >= 0) { insns[k].Target = at[insns[k].Target]; }
+            }
+            for (size_t t = 0; t < tables; t++) {
+                for (auto& target : code.Switches[t].Targets) { target = at[target]; }
+            }
+            for (const auto& h : code.Handlers) { handlers.push_back({at[h.Start], at[h.End], at[h.Target], h.CatchType}); }
+            for (auto& l : code.Lines) { l.Start = at[l.Start]; }
+            for (auto& l : code.Locals) {
+                l.Start = at[l.Start];
+                l.End = at[l.End];
+            }
+            // the frames of the caller no longer fit
+            for (auto& in : insns) { in.Pc = -1; }
+            code.Insns = std::move(insns);
+            code.Handlers = std::move(handlers);
+            if (max_locals > 0xffff) { throw std::length_error("too many locals"); }
+            code.MaxLocals = static_cast<U2>(max_locals);
+            const int max_stack = MaxStackOf(F, code);
+            if (max_stack > 0xffff) { throw std::length_error("operand stack too deep"); }
+            code.MaxStack = static_cast<U2>(max_stack);
+        }
+    }
+
+    int InlineCalls(ClassFile& f, const ClassHierarchy& h, const ExecutionProfile& profile, const ProfiledCode& input,
+                    const int class_budget) {
+        Inliner inliner(f, h, profile, input, class_budget);
+        if (!inliner.Any()) { return 0; }
+        return PatchMethods(f, h, [&](const MethodInfo& m, DecodedCode& code) {
+            try {
+                return inliner.Patch(m, code);
+            } catch (const InvalidBytecode&) {
+                return false;
+            } catch (const InvalidClassFile&) {
+                return false;
+            } catch (const std::length_error&) {
+                return false;
+            }
+        }, inliner.Order());
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+#include "Analyze/ExecutionProfile.h"
+
+namespace Patch {
+    // Replaces calls to methods of the class itself that are bound at compile time (static, private or
+    // final) by the code of the method: the arguments go to locals past those of the caller, returns
+    // become jumps past the call, and the exception handlers of the callee go ahead of the caller's.
+    // Methods are done callees first, by the strongly connected components of the calls within the class,
+    // so what goes in has had its own calls inlined already; calls within a component (recursion) stay.
+    // That makes the pass serial within a class; classes are independent, so they run in parallel like
+    // any other pass.
+    //
+    // A call site costs what it adds to the code: the callee less the call, plus the stores of the
+    // arguments, the jumps the returns become and the callee's exception table entries. Sites that add
+    // nothing are always inlined. Others are if the callee is within MaxInlineSize (35 bytes), or within
+    // FreqInlineSize (325) at a site the profile has run frequently (InlineFrequencyCount, 100 times, or
+    // once every four invocations of the caller, by its branch counts, which only count while the code
+    // of the caller is still what input holds for it). The sites run most are taken
+    // first, then the cheapest, while the caller stays within HugeMethodLimit (8000), beyond which HotSpot
+    // compiles nothing, and what the class grew by within class_budget bytes. The budget is per class,
+    // not per batch, so that what a class becomes does not depend on the others (or on which of them
+    // ran first), and a method is only charged for once it is encoded. Returns the number of methods
+    // changed.
+    int InlineCalls(Parse::ClassFile& f, const Analyze::ClassHierarchy& h, const Analyze::ExecutionProfile& profile,
+                    const Analyze::ProfiledCode& input, int class_budget);
+}
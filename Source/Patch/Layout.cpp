@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/PoolEditor.h"
+#include "Analyze/Insns.h"
+#include "Analyze/StackMap.h"
+#include "Analyze/ValueFlow.h"
+#include "Layout.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        constexpr U2 ACC_PRIVATE = 0x0002;
+        constexpr U2 ACC_STATIC = 0x0008;
+        constexpr U2 ACC_INTERFACE = 0x0200;
+        constexpr U2 ACC_SYNTHETIC = 0x1000;
+
+        // HotSpot's limits on the bytecode size of the methods it inlines: MaxInlineSize for any call,
+        // FreqInlineSize for a call that runs often
+        constexpr int MAX_INLINE_SIZE = 35;
+        constexpr int FREQ_INLINE_SIZE = 325;
+        // bytes a path has to be longer than the call that replaces it to be outlined
+        constexpr int MIN_OUTLINE_GAIN = 8;
+        // instructions of a cold path at most
+        constexpr int MAX_PATH = 4096;
+
+        bool conditional(const uint8_t op) {
+            return (op >= OP_IFEQ && op <= OP_IF_ACMPNE) || op == OP_IFNULL || op == OP_IFNONNULL;
+        }
+        uint8_t inverted(const uint8_t op) {
+            return static_cast<uint8_t>(op >= OP_IFNULL ? op ^ 1 : ((op - OP_IFEQ) ^ 1) + OP_IFEQ);
+        }
+        bool returns(const uint8_t op) { return op >= OP_IRETURN && op <= OP_RETURN; }
+        bool reads(const Insn& in) { return (in.Op >= OP_ILOAD && in.Op <= OP_ALOAD) || in.Op == OP_IINC; }
+        bool writes(const Insn& in) { return (in.Op >= OP_ISTORE && in.Op <= OP_ASTORE) || in.Op == OP_IINC; }
+        bool wide_local(const uint8_t op) {
+            return op == OP_LLOAD || op == OP_DLOAD || op == OP_LSTORE || op == OP_DSTORE;
+        }
+        int load_size(const int local) { return local < 4 ? 1 : local < 256 ? 2 : 4; }
+
+        int code_length(const AttributeInfo& a) {
+            return a.Info[4] << 24 | a.Info[5] << 16 | a.Info[6] << 8 | a.Info[7];
+        }
+
+        // code a conditional branch leads to that leaves the method without coming back
+        struct ColdPath {
+            int Branch;             // the conditional branch
+            bool Taken;             // the side of it
+            int Entry;
+            std::vector<int> Insns; // ascending
+            uint8_t Exit;           // athrow, or the return all of it ends in
+            int Bytes;
+        };
+
+        // a method a cold path went to, and the call that replaces the path
+        struct Outlined {
+            size_t Caller;
+            MethodInfo Method;
+            ColdPath Path;
+            std::vector<Insn> Call;
+            int Saved; // bytes
+        };
+
+        class Layout {
+        public:
+            Layout(ClassFile& f, const ClassHierarchy& h, const ExecutionProfile& profile, const int budget):
+                F(f), H(h), Profile(profile), Budget(budget) {
+                for (const auto& m : f.Methods) { Names.emplace(Utf8At(f, m.NameIndex)); }
+            }
+
+            bool Patch(const MethodInfo& m, DecodedCode& code);
+            std::vector<InlineFit> AddOutlined(const std::vector<std::vector<U1>>& before);
+
+        private:
+            std::vector<ColdPath> FindColdPaths(const DecodedCode& code, int id);
+            bool Collect(const DecodedCode& code, ColdPath& path);
+            bool Outline(const MethodInfo& m, const DecodedCode& code, const ColdPath& path, const Frame& entry,
+                         const Frame* declared);
+            std::string ColdName(std::string_view name);
+
+            ClassFile& F;
+            const ClassHierarchy& H;
+            const ExecutionProfile& Profile;
+            const int Budget;
+            std::set<std::string, std::less<>> Names; // of the methods of F
+            std::vector<Outlined> Methods;            // to add once every method is patched
+            std::vector<int> Entries;                 // jumps to each instruction
+            std::vector<bool> Caught;                 // handler targets
+            std::vector<int> Mark;                    // Stamp for the instructions of the path collected
+            int Stamp = 0;
+        };
+
+        // Follows the code from path.Entry to where it leaves the method. Fails on code anything outside
+        // the path comes to, on switches and monitors, and on code not all in the same handler ranges.
+        bool Layout::Collect(const DecodedCode& code, ColdPath& path) {
+            const int n = static_cast<int>(code.Insns.size());
+            const int stamp = ++Stamp;
+            std::vector<int> work{path.Entry};
+            path.Exit = OP_NOP;
+            while (!work.empty()) {
+                const int j = work.back();
+                work.pop_back();
+                if (Mark[j] == stamp) { continue; }
+                Mark[j] = stamp;
+                path.Insns.push_back(j);
+                const auto& in = code.Insns[j];
+                const auto flags = OpcodeTable[in.Op].Flags;
+                if (path.Insns.size() > MAX_PATH || Caught[j] || (flags & OPF_SWITCH) ||
+                    in.Op == OP_MONITORENTER || in.Op == OP_MONITOREXIT) {
+                    return false;
+                }
+                if (in.Op == OP_ATHROW || returns(in.Op)) {
+                    if (path.Exit != OP_NOP && path.Exit != in.Op) { return false; }
+                    path.Exit = in.Op;
+                    continue;
+                }
+                if (in.Target >= 0) { work.push_back(in.Target); }
+                if (!(flags & OPF_END)) {
+                    if (j + 1 >= n) { return false; }
+                    work.push_back(j + 1);
+                }
+            }
+            if (path.Exit == OP_NOP) { return false; }
+            std::sort(path.Insns.begin(), path.Insns.end());
+
+            // nothing else comes to it, by jumping or falling through
+            std::map<int, int> inside; // jumps to each instruction from the path
+            if (path.Taken) { inside[path.Entry]++; }
+            for (const int j : path.Insns) {
+                const auto& in = code.Insns[j];
+                if (in.Target >= 0) { inside[in.Target]++; }
+                if (j == path.Entry && !path.Taken) { continue; } // the branch falls through to it
+                if (j > 0 && Mark[j - 1] != stamp && !(OpcodeTable[code.Insns[j - 1].Op].Flags & OPF_END)) { return false; }
+            }
+            for (const int j : path.Insns) {
+                const auto at = inside.find(j);
+                if (Entries[j] != (at == inside.end() ? 0 : at->second)) { return false; }
+            }
+            for (const auto& h : code.Handlers) {
+                const bool covered = h.Start <= path.Entry && path.Entry < h.End;
+                for (const int j : path.Insns) {
+                    if ((h.Start <= j && j < h.End) != covered) { return false; }
+                }
+            }
+            path.Bytes = 0;
+            for (const int j : path.Insns) { path.Bytes += code.DecodedPcs[j + 1] - code.DecodedPcs[j]; }
+            return true;
+        }
+
+        std::vector<ColdPath> Layout::FindColdPaths(const DecodedCode& code, const int id) {
+            const int n = static_cast<int>(code.Insns.size());
+            Entries.assign(n, 0);
+            Caught.assign(n, false);
+            Mark.assign(n, 0);
+            for (const auto& in : code.Insns) {
+                if (in.Target >= 0) { Entries[in.Target]++; }
+                if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                    for (const int t : code.Switches[in.Value].Targets) { Entries[t]++; }
+                }
+            }
+            for (const auto& h : code.Handlers) { Caught[h.Target] = true; }
+            const ValueFlow flow(F, code, std::vector<int>(n, -1));
+
+            std::vector<ColdPath> paths;
+            for (int i = 0; i < n; i++) {
+                const auto& in = code.Insns[i];
+                if (!conditional(in.Op) || flow.Depth(i) < 0) { continue; }
+                const BranchCounts* counts = id >= 0 && in.Pc >= 0 ? Profile.Branch(id, in.Pc) : nullptr;
+                for (const bool taken : {false, true}) {
+                    ColdPath path{i, taken, taken ? in.Target : i + 1, {}, OP_NOP, 0};
+                    if (path.Entry == (taken ? i + 1 : in.Target) || path.Entry >= n || flow.Depth(path.Entry) != 0) {
+                        continue;
+                    }
+                    if (counts && ((taken ? counts->Taken : counts->NotTaken) != 0 ||
+                                   (taken ? counts->NotTaken : counts->Taken) == 0)) {
+                        continue;
+                    }
+                    if (!Collect(code, path) || (!counts && path.Exit != OP_ATHROW)) { continue; }
+                    paths.push_back(std::move(path));
+                    break; // the other side has the rest of the method
+                }
+            }
+            return paths;
+        }
+
+        // Builds the method the path goes to and the call that replaces it. The locals the path reads that
+        // have a type where it starts (entry) are the arguments, in slot order; what it throws is returned.
+        // A reference argument has the type the LocalVariableTable declares there, or else the one of the
+        // frame the input has there (declared, if any): the computed one may be a supertype the merges
+        // widened to, which the path may not be able to use. A path reading null or a reference neither
+        // declares stays where it is.
+        bool Layout::Outline(const MethodInfo& m, const DecodedCode& code, const ColdPath& path, const Frame& entry,
+                             const Frame* declared) {
+            std::map<int, int> width;  // of each local the path uses
+            std::set<int> read;
+            for (const int j : path.Insns) {
+                const auto& in = code.Insns[j];
+                if (!reads(in) && !writes(in)) { continue; }
+                auto& w = width[in.Local];
+                w = std::max(w, wide_local(in.Op) ? 2 : 1);
+                if (reads(in)) { read.insert(in.Local); }
+            }
+
+            std::map<int, int> slot; // of each local in the new method
+            std::string desc = "(";
+            int next = 0, bytes = 4;
+            std::vector<Insn> call;
+            for (const int local : read) {
+                if (local >= static_cast<int>(entry.Locals.size())) { continue; }
+                const VType& t = entry.Locals[local];
+                if (t.Tag == VTag::Null) { return false; }
+                auto type = TypeDescriptor(t);
+                if (type.empty()) { continue; }
+                if (t.Tag == VTag::Object) {
+                    type.clear();
+                    for (const auto& l : code.Locals) {
+                        if (!l.Generic && l.Index == local && l.Start <= path.Entry && path.Entry < l.End) {
+                            type = Utf8At(F, l.Descriptor);
+                        }
+                    }
+                    if (type.empty() && declared && local < static_cast<int>(declared->Locals.size()) &&
+                        declared->Locals[local].Tag == VTag::Object) {
+                        type = TypeDescriptor(declared->Locals[local]);
+                    }
+                    if (type.empty() || (type[0] != 'L' && type[0] != '[')) { return false; }
+                }
+                desc += type;
+                slot[local] = next;
+                next += TypeSlots(type[0]);
+                call.push_back(LoadInsn(type[0], local));
+                bytes += load_size(local);
+            }
+            for (const auto& [local, w] : width) {
+                if (slot.count(local)) { continue; }
+                slot[local] = next;
+                next += w;
+            }
+            if (path.Bytes - bytes < MIN_OUTLINE_GAIN || next > 0xffff) { return false; }
+            if (path.Exit == OP_ATHROW) {
+                desc += ")Ljava/lang/Throwable;";
+            } else {
+                const auto caller = Utf8At(F, m.DescriptorIndex);
+                desc += caller.substr(caller.find(')'));
+            }
+
+            std::map<int, int> index; // of each instruction of the path in the new method
+            const int first = path.Insns.front() == path.Entry ? 0 : 1;
+            for (size_t k = 0; k < path.Insns.size(); k++) { index[path.Insns[k]] = first + static_cast<int>(k); }
+            std::vector<Insn> insns;
+            if (first) {
+                Insn go;
+                go.Op = OP_GOTO;
+                go.Target = index[path.Entry];
+                insns.push_back(go);
+            }
+            for (const int j : path.Insns) {
+                auto in = code.Insns[j];
+                in.Pc = -1;
+                if (reads(in) || writes(in)) { in.Local = slot[in.Local]; }
+                if (in.Target >= 0) { in.Target = index[in.Target]; }
+                if (in.Op == OP_ATHROW) { in.Op = OP_ARETURN; }
+                insns.push_back(in);
+            }
+
+            // built right away, so that a path whose method cannot be is left where it is
+            PoolEditor pool(F);
+            const auto name = ColdName(Utf8At(F, m.NameIndex));
+            MethodInfo callee;
+            callee.AccessFlags = ACC_PRIVATE | ACC_STATIC | ACC_SYNTHETIC;
+            callee.NameIndex = pool.Utf8(name);
+            callee.DescriptorIndex = pool.Utf8(desc);
+            try {
+                callee.Attributes.push_back(AssembleCode(F, callee, std::move(insns), next, H));
+            } catch (const FrameError&) {
+                return false;
+            } catch (const std::length_error&) {
+                return false;
+            }
+            callee.AttributesCount = 1;
+
+            Insn invoke;
+            invoke.Op = OP_INVOKESTATIC;
+            invoke.Value = PoolEditor(F).MethodRef(ClassNameAt(F, F.ThisClass), name, desc);
+            call.push_back(invoke);
+            Insn exit;
+            exit.Op = path.Exit;
+            call.push_back(exit);
+            Names.insert(name);
+            Methods.push_back({static_cast<size_t>(&m - F.Methods.data()), std::move(callee), path, std::move(call),
+                               path.Bytes - bytes});
+            return true;
+        }
+
+        std::string Layout::ColdName(const std::string_view name) {
+            std::string base;
+            for (const char c : name) {
+                if (c != '<' && c != '>') { base += c; }
+            }
+            base += "$cold";
+            for (int k = 0;; k++) {
+                auto candidate = base + std::to_string(k);
+                if (!Names.count(candidate)) { return candidate; }
+            }
+        }
+
+        bool Layout::Patch(const MethodInfo& m, DecodedCode& code) {
+            const int n = static_cast<int>(code.Insns.size());
+            const int id = Profile.Id(F, m);
+            auto paths = FindColdPaths(code, id);
+            if (paths.empty()) { return false; }
+            std::stable_sort(paths.begin(), paths.end(), [](const ColdPath& a, const ColdPath& b) {
+                return a.Bytes > b.Bytes;
+            });
+            std::vector<bool> taken(n);
+            auto overlaps = [&](const ColdPath& p) {
+                return std::any_of(p.Insns.begin(), p.Insns.end(), [&](const int j) { return taken[j]; });
+            };
+            auto take = [&](const ColdPath& p) {
+                for (const int j : p.Insns) { taken[j] = true; }
+            };
+
+            // outlining, as long as the method is over budget
+            int length = code.DecodedPcs.back();
+            const size_t outlined = Methods.size();
+            if (id >= 0 && Profile.Counts(id).Invocations > 0 && length > Budget && !(F.AccessFlags & ACC_INTERFACE)) {
+                std::vector<Frame> frames, declared; // computed, and as the input has them
+                CodeAttribute attr;
+                for (const auto& a : m.Attributes) {
+                    if (Utf8At(F, a.AttributeNameIndex) == "Code") { Parser{}.ParseCodeOnto(a.Info, attr); }
+                }
+                try {
+                    std::vector<int> at;
+                    for (const auto& p : paths) { at.push_back(code.Insns[p.Entry].Pc); }
+                    frames = ComputeFrames(F, m, attr, H, at);
+                } catch (const FrameError&) {
+                }
+                for (const auto& a : attr.Attributes) {
+                    if (Utf8At(F, a.AttributeNameIndex) != "StackMapTable") { continue; }
+                    try {
+                        declared = DecodeStackMapTable(F, a.Info, InitialFrame(F, m));
+                    } catch (const InvalidClassFile&) {
+                    }
+                }
+                for (const auto& p : paths) {
+                    if (length <= Budget || frames.empty()) { break; }
+                    if (overlaps(p)) { continue; }
+                    const int pc = code.Insns[p.Entry].Pc;
+                    auto at = [&](const std::vector<Frame>& in) {
+                        return std::find_if(in.begin(), in.end(), [&](const Frame& fr) { return fr.Offset == pc; });
+                    };
+                    const auto entry = at(frames), input = at(declared);
+                    if (entry == frames.end() ||
+                        !Outline(m, code, p, *entry, input == declared.end() ? nullptr : &*input)) {
+                        continue;
+                    }
+                    length -= Methods.back().Saved;
+                    take(p);
+                }
+            }
+
+            // the rest goes to the end
+            std::vector<const ColdPath*> sink;
+            for (const auto& p : paths) {
+                if (overlaps(p) || p.Insns.back() == n - 1) { continue; }
+                if (!p.Taken && (p.Insns.front() != p.Branch + 1 || p.Insns.back() + 1 != code.Insns[p.Branch].Target ||
+                                 static_cast<int>(p.Insns.size()) != p.Insns.back() - p.Insns.front() + 1)) {
+                    continue;
+                }
+                take(p);
+                sink.push_back(&p);
+            }
+            if (Methods.size() == outlined && sink.empty()) { return false; }
+
+            std::vector<int> at(n); // index of each instruction once the cold paths are at the end
+            for (int i = 0; i < n; i++) { at[i] = i; }
+            if (!sink.empty()) {
+                std::sort(sink.begin(), sink.end(), [](const ColdPath* a, const ColdPath* b) {
+                    return a->Insns.front() < b->Insns.front();
+                });
+                std::vector<bool> sunk(n);
+                for (const auto* p : sink) {
+                    for (const int j : p->Insns) { sunk[j] = true; }
+                    if (!p->Taken) {
+                        auto& branch = code.Insns[p->Branch];
+                        branch.Op = inverted(branch.Op);
+                        branch.Target = p->Entry;
+                    }
+                }
+                std::vector<int> order;
+                for (int i = 0; i < n; i++) {
+                    if (!sunk[i]) { order.push_back(i); }
+                }
+                for (const auto* p : sink) { order.insert(order.end(), p->Insns.begin(), p->Insns.end()); }
+                for (int k = 0; k < n; k++) { at[order[k]] = k; }
+                ReorderCode(code, order);
+                // moved code does not keep its frames by offset
+                for (auto& in : code.Insns) { in.Pc = -1; }
+            }
+            CodeRewriter rewriter(code);
+            for (size_t k = outlined; k < Methods.size(); k++) {
+                const auto& o = Methods[k];
+                rewriter.Replace(at[o.Path.Entry], o.Call);
+                for (const int j : o.Path.Insns) {
+                    if (j != o.Path.Entry) { rewriter.Replace(at[j], {}); }
+                }
+            }
+            rewriter.Apply();
+            return true;
+        }
+
+        std::vector<InlineFit> Layout::AddOutlined(const std::vector<std::vector<U1>>& before) {
+            std::vector<InlineFit> fits;
+            const size_t count = F.Methods.size();
+            std::vector<bool> patched(count);
+            for (auto& o : Methods) {
+                const auto& caller = F.Methods[o.Caller];
+                const auto code = std::find_if(caller.Attributes.begin(), caller.Attributes.end(), [&](const AttributeInfo& a) {
+                    return Utf8At(F, a.AttributeNameIndex) == "Code";
+                });
+                if (code->Info == before[o.Caller]) { continue; } // the caller was left as it was
+                F.Methods.push_back(std::move(o.Method));
+                patched[o.Caller] = true;
+            }
+            F.MethodsCount = static_cast<U2>(F.Methods.size());
+
+            for (size_t k = 0; k < count; k++) {
+                if (!patched[k]) { continue; }
+                const auto& m = F.Methods[k];
+                for (const auto& a : m.Attributes) {
+                    if (Utf8At(F, a.AttributeNameIndex) != "Code") { continue; }
+                    const int was = code_length(AttributeInfo{0, 0, before[k]}), now = code_length(a);
+                    for (const int limit : {MAX_INLINE_SIZE, FREQ_INLINE_SIZE}) {
+                        if (was > limit && now <= limit) {
+                            fits.push_back({std::string(Utf8At(F, m.NameIndex)) + std::string(Utf8At(F, m.DescriptorIndex)),
+                                            was, now, limit});
+                            break;
+                        }
+                    }
+                }
+            }
+            return fits;
+        }
+    }
+
+    std::vector<InlineFit> LayOutColdPaths(ClassFile& f, const ClassHierarchy& h, const ExecutionProfile& profile,
+                                           const int budget) {
+        Layout layout(f, h, profile, budget);
+        std::vector<std::vector<U1>> before;
+        for (const auto& m : f.Methods) {
+            before.emplace_back();
+            for (const auto& a : m.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) == "Code") { before.back() = a.Info; }
+            }
+        }
+        PatchMethods(f, h, [&](const MethodInfo& m, DecodedCode& code) {
+            try {
+                return layout.Patch(m, code);
+            } catch (const InvalidBytecode&) {
+                return false;
+            } catch (const InvalidClassFile&) {
+                return false;
+            }
+        });
+        return layout.AddOutlined(before);
+    }
+}
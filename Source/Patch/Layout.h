@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+#include "Analyze/ExecutionProfile.h"
+
+namespace Patch {
+    // A method whose code went from above one of HotSpot's inlining limits to within it
+    struct InlineFit {
+        std::string Method; // name and descriptor
+        int Before, After;  // code length
+        int Limit;          // MaxInlineSize (35) or FreqInlineSize (325), the lower if it got within both
+    };
+
+    // Gets the cold paths of every method out of the way of the hot code. A cold path is code a
+    // conditional branch leads to that leaves the method (by throwing or returning) without coming back
+    // to the rest of it: error handling, say. It is cold if the profile has the branch never going there
+    // while going the other way, or, for a branch the profile has no counts for, if it only throws.
+    //
+    // In a method the profile has invocations for and whose code is longer than budget, the largest cold
+    // paths are outlined into private static methods until it fits: the path gets the locals it reads as
+    // arguments and returns what it throws, or what it returns. A reference argument is typed as the
+    // LocalVariableTable or the input's frame declares it; a path reading null, or a reference neither
+    // declares, is not outlined. The other cold paths are moved to the end of the method, the branch
+    // inverted where it fell through to them. Runs before anything else rewrites code, as branch counts
+    // go by the offsets of the input. Returns the methods that got within an inlining limit.
+    std::vector<InlineFit> LayOutColdPaths(Parse::ClassFile& f, const Analyze::ClassHierarchy& h,
+                                           const Analyze::ExecutionProfile& profile, int budget);
+}
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include "Parse/CpRefs.h"
+#include "Analyze/Insns.h"
+#include "Locals.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        constexpr U2 ACC_STATIC = 0x0008;
+
+        bool reads(const Insn& in) { return (in.Op >= OP_ILOAD && in.Op <= OP_ALOAD) || in.Op == OP_IINC; }
+        bool writes(const Insn& in) { return (in.Op >= OP_ISTORE && in.Op <= OP_ASTORE) || in.Op == OP_IINC; }
+        int width(const Insn& in) {
+            return in.Op == OP_LLOAD || in.Op == OP_DLOAD || in.Op == OP_LSTORE || in.Op == OP_DSTORE ? 2 : 1;
+        }
+
+        // pushes that can go away together with a store of what they push
+        bool pure_push(const Insn& in, const int slots) {
+            switch (in.Op) {
+            case OP_ACONST_NULL: case OP_ICONST_M1: case OP_ICONST_0: case OP_ICONST_1: case OP_ICONST_2:
+            case OP_ICONST_3: case OP_ICONST_4: case OP_ICONST_5: case OP_FCONST_0: case OP_FCONST_1:
+            case OP_FCONST_2: case OP_BIPUSH: case OP_SIPUSH: case OP_ILOAD: case OP_FLOAD: case OP_ALOAD:
+            case OP_DUP:
+                return slots == 1;
+            case OP_LCONST_0: case OP_LCONST_1: case OP_DCONST_0: case OP_DCONST_1: case OP_LLOAD: case OP_DLOAD:
+            case OP_DUP2:
+                return slots == 2;
+            default:
+                return false;
+            }
+        }
+
+        // a set of locals
+        struct Slots {
+            std::vector<uint64_t> Bits;
+
+            explicit Slots(const int n = 0): Bits((n + 63) / 64) {}
+            bool Has(const int s) const { return Bits[s >> 6] >> (s & 63) & 1; }
+            void Set(const int s) { Bits[s >> 6] |= uint64_t{1} << (s & 63); }
+            void Reset(const int s) { Bits[s >> 6] &= ~(uint64_t{1} << (s & 63)); }
+            // whether that added any
+            bool Add(const Slots& o) {
+                bool added = false;
+                for (size_t k = 0; k < Bits.size(); k++) {
+                    added |= (o.Bits[k] & ~Bits[k]) != 0;
+                    Bits[k] |= o.Bits[k];
+                }
+                return added;
+            }
+        };
+
+        struct Block {
+            int Start, End;
+            std::vector<int> Next;     // blocks control goes on to
+            std::vector<int> Handlers; // blocks of the handlers that catch in this one
+            Slots LiveIn;              // locals some path from the start reads before writing
+            std::vector<int> Webs;     // the web in each live local on entry
+            bool Reached = false;
+            bool Queued = false;
+        };
+
+        // A web is a store together with every load that may read what it stored, and with every other
+        // store those loads may read; webs, not locals, get slots. Each store starts a web of its own
+        // (its instruction index identifies it, N + slot for a parameter), and a local that is live where
+        // paths meet joins the webs it holds on each of them.
+        class Compactor {
+        public:
+            Compactor(const ClassFile& f, const MethodInfo& m, DecodedCode& code):
+                F(f), M(m), Code(code), N(static_cast<int>(code.Insns.size())), Locals(code.MaxLocals) {}
+
+            bool Run();
+
+        private:
+            bool split_blocks();
+            void find_liveness();
+            bool find_webs();
+            void merge(int b, const std::vector<int>& webs);
+            void run_block(int b);
+            int find(int web);
+            void interfere(std::vector<int>& live_in);
+            int color();
+            void rewrite(int max_locals, bool renumbered, const std::vector<int>& live_in);
+
+            const ClassFile& F;
+            const MethodInfo& M;
+            DecodedCode& Code;
+            const int N, Locals;
+            std::vector<int> ParamWidth; // per slot, 0 for slots that start no parameter
+            int Params = 0;
+            std::vector<Block> Blocks;
+            std::vector<int> BlockAt;
+            std::vector<int> Work;
+            std::vector<int> Parent; // of each web, for joining them
+            std::vector<int> WebOf;  // the web loads, stores and iinc read or write
+            bool Undefined = false;  // a local read where no store reaches it
+            std::vector<int> Width;
+            std::vector<bool> Dead; // stores whose values nothing reads
+            std::vector<std::vector<int>> Interferes;
+            std::vector<int> Slot;   // of each web
+            std::vector<int> Tracked; // column of each local in the live_in of interfere, -1 if not needed
+            int Columns = 0;
+        };
+
+        bool Compactor::split_blocks() {
+            std::vector<bool> leader(N + 1);
+            leader[0] = true;
+            for (int i = 0; i < N; i++) {
+                const Insn& in = Code.Insns[i];
+                const auto flags = OpcodeTable[in.Op].Flags;
+                if (in.Target >= 0) { leader[in.Target] = leader[i + 1] = true; }
+                if (flags & OPF_SWITCH) {
+                    for (const int t : Code.Switches[in.Value].Targets) { leader[t] = true; }
+                }
+                if (flags & (OPF_SWITCH | OPF_END)) { leader[i + 1] = true; }
+            }
+            for (const auto& h : Code.Handlers) {
+                if (h.Start < h.End) { leader[h.Start] = leader[h.End] = leader[h.Target] = true; }
+            }
+            BlockAt.assign(N, -1);
+            for (int i = 0; i < N; i++) {
+                if (!leader[i]) { continue; }
+                if (!Blocks.empty()) { Blocks.back().End = i; }
+                BlockAt[i] = static_cast<int>(Blocks.size());
+                Blocks.push_back({i, N, {}, {}, Slots(Locals), {}});
+            }
+            for (auto& b : Blocks) {
+                const Insn& last = Code.Insns[b.End - 1];
+                if (last.Target >= 0) { b.Next.push_back(BlockAt[last.Target]); }
+                if (OpcodeTable[last.Op].Flags & OPF_SWITCH) {
+                    for (const int t : Code.Switches[last.Value].Targets) { b.Next.push_back(BlockAt[t]); }
+                }
+                if (!(OpcodeTable[last.Op].Flags & OPF_END)) {
+                    if (b.End == N) { return false; } // falls off the end of the code
+                    b.Next.push_back(BlockAt[b.End]);
+                }
+                for (const auto& h : Code.Handlers) {
+                    if (b.Start >= h.Start && b.Start < h.End) { b.Handlers.push_back(BlockAt[h.Target]); }
+                }
+            }
+            return true;
+        }
+
+        void Compactor::find_liveness() {
+            for (bool more = true; more;) {
+                more = false;
+                for (auto b = Blocks.rbegin(); b != Blocks.rend(); ++b) {
+                    Slots live(Locals), caught(Locals);
+                    for (const int next : b->Next) { live.Add(Blocks[next].LiveIn); }
+                    for (const int h : b->Handlers) { caught.Add(Blocks[h].LiveIn); }
+                    live.Add(caught);
+                    for (int i = b->End - 1; i >= b->Start; i--) {
+                        const Insn& in = Code.Insns[i];
+                        if (writes(in)) { live.Reset(in.Local); }
+                        if (reads(in)) { live.Set(in.Local); }
+                        live.Add(caught);
+                    }
+                    more |= b->LiveIn.Add(live);
+                }
+            }
+        }
+
+        int Compactor::find(int web) {
+            while (Parent[web] != web) { web = Parent[web] = Parent[Parent[web]]; }
+            return web;
+        }
+
+        void Compactor::merge(const int b, const std::vector<int>& webs) {
+            auto& block = Blocks[b];
+            bool changed = !block.Reached;
+            if (!block.Reached) {
+                block.Reached = true;
+                block.Webs.assign(Locals, -1);
+            }
+            for (int s = 0; s < Locals; s++) {
+                if (webs[s] < 0 || !block.LiveIn.Has(s)) { continue; }
+                if (block.Webs[s] < 0) {
+                    block.Webs[s] = webs[s];
+                    changed = true;
+                } else {
+                    Parent[find(webs[s])] = find(block.Webs[s]);
+                }
+            }
+            if (changed && !block.Queued) {
+                block.Queued = true;
+                Work.push_back(b);
+            }
+        }
+
+        void Compactor::run_block(const int b) {
+            auto webs = Blocks[b].Webs;
+            for (int i = Blocks[b].Start; i < Blocks[b].End; i++) {
+                const Insn& in = Code.Insns[i];
+                for (const int h : Blocks[b].Handlers) { merge(h, webs); }
+                if (reads(in)) {
+                    if (webs[in.Local] < 0) { Undefined = true; }
+                    WebOf[i] = webs[in.Local];
+                } else if (writes(in)) {
+                    WebOf[i] = webs[in.Local] = i;
+                    for (const int h : Blocks[b].Handlers) { merge(h, webs); }
+                }
+            }
+            for (const int next : Blocks[b].Next) { merge(next, webs); }
+        }
+
+        bool Compactor::find_webs() {
+            Parent.resize(N + Locals);
+            for (int w = 0; w < N + Locals; w++) { Parent[w] = w; }
+            WebOf.assign(N, -1);
+            std::vector<int> entry(Locals, -1);
+            for (int s = 0; s < Params; s++) {
+                if (ParamWidth[s]) { entry[s] = N + s; }
+            }
+            merge(0, entry);
+            while (!Work.empty()) {
+                const int b = Work.back();
+                Work.pop_back();
+                Blocks[b].Queued = false;
+                run_block(b);
+            }
+            if (Undefined) { return false; }
+            for (const auto& b : Blocks) {
+                // unreachable code would have no frames anyway
+                if (!b.Reached) { return false; }
+                for (int s = 0; s < Locals; s++) {
+                    if (b.LiveIn.Has(s) && b.Webs[s] < 0) { return false; }
+                }
+            }
+            return true;
+        }
+
+        // Goes over the code backwards with the web live in each local, for which webs are live where
+        // another is stored and which stores are dead; live_in gets the web live before each
+        // instruction in the Tracked locals.
+        void Compactor::interfere(std::vector<int>& live_in) {
+            Dead.assign(N, false);
+            Interferes.assign(N + Locals, {});
+            live_in.assign(static_cast<size_t>(N) * Columns, -1);
+            std::vector<int> live(Locals);
+            std::vector<std::pair<int, int>> caught; // local and web
+            for (const auto& b : Blocks) {
+                std::fill(live.begin(), live.end(), -1);
+                caught.clear();
+                for (const int next : b.Next) {
+                    for (int s = 0; s < Locals; s++) {
+                        if (Blocks[next].LiveIn.Has(s)) { live[s] = find(Blocks[next].Webs[s]); }
+                    }
+                }
+                for (const int h : b.Handlers) {
+                    for (int s = 0; s < Locals; s++) {
+                        if (Blocks[h].LiveIn.Has(s)) { caught.emplace_back(s, find(Blocks[h].Webs[s])); }
+                    }
+                }
+                for (const auto& [s, web] : caught) { live[s] = web; }
+                for (int i = b.End - 1; i >= b.Start; i--) {
+                    const Insn& in = Code.Insns[i];
+                    if (writes(in)) {
+                        const int web = find(WebOf[i]);
+                        if (live[in.Local] < 0) {
+                            Dead[i] = true;
+                        } else {
+                            for (int s = 0; s < Locals; s++) {
+                                if (s != in.Local && live[s] >= 0 && live[s] != web) {
+                                    Interferes[web].push_back(live[s]);
+                                    Interferes[live[s]].push_back(web);
+                                }
+                            }
+                        }
+                        live[in.Local] = -1;
+                    }
+                    if (reads(in)) { live[in.Local] = find(WebOf[i]); }
+                    for (const auto& [s, web] : caught) { live[s] = web; }
+                    for (int s = 0; s < Locals; s++) {
+                        if (Tracked[s] >= 0) { live_in[static_cast<size_t>(i) * Columns + Tracked[s]] = live[s]; }
+                    }
+                }
+            }
+        }
+
+        // Gives each web the lowest slot past the parameters that none of the webs it interferes with has,
+        // in the order the webs are first stored. Returns the max_locals that takes.
+        int Compactor::color() {
+            Slot.assign(N + Locals, -1);
+            int top = Params;
+            for (int s = 0; s < Params; s++) {
+                if (ParamWidth[s]) { Slot[find(N + s)] = s; }
+            }
+            std::vector<std::pair<int, int>> taken;
+            for (int i = 0; i < N; i++) {
+                if (WebOf[i] < 0 || (Dead[i] && !reads(Code.Insns[i]))) { continue; }
+                const int web = find(WebOf[i]);
+                if (Slot[web] >= 0) { continue; }
+                taken.clear();
+                for (const int other : Interferes[web]) {
+                    if (Slot[other] >= 0) { taken.emplace_back(Slot[other], Slot[other] + Width[other]); }
+                }
+                std::sort(taken.begin(), taken.end());
+                int slot = Params;
+                for (const auto& [start, end] : taken) {
+                    if (start >= slot + Width[web]) { break; }
+                    slot = std::max(slot, end);
+                }
+                Slot[web] = slot;
+                top = std::max(top, slot + Width[web]);
+            }
+            return top;
+        }
+
+        void Compactor::rewrite(const int max_locals, const bool renumbered, const std::vector<int>& live_in) {
+            CodeRewriter rewriter(Code);
+            for (int i = 0; i < N; i++) {
+                Insn& in = Code.Insns[i];
+                if (Dead[i]) {
+                    if (in.Op == OP_IINC) {
+                        rewriter.Replace(i, {});
+                    } else if (i > 0 && BlockAt[i] < 0 && pure_push(Code.Insns[i - 1], width(in))) {
+                        rewriter.Replace(i - 1, {});
+                        rewriter.Replace(i, {});
+                    } else {
+                        Insn pop;
+                        pop.Op = width(in) == 2 ? OP_POP2 : OP_POP;
+                        rewriter.Replace(i, {pop});
+                    }
+                } else if (WebOf[i] >= 0) {
+                    in.Local = Slot[find(WebOf[i])];
+                }
+            }
+
+            // the variables past the parameters go where their webs went, for as long as they are live
+            std::vector<LocalEntry> entries;
+            for (const auto& e : Code.Locals) {
+                const auto desc = Utf8At(F, e.Descriptor);
+                const int slots = !desc.empty() && (desc[0] == 'J' || desc[0] == 'D') ? 2 : 1;
+                if (e.Index < Params || !renumbered) {
+                    if (e.Index + slots <= max_locals) { entries.push_back(e); }
+                    continue;
+                }
+                if (e.Index >= Locals || Tracked[e.Index] < 0) { continue; }
+                auto web_at = [&](const int i) { return live_in[static_cast<size_t>(i) * Columns + Tracked[e.Index]]; };
+                for (int i = std::max(e.Start, 0); i < std::min(e.End, N);) {
+                    const int web = web_at(i);
+                    if (web < 0 || Width[web] != slots) {
+                        i++;
+                        continue;
+                    }
+                    int end = i + 1;
+                    while (end < std::min(e.End, N) && web_at(end) == web) { end++; }
+                    entries.push_back({i, end, e.Name, e.Descriptor, static_cast<U2>(Slot[web]), e.Generic});
+                    i = end;
+                }
+            }
+            Code.Locals = std::move(entries);
+            rewriter.Apply();
+            Code.MaxLocals = static_cast<U2>(max_locals);
+        }
+
+        bool Compactor::Run() {
+            if (!N) { return false; }
+            ParamWidth.assign(Locals + 2, 0);
+            if (!(M.AccessFlags & ACC_STATIC)) { ParamWidth[Params++] = 1; }
+            const auto desc = Utf8At(F, M.DescriptorIndex);
+            for (size_t k = 1; k < desc.size() && desc[k] != ')'; k++) {
+                if (Params >= Locals) { return false; }
+                const size_t first = k;
+                while (desc[k] == '[') { k++; }
+                if (desc[k] == 'L') { k = desc.find(';', k); }
+                if (k == std::string_view::npos) { return false; }
+                ParamWidth[Params] = k == first && (desc[k] == 'J' || desc[k] == 'D') ? 2 : 1;
+                Params += ParamWidth[Params];
+            }
+            if (Params > Locals) { return false; }
+
+            int stack;
+            try {
+                stack = MaxStackOf(F, Code);
+            } catch (const InvalidBytecode&) {
+                return false;
+            }
+            bool changed = stack != Code.MaxStack;
+            Code.MaxStack = static_cast<U2>(stack);
+            if (Locals == Params || !split_blocks()) { return changed; }
+            find_liveness();
+            if (!find_webs()) { return changed; }
+
+            Width.assign(N + Locals, 1);
+            for (int s = 0; s < Params; s++) {
+                if (ParamWidth[s]) { Width[find(N + s)] = ParamWidth[s]; }
+            }
+            for (int i = 0; i < N; i++) {
+                if (WebOf[i] >= 0) { Width[find(WebOf[i])] = std::max(Width[find(WebOf[i])], width(Code.Insns[i])); }
+            }
+            Tracked.assign(Locals, -1);
+            for (const auto& e : Code.Locals) {
+                if (e.Index >= Params && e.Index < Locals && Tracked[e.Index] < 0) { Tracked[e.Index] = Columns++; }
+            }
+            std::vector<int> live_in;
+            interfere(live_in);
+
+            // the slots as they are, if coloring does no better
+            const int colored = color();
+            int kept = Params;
+            for (int i = 0; i < N; i++) {
+                if (WebOf[i] >= 0 && (!Dead[i] || reads(Code.Insns[i]))) {
+                    kept = std::max(kept, Code.Insns[i].Local + Width[find(WebOf[i])]);
+                }
+            }
+            const bool renumbered = colored < kept;
+            if (!renumbered) {
+                for (int i = 0; i < N; i++) {
+                    if (WebOf[i] >= 0) { Slot[find(WebOf[i])] = Code.Insns[i].Local; }
+                }
+            }
+            const bool dead = std::find(Dead.begin(), Dead.end(), true) != Dead.end();
+            const int max_locals = renumbered ? colored : kept;
+            if (!renumbered && !dead && max_locals == Locals) { return changed; }
+
+            rewrite(max_locals, renumbered, live_in);
+            // frames from scratch: the old ones have the locals where they were
+            for (auto& in : Code.Insns) { in.Pc = -1; }
+            return true;
+        }
+    }
+
+    int CompactLocals(ClassFile& f, const ClassHierarchy& h) {
+        return PatchMethods(f, h, [&](const MethodInfo& m, DecodedCode& code) { return Compactor(f, m, code).Run(); });
+    }
+}
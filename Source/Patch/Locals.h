@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+
+namespace Patch {
+    // Renumbers the locals of every method into as few slots as their lifetimes allow. The stores whose
+    // values a load may read are put together with it into one web; webs that are never live at the
+    // same time share a slot, the parameters keeping theirs. Stores whose values no load reads become
+    // pops (or go away with the push before them). LocalVariable(Type)Table entries follow their webs to
+    // the new slots, narrowed to where the variable is live. max_locals and max_stack are set to what
+    // the code needs exactly. Returns the number of methods changed.
+    int CompactLocals(Parse::ClassFile& f, const Analyze::ClassHierarchy& h);
+}
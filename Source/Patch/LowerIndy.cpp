@@ -0,0 +1,813 @@
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/PoolEditor.h"
+#include "Analyze/Insns.h"
+#include "Analyze/ValueFlow.h"
+#include "CompactPool.h"
+#include "LowerIndy.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        constexpr U2 ACC_PUBLIC = 0x0001;
+        constexpr U2 ACC_PRIVATE = 0x0002;
+        constexpr U2 ACC_STATIC = 0x0008;
+        constexpr U2 ACC_FINAL = 0x0010;
+        constexpr U2 ACC_SUPER = 0x0020;
+        constexpr U2 ACC_BRIDGE = 0x0040;
+        constexpr U2 ACC_INTERFACE = 0x0200;
+        constexpr U2 ACC_SYNTHETIC = 0x1000;
+
+        // reference kinds of method handles
+        constexpr int REF_INVOKE_VIRTUAL = 5, REF_INVOKE_STATIC = 6, REF_INVOKE_SPECIAL = 7,
+                      REF_NEW_INVOKE_SPECIAL = 8, REF_INVOKE_INTERFACE = 9;
+
+        // flags of LambdaMetafactory.altMetafactory
+        constexpr U4 FLAG_SERIALIZABLE = 1, FLAG_MARKERS = 2, FLAG_BRIDGES = 4;
+
+        Insn op(const uint8_t code, const int value = 0) {
+            Insn in;
+            in.Op = code;
+            in.Value = value;
+            return in;
+        }
+
+        struct BootstrapMethod {
+            U2 Handle;
+            std::vector<U2> Args;
+        };
+
+        // the entries of the BootstrapMethods attribute, and its index in f.Attributes (-1 if there is none)
+        std::vector<BootstrapMethod> read_bootstrap_methods(const ClassFile& f, int& attribute) {
+            std::vector<BootstrapMethod> methods;
+            attribute = -1;
+            for (size_t i = 0; i < f.Attributes.size(); i++) {
+                const auto& a = f.Attributes[i];
+                if (Utf8At(f, a.AttributeNameIndex) != "BootstrapMethods") { continue; }
+                attribute = static_cast<int>(i);
+                const U1* p = a.Info.data();
+                const U1* end = p + a.Info.size();
+                auto u2 = [&]() -> U2 {
+                    if (end - p < 2) { throw InvalidClassFile("truncated BootstrapMethods"); }
+                    p += 2;
+                    return static_cast<U2>(p[-2] << 8 | p[-1]);
+                };
+                for (int n = u2(); n > 0; n--) {
+                    BootstrapMethod m{u2(), {}};
+                    for (int k = u2(); k > 0; k--) { m.Args.push_back(u2()); }
+                    methods.push_back(std::move(m));
+                }
+                break;
+            }
+            return methods;
+        }
+
+        // the entry at index if it has the tag, else null
+        const CpInfoBase* entry(const ClassFile& f, const U2 index, const CPoolTags tag) {
+            if (index == 0 || index >= f.ConstantPool.size() || !f.ConstantPool[index]) { return nullptr; }
+            const auto& e = f.ConstantPool[index];
+            return e->Tag == tag ? e.get() : nullptr;
+        }
+
+        std::string_view method_type_at(const ClassFile& f, const U2 index) {
+            const auto* e = entry(f, index, CPoolTags::MethodType);
+            return e ? Utf8At(f, static_cast<const ConstantMethodTypeInfo*>(e)->DescriptorIndex) : std::string_view();
+        }
+
+        bool is_reference(const std::string_view type) { return type[0] == 'L' || type[0] == '['; }
+
+        // the name of a reference type for a Class entry: internal for a class, the descriptor for an array
+        std::string_view class_name(const std::string_view type) {
+            return type[0] == 'L' ? type.substr(1, type.size() - 2) : type;
+        }
+
+        std::string type_of_class(const std::string_view name) {
+            return name[0] == '[' ? std::string(name) : "L" + std::string(name) + ";";
+        }
+
+        // the parameter types of a method descriptor, and its return type; false if it does not parse
+        bool split_descriptor(const std::string_view desc, std::vector<std::string_view>& params,
+                              std::string_view& result) {
+            params.clear();
+            if (desc.empty() || desc[0] != '(') { return false; }
+            size_t i = 1;
+            while (i < desc.size() && desc[i] != ')') {
+                const size_t start = i;
+                while (i < desc.size() && desc[i] == '[') { i++; }
+                if (i < desc.size() && desc[i] == 'L') { i = desc.find(';', i); }
+                if (i >= desc.size()) { return false; }
+                params.push_back(desc.substr(start, ++i - start));
+            }
+            if (i + 1 >= desc.size()) { return false; }
+            result = desc.substr(i + 1);
+            return true;
+        }
+
+        struct BoxClass {
+            char Primitive;
+            std::string_view Name, Unbox;
+        };
+
+        constexpr BoxClass box_classes[] = {
+            {'Z', "java/lang/Boolean", "booleanValue"}, {'B', "java/lang/Byte", "byteValue"},
+            {'S', "java/lang/Short", "shortValue"}, {'C', "java/lang/Character", "charValue"},
+            {'I', "java/lang/Integer", "intValue"}, {'J', "java/lang/Long", "longValue"},
+            {'F', "java/lang/Float", "floatValue"}, {'D', "java/lang/Double", "doubleValue"},
+        };
+
+        const BoxClass* box_of(const char primitive) {
+            for (const auto& b : box_classes) {
+                if (b.Primitive == primitive) { return &b; }
+            }
+            return nullptr;
+        }
+
+        const BoxClass* box_class(const std::string_view name) {
+            for (const auto& b : box_classes) {
+                if (b.Name == name) { return &b; }
+            }
+            return nullptr;
+        }
+
+        Insn return_insn(const char type) {
+            if (type == 'V') { return op(OP_RETURN); }
+            return op(static_cast<uint8_t>(LoadInsn(type, 0).Op - OP_ILOAD + OP_IRETURN));
+        }
+
+        // straight-line code, built against the constant pool of the class it goes in
+        struct Emitter {
+            PoolEditor& Pool;
+            std::vector<Insn> Insns;
+
+            void Add(const uint8_t code, const int value = 0) { Insns.push_back(op(code, value)); }
+
+            void Invoke(const uint8_t code, const std::string_view owner, const std::string_view name,
+                        const std::string_view desc, const bool interface = false) {
+                Insn in = op(code, interface ? Pool.InterfaceMethodRef(owner, name, desc) : Pool.MethodRef(owner, name, desc));
+                if (code == OP_INVOKEINTERFACE) { in.Local = ArgumentSlots(desc) + 1; }
+                Insns.push_back(in);
+            }
+
+            bool Widen(char from, char to);
+            // the conversions the metafactory applies to a value of type from passed or returned as type
+            // to: widening, boxing, unboxing and casts; false where it would not link
+            bool Convert(std::string_view from, std::string_view to);
+        };
+
+        bool Emitter::Widen(const char from, const char to) {
+            static constexpr std::pair<char, std::string_view> wider[] = {
+                {'B', "SIJFD"}, {'S', "IJFD"}, {'C', "IJFD"}, {'I', "JFD"}, {'J', "FD"}, {'F', "D"},
+            };
+            if (from == to) { return true; }
+            bool allowed = false;
+            for (const auto& [type, to_types] : wider) { allowed |= type == from && to_types.find(to) != std::string_view::npos; }
+            if (!allowed) { return false; }
+            static constexpr std::string_view kinds = "IJFD";
+            auto kind = [](const char c) { return c == 'J' || c == 'F' || c == 'D' ? c : 'I'; };
+            const int a = static_cast<int>(kinds.find(kind(from))), b = static_cast<int>(kinds.find(kind(to)));
+            // i2l, i2f, i2d, l2i, l2f, l2d, f2i, f2l, f2d, d2i, d2l, d2f
+            if (a != b) { Add(static_cast<uint8_t>(OP_I2L + a * 3 + (b < a ? b : b - 1))); }
+            return true;
+        }
+
+        bool Emitter::Convert(const std::string_view from, const std::string_view to) {
+            if (from == to) { return true; }
+            if (from == "V" || to == "V") { return false; }
+            if (!is_reference(from) && !is_reference(to)) { return Widen(from[0], to[0]); }
+            if (!is_reference(from)) {
+                // a box passes for any of its supertypes
+                const auto* box = box_of(from[0]);
+                Invoke(OP_INVOKESTATIC, box->Name, "valueOf", std::string("(") + box->Primitive + ")L" + std::string(box->Name) + ";");
+                return true;
+            }
+            if (!is_reference(to)) {
+                const auto* box = from[0] == 'L' ? box_class(class_name(from)) : nullptr;
+                if (!box) {
+                    box = box_of(to[0]);
+                    Add(OP_CHECKCAST, Pool.Class(box->Name));
+                }
+                Invoke(OP_INVOKEVIRTUAL, box->Name, box->Unbox, std::string("()") + box->Primitive);
+                return Widen(box->Primitive, to[0]);
+            }
+            if (to != "Ljava/lang/Object;") { Add(OP_CHECKCAST, Pool.Class(class_name(to))); }
+            return true;
+        }
+
+        // appends a method with straight-line code to f
+        void add_method(ClassFile& f, PoolEditor& pool, const U2 access, const std::string_view name,
+                        const std::string_view desc, std::vector<Insn> insns, const int max_locals,
+                        const ClassHierarchy& h) {
+            MethodInfo m;
+            m.AccessFlags = access;
+            m.NameIndex = pool.Utf8(name);
+            m.DescriptorIndex = pool.Utf8(desc);
+            m.Attributes.push_back(AssembleCode(f, m, std::move(insns), max_locals, h));
+            m.AttributesCount = 1;
+            f.Methods.push_back(std::move(m));
+            f.MethodsCount = static_cast<U2>(f.Methods.size());
+        }
+
+        // the descriptor of the StringBuilder.append a value of type goes to, as StringConcatFactory
+        // turns it into a string
+        std::string_view append_descriptor(const std::string_view type) {
+            switch (type[0]) {
+            case 'Z': return "(Z)Ljava/lang/StringBuilder;";
+            case 'C': return "(C)Ljava/lang/StringBuilder;";
+            case 'B': case 'S': case 'I': return "(I)Ljava/lang/StringBuilder;";
+            case 'J': return "(J)Ljava/lang/StringBuilder;";
+            case 'F': return "(F)Ljava/lang/StringBuilder;";
+            case 'D': return "(D)Ljava/lang/StringBuilder;";
+            default:
+                // char[] too goes by String.valueOf(Object)
+                return type == "Ljava/lang/String;" ? "(Ljava/lang/String;)Ljava/lang/StringBuilder;"
+                                                    : "(Ljava/lang/Object;)Ljava/lang/StringBuilder;";
+            }
+        }
+
+        // What a StringConcatFactory call site of descriptor desc does, with its arguments kept in
+        // locals from base on; false for a site that is not handled. recipe is null for makeConcat.
+        bool concat_chain(const ClassFile& f, const BootstrapMethod& bsm, const bool recipe,
+                          const std::string_view desc, const int base, Emitter& out, int& locals) {
+            std::vector<std::string_view> params;
+            std::string_view result;
+            if (!split_descriptor(desc, params, result) || result != "Ljava/lang/String;") { return false; }
+            std::string pieces(params.size(), '\1');
+            if (recipe) {
+                const auto* e = bsm.Args.empty() ? nullptr : entry(f, bsm.Args[0], CPoolTags::String);
+                if (!e) { return false; }
+                pieces = std::string(Utf8At(f, static_cast<const ConstantStringInfo*>(e)->StringIndex));
+            }
+            std::vector<int> local;
+            int next = base;
+            for (const auto p : params) {
+                local.push_back(next);
+                next += TypeSlots(p[0]);
+            }
+            if (next > 0xffff) { return false; }
+            locals = next - base;
+
+            for (size_t k = params.size(); k-- > 0;) { out.Insns.push_back(StoreInsn(params[k][0], local[k])); }
+            out.Add(OP_NEW, out.Pool.Class("java/lang/StringBuilder"));
+            out.Add(OP_DUP);
+            out.Invoke(OP_INVOKESPECIAL, "java/lang/StringBuilder", "<init>", "()V");
+            // literal text, and string constants, is appended in runs; the recipe is modified UTF-8
+            // like the pool, and \1 and \2 never occur inside a multibyte character
+            std::string literal;
+            auto flush = [&]() {
+                if (literal.empty()) { return; }
+                out.Add(OP_LDC, out.Pool.String(literal));
+                out.Invoke(OP_INVOKEVIRTUAL, "java/lang/StringBuilder", "append", append_descriptor("Ljava/lang/String;"));
+                literal.clear();
+            };
+            size_t arg = 0, constant = 1;
+            for (const char c : pieces) {
+                if (c == '\1') {
+                    if (arg == params.size()) { return false; }
+                    flush();
+                    out.Insns.push_back(LoadInsn(params[arg][0], local[arg]));
+                    out.Invoke(OP_INVOKEVIRTUAL, "java/lang/StringBuilder", "append", append_descriptor(params[arg]));
+                    arg++;
+                } else if (c == '\2') {
+                    if (constant == bsm.Args.size()) { return false; }
+                    const U2 index = bsm.Args[constant++];
+                    const auto* e = index < f.ConstantPool.size() ? f.ConstantPool[index].get() : nullptr;
+                    if (!e) { return false; }
+                    if (e->Tag == CPoolTags::String) {
+                        literal += Utf8At(f, static_cast<const ConstantStringInfo*>(e)->StringIndex);
+                        continue;
+                    }
+                    std::string_view type;
+                    switch (e->Tag) {
+                    case CPoolTags::Integer: type = "I"; break;
+                    case CPoolTags::Float: type = "F"; break;
+                    case CPoolTags::Long: type = "J"; break;
+                    case CPoolTags::Double: type = "D"; break;
+                    default: return false;
+                    }
+                    flush();
+                    out.Add(TypeSlots(type[0]) == 2 ? OP_LDC2_W : OP_LDC, index);
+                    out.Invoke(OP_INVOKEVIRTUAL, "java/lang/StringBuilder", "append", append_descriptor(type));
+                } else {
+                    literal += c;
+                }
+            }
+            if (arg != params.size() || (recipe && constant != bsm.Args.size())) { return false; }
+            flush();
+            out.Invoke(OP_INVOKEVIRTUAL, "java/lang/StringBuilder", "toString", "()Ljava/lang/String;");
+            return true;
+        }
+
+        // what a LambdaMetafactory call site asks for
+        struct LambdaSite {
+            std::string_view Method, Factory;          // name of the interface method, descriptor of the site
+            std::string_view Erased, Instantiated;     // descriptors of the interface method
+            int Kind;                                  // of the implementation method handle
+            U2 Impl;                                   // its member reference
+            std::vector<std::string_view> Markers;     // further interfaces
+            std::vector<std::string_view> Bridges;     // further descriptors of the interface method
+        };
+
+        bool read_lambda(const ClassFile& f, const BootstrapMethod& bsm, const bool alt, LambdaSite& site) {
+            if (bsm.Args.size() < 3) { return false; }
+            site.Erased = method_type_at(f, bsm.Args[0]);
+            site.Instantiated = method_type_at(f, bsm.Args[2]);
+            const auto* handle = entry(f, bsm.Args[1], CPoolTags::MethodHandle);
+            if (site.Erased.empty() || site.Instantiated.empty() || !handle) { return false; }
+            site.Kind = static_cast<const ConstantMethodHandleInfo*>(handle)->ReferenceKind;
+            site.Impl = static_cast<const ConstantMethodHandleInfo*>(handle)->ReferenceIndex;
+            if (site.Kind < REF_INVOKE_VIRTUAL || site.Kind > REF_INVOKE_INTERFACE) { return false; }
+            if (!alt) { return bsm.Args.size() == 3; }
+
+            size_t k = 3;
+            auto integer = [&](U4& v) {
+                const auto* e = k < bsm.Args.size() ? entry(f, bsm.Args[k++], CPoolTags::Integer) : nullptr;
+                if (e) { v = static_cast<const ConstantIntegerInfo*>(e)->Bytes; }
+                return e != nullptr;
+            };
+            U4 flags, count;
+            if (!integer(flags) || (flags & FLAG_SERIALIZABLE)) { return false; }
+            if (flags & FLAG_MARKERS) {
+                if (!integer(count) || count > bsm.Args.size() - k) { return false; }
+                for (; count; count--) {
+                    if (!entry(f, bsm.Args[k], CPoolTags::Class)) { return false; }
+                    site.Markers.push_back(ClassNameAt(f, bsm.Args[k++]));
+                }
+            }
+            if (flags & FLAG_BRIDGES) {
+                if (!integer(count) || count > bsm.Args.size() - k) { return false; }
+                for (; count; count--) {
+                    site.Bridges.push_back(method_type_at(f, bsm.Args[k++]));
+                    if (site.Bridges.back().empty()) { return false; }
+                }
+            }
+            return k == bsm.Args.size();
+        }
+
+        // how the generated class reaches the implementation
+        struct Target {
+            uint8_t Op;
+            bool New = false;                 // new and dup come first
+            bool Interface = false;           // of the member reference
+            std::string Owner, Name, Desc;
+            std::vector<std::string> Params;  // what the call takes, a receiver first
+            std::string Result;               // what it leaves
+        };
+
+        // a static method of the host that calls an implementation the generated class may not
+        struct Bridge {
+            std::string Name, Desc;
+            std::vector<Insn> Insns;
+            int MaxLocals;
+            bool Needed = false; // by a class that was added
+        };
+
+        // A class generated for a call site. It is added, with the bridge it calls or the access to the
+        // host it needs, once one of the methods calling it is patched; until then nothing is changed.
+        struct LambdaClassFile {
+            ClassFile Class;
+            std::vector<size_t> Callers;  // methods of the host, by index
+            int Bridge = -1;              // in Bridges
+            std::string Open, OpenDesc;   // a private method of the host it calls directly
+        };
+
+        // the Code attribute of m as it is now; empty for a method without code
+        std::vector<U1> code_info(const ClassFile& f, const MethodInfo& m) {
+            for (const auto& a : m.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) == "Code") { return a.Info; }
+            }
+            return {};
+        }
+
+        class Lowering {
+        public:
+            Lowering(ClassFile& f, const ClassHierarchy& h, std::vector<ClassFile>* lambdas):
+                F(f), H(h), Lambdas(lambdas), Host(ClassNameAt(f, f.ThisClass)) {
+                Bootstrap = read_bootstrap_methods(f, BootstrapAttribute);
+                for (const auto& m : f.Methods) { Names.emplace(Utf8At(f, m.NameIndex)); }
+            }
+
+            bool Any() const { return !Bootstrap.empty(); }
+            bool Patch(const MethodInfo& m, DecodedCode& code);
+            // before is the code of each method before patching
+            void AddClasses(const std::vector<std::vector<U1>>& before);
+            void DropBootstrapMethods();
+
+        private:
+            enum class Factory { None, Concat, ConcatWithConstants, Lambda, AltLambda };
+            Factory FactoryOf(U2 indy, const BootstrapMethod*& bsm) const;
+            // the name of the class generated for a lambda call site, empty if the site is not handled
+            std::string LambdaClass(U2 indy, const BootstrapMethod& bsm, bool alt, size_t caller, PoolEditor& pool);
+            bool FindTarget(const LambdaSite& site, Target& t, Bridge& bridge, PoolEditor& pool) const;
+            // the first names not taken by a method of the host or a class of the batch, nor given out before
+            std::string BridgeName() const;
+            std::string LambdaName() const;
+            bool Implement(ClassFile& c, PoolEditor& pool, const LambdaSite& site, std::string_view desc,
+                           const Target& t, U2 access) const;
+
+            ClassFile& F;
+            const ClassHierarchy& H;
+            std::vector<ClassFile>* Lambdas;
+            std::string Host;
+            std::set<std::string, std::less<>> Names; // of the methods of F
+            std::vector<BootstrapMethod> Bootstrap;
+            int BootstrapAttribute = -1;
+            std::map<U2, size_t> Generated;       // index in Classes by InvokeDynamic entry
+            std::vector<LambdaClassFile> Classes;
+            std::map<U4, int> Bridged;            // index in Bridges by kind << 16 | the member reference it calls
+            std::vector<Bridge> Bridges;
+        };
+
+        Lowering::Factory Lowering::FactoryOf(const U2 indy, const BootstrapMethod*& bsm) const {
+            const auto* e = entry(F, indy, CPoolTags::InvokeDynamic);
+            if (!e) { return Factory::None; }
+            const auto index = static_cast<const ConstantInvokeDynamicInfo*>(e)->BootstrapMethodAttrIndex;
+            if (index >= Bootstrap.size()) { return Factory::None; }
+            bsm = &Bootstrap[index];
+            const auto* handle = entry(F, bsm->Handle, CPoolTags::MethodHandle);
+            if (!handle || static_cast<const ConstantMethodHandleInfo*>(handle)->ReferenceKind != REF_INVOKE_STATIC) {
+                return Factory::None;
+            }
+            const auto m = MemberRefAt(F, static_cast<const ConstantMethodHandleInfo*>(handle)->ReferenceIndex);
+            if (m.Owner == "java/lang/invoke/StringConcatFactory") {
+                if (m.Name == "makeConcatWithConstants") { return Factory::ConcatWithConstants; }
+                if (m.Name == "makeConcat") { return Factory::Concat; }
+            } else if (m.Owner == "java/lang/invoke/LambdaMetafactory") {
+                if (m.Name == "metafactory") { return Factory::Lambda; }
+                if (m.Name == "altMetafactory") { return Factory::AltLambda; }
+            }
+            return Factory::None;
+        }
+
+        bool Lowering::FindTarget(const LambdaSite& site, Target& t, Bridge& bridge, PoolEditor& pool) const {
+            const auto ref = MemberRefAt(F, site.Impl);
+            std::vector<std::string_view> params;
+            std::string_view result;
+            if (!split_descriptor(ref.Descriptor, params, result)) { return false; }
+            const bool receiver = site.Kind == REF_INVOKE_VIRTUAL || site.Kind == REF_INVOKE_INTERFACE ||
+                                  site.Kind == REF_INVOKE_SPECIAL;
+            t.Result = site.Kind == REF_NEW_INVOKE_SPECIAL ? type_of_class(ref.Owner) : std::string(result);
+            if (site.Kind == REF_NEW_INVOKE_SPECIAL && (ref.Name != "<init>" || result != "V")) { return false; }
+
+            // A method or constructor of the host that is not private is in the same package as the
+            // generated class. A private static lambda body of the host is opened up to the package
+            // instead of bridged, which changes nothing for the host: a static method is never overridden.
+            const MethodInfo* own = nullptr;
+            if (ref.Owner == Host) {
+                for (const auto& m : F.Methods) {
+                    if (Utf8At(F, m.NameIndex) == ref.Name && Utf8At(F, m.DescriptorIndex) == ref.Descriptor) { own = &m; }
+                }
+            }
+            const bool body = own && site.Kind == REF_INVOKE_STATIC && (own->AccessFlags & ACC_SYNTHETIC) &&
+                              (own->AccessFlags & ACC_STATIC) && ref.Name.substr(0, 7) == "lambda$";
+            if (own && site.Kind != REF_INVOKE_SPECIAL && (!(own->AccessFlags & ACC_PRIVATE) || body)) {
+                static constexpr uint8_t ops[] = {OP_INVOKEVIRTUAL, OP_INVOKESTATIC, OP_INVOKESPECIAL,
+                                                  OP_INVOKESPECIAL, OP_INVOKEINTERFACE};
+                t.Op = ops[site.Kind - REF_INVOKE_VIRTUAL];
+                t.New = site.Kind == REF_NEW_INVOKE_SPECIAL;
+                t.Interface = F.ConstantPool[site.Impl]->Tag == CPoolTags::InterfaceMethodRef;
+                t.Owner = std::string(ref.Owner), t.Name = std::string(ref.Name), t.Desc = std::string(ref.Descriptor);
+                if (receiver) { t.Params.push_back(type_of_class(ref.Owner)); }
+                t.Params.insert(t.Params.end(), params.begin(), params.end());
+                return true;
+            }
+
+            // invokespecial only takes a receiver of the host
+            bridge.Desc = "(";
+            if (receiver) { bridge.Desc += type_of_class(site.Kind == REF_INVOKE_SPECIAL ? std::string_view(Host) : ref.Owner); }
+            for (const auto p : params) { bridge.Desc += p; }
+            bridge.Desc += ")" + t.Result;
+            const auto it = Bridged.find(static_cast<U4>(site.Kind) << 16 | site.Impl);
+            bridge.Name = it != Bridged.end() ? Bridges[it->second].Name : BridgeName();
+
+            Emitter e{pool, {}};
+            if (site.Kind == REF_NEW_INVOKE_SPECIAL) {
+                e.Add(OP_NEW, pool.Class(ref.Owner));
+                e.Add(OP_DUP);
+            }
+            std::vector<std::string_view> bridge_params;
+            split_descriptor(bridge.Desc, bridge_params, result);
+            int local = 0;
+            for (const auto p : bridge_params) {
+                e.Insns.push_back(LoadInsn(p[0], local));
+                local += TypeSlots(p[0]);
+            }
+            static constexpr uint8_t ops[] = {OP_INVOKEVIRTUAL, OP_INVOKESTATIC, OP_INVOKESPECIAL, OP_INVOKESPECIAL,
+                                              OP_INVOKEINTERFACE};
+            Insn call = op(ops[site.Kind - REF_INVOKE_VIRTUAL], site.Impl);
+            if (call.Op == OP_INVOKEINTERFACE) { call.Local = ArgumentSlots(ref.Descriptor) + 1; }
+            e.Insns.push_back(call);
+            e.Insns.push_back(return_insn(t.Result[0]));
+            bridge.Insns = std::move(e.Insns);
+            bridge.MaxLocals = local;
+
+            t.Op = OP_INVOKESTATIC;
+            t.Interface = (F.AccessFlags & ACC_INTERFACE) != 0;
+            t.Owner = Host, t.Name = bridge.Name, t.Desc = bridge.Desc;
+            t.Params.assign(bridge_params.begin(), bridge_params.end());
+            return true;
+        }
+
+        // the interface method of descriptor desc: captured values from the fields, then the arguments,
+        // converted to what the target takes; then its result converted back
+        bool Lowering::Implement(ClassFile& c, PoolEditor& pool, const LambdaSite& site, const std::string_view desc,
+                                 const Target& t, const U2 access) const {
+            std::vector<std::string_view> captured, params, instantiated;
+            std::string_view r, result, instantiated_result;
+            if (!split_descriptor(site.Factory, captured, r) || !split_descriptor(desc, params, result) ||
+                !split_descriptor(site.Instantiated, instantiated, instantiated_result) ||
+                params.size() != instantiated.size() || captured.size() + params.size() != t.Params.size()) {
+                return false;
+            }
+            const auto self = ClassNameAt(c, c.ThisClass);
+            Emitter e{pool, {}};
+            if (t.New) {
+                e.Add(OP_NEW, pool.Class(t.Owner));
+                e.Add(OP_DUP);
+            }
+            size_t k = 0;
+            for (size_t i = 0; i < captured.size(); i++, k++) {
+                e.Insns.push_back(LoadInsn('L', 0));
+                e.Add(OP_GETFIELD, pool.FieldRef(self, "arg$" + std::to_string(i + 1), captured[i]));
+                if (!e.Convert(captured[i], t.Params[k])) { return false; }
+            }
+            int local = 1;
+            for (size_t i = 0; i < params.size(); i++, k++) {
+                e.Insns.push_back(LoadInsn(params[i][0], local));
+                local += TypeSlots(params[i][0]);
+                if (!e.Convert(params[i], instantiated[i]) || !e.Convert(instantiated[i], t.Params[k])) { return false; }
+            }
+            e.Invoke(t.Op, t.Owner, t.Name, t.Desc, t.Interface);
+            if (result == "V") {
+                if (t.Result != "V") { e.Add(TypeSlots(t.Result[0]) == 2 ? OP_POP2 : OP_POP); }
+            } else if (!e.Convert(t.Result, instantiated_result) || !e.Convert(instantiated_result, result)) {
+                return false;
+            }
+            e.Insns.push_back(return_insn(result[0]));
+            add_method(c, pool, access, site.Method, desc, std::move(e.Insns), local, H);
+            return true;
+        }
+
+        std::string Lowering::BridgeName() const {
+            for (int k = 0;; k++) {
+                auto candidate = "access$lambda$" + std::to_string(k);
+                if (!Names.count(candidate) &&
+                    std::none_of(Bridges.begin(), Bridges.end(), [&](const Bridge& b) { return b.Name == candidate; })) {
+                    return candidate;
+                }
+            }
+        }
+
+        std::string Lowering::LambdaName() const {
+            for (int k = 0;; k++) {
+                auto candidate = Host + "$$Lambda$" + std::to_string(k);
+                if (!H.Known(ClassType(candidate)) &&
+                    std::none_of(Classes.begin(), Classes.end(), [&](const LambdaClassFile& c) {
+                        return ClassNameAt(c.Class, c.Class.ThisClass) == candidate;
+                    })) {
+                    return candidate;
+                }
+            }
+        }
+
+        // One class per call site, as the metafactory would spin it:
+        //   final synthetic class Host$$Lambda$N implements I {
+        //       private final C1 arg$1; ...
+        //       private Host$$Lambda$N(C1 a, ...) { arg$1 = a; ... }
+        //       static I get$Lambda(C1 a, ...) { return new Host$$Lambda$N(a, ...); }
+        //       public R m(P p, ...) { return impl(arg$1, ..., p, ...); } // and a bridge per further descriptor
+        //   }
+        // Without captured values, get$Lambda hands out the one instance <clinit> makes, as the metafactory
+        // does.
+        std::string Lowering::LambdaClass(const U2 indy, const BootstrapMethod& bsm, const bool alt, const size_t caller,
+                                          PoolEditor& pool) {
+            const auto known = Generated.find(indy);
+            if (known != Generated.end()) {
+                auto& lambda = Classes[known->second];
+                lambda.Callers.push_back(caller);
+                return std::string(ClassNameAt(lambda.Class, lambda.Class.ThisClass));
+            }
+            LambdaSite site;
+            const auto nat = MemberRefAt(F, indy);
+            site.Method = nat.Name, site.Factory = nat.Descriptor;
+            std::vector<std::string_view> captured;
+            std::string_view iface;
+            if (!read_lambda(F, bsm, alt, site) || !split_descriptor(site.Factory, captured, iface) ||
+                iface[0] != 'L') {
+                return {};
+            }
+            Target t;
+            Bridge bridge;
+            if (!FindTarget(site, t, bridge, pool)) { return {}; }
+
+            const std::string name = LambdaName();
+            const std::string type = type_of_class(name);
+            ClassFile c{};
+            c.Magic = 0xCAFEBABE;
+            c.MinorVersion = F.MinorVersion, c.MajorVersion = F.MajorVersion;
+            c.ConstantPool.emplace_back();
+            PoolEditor cp(c);
+            c.AccessFlags = ACC_FINAL | ACC_SUPER | ACC_SYNTHETIC;
+            c.ThisClass = cp.Class(name);
+            c.SuperClass = cp.Class("java/lang/Object");
+            c.Interfaces.push_back(cp.Class(class_name(iface)));
+            for (const auto marker : site.Markers) { c.Interfaces.push_back(cp.Class(marker)); }
+            c.InterfaceCount = static_cast<U2>(c.Interfaces.size());
+
+            std::string ctor = "(";
+            for (size_t i = 0; i < captured.size(); i++) {
+                FieldInfo field;
+                field.AccessFlags = ACC_PRIVATE | ACC_FINAL;
+                field.NameIndex = cp.Utf8("arg$" + std::to_string(i + 1));
+                field.DescriptorIndex = cp.Utf8(captured[i]);
+                c.Fields.push_back(std::move(field));
+                ctor += captured[i];
+            }
+            ctor += ")V";
+            if (captured.empty()) {
+                FieldInfo field;
+                field.AccessFlags = ACC_PRIVATE | ACC_STATIC | ACC_FINAL;
+                field.NameIndex = cp.Utf8("INSTANCE");
+                field.DescriptorIndex = cp.Utf8(type);
+                c.Fields.push_back(std::move(field));
+            }
+            c.FieldCount = static_cast<U2>(c.Fields.size());
+
+            Emitter init{cp, {}}, factory{cp, {}};
+            init.Insns.push_back(LoadInsn('L', 0));
+            init.Invoke(OP_INVOKESPECIAL, "java/lang/Object", "<init>", "()V");
+            factory.Add(OP_NEW, c.ThisClass);
+            factory.Add(OP_DUP);
+            int local = 0;
+            for (size_t i = 0; i < captured.size(); i++) {
+                init.Insns.push_back(LoadInsn('L', 0));
+                init.Insns.push_back(LoadInsn(captured[i][0], local + 1));
+                init.Add(OP_PUTFIELD, cp.FieldRef(name, "arg$" + std::to_string(i + 1), captured[i]));
+                factory.Insns.push_back(LoadInsn(captured[i][0], local));
+                local += TypeSlots(captured[i][0]);
+            }
+            init.Add(OP_RETURN);
+            factory.Invoke(OP_INVOKESPECIAL, name, "<init>", ctor);
+            add_method(c, cp, ACC_PRIVATE, "<init>", ctor, std::move(init.Insns), local + 1, H);
+            if (captured.empty()) {
+                factory.Add(OP_PUTSTATIC, cp.FieldRef(name, "INSTANCE", type));
+                factory.Add(OP_RETURN);
+                add_method(c, cp, ACC_STATIC, "<clinit>", "()V", std::move(factory.Insns), 0, H);
+                factory.Insns.clear();
+                factory.Add(OP_GETSTATIC, cp.FieldRef(name, "INSTANCE", type));
+            }
+            factory.Add(OP_ARETURN);
+            add_method(c, cp, ACC_STATIC | ACC_SYNTHETIC, "get$Lambda", site.Factory, std::move(factory.Insns), local, H);
+
+            if (!Implement(c, cp, site, site.Erased, t, ACC_PUBLIC)) { return {}; }
+            for (const auto desc : site.Bridges) {
+                if (desc == site.Erased) { continue; }
+                if (!Implement(c, cp, site, desc, t, ACC_PUBLIC | ACC_BRIDGE | ACC_SYNTHETIC)) { return {}; }
+            }
+
+            // the site is lowered; what makes the implementation reachable comes with the class
+            LambdaClassFile lambda{std::move(c), {caller}, -1, {}, {}};
+            if (t.Owner == Host && t.Name == bridge.Name) {
+                const auto added = Bridged.emplace(static_cast<U4>(site.Kind) << 16 | site.Impl, static_cast<int>(Bridges.size()));
+                if (added.second) { Bridges.push_back(std::move(bridge)); }
+                lambda.Bridge = added.first->second;
+            } else if (t.Owner == Host) {
+                lambda.Open = t.Name, lambda.OpenDesc = t.Desc;
+            }
+            Generated.emplace(indy, Classes.size());
+            Classes.push_back(std::move(lambda));
+            return name;
+        }
+
+        bool Lowering::Patch(const MethodInfo& m, DecodedCode& code) {
+            if (std::none_of(code.Insns.begin(), code.Insns.end(), [](const Insn& in) { return in.Op == OP_INVOKEDYNAMIC; })) {
+                return false;
+            }
+            PoolEditor pool(F); // frames of the methods before may have added entries
+            CodeRewriter rewriter(code);
+            std::unique_ptr<ValueFlow> flow; // for the stack depths, once there is a concatenation
+            int max_stack = code.MaxStack, max_locals = code.MaxLocals;
+            for (int i = 0; i < static_cast<int>(code.Insns.size()); i++) {
+                const auto& in = code.Insns[i];
+                if (in.Op != OP_INVOKEDYNAMIC) { continue; }
+                const auto indy = static_cast<U2>(in.Value);
+                const BootstrapMethod* bsm = nullptr;
+                const auto factory = FactoryOf(indy, bsm);
+                if (factory == Factory::Concat || factory == Factory::ConcatWithConstants) {
+                    if (!flow) { flow = std::make_unique<ValueFlow>(F, code, std::vector<int>(code.Insns.size(), -1)); }
+                    const auto desc = MemberRefAt(F, indy).Descriptor;
+                    Emitter e{pool, {}};
+                    int locals;
+                    if (flow->Depth(i) < 0 ||
+                        !concat_chain(F, *bsm, factory == Factory::ConcatWithConstants, desc, code.MaxLocals, e, locals)) {
+                        continue;
+                    }
+                    rewriter.Replace(i, std::move(e.Insns));
+                    max_locals = std::max(max_locals, code.MaxLocals + locals);
+                    max_stack = std::max(max_stack, flow->Depth(i) - ArgumentSlots(desc) + 3);
+                } else if ((factory == Factory::Lambda || factory == Factory::AltLambda) && Lambdas) {
+                    const auto name = LambdaClass(indy, *bsm, factory == Factory::AltLambda,
+                                                  static_cast<size_t>(&m - F.Methods.data()), pool);
+                    if (name.empty()) { continue; }
+                    rewriter.Replace(i, {op(OP_INVOKESTATIC, pool.MethodRef(name, "get$Lambda", MemberRefAt(F, indy).Descriptor))});
+                }
+            }
+            if (rewriter.Empty() || max_stack > 0xffff) { return false; }
+            code.MaxStack = static_cast<U2>(max_stack);
+            code.MaxLocals = static_cast<U2>(max_locals);
+            rewriter.Apply();
+            return true;
+        }
+
+        void Lowering::AddClasses(const std::vector<std::vector<U1>>& before) {
+            std::vector<bool> patched(before.size());
+            for (size_t k = 0; k < before.size(); k++) { patched[k] = code_info(F, F.Methods[k]) != before[k]; }
+            for (auto& lambda : Classes) {
+                if (std::none_of(lambda.Callers.begin(), lambda.Callers.end(), [&](const size_t k) { return patched[k]; })) {
+                    continue; // every site was left as it was
+                }
+                if (lambda.Bridge >= 0) { Bridges[lambda.Bridge].Needed = true; }
+                for (auto& m : F.Methods) {
+                    if (lambda.Open.empty() || Utf8At(F, m.NameIndex) != lambda.Open ||
+                        Utf8At(F, m.DescriptorIndex) != lambda.OpenDesc || !(m.AccessFlags & ACC_PRIVATE)) {
+                        continue;
+                    }
+                    // interface methods are public or private
+                    m.AccessFlags &= ~ACC_PRIVATE;
+                    if (F.AccessFlags & ACC_INTERFACE) { m.AccessFlags |= ACC_PUBLIC; }
+                }
+                Lambdas->push_back(std::move(lambda.Class));
+            }
+
+            PoolEditor pool(F);
+            // static methods of an interface are public or private
+            const U2 access = ACC_STATIC | ACC_SYNTHETIC | (F.AccessFlags & ACC_INTERFACE ? ACC_PUBLIC : 0);
+            for (auto& b : Bridges) {
+                if (b.Needed) { add_method(F, pool, access, b.Name, b.Desc, std::move(b.Insns), b.MaxLocals, H); }
+            }
+        }
+
+        // Once no code bootstraps anything any more (a method that could not be patched may still). The
+        // InvokeDynamic entries of the lowered sites go too, as the JVM rejects them without the
+        // attribute: the pool is compacted, and if it cannot be the attribute stays.
+        void Lowering::DropBootstrapMethods() {
+            for (const auto& e : F.ConstantPool) {
+                if (e && e->Tag == CPoolTags::Dynamic) { return; }
+            }
+            for (const auto& m : F.Methods) {
+                for (const auto& a : m.Attributes) {
+                    if (Utf8At(F, a.AttributeNameIndex) != "Code") { continue; }
+                    CodeAttribute code;
+                    Parser{}.ParseCodeOnto(a.Info, code);
+                    try {
+                        const auto d = DecodeCode(F, code);
+                        for (const auto& in : d.Insns) {
+                            if (in.Op == OP_INVOKEDYNAMIC) { return; }
+                        }
+                    } catch (const InvalidBytecode&) {
+                        return;
+                    }
+                }
+            }
+            auto attribute = std::move(F.Attributes[BootstrapAttribute]);
+            F.Attributes.erase(F.Attributes.begin() + BootstrapAttribute);
+            F.AttributesCount = static_cast<U2>(F.Attributes.size());
+            CompactConstantPool(F);
+            for (const auto& e : F.ConstantPool) {
+                if (e && e->Tag == CPoolTags::InvokeDynamic) {
+                    F.Attributes.insert(F.Attributes.begin() + BootstrapAttribute, std::move(attribute));
+                    F.AttributesCount = static_cast<U2>(F.Attributes.size());
+                    return;
+                }
+            }
+        }
+    }
+
+    int LowerInvokeDynamic(ClassFile& f, const ClassHierarchy& h, std::vector<ClassFile>* lambdas) {
+        Lowering lowering(f, h, lambdas);
+        if (!lowering.Any()) { return 0; }
+        std::vector<std::vector<U1>> before;
+        for (const auto& m : f.Methods) { before.push_back(code_info(f, m)); }
+        const int changed = PatchMethods(f, h, [&](const MethodInfo& m, DecodedCode& code) {
+            try {
+                return lowering.Patch(m, code);
+            } catch (const InvalidBytecode&) {
+                return false;
+            } catch (const InvalidClassFile&) {
+                return false;
+            } catch (const std::length_error&) {
+                return false; // the constant pool is full
+            }
+        });
+        lowering.AddClasses(before);
+        if (changed) { lowering.DropBootstrapMethods(); }
+        return changed;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+
+namespace Patch {
+    // Replaces the invokedynamic call sites of the JDK's own bootstrap methods by the bytecode they would
+    // link to, so that nothing is left to bootstrap when the class first runs them:
+    //  - StringConcatFactory.makeConcat and makeConcatWithConstants become a StringBuilder chain. The
+    //    arguments are stored in new locals and appended in recipe order; a site with a constant that is
+    //    not a string or a number is left alone.
+    //  - LambdaMetafactory.metafactory and altMetafactory, if lambdas is not null, become a call to the
+    //    factory of a class generated for the site and added to lambdas. That class implements the
+    //    interface, markers and bridges the way the metafactory would, and calls the implementation
+    //    directly if it may, or else through a static bridge added to f. Serializable lambdas are left
+    //    alone.
+    // Generated classes and bridges are only added for the sites of methods that could be encoded again.
+    // They take the first Host$$Lambda$N and access$lambda$N not already a class known to h or a method
+    // of f, so that running on an output again adds to what is there.
+    // The BootstrapMethods attribute is dropped once nothing needs it, and the pool compacted to get rid
+    // of the InvokeDynamic entries (the attribute stays if it cannot be). Returns the number of methods
+    // changed.
+    int LowerInvokeDynamic(Parse::ClassFile& f, const Analyze::ClassHierarchy& h,
+                           std::vector<Parse::ClassFile>* lambdas);
+}
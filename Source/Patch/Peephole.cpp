@@ -0,0 +1,311 @@
+#include <array>
+#include <initializer_list>
+#include <stdexcept>
+#include "Analyze/Insns.h"
+#include "Peephole.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        // a set of opcodes
+        struct OpSet {
+            uint64_t Bits[4] = {};
+
+            constexpr bool Has(const uint8_t op) const { return Bits[op >> 6] >> (op & 63) & 1; }
+            constexpr bool Empty() const { return !(Bits[0] | Bits[1] | Bits[2] | Bits[3]); }
+            constexpr OpSet operator|(const OpSet& o) const {
+                OpSet s;
+                for (int k = 0; k < 4; k++) { s.Bits[k] = Bits[k] | o.Bits[k]; }
+                return s;
+            }
+        };
+
+        constexpr OpSet ops(const std::initializer_list<int> list) {
+            OpSet s;
+            for (const int op : list) { s.Bits[op >> 6] |= uint64_t{1} << (op & 63); }
+            return s;
+        }
+
+        constexpr OpSet range(const int first, const int last) {
+            OpSet s;
+            for (int op = first; op <= last; op++) { s.Bits[op >> 6] |= uint64_t{1} << (op & 63); }
+            return s;
+        }
+
+        constexpr OpSet INT_CONST = range(OP_ICONST_M1, OP_ICONST_5) | ops({OP_BIPUSH, OP_SIPUSH});
+        // pushes of one slot and of two that have no other effect
+        constexpr OpSet PUSH1 = INT_CONST | range(OP_FCONST_0, OP_FCONST_2) |
+                                ops({OP_ACONST_NULL, OP_ILOAD, OP_FLOAD, OP_ALOAD, OP_DUP});
+        constexpr OpSet PUSH2 = ops({OP_LCONST_0, OP_LCONST_1, OP_DCONST_0, OP_DCONST_1, OP_LLOAD, OP_DLOAD, OP_DUP2});
+        constexpr OpSet LOAD = range(OP_ILOAD, OP_ALOAD);
+        constexpr OpSet STORE = range(OP_ISTORE, OP_ASTORE);
+        constexpr OpSet IF = range(OP_IFEQ, OP_IFLE);
+        constexpr OpSet IF_CMP = range(OP_IF_ICMPEQ, OP_IF_ICMPLE);
+        constexpr OpSet NEG = range(OP_INEG, OP_DNEG);
+
+        // the instructions a pattern is tried at, from the first of them
+        struct Window {
+            const ClassFile& F;
+            const DecodedCode& Code;
+            int At;
+
+            const Insn& operator[](const int k) const { return Code.Insns[At + k]; }
+        };
+
+        int int_const(const Insn& in) { return in.Op == OP_BIPUSH || in.Op == OP_SIPUSH ? in.Value : in.Op - OP_ICONST_0; }
+
+        // whether ifeq to ifle (or if_icmpeq to if_icmple) branches for a compared to b
+        bool holds(const uint8_t op, const int a, const int b) {
+            switch ((op - OP_IFEQ) % 6) {
+            case 0: return a == b;
+            case 1: return a != b;
+            case 2: return a < b;
+            case 3: return a >= b;
+            case 4: return a > b;
+            default: return a <= b;
+            }
+        }
+
+        bool constant_tag(const Window& w, const std::initializer_list<CPoolTags> tags) {
+            const auto& pool = w.F.ConstantPool;
+            const int index = w[0].Value;
+            if (index <= 0 || index >= static_cast<int>(pool.size()) || !pool[index]) { return false; }
+            for (const auto tag : tags) {
+                if (pool[index]->Tag == tag) { return true; }
+            }
+            return false;
+        }
+
+        Insn op(const uint8_t code) {
+            Insn in;
+            in.Op = code;
+            return in;
+        }
+
+        Insn jump(const int target) {
+            Insn in = op(OP_GOTO);
+            in.Target = target;
+            return in;
+        }
+
+        using Insns = std::vector<Insn>;
+
+        struct Pattern {
+            std::array<OpSet, 4> Ops; // the instructions matched, up to the first empty set
+            bool (*When)(const Window&);
+            Insns (*Then)(const Window&);
+        };
+
+        constexpr bool always(const Window&) { return true; }
+        Insns nothing(const Window&) { return {}; }
+
+        constexpr Pattern patterns[] = {
+            // x = x
+            {{LOAD, STORE}, [](const Window& w) {
+                return w[1].Op - w[0].Op == OP_ISTORE - OP_ILOAD && w[0].Local == w[1].Local;
+            }, nothing},
+            // values pushed for nothing
+            {{PUSH1, ops({OP_POP})}, always, nothing},
+            {{PUSH2, ops({OP_POP2})}, always, nothing},
+            {{ops({OP_LDC}), ops({OP_POP})}, [](const Window& w) {
+                return constant_tag(w, {CPoolTags::Integer, CPoolTags::Float, CPoolTags::String});
+            }, nothing},
+            {{ops({OP_LDC2_W}), ops({OP_POP2})}, [](const Window& w) {
+                return constant_tag(w, {CPoolTags::Long, CPoolTags::Double});
+            }, nothing},
+            {{ops({OP_DUP}), ops({OP_ISTORE, OP_FSTORE, OP_ASTORE}), ops({OP_POP})}, always,
+             [](const Window& w) { return Insns{w[1]}; }},
+            {{ops({OP_DUP2}), ops({OP_LSTORE, OP_DSTORE}), ops({OP_POP2})}, always,
+             [](const Window& w) { return Insns{w[1]}; }},
+            // x = x + c and x = x - c
+            {{ops({OP_ILOAD}), INT_CONST, ops({OP_IADD, OP_ISUB}), ops({OP_ISTORE})}, [](const Window& w) {
+                const int c = w[2].Op == OP_IADD ? int_const(w[1]) : -int_const(w[1]);
+                return w[0].Local == w[3].Local && c >= -32768 && c < 32768;
+            }, [](const Window& w) {
+                Insn inc = op(OP_IINC);
+                inc.Local = w[0].Local;
+                inc.Value = w[2].Op == OP_IADD ? int_const(w[1]) : -int_const(w[1]);
+                return Insns{inc};
+            }},
+            {{ops({OP_IINC})}, [](const Window& w) { return w[0].Value == 0; }, nothing},
+            // branches on constants
+            {{INT_CONST, IF}, always, [](const Window& w) {
+                return holds(w[1].Op, int_const(w[0]), 0) ? Insns{jump(w[1].Target)} : Insns{};
+            }},
+            {{INT_CONST, INT_CONST, IF_CMP}, always, [](const Window& w) {
+                return holds(w[2].Op, int_const(w[0]), int_const(w[1])) ? Insns{jump(w[2].Target)} : Insns{};
+            }},
+            {{ops({OP_ACONST_NULL}), ops({OP_IFNULL, OP_IFNONNULL})}, always, [](const Window& w) {
+                return w[1].Op == OP_IFNULL ? Insns{jump(w[1].Target)} : Insns{};
+            }},
+            // branches to the next instruction
+            {{ops({OP_GOTO})}, [](const Window& w) { return w[0].Target == w.At + 1; }, nothing},
+            {{IF | ops({OP_IFNULL, OP_IFNONNULL})}, [](const Window& w) { return w[0].Target == w.At + 1; },
+             [](const Window&) { return Insns{op(OP_POP)}; }},
+            {{IF_CMP | ops({OP_IF_ACMPEQ, OP_IF_ACMPNE})}, [](const Window& w) { return w[0].Target == w.At + 1; },
+             [](const Window&) { return Insns{op(OP_POP2)}; }},
+            // a goto to a return returns right away
+            {{ops({OP_GOTO})}, [](const Window& w) {
+                const uint8_t to = w.Code.Insns[w[0].Target].Op;
+                return to >= OP_IRETURN && to <= OP_RETURN;
+            }, [](const Window& w) { return Insns{op(w.Code.Insns[w[0].Target].Op)}; }},
+            // operations that cancel out or do nothing
+            {{ops({OP_SWAP}), ops({OP_SWAP})}, always, nothing},
+            {{NEG, NEG}, [](const Window& w) { return w[0].Op == w[1].Op; }, nothing},
+            {{ops({OP_I2L}), ops({OP_L2I})}, always, nothing},
+            {{ops({OP_NOP})}, always, nothing},
+            {{INT_CONST, ops({OP_IADD, OP_ISUB, OP_IOR, OP_IXOR, OP_ISHL, OP_ISHR, OP_IUSHR})},
+             [](const Window& w) { return int_const(w[0]) == 0; }, nothing},
+            {{INT_CONST, ops({OP_IMUL, OP_IDIV})}, [](const Window& w) { return int_const(w[0]) == 1; }, nothing},
+            {{ops({OP_CHECKCAST}), ops({OP_CHECKCAST})}, [](const Window& w) { return w[0].Value == w[1].Value; },
+             [](const Window& w) { return Insns{w[0]}; }},
+        };
+        constexpr int PATTERNS = sizeof patterns / sizeof patterns[0];
+
+        // the patterns that may start at each opcode, in table order
+        struct PatternIndex {
+            std::array<uint16_t, 257> Start{};       // into Patterns, by opcode
+            std::array<uint8_t, 256 * 4> Patterns{}; // indices into patterns
+        };
+        static_assert(PATTERNS <= 256, "too many patterns for the index");
+
+        constexpr PatternIndex index_patterns() {
+            PatternIndex index;
+            int n = 0;
+            for (int op = 0; op < 256; op++) {
+                index.Start[op] = static_cast<uint16_t>(n);
+                for (int p = 0; p < PATTERNS; p++) {
+                    if (!patterns[p].Ops[0].Has(static_cast<uint8_t>(op))) { continue; }
+                    // not a constant expression, so the build fails if it is ever reached
+                    if (n == static_cast<int>(index.Patterns.size())) { throw std::length_error("pattern index full"); }
+                    index.Patterns[n++] = static_cast<uint8_t>(p);
+                }
+            }
+            index.Start[256] = static_cast<uint16_t>(n);
+            return index;
+        }
+
+        constexpr PatternIndex pattern_index = index_patterns();
+
+        // instructions something may come to other than from the one before
+        std::vector<bool> entries(const DecodedCode& code) {
+            std::vector<bool> entry(code.Insns.size() + 1);
+            for (const auto& in : code.Insns) {
+                if (in.Target >= 0) { entry[in.Target] = true; }
+            }
+            for (const auto& table : code.Switches) {
+                for (const int t : table.Targets) { entry[t] = true; }
+            }
+            for (const auto& h : code.Handlers) { entry[h.Start] = entry[h.End] = entry[h.Target] = true; }
+            return entry;
+        }
+
+        // where a jump to an instruction ends up, past any gotos
+        int thread(const DecodedCode& code, int target) {
+            for (size_t hops = 0; code.Insns[target].Op == OP_GOTO && hops < code.Insns.size(); hops++) {
+                target = code.Insns[target].Target;
+            }
+            return target;
+        }
+
+        // drops what no path from the start reaches
+        bool drop_unreachable(DecodedCode& code) {
+            const int n = static_cast<int>(code.Insns.size());
+            std::vector<bool> reached(n);
+            std::vector<int> work{0};
+            auto walk = [&]() {
+                while (!work.empty()) {
+                    int i = work.back();
+                    work.pop_back();
+                    for (; i < n && !reached[i]; i++) {
+                        reached[i] = true;
+                        const Insn& in = code.Insns[i];
+                        if (in.Target >= 0) { work.push_back(in.Target); }
+                        if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                            for (const int t : code.Switches[in.Value].Targets) { work.push_back(t); }
+                        }
+                        if (OpcodeTable[in.Op].Flags & OPF_END) { break; }
+                    }
+                }
+            };
+            walk();
+            for (bool more = true; more;) {
+                more = false;
+                for (const auto& h : code.Handlers) {
+                    if (reached[h.Target]) { continue; }
+                    for (int i = h.Start; i < h.End; i++) {
+                        if (!reached[i]) { continue; }
+                        work.push_back(h.Target);
+                        walk();
+                        more = true;
+                        break;
+                    }
+                }
+            }
+            CodeRewriter rewriter(code);
+            for (int i = 0; i < n; i++) {
+                if (!reached[i]) { rewriter.Replace(i, {}); }
+            }
+            if (rewriter.Empty()) { return false; }
+            rewriter.Apply();
+            return true;
+        }
+
+        // one scan over the code
+        bool peephole(const ClassFile& f, DecodedCode& code) {
+            const int n = static_cast<int>(code.Insns.size());
+            const auto entry = entries(code);
+            bool changed = false;
+            CodeRewriter rewriter(code);
+            for (int i = 0; i < n;) {
+                auto& in = code.Insns[i];
+                if (IsBranch(in.Op) || (OpcodeTable[in.Op].Flags & OPF_SWITCH)) {
+                    const int target = thread(code, in.Target);
+                    if (target != in.Target) { in.Target = target, in.Pc = -1, changed = true; }
+                }
+                if (OpcodeTable[in.Op].Flags & OPF_SWITCH) {
+                    for (auto& t : code.Switches[in.Value].Targets) {
+                        const int target = thread(code, t);
+                        if (target != t) { t = target, in.Pc = -1, changed = true; }
+                    }
+                }
+
+                int matched = 0;
+                for (int k = pattern_index.Start[in.Op]; k < pattern_index.Start[in.Op + 1] && !matched; k++) {
+                    const auto& p = patterns[pattern_index.Patterns[k]];
+                    int length = 1;
+                    // the rest of the window must only be come to from the instruction before
+                    while (length < 4 && !p.Ops[length].Empty() && i + length < n &&
+                           p.Ops[length].Has(code.Insns[i + length].Op) && !entry[i + length]) {
+                        length++;
+                    }
+                    if (length < 4 && !p.Ops[length].Empty()) { continue; }
+                    const Window w{f, code, i};
+                    if (!p.When(w)) { continue; }
+                    rewriter.Replace(i, p.Then(w));
+                    for (int j = 1; j < length; j++) { rewriter.Replace(i + j, {}); }
+                    matched = length;
+                }
+                i += matched ? matched : 1;
+            }
+            changed |= !rewriter.Empty();
+            rewriter.Apply();
+            if (changed) { drop_unreachable(code); }
+            return changed;
+        }
+
+        // scans again while that changes something, as a change may leave code for other patterns
+        // (a branch folded, the code it skipped dropped, a goto left pointing at the next instruction)
+        constexpr int MAX_SCANS = 4;
+    }
+
+    int Peephole(ClassFile& f, const ClassHierarchy& h) {
+        return PatchMethods(f, h, [&](const MethodInfo&, DecodedCode& code) {
+            int scans = 0;
+            while (scans < MAX_SCANS && peephole(f, code)) { scans++; }
+            return scans > 0;
+        });
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+
+namespace Patch {
+    // Local cleanup of every method in linear scans over its instructions: branches to a goto go where the
+    // goto goes, a goto to a return becomes the return, and short windows of instructions are matched
+    // against a fixed table of patterns (a value pushed and popped, x = x, x = x + c into iinc,
+    // branches on constants, operations that cancel out, ...). Code no longer reachable afterwards is
+    // dropped, and the scan repeated (a few times at most) while it changes something. Returns the
+    // number of methods changed.
+    int Peephole(Parse::ClassFile& f, const Analyze::ClassHierarchy& h);
+}
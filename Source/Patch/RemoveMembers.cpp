@@ -0,0 +1,25 @@
+#include "RemoveMembers.h"
+
+using namespace Parse;
+
+namespace Patch {
+    namespace {
+        template<class T>
+        int filter(std::vector<T>& members, U2& count, const std::vector<bool>& keep) {
+            size_t out = 0;
+            for (size_t i = 0; i < members.size(); i++) {
+                if (i < keep.size() && !keep[i]) { continue; }
+                if (out != i) { members[out] = std::move(members[i]); }
+                out++;
+            }
+            const int removed = static_cast<int>(members.size() - out);
+            members.resize(out);
+            count = static_cast<U2>(out);
+            return removed;
+        }
+    }
+
+    int RemoveMembers(ClassFile& f, const std::vector<bool>& keep_fields, const std::vector<bool>& keep_methods) {
+        return filter(f.Fields, f.FieldCount, keep_fields) + filter(f.Methods, f.MethodsCount, keep_methods);
+    }
+}
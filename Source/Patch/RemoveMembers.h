@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vector>
+#include "Parse/ClassFile.h"
+
+namespace Patch {
+    // Removes the fields and methods whose entry in keep_fields / keep_methods (in the order of the class
+    // file) is false. Returns the number of members removed. Their names and descriptors stay in the
+    // constant pool until it is compacted.
+    int RemoveMembers(Parse::ClassFile& f, const std::vector<bool>& keep_fields, const std::vector<bool>& keep_methods);
+}
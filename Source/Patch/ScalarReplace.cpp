@@ -0,0 +1,130 @@
+#include <stdexcept>
+#include "Parse/CpRefs.h"
+#include "Parse/PoolEditor.h"
+#include "Analyze/Insns.h"
+#include "ScalarReplace.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        Insn op(const uint8_t code) {
+            Insn in;
+            in.Op = code;
+            return in;
+        }
+
+        // the type of each argument of a method descriptor, by the first character of its descriptor
+        std::vector<char> argument_types(const std::string_view desc) {
+            std::vector<char> types;
+            for (size_t i = 1; i < desc.size() && desc[i] != ')'; i++) {
+                types.push_back(desc[i]);
+                while (desc[i] == '[') { i++; }
+                if (desc[i] == 'L') { i = desc.find(';', i); }
+            }
+            return types;
+        }
+
+        void replace(const ClassFile& f, const ScalarAllocation& a, const std::vector<int>& locals,
+                     PoolEditor& pool, CodeRewriter& rewriter, DecodedCode& code) {
+            const auto& fields = a.Class->Fields;
+            std::vector<Insn> with;
+            for (size_t k = 0; k < fields.size(); k++) {
+                with.push_back(DefaultValue(fields[k].second[0]));
+                with.push_back(StoreInsn(fields[k].second[0], locals[k]));
+            }
+            with.push_back(op(OP_ACONST_NULL));
+            rewriter.Replace(a.New, std::move(with));
+
+            for (const int use : a.Uses) {
+                const auto ref = MemberRefAt(f, static_cast<U2>(code.Insns[use].Value));
+                with.clear();
+                if (code.Insns[use].Op == OP_INVOKESPECIAL) {
+                    const auto& sources = a.Class->Constructor(ref.Descriptor)->Fields;
+                    const auto args = argument_types(ref.Descriptor);
+                    // the field each argument goes to first
+                    std::vector<int> first(args.size(), -1);
+                    for (size_t k = 0; k < fields.size(); k++) {
+                        if (sources[k].From == FieldSource::Kind::Param && first[sources[k].Param] < 0) {
+                            first[sources[k].Param] = static_cast<int>(k);
+                        }
+                    }
+                    for (int p = static_cast<int>(args.size()) - 1; p >= 0; p--) {
+                        if (first[p] >= 0) { with.push_back(StoreInsn(fields[first[p]].second[0], locals[first[p]])); }
+                        else { with.push_back(op(TypeSlots(args[p]) == 2 ? OP_POP2 : OP_POP)); }
+                    }
+                    with.push_back(op(OP_POP));
+                    for (size_t k = 0; k < fields.size(); k++) {
+                        const char type = fields[k].second[0];
+                        if (sources[k].From == FieldSource::Kind::Const) {
+                            with.push_back(sources[k].Const);
+                        } else if (sources[k].From == FieldSource::Kind::Param && first[sources[k].Param] != static_cast<int>(k)) {
+                            with.push_back(LoadInsn(type, locals[first[sources[k].Param]]));
+                        } else {
+                            continue;
+                        }
+                        with.push_back(StoreInsn(type, locals[k]));
+                    }
+                } else {
+                    const int k = a.Class->Field(ref.Name, ref.Descriptor);
+                    const char type = ref.Descriptor[0];
+                    if (code.Insns[use].Op == OP_PUTFIELD) {
+                        with.push_back(StoreInsn(type, locals[k]));
+                        with.push_back(op(OP_POP));
+                    } else {
+                        with.push_back(op(OP_POP));
+                        with.push_back(LoadInsn(type, locals[k]));
+                        // the local holds whatever was stored, which the verifier may only know as a supertype
+                        if ((type == 'L' && ref.Descriptor != "Ljava/lang/Object;") || type == '[') {
+                            Insn cast = op(OP_CHECKCAST);
+                            cast.Value = type == '[' ? pool.Class(ref.Descriptor)
+                                                     : pool.Class(ref.Descriptor.substr(1, ref.Descriptor.size() - 2));
+                            with.push_back(cast);
+                        }
+                    }
+                }
+                rewriter.Replace(use, std::move(with));
+            }
+        }
+    }
+
+    int ScalarReplace(ClassFile& f, const ScalarClasses& classes, const ClassHierarchy& h) {
+        if (classes.Empty()) { return 0; }
+        return PatchMethods(f, h, [&](const MethodInfo&, DecodedCode& code) {
+            try {
+                const auto allocations = FindScalarAllocations(f, code, classes);
+                if (allocations.empty()) { return false; }
+                PoolEditor pool(f); // frames of the methods before may have added entries
+                CodeRewriter rewriter(code);
+                int next = code.MaxLocals;
+                int max_stack = code.MaxStack;
+                for (const auto& a : allocations) {
+                    std::vector<int> locals;
+                    int end = next;
+                    for (const auto& field : a.Class->Fields) {
+                        locals.push_back(end);
+                        end += TypeSlots(field.second[0]);
+                    }
+                    if (end > 0xffff) { break; }
+                    next = end;
+                    max_stack = std::max(max_stack, a.Depth + 2);
+                    replace(f, a, locals, pool, rewriter, code);
+                }
+                if (rewriter.Empty() || max_stack > 0xffff) { return false; }
+                const int old_locals = code.MaxLocals;
+                code.MaxLocals = static_cast<U2>(next);
+                code.MaxStack = static_cast<U2>(max_stack);
+                rewriter.Apply();
+                ForgetFramesWhereLive(code, old_locals);
+                return true;
+            } catch (const InvalidBytecode&) {
+                return false;
+            } catch (const InvalidClassFile&) {
+                return false;
+            } catch (const std::length_error&) {
+                return false; // the constant pool is full
+            }
+        });
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+#include "Analyze/Escape.h"
+#include "Analyze/Hierarchy.h"
+
+namespace Patch {
+    // Replaces every object a method of f allocates and never lets go of (see Analyze/Escape.h) by a
+    // local per field: the allocation and the constructor call become stores to the locals, getfield and
+    // putfield loads and stores, and the reference itself null. Returns the number of methods changed.
+    int ScalarReplace(Parse::ClassFile& f, const Analyze::ScalarClasses& classes, const Analyze::ClassHierarchy& h);
+}
@@ -0,0 +1,366 @@
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "Util/mutf8.h"
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/PoolEditor.h"
+#include "Analyze/Insns.h"
+#include "Analyze/Interpreter.h"
+#include "Analyze/StackMap.h"
+#include "StaticInit.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        using Kind = Constant::Kind;
+
+        // arrays with at least this many elements set are decoded from a string
+        constexpr size_t DECODE_MIN = 16;
+
+        Insn op(const uint8_t code, const int value = 0) {
+            Insn in;
+            in.Op = code;
+            in.Value = value;
+            return in;
+        }
+
+        Insn local(const uint8_t code, const int local) {
+            Insn in;
+            in.Op = code;
+            in.Local = local;
+            return in;
+        }
+
+        std::string mutf8(const std::u16string& s) {
+            std::string out(3 * s.size(), '\0');
+            out.resize(utf16_to_mutf8(reinterpret_cast<const uint16_t*>(s.data()), s.size(),
+                                      reinterpret_cast<uint8_t*>(out.data())));
+            return out;
+        }
+
+        template<typename T>
+        bool same_bits(const T a, const T b) { return std::memcmp(&a, &b, sizeof a) == 0; }
+
+        // newarray type and xastore of an element descriptor
+        int newarray_type(const char type) {
+            static constexpr char types[] = "ZCFDBSIJ";
+            return static_cast<int>(std::strchr(types, type) - types) + 4;
+        }
+
+        uint8_t array_store(const char type) {
+            switch (type) {
+            case 'Z': case 'B': return OP_BASTORE;
+            case 'C': return OP_CASTORE;
+            case 'S': return OP_SASTORE;
+            case 'I': return OP_IASTORE;
+            case 'J': return OP_LASTORE;
+            case 'F': return OP_FASTORE;
+            case 'D': return OP_DASTORE;
+            default: return OP_AASTORE;
+            }
+        }
+
+        // writes the code that sets the statics to the values a run left
+        class Builder {
+        public:
+            Builder(ClassFile& f, const Interpreter& run): Pool(f), F(f), Run(run) {}
+
+            void Push(const Constant& c);
+            // leaves a copy of the array on the stack
+            void Array(const Constant& a);
+            void Put(int field);
+
+            std::vector<Insn> Insns;
+            int MaxLocals = 0;
+            PoolEditor Pool;
+
+        private:
+            void Decode(const HeapArray& a);
+
+            ClassFile& F;
+            const Interpreter& Run;
+        };
+
+        void Builder::Push(const Constant& c) {
+            switch (c.Type) {
+            case Kind::Int: {
+                const auto v = static_cast<int32_t>(c.Bits);
+                if (v >= -1 && v <= 5) { Insns.push_back(op(static_cast<uint8_t>(OP_ICONST_0 + v))); }
+                else if (v >= -128 && v < 128) { Insns.push_back(op(OP_BIPUSH, v)); }
+                else if (v >= -32768 && v < 32768) { Insns.push_back(op(OP_SIPUSH, v)); }
+                else { Insns.push_back(op(OP_LDC, Pool.Integer(v))); }
+            }
+            return;
+            case Kind::Long:
+                if (c.Bits == 0 || c.Bits == 1) { Insns.push_back(op(static_cast<uint8_t>(OP_LCONST_0 + c.Bits))); }
+                else { Insns.push_back(op(OP_LDC2_W, Pool.Long(c.Bits))); }
+                return;
+            case Kind::Float: {
+                const auto v = static_cast<float>(c.Real);
+                if (same_bits(v, 0.0f) || v == 1.0f || v == 2.0f) {
+                    Insns.push_back(op(static_cast<uint8_t>(OP_FCONST_0 + static_cast<int>(v))));
+                } else {
+                    Insns.push_back(op(OP_LDC, Pool.Float(v)));
+                }
+            }
+            return;
+            case Kind::Double:
+                if (same_bits(c.Real, 0.0) || c.Real == 1.0) {
+                    Insns.push_back(op(static_cast<uint8_t>(OP_DCONST_0 + static_cast<int>(c.Real))));
+                } else {
+                    Insns.push_back(op(OP_LDC2_W, Pool.Double(c.Real)));
+                }
+                return;
+            case Kind::String: Insns.push_back(op(OP_LDC, Pool.String(mutf8(Run.StringAt(c))))); return;
+            case Kind::Array: Array(c); return;
+            default: Insns.push_back(op(OP_ACONST_NULL));
+            }
+        }
+
+        // Locals 0 to 2 hold the array, the string and the index; an int outside of 0 to 65535 takes
+        // two chars, the high one first.
+        void Builder::Decode(const HeapArray& a) {
+            const char type = a.Type;
+            const auto n = static_cast<int32_t>(a.Elements.size());
+            bool wide = false;
+            for (const auto& e : a.Elements) { wide |= type == 'I' && (e.Bits < 0 || e.Bits > 0xffff); }
+            std::u16string s;
+            for (const auto& e : a.Elements) {
+                const auto v = static_cast<uint32_t>(e.Bits);
+                if (wide) { s += static_cast<char16_t>(v >> 16); }
+                s += static_cast<char16_t>(type == 'B' ? v & 0xff : v & 0xffff);
+            }
+            const U2 char_at = Pool.MethodRef("java/lang/String", "charAt", "(I)C");
+            MaxLocals = 3;
+
+            Push({Kind::Int, n, 0});
+            Insns.push_back(op(OP_NEWARRAY, newarray_type(type)));
+            Insns.push_back(local(OP_ASTORE, 0));
+            Insns.push_back(op(OP_LDC, Pool.String(mutf8(s))));
+            Insns.push_back(local(OP_ASTORE, 1));
+            Insns.push_back(op(OP_ICONST_0));
+            Insns.push_back(local(OP_ISTORE, 2));
+            const int loop = static_cast<int>(Insns.size());
+            Insns.push_back(local(OP_ILOAD, 2));
+            Push({Kind::Int, n, 0});
+            const int exit = static_cast<int>(Insns.size());
+            Insns.push_back(op(OP_IF_ICMPGE));
+            Insns.push_back(local(OP_ALOAD, 0));
+            Insns.push_back(local(OP_ILOAD, 2));
+            if (wide) {
+                Insns.insert(Insns.end(), {local(OP_ALOAD, 1), local(OP_ILOAD, 2), op(OP_ICONST_1), op(OP_ISHL),
+                                           op(OP_INVOKEVIRTUAL, char_at), op(OP_BIPUSH, 16), op(OP_ISHL),
+                                           local(OP_ALOAD, 1), local(OP_ILOAD, 2), op(OP_ICONST_1), op(OP_ISHL),
+                                           op(OP_ICONST_1), op(OP_IADD), op(OP_INVOKEVIRTUAL, char_at), op(OP_IOR)});
+            } else {
+                Insns.insert(Insns.end(), {local(OP_ALOAD, 1), local(OP_ILOAD, 2), op(OP_INVOKEVIRTUAL, char_at)});
+            }
+            if (type == 'B') { Insns.push_back(op(OP_I2B)); }
+            if (type == 'S') { Insns.push_back(op(OP_I2S)); }
+            Insns.push_back(op(array_store(type)));
+            Insn inc = local(OP_IINC, 2);
+            inc.Value = 1;
+            Insns.push_back(inc);
+            Insn back = op(OP_GOTO);
+            back.Target = loop;
+            Insns.push_back(back);
+            Insns[exit].Target = static_cast<int>(Insns.size());
+            Insns.push_back(local(OP_ALOAD, 0));
+        }
+
+        void Builder::Array(const Constant& c) {
+            const auto& a = Run.ArrayAt(c);
+            const Constant zero = Interpreter::Default(a.Type);
+            size_t set = 0;
+            for (const auto& e : a.Elements) { set += e != zero; }
+            if (a.Type == 'C' && set) {
+                std::u16string s;
+                for (const auto& e : a.Elements) { s += static_cast<char16_t>(e.Bits); }
+                Insns.push_back(op(OP_LDC, Pool.String(mutf8(s))));
+                Insns.push_back(op(OP_INVOKEVIRTUAL, Pool.MethodRef("java/lang/String", "toCharArray", "()[C")));
+                return;
+            }
+            if (set >= DECODE_MIN && (a.Type == 'Z' || a.Type == 'B' || a.Type == 'S' || a.Type == 'I')) {
+                Decode(a);
+                return;
+            }
+            Push({Kind::Int, static_cast<int64_t>(a.Elements.size()), 0});
+            if (a.Type == 'L') { Insns.push_back(op(OP_ANEWARRAY, Pool.Class("java/lang/String"))); }
+            else { Insns.push_back(op(OP_NEWARRAY, newarray_type(a.Type))); }
+            for (size_t k = 0; k < a.Elements.size(); k++) {
+                if (a.Elements[k] == zero) { continue; }
+                Insns.push_back(op(OP_DUP));
+                Push({Kind::Int, static_cast<int64_t>(k), 0});
+                Push(a.Elements[k]);
+                Insns.push_back(op(array_store(a.Type)));
+            }
+        }
+
+        void Builder::Put(const int field) {
+            const auto& fi = F.Fields[field];
+            Insns.push_back(op(OP_PUTSTATIC, Pool.FieldRef(ClassNameAt(F, F.ThisClass), Utf8At(F, fi.NameIndex),
+                                                           Utf8At(F, fi.DescriptorIndex))));
+        }
+
+        // the ConstantValue entry of a value for a field, 0 if it cannot have one
+        U2 constant_value(PoolEditor& pool, const Interpreter& run, const Constant& c, const std::string_view desc) {
+            switch (c.Type) {
+            case Kind::Int:
+                return desc.size() == 1 && std::strchr("ZBCSI", desc[0]) ? pool.Integer(static_cast<int32_t>(c.Bits)) : 0;
+            case Kind::Long: return desc == "J" ? pool.Long(c.Bits) : 0;
+            case Kind::Float: return desc == "F" ? pool.Float(static_cast<float>(c.Real)) : 0;
+            case Kind::Double: return desc == "D" ? pool.Double(c.Real) : 0;
+            case Kind::String: return desc == "Ljava/lang/String;" ? pool.String(mutf8(run.StringAt(c))) : 0;
+            default: return 0;
+            }
+        }
+
+        // counts the bytes written to it
+        struct ByteCounter : IWriter {
+            void WriteU4(U4) override { Bytes += 4; }
+            void WriteU2(U2) override { Bytes += 2; }
+            void WriteU1(U1) override { Bytes += 1; }
+            void WriteBytes(const std::vector<U1>& bytes) override { Bytes += static_cast<long>(bytes.size()); }
+            long Bytes = 0;
+        };
+
+        // what the entries of the pool from first on take in the class file
+        long pool_bytes(const ClassFile& f, const size_t first) {
+            ByteCounter count;
+            for (size_t i = first; i < f.ConstantPool.size(); i++) {
+                if (!f.ConstantPool[i]) { continue; } // second half of a long or double
+                count.WriteU1(static_cast<U1>(f.ConstantPool[i]->Tag));
+                f.ConstantPool[i]->Write(count);
+            }
+            return count.Bytes;
+        }
+
+        long member_bytes(const MethodInfo& m) {
+            long bytes = 8;
+            for (const auto& a : m.Attributes) { bytes += 6 + static_cast<long>(a.Info.size()); }
+            return bytes;
+        }
+
+        bool has_constant_value(const ClassFile& f, const FieldInfo& field) {
+            for (const auto& a : field.Attributes) {
+                if (Utf8At(f, a.AttributeNameIndex) == "ConstantValue") { return true; }
+            }
+            return false;
+        }
+
+        // sets the ConstantValue of a field, or drops it for index 0
+        void set_constant_value(FieldInfo& field, PoolEditor& pool, const U2 index) {
+            const U2 name = pool.Utf8("ConstantValue");
+            auto& attributes = field.Attributes;
+            for (size_t i = 0; i < attributes.size(); i++) {
+                if (attributes[i].AttributeNameIndex != name) { continue; }
+                attributes.erase(attributes.begin() + static_cast<std::ptrdiff_t>(i));
+                break;
+            }
+            if (index) {
+                attributes.push_back({name, 2, {static_cast<U1>(index >> 8), static_cast<U1>(index)}});
+            }
+            field.AttributesCount = static_cast<U2>(attributes.size());
+        }
+    }
+
+    bool FoldStaticInitializer(ClassFile& f, const ClassHierarchy& h) {
+        int method = -1, code_attribute = -1;
+        for (size_t i = 0; i < f.Methods.size(); i++) {
+            if (Utf8At(f, f.Methods[i].NameIndex) != "<clinit>") { continue; }
+            method = static_cast<int>(i);
+            const auto& attributes = f.Methods[i].Attributes;
+            for (size_t k = 0; k < attributes.size(); k++) {
+                if (Utf8At(f, attributes[k].AttributeNameIndex) == "Code") { code_attribute = static_cast<int>(k); }
+            }
+        }
+        if (method < 0 || code_attribute < 0) { return false; }
+        const AttributeInfo& old = f.Methods[method].Attributes[code_attribute];
+
+        DecodedCode decoded;
+        try {
+            CodeAttribute code;
+            Parser{}.ParseCodeOnto(old.Info, code);
+            decoded = DecodeCode(f, code);
+        } catch (const InvalidBytecode&) {
+            return false;
+        }
+        Interpreter run(f);
+        if (!run.Run(decoded)) { return false; }
+
+        // entries added for a <clinit> that is not taken go again
+        const size_t pool_size = f.ConstantPool.size();
+        auto undo = [&]() {
+            f.ConstantPool.resize(pool_size);
+            f.ConstantPoolCount = static_cast<U2>(pool_size);
+            return false;
+        };
+        Builder b(f, run);
+        std::vector<std::pair<int, U2>> constants; // (field, ConstantValue entry or 0 to drop it)
+        std::vector<std::pair<Constant, std::vector<int>>> arrays; // and the fields holding each
+        try {
+            for (const auto& s : run.Statics()) {
+                if (s.Current == s.Initial) { continue; }
+                const auto desc = Utf8At(f, f.Fields[s.Field].DescriptorIndex);
+                const U2 index = s.Final ? constant_value(b.Pool, run, s.Current, desc) : 0;
+                if (s.Final && s.Current == Interpreter::Default(desc[0])) {
+                    constants.emplace_back(s.Field, 0);
+                } else if (index) {
+                    constants.emplace_back(s.Field, index);
+                } else if (s.Current.Type == Kind::Array) {
+                    auto it = arrays.begin();
+                    while (it != arrays.end() && it->first != s.Current) { ++it; }
+                    if (it == arrays.end()) { it = arrays.insert(it, {s.Current, {}}); }
+                    it->second.push_back(s.Field);
+                } else {
+                    b.Push(s.Current);
+                    b.Put(s.Field);
+                }
+            }
+            // an array several fields hold is built once
+            for (const auto& [array, fields] : arrays) {
+                b.Array(array);
+                for (size_t k = 0; k < fields.size(); k++) {
+                    if (k + 1 < fields.size()) { b.Insns.push_back(op(OP_DUP)); }
+                    b.Put(fields[k]);
+                }
+            }
+
+            // the class may not grow: what the new <clinit> takes, or saves, against what the constants
+            // add to the pool and to the fields
+            auto& m = f.Methods[method];
+            AttributeInfo code;
+            long growth = 0;
+            const bool drop = b.Insns.empty();
+            if (drop) {
+                growth -= member_bytes(m);
+            } else {
+                b.Insns.push_back(op(OP_RETURN));
+                code = AssembleCode(f, m, std::move(b.Insns), b.MaxLocals, h);
+                growth += static_cast<long>(code.Info.size()) - static_cast<long>(old.Info.size());
+            }
+            if (!constants.empty()) { b.Pool.Utf8("ConstantValue"); }
+            growth += pool_bytes(f, pool_size);
+            for (const auto& [field, index] : constants) {
+                const bool had = has_constant_value(f, f.Fields[field]);
+                growth += index && !had ? 8 : !index && had ? -8 : 0;
+            }
+            if (growth > 0) { return undo(); }
+            if (drop) {
+                f.Methods.erase(f.Methods.begin() + method);
+                f.MethodsCount = static_cast<U2>(f.Methods.size());
+            } else {
+                m.Attributes[code_attribute] = std::move(code);
+            }
+        } catch (const std::length_error&) {
+            return undo();
+        } catch (const FrameError&) {
+            return undo();
+        }
+        for (const auto& [field, index] : constants) { set_constant_value(f.Fields[field], b.Pool, index); }
+        return true;
+    }
+}
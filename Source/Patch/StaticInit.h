@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+
+namespace Patch {
+    // Runs the static initializer of f at build time (see Analyze/Interpreter.h) and, if the run gets to
+    // the end, puts what it left in place of it. A final static of a primitive or String type that the
+    // initializer changed gets a ConstantValue; the other statics it changed, arrays above all, are set
+    // by a new <clinit> that stores just the values. An array is built from a string constant where it
+    // can be (toCharArray for char[], a decoding loop for long boolean, byte, short and int arrays),
+    // otherwise element by element. The new <clinit> is left out if there is nothing to set. All of it
+    // is only taken if the class gets no larger: the new <clinit> against the old one, plus the constant
+    // pool entries and ConstantValue attributes it adds. Returns whether f changed.
+    bool FoldStaticInitializer(Parse::ClassFile& f, const Analyze::ClassHierarchy& h);
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/Writer.h"
+#include "StripAttributes.h"
+
+using namespace Parse;
+
+namespace Patch {
+    const std::vector<std::string> DebugAttributes = {
+        "LineNumberTable", "LocalVariableTable", "LocalVariableTypeTable", "SourceDebugExtension",
+    };
+
+    bool IsProtectedAttribute(const std::string& name) {
+        static const char* const protect[] = {
+            "Code", "ConstantValue", "StackMapTable", "BootstrapMethods", "NestHost", "NestMembers",
+            "PermittedSubclasses", "Module", "ModulePackages", "ModuleMainClass", "Record", "InnerClasses",
+            "EnclosingMethod",
+        };
+        return std::any_of(std::begin(protect), std::end(protect), [&](const char* p) { return name == p; });
+    }
+
+    namespace {
+        class Stripper {
+        public:
+            Stripper(const ClassFile& f, const std::vector<std::string>& names): File(f), Names(names) {}
+
+            // returns whether anything was removed; the count field is kept in sync
+            bool Filter(std::vector<AttributeInfo>& attributes, U2& count) {
+                const auto before = attributes.size();
+                attributes.erase(std::remove_if(attributes.begin(), attributes.end(), [this](AttributeInfo& a) {
+                    return Strip(a);
+                }), attributes.end());
+                count = static_cast<U2>(attributes.size());
+                Removed += static_cast<int>(before - attributes.size());
+                return attributes.size() != before;
+            }
+
+        private:
+            bool Strip(AttributeInfo& a) {
+                const auto name = Utf8At(File, a.AttributeNameIndex);
+                if (name == "Code") {
+                    CodeAttribute code;
+                    Parser{}.ParseCodeOnto(a.Info, code);
+                    if (Filter(code.Attributes, code.AttributesCount)) {
+                        Writer{}.WriteCodeOnto(code, a.Info);
+                        a.AttributeLength = static_cast<U4>(a.Info.size());
+                    }
+                    return false;
+                }
+                return std::find(Names.begin(), Names.end(), name) != Names.end();
+            }
+
+        public:
+            int Removed = 0;
+
+        private:
+            const ClassFile& File;
+            const std::vector<std::string>& Names;
+        };
+    }
+
+    int StripAttributes(ClassFile& f, const std::vector<std::string>& names) {
+        Stripper s(f, names);
+        for (auto& fi : f.Fields) { s.Filter(fi.Attributes, fi.AttributesCount); }
+        for (auto& mi : f.Methods) { s.Filter(mi.Attributes, mi.AttributesCount); }
+        s.Filter(f.Attributes, f.AttributesCount);
+        return s.Removed;
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Parse/ClassFile.h"
+
+namespace Patch {
+    // what --strip-debug removes; the same set javac -g:none leaves out, except SourceFile
+    extern const std::vector<std::string> DebugAttributes;
+
+    // attributes the JVM needs to load, link or verify a class; these are never stripped
+    bool IsProtectedAttribute(const std::string& name);
+
+    // Removes the named attributes from the class, its fields and methods, and the attributes nested in
+    // Code. Returns the number of attributes removed. The names stay in the constant pool until it is
+    // compacted.
+    int StripAttributes(Parse::ClassFile& f, const std::vector<std::string>& names);
+}
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include "Parse/CpRefs.h"
+#include "Analyze/Insns.h"
+#include "Analyze/ValueFlow.h"
+#include "Unboxing.h"
+
+using namespace Parse;
+using namespace Analyze;
+
+namespace Patch {
+    namespace {
+        struct BoxClass {
+            std::string_view Name;
+            char Primitive;
+        };
+
+        constexpr BoxClass box_classes[] = {
+            {"java/lang/Integer", 'I'}, {"java/lang/Long", 'J'}, {"java/lang/Float", 'F'},
+            {"java/lang/Double", 'D'}, {"java/lang/Short", 'S'}, {"java/lang/Byte", 'B'},
+            {"java/lang/Character", 'C'}, {"java/lang/Boolean", 'Z'},
+        };
+
+        // the primitive a box class holds, 0 for any other class
+        char boxed(const std::string_view cls) {
+            for (const auto& b : box_classes) {
+                if (b.Name == cls) { return b.Primitive; }
+            }
+            return 0;
+        }
+
+        // how a primitive is kept in a local or on the stack
+        char kind(const char primitive) {
+            return primitive == 'J' || primitive == 'F' || primitive == 'D' ? primitive : 'I';
+        }
+
+        // For each constant pool entry, the primitive a MethodRef to a static valueOf of a box class
+        // boxes; 0 for every other entry.
+        std::vector<char> box_refs(const ClassFile& f) {
+            std::vector<char> refs(f.ConstantPool.size());
+            for (size_t i = 1; i < f.ConstantPool.size(); i++) {
+                const auto& e = f.ConstantPool[i];
+                if (!e || e->Tag != CPoolTags::MethodRef) { continue; }
+                const auto& ref = ConstantMethodRefInfo::Reference(e);
+                const char primitive = boxed(ClassNameAt(f, ref.ClassIndex));
+                if (!primitive) { continue; }
+                const auto m = MemberRefAt(f, static_cast<U2>(i));
+                const auto owner = m.Owner;
+                if (m.Name == "valueOf" && m.Descriptor.size() == owner.size() + 5 && m.Descriptor[1] == primitive &&
+                    m.Descriptor.compare(0, 1, "(") == 0 && m.Descriptor.compare(2, 2, ")L") == 0 &&
+                    m.Descriptor.compare(4, owner.size(), owner) == 0 && m.Descriptor.back() == ';') {
+                    refs[i] = primitive;
+                }
+            }
+            return refs;
+        }
+
+        // What an unboxing of a box of primitive returns, by the first character of its descriptor;
+        // 0 if in is not one.
+        char unboxed(const ClassFile& f, const Insn& in, const char primitive) {
+            if (in.Op != OP_INVOKEVIRTUAL) { return 0; }
+            const auto m = MemberRefAt(f, static_cast<U2>(in.Value));
+            if (m.Descriptor.size() != 3 || m.Descriptor.compare(0, 2, "()") != 0) { return 0; }
+            const char result = m.Descriptor[2];
+            static constexpr std::pair<std::string_view, char> own[] = {
+                {"booleanValue", 'Z'}, {"charValue", 'C'}, {"byteValue", 'B'}, {"shortValue", 'S'},
+                {"intValue", 'I'}, {"longValue", 'J'}, {"floatValue", 'F'}, {"doubleValue", 'D'},
+            };
+            bool named = false;
+            for (const auto& [name, type] : own) { named |= m.Name == name && result == type; }
+            if (!named) { return 0; }
+            if (boxed(m.Owner) == primitive) {
+                // Integer.longValue and the like; Boolean and Character have only their own
+                return primitive == 'Z' || primitive == 'C' ? (result == primitive ? result : 0) : result;
+            }
+            // all but booleanValue and charValue are methods of Number
+            return m.Owner == "java/lang/Number" && primitive != 'Z' && primitive != 'C' && result != 'Z' &&
+                   result != 'C' ? result : 0;
+        }
+
+        // the casts from a primitive on the stack to what unboxing it as result gives
+        void convert(const char primitive, const char result, std::vector<Insn>& out) {
+            static constexpr char kinds[] = "IJFD";
+            const int from = static_cast<int>(std::string_view(kinds).find(kind(primitive)));
+            const int to = static_cast<int>(std::string_view(kinds).find(kind(result)));
+            Insn in;
+            if (from != to) {
+                // i2l, i2f, i2d, l2i, l2f, l2d, f2i, f2l, f2d, d2i, d2l, d2f
+                in.Op = static_cast<uint8_t>(OP_I2L + from * 3 + (to < from ? to : to - 1));
+                out.push_back(in);
+            }
+            if (result == primitive || kind(result) != 'I') { return; }
+            switch (result) {
+            case 'B': in.Op = OP_I2B; break;
+            case 'C': in.Op = OP_I2C; break;
+            case 'S': in.Op = OP_I2S; break;
+            default: return;
+            }
+            out.push_back(in);
+        }
+
+        struct Rewrite {
+            const ClassFile& F;
+            const std::vector<char>& Refs; // see box_refs
+            DecodedCode& Code;
+            std::vector<bool> Target;      // instructions something jumps to
+            CodeRewriter Rewriter;
+            int Next;                      // first free local
+            int MaxStack;
+
+            Rewrite(const ClassFile& f, const std::vector<char>& refs, DecodedCode& code):
+                F(f), Refs(refs), Code(code), Target(code.Insns.size() + 1), Rewriter(code), Next(code.MaxLocals),
+                MaxStack(code.MaxStack) {
+                for (const auto& in : code.Insns) {
+                    if (in.Target >= 0) { Target[in.Target] = true; }
+                }
+                for (const auto& table : code.Switches) {
+                    for (const int t : table.Targets) { Target[t] = true; }
+                }
+                for (const auto& h : code.Handlers) { Target[h.Target] = true; }
+            }
+
+            char primitive(const int box) const { return Refs[Code.Insns[box].Value]; }
+
+            // Cancels the boxes of sources (see ValueFlow) that are only unboxed. Returns the boxes left.
+            std::vector<int> Run(const std::vector<int>& sources);
+        };
+
+        std::vector<int> Rewrite::Run(const std::vector<int>& sources) {
+            const int n = static_cast<int>(Code.Insns.size());
+            const ValueFlow flow(F, Code, sources);
+            std::vector<bool> kept(n); // used other than by unboxing
+            std::vector<std::vector<int>> uses(n);
+            for (int i = 0; i < n; i++) {
+                const auto& inputs = flow.Inputs(i);
+                for (size_t k = 0; k < inputs.size(); k++) {
+                    const int s = inputs[k];
+                    if (s < 0) { continue; }
+                    if (k || !unboxed(F, Code.Insns[i], primitive(s))) { kept[s] = true; }
+                    else { uses[s].push_back(i); }
+                }
+            }
+
+            std::vector<int> left;
+            std::vector<int> local(n, -1);
+            for (int box = 0; box < n; box++) {
+                const int s = sources[box];
+                if (s < 0 || flow.Depth(box) < 0) { continue; }
+                const char p = primitive(box);
+                const int slots = TypeSlots(kind(p));
+                if (kept[s] || flow.Ambiguous(s) || (local[s] < 0 && Next + slots > 0xffff)) {
+                    left.push_back(box);
+                    continue;
+                }
+                std::vector<Insn> with;
+                if (std::find(uses[s].begin(), uses[s].end(), box + 1) != uses[s].end() && !Target[box + 1]) {
+                    // unboxed right away, the only place its value goes
+                    const char result = unboxed(F, Code.Insns[box + 1], p);
+                    convert(p, result, with);
+                    Rewriter.Replace(box, {});
+                    Rewriter.Replace(box + 1, std::move(with));
+                    MaxStack = std::max(MaxStack, flow.Depth(box) - slots + TypeSlots(result));
+                    uses[s].erase(std::find(uses[s].begin(), uses[s].end(), box + 1));
+                    continue;
+                }
+                if (local[s] < 0) {
+                    local[s] = Next;
+                    Next += slots;
+                }
+                with.push_back(StoreInsn(kind(p), local[s]));
+                with.push_back(DefaultValue('L'));
+                Rewriter.Replace(box, std::move(with));
+            }
+            for (int s = 0; s < n; s++) {
+                if (local[s] < 0) { continue; }
+                const char p = primitive(s);
+                for (const int use : uses[s]) {
+                    std::vector<Insn> with;
+                    with.push_back(Insn{OP_POP});
+                    with.push_back(LoadInsn(kind(p), local[s]));
+                    convert(p, unboxed(F, Code.Insns[use], p), with);
+                    Rewriter.Replace(use, std::move(with));
+                    MaxStack = std::max(MaxStack, flow.Depth(use) + 1);
+                }
+            }
+            return left;
+        }
+
+        bool patch(const ClassFile& f, const std::vector<char>& refs, DecodedCode& code) {
+            const int n = static_cast<int>(code.Insns.size());
+            // The boxes of a primitive type are first followed as one, so that a box may take the place
+            // of another (an accumulator in a loop, say) and still be kept in one local. Where that fails,
+            // they are tried one by one.
+            std::vector<int> sources(n, -1);
+            std::vector<int> members(n);
+            int first[128];
+            std::fill(std::begin(first), std::end(first), -1);
+            bool any = false;
+            for (int i = 0; i < n; i++) {
+                const auto& in = code.Insns[i];
+                if (in.Op != OP_INVOKESTATIC || in.Value >= static_cast<int>(refs.size()) || !refs[in.Value]) { continue; }
+                int& group = first[static_cast<int>(refs[in.Value])];
+                if (group < 0) { group = i; }
+                sources[i] = group;
+                members[group]++;
+                any = true;
+            }
+            if (!any) { return false; }
+
+            Rewrite rewrite(f, refs, code);
+            const auto left = rewrite.Run(sources);
+            std::vector<int> alone(n, -1);
+            bool retry = false;
+            for (const int box : left) {
+                if (members[sources[box]] > 1) { alone[box] = box, retry = true; }
+            }
+            if (retry) { rewrite.Run(alone); }
+
+            if (rewrite.Rewriter.Empty() || rewrite.MaxStack > 0xffff) { return false; }
+            const int old_locals = code.MaxLocals;
+            code.MaxLocals = static_cast<U2>(rewrite.Next);
+            code.MaxStack = static_cast<U2>(rewrite.MaxStack);
+            rewrite.Rewriter.Apply();
+            ForgetFramesWhereLive(code, old_locals);
+            return true;
+        }
+    }
+
+    int EliminateBoxing(ClassFile& f, const ClassHierarchy& h) {
+        const auto refs = box_refs(f);
+        if (std::find_if(refs.begin(), refs.end(), [](const char c) { return c != 0; }) == refs.end()) { return 0; }
+        return PatchMethods(f, h, [&](const MethodInfo&, DecodedCode& code) {
+            try {
+                return patch(f, refs, code);
+            } catch (const InvalidBytecode&) {
+                return false;
+            } catch (const InvalidClassFile&) {
+                return false;
+            }
+        });
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Parse/ClassFile.h"
+#include "Analyze/Hierarchy.h"
+
+namespace Patch {
+    // Cancels the boxing of primitives (Integer.valueOf and the like) whose box is only ever unboxed
+    // again (intValue, or any other xxxValue of Number with the cast it stands for). A box unboxed right
+    // away goes away with its unboxing; otherwise the primitive is kept in a new local, the box becomes
+    // null, and every unboxing loads the local. Boxes used any other way, even once, are left alone.
+    // Returns the number of methods changed.
+    int EliminateBoxing(Parse::ClassFile& f, const Analyze::ClassHierarchy& h);
+}
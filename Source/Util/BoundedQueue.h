@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace Utils {
+    // Fixed-capacity queue for any number of producers and consumers, without locks: every cell carries
+    // a sequence number that says whether it is ready to be written or read in the current lap, so a
+    // push or pop is one CAS on its end of the queue plus a store to the cell (Vyukov's bounded MPMC
+    // queue). Neither operation waits; they report a full or empty queue and leave the waiting to the
+    // caller.
+    template<class T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity): Mask(round_up(capacity) - 1), Cells(new Cell[Mask + 1]) {
+            for (size_t i = 0; i <= Mask; i++) { Cells[i].Seq.store(i, std::memory_order_relaxed); }
+        }
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        size_t Capacity() const { return Mask + 1; }
+
+        bool TryPush(const T& v) {
+            size_t pos = Tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& c = Cells[pos & Mask];
+                const size_t seq = c.Seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+                if (diff == 0) {
+                    if (Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        c.Value = v;
+                        c.Seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false; // the cell still holds a value from the previous lap
+                } else {
+                    pos = Tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool TryPop(T& v) {
+            size_t pos = Head.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& c = Cells[pos & Mask];
+                const size_t seq = c.Seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+                if (diff == 0) {
+                    if (Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        v = c.Value;
+                        c.Seq.store(pos + Mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false; // nothing has been pushed to the cell in this lap yet
+                } else {
+                    pos = Head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> Seq;
+            T Value;
+        };
+
+        static size_t round_up(size_t n) {
+            size_t p = 2;
+            while (p < n) { p <<= 1; }
+            return p;
+        }
+
+        const size_t Mask;
+        std::unique_ptr<Cell[]> Cells;
+        alignas(64) std::atomic<size_t> Tail{0};
+        alignas(64) std::atomic<size_t> Head{0};
+    };
+}
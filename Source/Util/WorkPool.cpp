@@ -0,0 +1,134 @@
+#include "WorkPool.h"
+
+namespace Utils {
+    namespace {
+        uint64_t pack(const uint32_t begin, const uint32_t end) {
+            return static_cast<uint64_t>(begin) << 32 | end;
+        }
+
+        int shared_threads = 0;
+        thread_local bool serial = false;
+    }
+
+    WorkPool::WorkPool(const int threads): NumThreads(threads < 1 ? 1 : threads), Slots(new Slot[NumThreads]) {
+        for (int i = 1; i < NumThreads; i++) { Workers.emplace_back(&WorkPool::WorkerMain, this, i); }
+    }
+
+    WorkPool::~WorkPool() {
+        {
+            std::lock_guard<std::mutex> guard(Lock);
+            Quit = true;
+        }
+        Wake.notify_all();
+        for (auto& t : Workers) { t.join(); }
+    }
+
+    WorkPool& WorkPool::Shared() {
+        static WorkPool pool(shared_threads ? shared_threads : static_cast<int>(std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+    void WorkPool::SetSharedThreads(const int threads) {
+        shared_threads = threads;
+    }
+
+    void WorkPool::SerialOnThisThread() {
+        serial = true;
+    }
+
+    // the next iteration for worker: from the front of its own range, else half of the fullest other one
+    bool WorkPool::Next(const int worker, int& i) {
+        auto& own = Slots[worker].Range;
+        for (;;) {
+            if (Failed.load(std::memory_order_relaxed)) { return false; }
+            uint64_t r = own.load(std::memory_order_acquire);
+            while (static_cast<uint32_t>(r >> 32) < static_cast<uint32_t>(r)) {
+                if (own.compare_exchange_weak(r, r + (1ull << 32), std::memory_order_acq_rel)) {
+                    i = static_cast<int>(r >> 32);
+                    return true;
+                }
+            }
+
+            int victim = -1;
+            uint32_t most = 0;
+            for (int w = 0; w < Threads(); w++) {
+                const uint64_t v = Slots[w].Range.load(std::memory_order_relaxed);
+                const uint32_t left = static_cast<uint32_t>(v) - static_cast<uint32_t>(v >> 32);
+                if (w != worker && static_cast<uint32_t>(v >> 32) < static_cast<uint32_t>(v) && left > most) {
+                    most = left;
+                    victim = w;
+                }
+            }
+            if (victim < 0) { return false; }
+            auto& theirs = Slots[victim].Range;
+            uint64_t v = theirs.load(std::memory_order_acquire);
+            const uint32_t begin = static_cast<uint32_t>(v >> 32), end = static_cast<uint32_t>(v);
+            if (begin >= end) { continue; }
+            const uint32_t mid = begin + (end - begin) / 2; // a single iteration left is taken whole
+            if (theirs.compare_exchange_strong(v, pack(begin, mid), std::memory_order_acq_rel)) {
+                // own is empty, and nobody writes an empty range but its owner
+                own.store(pack(mid, end), std::memory_order_release);
+            }
+        }
+    }
+
+    void WorkPool::Work(const int worker) {
+        int i;
+        while (Next(worker, i)) {
+            try {
+                (*Body)(i, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(Lock);
+                if (!Error) { Error = std::current_exception(); }
+                Failed = true;
+            }
+        }
+    }
+
+    void WorkPool::WorkerMain(const int worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(Lock);
+                Wake.wait(lock, [&] { return Quit || Generation != seen; });
+                if (Quit) { return; }
+                seen = Generation;
+            }
+            Work(worker);
+            std::lock_guard<std::mutex> guard(Lock);
+            if (--Running == 0) { Done.notify_one(); }
+        }
+    }
+
+    void WorkPool::ParallelFor(const int n, const std::function<void(int, int)>& body) {
+        std::unique_lock<std::mutex> busy(Busy, std::try_to_lock);
+        if (n <= 0) { return; }
+        if (serial || !busy.owns_lock() || Threads() == 1 || n == 1) {
+            for (int i = 0; i < n; i++) { body(i, 0); }
+            return;
+        }
+
+        const int threads = Threads();
+        for (int w = 0; w < threads; w++) {
+            const auto begin = static_cast<uint32_t>(static_cast<int64_t>(n) * w / threads);
+            const auto end = static_cast<uint32_t>(static_cast<int64_t>(n) * (w + 1) / threads);
+            Slots[w].Range.store(pack(begin, end), std::memory_order_relaxed);
+        }
+        Body = &body;
+        Failed = false;
+        Error = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(Lock);
+            Running = threads - 1;
+            Generation++;
+        }
+        Wake.notify_all();
+        Work(0);
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            Done.wait(lock, [&] { return Running == 0; });
+        }
+        Body = nullptr;
+        if (Error) { std::rethrow_exception(Error); }
+    }
+}
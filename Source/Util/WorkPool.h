@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Utils {
+    // Threads for splitting one large job, such as the methods of a huge class, into independent
+    // iterations. Each worker owns a range of the iterations and takes them from its front; a worker
+    // whose range runs out steals the back half of the fullest one. Taking and stealing are a CAS
+    // each, so uneven iteration costs even out without a shared queue.
+    class WorkPool {
+    public:
+        explicit WorkPool(int threads); // including the thread that calls ParallelFor
+        WorkPool(const WorkPool&) = delete;
+        WorkPool& operator=(const WorkPool&) = delete;
+        ~WorkPool();
+
+        int Threads() const { return NumThreads; }
+
+        // Calls body(i, worker) for every i in [0, n) and returns when all calls have; worker, below
+        // Threads(), tells which thread is calling, for per-thread scratch state. The caller takes
+        // part as worker 0. After an exception the remaining iterations are skipped and the first
+        // exception is rethrown. A call made while the pool is busy (from another thread or from
+        // inside body) runs serially on the calling thread.
+        void ParallelFor(int n, const std::function<void(int, int)>& body);
+
+        // the pool shared by the whole process, created on first use
+        static WorkPool& Shared();
+        // threads of the shared pool, 0 = one per core; only effective before its first use
+        static void SetSharedThreads(int threads);
+        // Makes the ParallelFor calls of the calling thread run serially on it, for a thread that is one
+        // of several doing jobs side by side already (a pipeline stage), which would otherwise have the
+        // pool's threads compete with them for the cores.
+        static void SerialOnThisThread();
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> Range{0}; // begin << 32 | end
+        };
+
+        void Work(int worker);
+        bool Next(int worker, int& i);
+        void WorkerMain(int worker);
+
+        int NumThreads;
+        std::unique_ptr<Slot[]> Slots;
+        std::vector<std::thread> Workers;
+
+        std::mutex Busy;
+        std::mutex Lock; // guards the fields below
+        std::condition_variable Wake, Done;
+        uint64_t Generation = 0;
+        int Running = 0; // helper threads still in the current job
+        bool Quit = false;
+
+        const std::function<void(int, int)>* Body = nullptr;
+        std::atomic<bool> Failed{false};
+        std::exception_ptr Error;
+    };
+}
@@ -0,0 +1,58 @@
+#include <string.h>
+#include "bytescan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+
+static int
+highest_bit(unsigned x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return (int) i;
+#else
+    return 31 - __builtin_clz(x);
+#endif
+}
+#endif
+
+void
+bytemask2(const char *s, size_t n, char ca, char cb, uint64_t *a, uint64_t *b)
+{
+    size_t i = 0, words = (n + 63) / 64;
+    memset(a, 0, words * sizeof *a);
+    memset(b, 0, words * sizeof *b);
+#ifdef HAVE_SSE2
+    {
+        const __m128i va = _mm_set1_epi8(ca), vb = _mm_set1_epi8(cb);
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+            a[i / 64] |= (uint64_t) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, va)) << i % 64;
+            b[i / 64] |= (uint64_t) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, vb)) << i % 64;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        a[i / 64] |= (uint64_t) (s[i] == ca) << i % 64;
+        b[i / 64] |= (uint64_t) (s[i] == cb) << i % 64;
+    }
+}
+
+const char *
+last_byte(const char *s, size_t n, char c)
+{
+#ifdef HAVE_SSE2
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; n >= 16; n -= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + n - 16));
+        unsigned m = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc));
+        if (m) return s + n - 16 + highest_bit(m);
+    }
+#endif
+    while (n--) {
+        if (s[n] == c) return s + n;
+    }
+    return NULL;
+}
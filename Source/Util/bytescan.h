@@ -0,0 +1,39 @@
+/* Byte scanning for parsers: position bitmaps and last occurrence, 16 bytes at a time with SSE2 */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One pass over s[0..n): bit i % 64 of a[i / 64] is set when s[i] == ca, likewise b for cb. Both
+ * arrays need (n + 63) / 64 words; bits past n are clear.
+ */
+void bytemask2(const char *s, size_t n, char ca, char cb, uint64_t *a, uint64_t *b);
+
+/* last c in s[0..n), or NULL */
+const char *last_byte(const char *s, size_t n, char c);
+
+static inline int
+ctz64(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int) i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,17 @@
+/* Non-cryptographic hashing */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* XXH64; the result does not depend on the host's byte order */
+uint64_t hash64(const void *p, size_t len, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+#include <errno.h>
+#include "mapfile.h"
+
+#ifdef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* no mmap: read the whole file instead */
+const void *
+map_file(const char *path, size_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    long len;
+    void *p;
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    p = len > 0 ? malloc(len) : NULL;
+    if (!p || fread(p, 1, len, fp) != (size_t) len) {
+        free(p);
+        fclose(fp);
+        errno = EIO;
+        return NULL;
+    }
+    fclose(fp);
+    *size = len;
+    return p;
+}
+
+void
+unmap_file(const void *p, size_t size)
+{
+    (void) size;
+    free((void *) p);
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const void *
+map_file(const char *path, size_t *size)
+{
+    struct stat st;
+    void *p;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* the mapping keeps the file alive */
+    if (p == MAP_FAILED) return NULL;
+    *size = st.st_size;
+    return p;
+}
+
+void
+unmap_file(const void *p, size_t size)
+{
+    munmap((void *) p, size);
+}
+
+#endif
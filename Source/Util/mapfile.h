@@ -0,0 +1,17 @@
+/* Read-only file mapping */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returns NULL (and sets errno) on failure; an empty file cannot be mapped */
+const void *map_file(const char *path, size_t *size);
+void unmap_file(const void *p, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
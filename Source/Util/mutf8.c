@@ -0,0 +1,222 @@
+#include <string.h>
+#include "mutf8.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define HAVE_AVX2 1 /* compiled for the target attribute, used if the CPU has it */
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static int
+ctz(unsigned x)
+{
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int) i;
+}
+#else
+#define ctz __builtin_ctz
+#endif
+
+/* length of the prefix of s made of bytes 0x01-0x7f */
+static size_t
+ascii_run_scalar(const uint8_t *s, size_t n)
+{
+    size_t i = 0;
+    while (i < n && (int8_t) s[i] > 0) i++;
+    return i;
+}
+
+#ifdef HAVE_SSE2
+static size_t
+ascii_run_sse2(const uint8_t *s, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i;
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        /* signed compare: exactly 0x01-0x7f are > 0 */
+        unsigned ok = (unsigned) _mm_movemask_epi8(_mm_cmpgt_epi8(v, zero));
+        if (ok != 0xffff) return i + ctz(~ok);
+    }
+    return i + ascii_run_scalar(s + i, n - i);
+}
+#endif
+
+#ifdef HAVE_AVX2
+__attribute__((target("avx2"))) static size_t
+ascii_run_avx2(const uint8_t *s, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i;
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+        unsigned ok = (unsigned) _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, zero));
+        if (ok != 0xffffffff) return i + ctz(~ok);
+    }
+    return i + ascii_run_sse2(s + i, n - i);
+}
+#endif
+
+static size_t
+ascii_run(const uint8_t *s, size_t n)
+{
+#ifdef HAVE_AVX2
+    if (n >= 64 && __builtin_cpu_supports("avx2")) return ascii_run_avx2(s, n);
+#endif
+#ifdef HAVE_SSE2
+    return ascii_run_sse2(s, n);
+#else
+    return ascii_run_scalar(s, n);
+#endif
+}
+
+static void
+widen(const uint8_t *s, size_t n, uint16_t *out)
+{
+    size_t i = 0;
+#ifdef HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *) (out + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+    for (; i < n; i++) out[i] = s[i];
+}
+
+/*
+ * the non-ASCII sequence at s: its length, or 0 if malformed, and the UTF-16 code unit it encodes;
+ * overlong forms are malformed, but for C0 80, the one way NUL is written
+ */
+static int
+decode(const uint8_t *s, size_t n, unsigned *c)
+{
+    if ((s[0] & 0xe0) == 0xc0) {
+        if (n < 2 || (s[1] & 0xc0) != 0x80) return 0;
+        *c = (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+        return *c >= 0x80 || *c == 0 ? 2 : 0;
+    }
+    if ((s[0] & 0xf0) == 0xe0) {
+        if (n < 3 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80) return 0;
+        *c = (s[0] & 0x0f) << 12 | (s[1] & 0x3f) << 6 | (s[2] & 0x3f);
+        return *c >= 0x800 ? 3 : 0;
+    }
+    return 0; /* NUL, stray continuation byte or 0xf0-0xff */
+}
+
+static char *
+put_utf8(char *p, unsigned c)
+{
+    if (c < 0x80) {
+        *p++ = (char) c;
+    } else if (c < 0x800) {
+        *p++ = (char) (0xc0 | c >> 6);
+        *p++ = (char) (0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        *p++ = (char) (0xe0 | c >> 12);
+        *p++ = (char) (0x80 | (c >> 6 & 0x3f));
+        *p++ = (char) (0x80 | (c & 0x3f));
+    } else {
+        *p++ = (char) (0xf0 | c >> 18);
+        *p++ = (char) (0x80 | (c >> 12 & 0x3f));
+        *p++ = (char) (0x80 | (c >> 6 & 0x3f));
+        *p++ = (char) (0x80 | (c & 0x3f));
+    }
+    return p;
+}
+
+int
+mutf8_valid(const uint8_t *s, size_t n)
+{
+    size_t i = 0;
+    unsigned c;
+    int len;
+    for (;;) {
+        i += ascii_run(s + i, n - i);
+        if (i == n) return 1;
+        if (!(len = decode(s + i, n - i, &c))) return 0;
+        i += len;
+    }
+}
+
+/* Malformed bytes, which callers are supposed to have ruled out, are dropped. */
+
+size_t
+mutf8_to_utf8(const uint8_t *s, size_t n, char *out)
+{
+    char *p = out;
+    size_t i = 0, run;
+    unsigned c, low;
+    int len, len2;
+    for (;;) {
+        run = ascii_run(s + i, n - i);
+        memcpy(p, s + i, run);
+        p += run;
+        i += run;
+        if (i == n) return p - out;
+        if (!(len = decode(s + i, n - i, &c))) {
+            i++;
+            continue;
+        }
+        i += len;
+        if (c >= 0xd800 && c < 0xdc00 && i < n && (len2 = decode(s + i, n - i, &low)) &&
+            low >= 0xdc00 && low < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00); /* 6 bytes in, 4 out */
+            i += len2;
+        } else if (c >= 0xd800 && c < 0xe000) {
+            c = 0xfffd;
+        }
+        p = put_utf8(p, c);
+    }
+}
+
+size_t
+mutf8_to_utf16(const uint8_t *s, size_t n, uint16_t *out)
+{
+    uint16_t *p = out;
+    size_t i = 0, run;
+    unsigned c;
+    int len;
+    for (;;) {
+        run = ascii_run(s + i, n - i);
+        widen(s + i, run, p);
+        p += run;
+        i += run;
+        if (i == n) return p - out;
+        if (!(len = decode(s + i, n - i, &c))) {
+            i++;
+            continue;
+        }
+        i += len;
+        *p++ = (uint16_t) c; /* surrogates are already UTF-16 */
+    }
+}
+
+size_t
+utf16_to_mutf8(const uint16_t *s, size_t n, uint8_t *out)
+{
+    uint8_t *p = out;
+    size_t i;
+    unsigned c;
+    for (i = 0; i < n; i++) {
+        c = s[i];
+        if (c && c < 0x80) {
+            *p++ = (uint8_t) c;
+        } else if (c < 0x800) { /* NUL too */
+            *p++ = (uint8_t) (0xc0 | c >> 6);
+            *p++ = (uint8_t) (0x80 | (c & 0x3f));
+        } else {
+            *p++ = (uint8_t) (0xe0 | c >> 12);
+            *p++ = (uint8_t) (0x80 | (c >> 6 & 0x3f));
+            *p++ = (uint8_t) (0x80 | (c & 0x3f));
+        }
+    }
+    return p - out;
+}
@@ -0,0 +1,35 @@
+/*
+ * Modified UTF-8, the string encoding of class files (JVMS 4.4.7): NUL is written C0 80 and
+ * supplementary characters as two 3-byte surrogates, so no byte is 0 or 0xf0-0xff.
+ *
+ * ASCII runs, the common case in class files, are scanned 16 or 32 bytes at a time (SSE2, or AVX2
+ * when the CPU has it); everything else goes through the scalar decoder.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 1 if s[0..n) is well-formed modified UTF-8 */
+int mutf8_valid(const uint8_t *s, size_t n);
+
+/*
+ * Standard UTF-8 of a valid s: C0 80 becomes NUL, surrogate pairs become 4-byte sequences and lone
+ * surrogates U+FFFD. Never longer than the input; returns the output length.
+ */
+size_t mutf8_to_utf8(const uint8_t *s, size_t n, char *out);
+
+/* UTF-16 of a valid s; needs room for n code units, returns the number written */
+size_t mutf8_to_utf16(const uint8_t *s, size_t n, uint16_t *out);
+
+/* modified UTF-8 of any UTF-16 s, surrogates one by one; needs room for 3 * n bytes, returns the length */
+size_t utf16_to_mutf8(const uint16_t *s, size_t n, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -98,6 +98,18 @@ rfreeall(Region *r)
     r->head = 0;
 }
 
+/* bytes taken from r's chunks, counting what was left at the end of full chunks */
+size_t
+rused(const Region *r)
+{
+    const Chunk *c;
+    size_t n = 0;
+    for (c = r->head; c; c = c->next) {
+        n += (c == r->head ? (const char *) r->cur : (const char *) c->limit) - c->data;
+    }
+    return n;
+}
+
 void
 rfree(Region *r, void *p)
 {
@@ -113,6 +125,27 @@ rfree(Region *r, void *p)
     r->head = c;
 }
 
+/*
+ * Moves src's chunks to dst, on top of dst's own, so that what was allocated
+ * from either lives as long as dst.  Allocation goes on in src's last chunk;
+ * rfree(dst, p) for p allocated from dst before the merge frees the merged
+ * chunks too.  src is left empty and needs rinit before it is used again.
+ */
+void
+rmerge(Region *dst, Region *src)
+{
+    Chunk *c = src->head;
+    if (!c) return;
+    while (c->next) c = c->next;
+    c->next = dst->head;
+    dst->head = src->head;
+    dst->cur = src->cur;
+    dst->limit = src->limit;
+    src->cur = 0;
+    src->limit = 0;
+    src->head = 0;
+}
+
 /* printf */
 
 #define INIT_BUFSIZE 32
@@ -60,6 +60,8 @@ void *ralloc(Region *r, int size, int align);
 void rinit(Region *r);
 void rfreeall(Region *r);
 void rfree(Region *r, void *p);
+size_t rused(const Region *r);
+void rmerge(Region *dst, Region *src);
 void ralign(Region *r, int align);
 
 void init_heapbuf(HeapBuf *);
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include "Parse/ClassFile.h"
+#include "Parse/CpInfo.h"
+#include "Parse/Writer.h"
+
+namespace Support {
+    using namespace Parse;
+
+    // Assembles synthetic classes: constants are interned, members take raw attribute bytes
+    class ClassBuilder {
+    public:
+        ClassBuilder(const std::string& name, const std::string& super) {
+            File.Magic = 0xcafebabe;
+            File.MajorVersion = 52;
+            File.ConstantPool.emplace_back(); // index 0 is unused
+            File.AccessFlags = 0x21; // public super
+            File.ThisClass = Class(name);
+            File.SuperClass = Class(super);
+        }
+
+        U2 Utf8(const std::string& s) {
+            return Intern({CPoolTags::Utf8, s, 0}, [&] {
+                auto e = std::make_unique<ConstantUtf8Info>();
+                e->Bytes.assign(s.begin(), s.end());
+                e->Length = static_cast<U2>(s.size());
+                return e;
+            });
+        }
+
+        U2 Integer(const U4 v) {
+            return Intern({CPoolTags::Integer, "", v}, [&] {
+                auto e = std::make_unique<ConstantIntegerInfo>();
+                e->Bytes = v;
+                return e;
+            });
+        }
+
+        U2 Float(const U4 bits) {
+            return Intern({CPoolTags::Float, "", bits}, [&] {
+                auto e = std::make_unique<ConstantFloatInfo>();
+                e->Bytes = bits;
+                return e;
+            });
+        }
+
+        // takes two pool slots
+        U2 Long(const uint64_t v) {
+            return Intern({CPoolTags::Long, "", v}, [&] {
+                auto e = std::make_unique<ConstantLongInfo>();
+                e->HighBytes = static_cast<U4>(v >> 32);
+                e->LowBytes = static_cast<U4>(v);
+                return e;
+            }, 2);
+        }
+
+        U2 Class(const std::string& name) {
+            const U2 n = Utf8(name);
+            return Intern({CPoolTags::Class, "", n}, [&] {
+                auto e = std::make_unique<ConstantClassInfo>();
+                e->NameIndex = n;
+                return e;
+            });
+        }
+
+        U2 String(const std::string& s) {
+            const U2 n = Utf8(s);
+            return Intern({CPoolTags::String, "", n}, [&] {
+                auto e = std::make_unique<ConstantStringInfo>();
+                e->StringIndex = n;
+                return e;
+            });
+        }
+
+        U2 NameAndType(const std::string& name, const std::string& desc) {
+            const U4 key = static_cast<U4>(Utf8(name)) << 16 | Utf8(desc);
+            return Intern({CPoolTags::NameAndType, "", key}, [&] {
+                auto e = std::make_unique<ConstantNameAndTypeInfo>();
+                e->NameIndex = static_cast<U2>(key >> 16);
+                e->DescriptorIndex = static_cast<U2>(key);
+                return e;
+            });
+        }
+
+        U2 MethodRef(const std::string& owner, const std::string& name, const std::string& desc) {
+            const U4 key = static_cast<U4>(Class(owner)) << 16 | NameAndType(name, desc);
+            return Intern({CPoolTags::MethodRef, "", key}, [&] {
+                auto e = std::make_unique<ConstantMethodRefInfo>();
+                e->ClassIndex = static_cast<U2>(key >> 16);
+                e->NameAndTypeIndex = static_cast<U2>(key);
+                return e;
+            });
+        }
+
+        U2 FieldRef(const std::string& owner, const std::string& name, const std::string& desc) {
+            const U4 key = static_cast<U4>(Class(owner)) << 16 | NameAndType(name, desc);
+            return Intern({CPoolTags::FieldRef, "", key}, [&] {
+                auto e = std::make_unique<ConstantFieldRefInfo>();
+                e->ClassIndex = static_cast<U2>(key >> 16);
+                e->NameAndTypeIndex = static_cast<U2>(key);
+                return e;
+            });
+        }
+
+        U2 MethodHandle(const U1 kind, const U2 reference) {
+            return Intern({CPoolTags::MethodHandle, "", static_cast<U4>(kind) << 16 | reference}, [&] {
+                auto e = std::make_unique<ConstantMethodHandleInfo>();
+                e->ReferenceKind = kind;
+                e->ReferenceIndex = reference;
+                return e;
+            });
+        }
+
+        U2 MethodType(const std::string& desc) {
+            const U2 d = Utf8(desc);
+            return Intern({CPoolTags::MethodType, "", d}, [&] {
+                auto e = std::make_unique<ConstantMethodTypeInfo>();
+                e->DescriptorIndex = d;
+                return e;
+            });
+        }
+
+        // bsm indexes the BootstrapMethods attribute, which is left to the caller
+        U2 InvokeDynamic(const U2 bsm, const std::string& name, const std::string& desc) {
+            const U4 key = static_cast<U4>(bsm) << 16 | NameAndType(name, desc);
+            return Intern({CPoolTags::InvokeDynamic, "", key}, [&] {
+                auto e = std::make_unique<ConstantInvokeDynamicInfo>();
+                e->BootstrapMethodAttrIndex = static_cast<U2>(key >> 16);
+                e->NameAndTypeIndex = static_cast<U2>(key);
+                return e;
+            });
+        }
+
+        size_t PoolSize() const { return File.ConstantPool.size(); }
+
+        AttributeInfo Attribute(const std::string& name, std::vector<U1> info) {
+            AttributeInfo a;
+            a.AttributeNameIndex = Utf8(name);
+            a.AttributeLength = static_cast<U4>(info.size());
+            a.Info = std::move(info);
+            return a;
+        }
+
+        AttributeInfo Code(const U2 max_stack, const U2 max_locals, std::vector<U1> code,
+                           std::vector<AttributeInfo> attributes = {}) {
+            CodeAttribute c;
+            c.MaxStack = max_stack;
+            c.MaxLocals = max_locals;
+            c.CodeLength = static_cast<U4>(code.size());
+            c.Code = std::move(code);
+            c.AttributesCount = static_cast<U2>(attributes.size());
+            c.Attributes = std::move(attributes);
+            std::vector<U1> info;
+            Writer{}.WriteCodeOnto(c, info);
+            return Attribute("Code", std::move(info));
+        }
+
+        void AddField(const U2 flags, const std::string& name, const std::string& desc,
+                      std::vector<AttributeInfo> attributes = {}) {
+            FieldInfo f;
+            f.AccessFlags = flags;
+            f.NameIndex = Utf8(name);
+            f.DescriptorIndex = Utf8(desc);
+            f.AttributesCount = static_cast<U2>(attributes.size());
+            f.Attributes = std::move(attributes);
+            File.Fields.push_back(std::move(f));
+        }
+
+        void AddMethod(const U2 flags, const std::string& name, const std::string& desc,
+                       std::vector<AttributeInfo> attributes = {}) {
+            MethodInfo m;
+            m.AccessFlags = flags;
+            m.NameIndex = Utf8(name);
+            m.DescriptorIndex = Utf8(desc);
+            m.AttributesCount = static_cast<U2>(attributes.size());
+            m.Attributes = std::move(attributes);
+            File.Methods.push_back(std::move(m));
+        }
+
+        void AddAttribute(AttributeInfo a) { File.Attributes.push_back(std::move(a)); }
+
+        std::vector<std::byte> Build() {
+            File.ConstantPoolCount = static_cast<U2>(File.ConstantPool.size());
+            File.FieldCount = static_cast<U2>(File.Fields.size());
+            File.MethodsCount = static_cast<U2>(File.Methods.size());
+            File.AttributesCount = static_cast<U2>(File.Attributes.size());
+            std::vector<std::byte> bytes;
+            Writer{}.WriteOnto(File, bytes);
+            return bytes;
+        }
+
+    private:
+        using Key = std::tuple<CPoolTags, std::string, uint64_t>;
+
+        template <class F>
+        U2 Intern(const Key& key, F make, const size_t slots = 1) {
+            const auto it = Pool.find(key);
+            if (it != Pool.end()) { return it->second; }
+            if (File.ConstantPool.size() + slots > 0xffff) { throw std::length_error("constant pool full"); }
+            const auto index = static_cast<U2>(File.ConstantPool.size());
+            File.ConstantPool.push_back(make());
+            if (slots == 2) { File.ConstantPool.emplace_back(); }
+            Pool.emplace(key, index);
+            return index;
+        }
+
+        ClassFile File;
+        std::map<Key, U2> Pool;
+    };
+}
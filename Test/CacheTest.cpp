@@ -0,0 +1,138 @@
+/*
+ * ClassCache: an entry reads back as it was stored, with or without its output; a missing entry, one of
+ * another configuration, and one truncated or with a length past its end all read as a miss.
+ * DependencyHashes: an entry goes stale when a supertype in the batch changes, and not when an unrelated
+ * class does.
+ */
+
+#include <filesystem>
+#include <fstream>
+#include "Driver/Cache.h"
+#include "Fixture.h"
+
+using namespace Test;
+using Driver::CacheEntry;
+using Driver::ClassCache;
+
+namespace {
+    const auto dir = std::filesystem::temp_directory_path() / "CacheTest";
+
+    std::vector<std::byte> bytes(const std::string_view s) {
+        std::vector<std::byte> b(s.size());
+        for (size_t k = 0; k < s.size(); k++) { b[k] = static_cast<std::byte>(s[k]); }
+        return b;
+    }
+
+    CacheEntry entry() {
+        CacheEntry e;
+        e.ThisClass = "test/Impl";
+        e.SuperClass = "test/Base";
+        e.Interfaces = {"java/lang/Runnable", "test/Shape"};
+        e.References = {"java/lang/Object", "test/Base", "test/Point"};
+        e.DepHash = 0x0123456789abcdefULL;
+        e.Output = bytes("output class");
+        e.Generated = {{"test/Impl$$Lambda$0", bytes("lambda")}};
+        return e;
+    }
+
+    // the only file of the cache
+    std::filesystem::path stored() {
+        for (const auto& f : std::filesystem::recursive_directory_iterator(dir)) {
+            if (f.is_regular_file()) { return f.path(); }
+        }
+        return {};
+    }
+
+    void round_trip() {
+        std::filesystem::remove_all(dir);
+        const ClassCache cache(dir.string(), 1);
+        const auto key = cache.Key(bytes("input class"));
+        EXPECT(key != ClassCache(dir.string(), 2).Key(bytes("input class")));
+        CacheEntry e;
+        EXPECT(!cache.Load(key, e, true));
+
+        const auto in = entry();
+        cache.Store(key, in);
+        EXPECT(cache.Load(key, e, true));
+        EXPECT(e.ThisClass == in.ThisClass && e.SuperClass == in.SuperClass && e.Interfaces == in.Interfaces);
+        EXPECT(e.References == in.References && e.DepHash == in.DepHash);
+        EXPECT(e.Output == in.Output && e.Generated == in.Generated);
+
+        // the hierarchy facts only
+        CacheEntry facts;
+        EXPECT(cache.Load(key, facts, false));
+        EXPECT(facts.ThisClass == in.ThisClass && facts.References == in.References);
+        EXPECT(facts.Output.empty() && facts.Generated.empty());
+
+        // of another configuration, under another key
+        EXPECT(!ClassCache(dir.string(), 2).Load(ClassCache(dir.string(), 2).Key(bytes("input class")), e, true));
+        std::filesystem::remove_all(dir);
+    }
+
+    void damaged() {
+        std::filesystem::remove_all(dir);
+        const ClassCache cache(dir.string(), 1);
+        const auto key = cache.Key(bytes("input class"));
+        cache.Store(key, entry());
+        const auto path = stored();
+        const auto size = std::filesystem::file_size(path);
+
+        // truncated within the classes it generated: the facts before them still read, the output does not
+        std::filesystem::resize_file(path, size - 10);
+        CacheEntry e;
+        EXPECT(!cache.Load(key, e, true));
+        EXPECT(cache.Load(key, e, false));
+
+        // a count of references past the end of the entry
+        cache.Store(key, entry());
+        {
+            std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+            // magic, DepHash, and the strings of ThisClass, SuperClass and two interfaces
+            f.seekp(4 + 8 + (2 + 9) + (2 + 9) + 2 + (2 + 18) + (2 + 10));
+            f.write("\xff\xff\xff\xff", 4);
+        }
+        EXPECT(!cache.Load(key, e, false));
+
+        // not an entry at all
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << "JOC";
+        EXPECT(!cache.Load(key, e, false));
+        std::filesystem::remove_all(dir);
+    }
+
+    void dependencies() {
+        // Impl extends Base implements Shape; Base and Shape in the batch, Other unrelated
+        std::vector<CacheEntry> facts(4);
+        facts[0].ThisClass = "test/Impl";
+        facts[0].SuperClass = "test/Base";
+        facts[0].Interfaces = {"test/Shape"};
+        facts[1].ThisClass = "test/Base";
+        facts[1].SuperClass = "java/lang/Object";
+        facts[2].ThisClass = "test/Shape";
+        facts[2].SuperClass = "java/lang/Object";
+        facts[3].ThisClass = "test/Other";
+        facts[3].SuperClass = "java/lang/Object";
+        const std::vector<uint64_t> keys{1, 2, 3, 4};
+        const auto hashes = Driver::DependencyHashes(keys, facts);
+
+        auto changed = keys;
+        changed[3] = 40; // Other
+        EXPECT(Driver::DependencyHashes(changed, facts)[0] == hashes[0]);
+        changed[1] = 20; // Base
+        EXPECT(Driver::DependencyHashes(changed, facts)[0] != hashes[0]);
+        EXPECT(Driver::DependencyHashes(changed, facts)[2] == hashes[2]);
+        changed = keys;
+        changed[2] = 30; // Shape
+        EXPECT(Driver::DependencyHashes(changed, facts)[0] != hashes[0]);
+
+        // a circular hierarchy still hashes
+        facts[1].SuperClass = "test/Impl";
+        EXPECT(Driver::DependencyHashes(keys, facts).size() == keys.size());
+    }
+}
+
+int main() {
+    round_trip();
+    damaged();
+    dependencies();
+    return Failures();
+}
@@ -0,0 +1,47 @@
+/*
+ * CompactLocals: two ints never live at once share a local, and a store never read is dropped; the
+ * frame at the branch target, which had both, verifies with the one.
+ */
+
+#include "Patch/Locals.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+int main() {
+    Support::ClassBuilder b("test/Slots", "java/lang/Object");
+    const U2 result = b.FieldRef("test/Slots", "Result", "I");
+    b.AddField(0x0009, "Result", "I");
+    // int a = 3; Result = a * 2; int dead = 5; int c = 4; if (c > 0) Result += c;
+    b.AddMethod(0x0009, "run", "()V", {b.Code(2, 3, {
+        OP_ICONST_3,                              // 0
+        OP_ISTORE_0,                              // 1
+        OP_ILOAD_0,                               // 2
+        OP_ICONST_2,                              // 3
+        OP_IMUL,                                  // 4
+        OP_PUTSTATIC, Hi(result), Lo(result),     // 5
+        OP_ICONST_5,                              // 8
+        OP_ISTORE_2,                              // 9
+        OP_ICONST_4,                              // 10
+        OP_ISTORE_1,                              // 11
+        OP_ILOAD_1,                               // 12
+        OP_IFLE, Hi(24 - 13), Lo(24 - 13),        // 13
+        OP_GETSTATIC, Hi(result), Lo(result),     // 16
+        OP_ILOAD_1,                               // 19
+        OP_IADD,                                  // 20
+        OP_PUTSTATIC, Hi(result), Lo(result),     // 21
+        OP_RETURN,                                // 24: frame [int, int, int]
+    })});
+
+    ClassHierarchy h;
+    auto f = Input(b, h);
+    ExpectVerifies(f, h);
+
+    EXPECT(Patch::CompactLocals(f, h) == 1);
+    f = RoundTrip(f);
+    ExpectVerifies(f, h);
+    EXPECT(DecodedOf(f, "run").MaxLocals == 1);
+    int64_t value = 0;
+    EXPECT(RunStatic(f, "run", "Result", value) && value == 10);
+    return Failures();
+}
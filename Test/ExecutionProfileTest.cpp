@@ -0,0 +1,102 @@
+/*
+ * ExecutionProfile: comments and blank lines are skipped, counts of a method or branch in several
+ * records (profiles concatenated) add up, an empty file has no records, and a malformed record is
+ * reported with its line. The hash of the counts of a class only changes with them.
+ */
+
+#include <filesystem>
+#include <string>
+#include "Analyze/ExecutionProfile.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+namespace {
+    const auto dir = std::filesystem::temp_directory_path();
+
+    std::string write(const char* name, const char* text) {
+        const auto path = (dir / name).string();
+        if (auto* out = std::fopen(path.c_str(), "w")) {
+            std::fputs(text, out);
+            std::fclose(out);
+        }
+        return path;
+    }
+
+    // the message of the InvalidProfile loading text throws, empty if none
+    std::string error_of(const char* text) {
+        const auto path = write("ExecutionProfileTest.bad", text);
+        std::string what;
+        try {
+            ExecutionProfile{}.Load(path.c_str());
+        } catch (const InvalidProfile& e) {
+            what = e.what();
+        }
+        std::filesystem::remove(path);
+        return what;
+    }
+
+    bool ends_with(const std::string& s, const std::string& tail) {
+        return s.size() >= tail.size() && s.compare(s.size() - tail.size(), tail.size(), tail) == 0;
+    }
+}
+
+int main() {
+    const auto first = write("ExecutionProfileTest.1", "# run 1\n"
+                                                       "method test/A run ()V 10\n"
+                                                       "\n"
+                                                       "branch test/A run ()V 7 3 7\n"
+                                                       "branch test/A run ()V 2 1 0\n"
+                                                       "method test/A run (I)V 5\n");
+    const auto second = write("ExecutionProfileTest.2", "method test/A run ()V 32\r\n"
+                                                        "  branch\ttest/A run ()V 7 4 1\n"
+                                                        "method test/B run ()V 1");
+    const auto empty = write("ExecutionProfileTest.0", "");
+
+    ExecutionProfile profile;
+    try {
+        profile.Load(empty.c_str());
+        EXPECT(profile.Empty());
+        profile.Load(first.c_str());
+        profile.Load(second.c_str());
+    } catch (const InvalidProfile& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        EXPECT(false);
+    }
+    for (const auto& path : {first, second, empty}) { std::filesystem::remove(path); }
+
+    EXPECT(profile.MethodCount() == 3);
+    const int run = profile.Id("test/A", "run", "()V");
+    EXPECT(run >= 0 && profile.Counts(run).Invocations == 42);
+    EXPECT(profile.MaxInvocations() == 42);
+    EXPECT(run >= 0 && profile.Counts(run).Branches.size() == 2);
+    const auto* branch = run >= 0 ? profile.Branch(run, 7) : nullptr;
+    EXPECT(branch && branch->Taken == 7 && branch->NotTaken == 8);
+    EXPECT(run >= 0 && !profile.Branch(run, 3));
+    // by descriptor and class too
+    const int overload = profile.Id("test/A", "run", "(I)V");
+    EXPECT(overload >= 0 && overload != run && profile.Counts(overload).Invocations == 5);
+    const int other = profile.Id("test/B", "run", "()V");
+    EXPECT(other >= 0 && other != run && profile.Counts(other).Invocations == 1);
+    EXPECT(profile.Id("test/A", "walk", "()V") < 0);
+
+    // in another order, with another class counted differently
+    const auto again = write("ExecutionProfileTest.3", "method test/B run ()V 2\n"
+                                                       "method test/A run (I)V 5\n"
+                                                       "branch test/A run ()V 7 7 8\n"
+                                                       "branch test/A run ()V 2 1 0\n"
+                                                       "method test/A run ()V 42\n");
+    ExecutionProfile reordered;
+    reordered.Load(again.c_str());
+    std::filesystem::remove(again);
+    EXPECT(reordered.Hash("test/A") == profile.Hash("test/A"));
+    EXPECT(reordered.Hash("test/B") != profile.Hash("test/B"));
+    EXPECT(profile.Hash("test/C") == 0);
+
+    EXPECT(ends_with(error_of("# fine\nmethod test/A run ()V x\n"), ":2: bad count"));
+    EXPECT(ends_with(error_of("method test/A run ()V\n"), ":1: wrong number of fields"));
+    EXPECT(ends_with(error_of("\n\ncall test/A run ()V 1\n"), ":3: unknown record"));
+    EXPECT(ends_with(error_of("branch test/A run ()V 65536 1 1\n"), ":1: bad bytecode offset"));
+    EXPECT(error_of("").empty());
+    return Failures();
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Parse/ClassFile.h"
+#include "Parse/CpRefs.h"
+#include "Parse/Parser.h"
+#include "Parse/Writer.h"
+#include "Analyze/Hierarchy.h"
+#include "Analyze/Insns.h"
+#include "Analyze/Interpreter.h"
+#include "Analyze/StackMap.h"
+#include "ClassBuilder.h"
+
+/*
+ * Input/output class fixtures for the passes. A class is assembled with Support::ClassBuilder and given
+ * the frames javac would have given it; the test runs a pass over it, and the output, written out and
+ * read back, has every method checked against its StackMapTable (VerifyStackMap), and is run with the
+ * Interpreter where its code only does what that runs.
+ *
+ * Code is spelled out as bytes, with the offset of each instruction in a comment. Each test is an
+ * executable of its own returning the number of checks that failed.
+ */
+
+#define EXPECT(cond) Test::Expect((cond), #cond, __FILE__, __LINE__)
+
+namespace Test {
+    using namespace Parse;
+    using namespace Analyze;
+
+    inline int& failed() {
+        static int n = 0;
+        return n;
+    }
+
+    inline int Failures() { return failed(); }
+
+    inline void Expect(const bool ok, const char* what, const char* file, const int line) {
+        if (ok) { return; }
+        std::fprintf(stderr, "%s:%d: failed: %s\n", file, line, what);
+        failed()++;
+    }
+
+    // the two bytes of a constant pool index or branch offset
+    inline U1 Hi(const int v) { return static_cast<U1>(v >> 8); }
+    inline U1 Lo(const int v) { return static_cast<U1>(v); }
+
+    inline ClassFile Read(const std::vector<std::byte>& bytes) {
+        ClassFile f;
+        Parser{}.ParseOnto(bytes, f);
+        return f;
+    }
+
+    inline ClassFile RoundTrip(const ClassFile& f) {
+        std::vector<std::byte> bytes;
+        Writer{}.WriteOnto(f, bytes);
+        return Read(bytes);
+    }
+
+    // the class b assembled, with the frames of its methods computed; added to h
+    inline ClassFile Input(Support::ClassBuilder& b, ClassHierarchy& h) {
+        auto f = Read(b.Build());
+        h.AddClassFile(f);
+        EXPECT(RecomputeStackMaps(f, h) == 0);
+        return RoundTrip(f);
+    }
+
+    inline const MethodInfo* MethodOf(const ClassFile& f, const std::string_view name) {
+        for (auto& m : f.Methods) {
+            if (Utf8At(f, m.NameIndex) == name) { return &m; }
+        }
+        return nullptr;
+    }
+
+    inline CodeAttribute CodeOf(const ClassFile& f, const MethodInfo& m) {
+        CodeAttribute code;
+        for (auto& a : m.Attributes) {
+            if (Utf8At(f, a.AttributeNameIndex) == "Code") { Parser{}.ParseCodeOnto(a.Info, code); }
+        }
+        return code;
+    }
+
+    // the decoded code of the method called name; empty if there is none
+    inline DecodedCode DecodedOf(const ClassFile& f, const std::string_view name) {
+        const auto* m = MethodOf(f, name);
+        if (!m) { return {}; }
+        return DecodeCode(f, CodeOf(f, *m));
+    }
+
+    // Every method with code passes VerifyStackMap; the ones that do not are reported.
+    inline void ExpectVerifies(const ClassFile& f, const ClassHierarchy& h) {
+        for (auto& m : f.Methods) {
+            const auto code = CodeOf(f, m);
+            if (code.Code.empty()) { continue; }
+            try {
+                VerifyStackMap(f, m, code, h);
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "%s%s does not verify: %s\n", std::string(Utf8At(f, m.NameIndex)).c_str(),
+                             std::string(Utf8At(f, m.DescriptorIndex)).c_str(), e.what());
+                failed()++;
+            }
+        }
+    }
+
+    // instructions of code with opcode op
+    inline int Count(const DecodedCode& code, const uint8_t op) {
+        int n = 0;
+        for (auto& in : code.Insns) { n += in.Op == op; }
+        return n;
+    }
+
+    // calls in code to methods called name
+    inline int Calls(const ClassFile& f, const DecodedCode& code, const std::string_view name) {
+        int n = 0;
+        for (auto& in : code.Insns) {
+            if (in.Op >= OP_INVOKEVIRTUAL && in.Op <= OP_INVOKEINTERFACE) {
+                n += MemberRefAt(f, static_cast<U2>(in.Value)).Name == name;
+            }
+        }
+        return n;
+    }
+
+    // Runs the static method called name with the Interpreter and gives the int the static field called
+    // field is left with; false if the run stopped.
+    inline bool RunStatic(const ClassFile& f, const std::string_view name, const std::string_view field,
+                          int64_t& value) {
+        Interpreter run(f);
+        if (!run.Run(DecodedOf(f, name))) { return false; }
+        for (auto& s : run.Statics()) {
+            if (Utf8At(f, f.Fields[s.Field].NameIndex) != field) { continue; }
+            value = s.Current.Bits;
+            return s.Current.Type == Constant::Kind::Int;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * InlineCalls: a call the profile has run often gets a callee past MaxInlineSize, one it has never run
+ * does not, unless a pass before changed the code the branch counts are by; and what a method that could not be encoded would have added is not charged to the budget
+ * of its class.
+ */
+
+#include <filesystem>
+#include "Patch/Inline.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+namespace {
+    // Result = Flag != 0 ? big(1) : big(2); with a profile that never has Flag set
+    ClassFile frequent_class(ClassHierarchy& h, ExecutionProfile& profile) {
+        Support::ClassBuilder b("test/Freq", "java/lang/Object");
+        const U2 big = b.MethodRef("test/Freq", "big", "(I)I");
+        const U2 flag = b.FieldRef("test/Freq", "Flag", "I");
+        const U2 result = b.FieldRef("test/Freq", "Result", "I");
+        b.AddField(0x0009, "Flag", "I");
+        b.AddField(0x0009, "Result", "I");
+        // return n + 18; in 38 bytes, past MaxInlineSize
+        std::vector<U1> code{OP_ILOAD_0};
+        for (int k = 0; k < 18; k++) { code.insert(code.end(), {OP_ICONST_1, OP_IADD}); }
+        code.push_back(OP_IRETURN);
+        b.AddMethod(0x000a, "big", "(I)I", {b.Code(2, 1, code)});
+        b.AddMethod(0x0009, "run", "()V", {b.Code(1, 0, {
+            OP_GETSTATIC, Hi(flag), Lo(flag),         // 0
+            OP_IFEQ, Hi(14 - 3), Lo(14 - 3),          // 3
+            OP_ICONST_1,                              // 6
+            OP_INVOKESTATIC, Hi(big), Lo(big),        // 7
+            OP_PUTSTATIC, Hi(result), Lo(result),     // 10
+            OP_RETURN,                                // 13
+            OP_ICONST_2,                              // 14: frame []
+            OP_INVOKESTATIC, Hi(big), Lo(big),        // 15
+            OP_PUTSTATIC, Hi(result), Lo(result),     // 18
+            OP_RETURN,                                // 21
+        })});
+
+        auto f = Input(b, h);
+        ExpectVerifies(f, h);
+
+        const auto path = std::filesystem::temp_directory_path() / "InlineTest.prof";
+        if (auto* out = std::fopen(path.string().c_str(), "w")) {
+            std::fputs("method test/Freq run ()V 50\nbranch test/Freq run ()V 3 50 0\n", out);
+            std::fclose(out);
+        }
+        profile.Load(path.string().c_str());
+        std::filesystem::remove(path);
+        return f;
+    }
+
+    void frequent() {
+        ClassHierarchy h;
+        ExecutionProfile profile;
+        auto f = frequent_class(h, profile);
+        const ProfiledCode input(f);
+
+        EXPECT(Patch::InlineCalls(f, h, profile, input, 2048) == 1);
+        f = RoundTrip(f);
+        ExpectVerifies(f, h);
+        // the call that never ran stays
+        EXPECT(Calls(f, DecodedOf(f, "run"), "big") == 1);
+        int64_t value = 0;
+        EXPECT(RunStatic(f, "run", "Result", value) && value == 20);
+    }
+
+    // the arms swapped after the input was taken, with the branch where it was: its counts no longer
+    // say which arm ran, so both split the invocations evenly and both calls go in
+    void moved() {
+        ClassHierarchy h;
+        ExecutionProfile profile;
+        auto f = frequent_class(h, profile);
+        const ProfiledCode input(f);
+        for (auto& a : f.Methods[MethodOf(f, "run") - f.Methods.data()].Attributes) {
+            if (Utf8At(f, a.AttributeNameIndex) == "Code") { std::swap(a.Info[8 + 6], a.Info[8 + 14]); }
+        }
+
+        EXPECT(Patch::InlineCalls(f, h, profile, input, 2048) == 1);
+        f = RoundTrip(f);
+        ExpectVerifies(f, h);
+        EXPECT(Calls(f, DecodedOf(f, "run"), "big") == 0);
+        int64_t value = 0;
+        EXPECT(RunStatic(f, "run", "Result", value) && value == 19);
+    }
+
+    void charged() {
+        Support::ClassBuilder b("test/Charge", "java/lang/Object");
+        const U2 inc = b.MethodRef("test/Charge", "inc", "(I)I");
+        const U2 result = b.FieldRef("test/Charge", "Result", "I");
+        b.AddField(0x0009, "Result", "I");
+        // return n + 3; it grows a caller by 6 bytes with its argument in local 4, by 5 in local 0
+        b.AddMethod(0x000a, "inc", "(I)I", {b.Code(2, 1, {
+            OP_ILOAD_0, OP_ICONST_1, OP_IADD, OP_ICONST_1, OP_IADD, OP_ICONST_1, OP_IADD, OP_IRETURN,
+        })});
+        // inc(1); Base x = c ? a : b; return x; with A and B (and so what they have in common) unknown to
+        // the hierarchy, so its frames cannot be computed again
+        const U2 a = b.Class("test/A"), c = b.Class("test/B"), base = b.Class("test/Base");
+        b.AddMethod(0x0009, "pick", "(ZLtest/A;Ltest/B;)Ljava/lang/Object;", {b.Code(1, 4, {
+            OP_ICONST_1,                                           // 0
+            OP_INVOKESTATIC, Hi(inc), Lo(inc),                     // 1
+            OP_POP,                                                // 4
+            OP_ILOAD_0,                                            // 5
+            OP_IFEQ, Hi(13 - 6), Lo(13 - 6),                       // 6
+            OP_ALOAD_1,                                            // 9
+            OP_GOTO, Hi(14 - 10), Lo(14 - 10),                     // 10
+            OP_ALOAD_2,                                            // 13: frame [int, A, B]
+            OP_ASTORE_3,                                           // 14: frame [int, A, B] [Base]
+            OP_ALOAD_3,                                            // 15
+            OP_ARETURN,                                            // 16
+        }, {b.Attribute("StackMapTable", {
+            0, 2,
+            13,                                                    // same_frame
+            255, 0, 0, 0, 3, 1, 7, Hi(a), Lo(a), 7, Hi(c), Lo(c),  // full_frame
+            0, 1, 7, Hi(base), Lo(base),
+        })})});
+        // Result = inc(2);
+        b.AddMethod(0x0009, "run", "()V", {b.Code(1, 0, {
+            OP_ICONST_2,                                           // 0
+            OP_INVOKESTATIC, Hi(inc), Lo(inc),                     // 1
+            OP_PUTSTATIC, Hi(result), Lo(result),                  // 4
+            OP_RETURN,                                             // 7
+        })});
+
+        ClassHierarchy h;
+        auto f = Read(b.Build());
+        h.AddClassFile(f);
+        const auto before = CodeOf(f, *MethodOf(f, "pick")).Code;
+
+        // room for one of the two calls: pick comes first, and is left as it was
+        EXPECT(Patch::InlineCalls(f, h, ExecutionProfile{}, ProfiledCode{}, 6) == 1);
+        f = RoundTrip(f);
+        EXPECT(CodeOf(f, *MethodOf(f, "pick")).Code == before);
+        EXPECT(Calls(f, DecodedOf(f, "run"), "inc") == 0);
+        int64_t value = 0;
+        EXPECT(RunStatic(f, "run", "Result", value) && value == 5);
+    }
+}
+
+int main() {
+    frequent();
+    moved();
+    charged();
+    return Failures();
+}
@@ -0,0 +1,129 @@
+/*
+ * Interpreter: a static initializer with a loop, long arithmetic, strings and an array of primitives
+ * runs to its return with the statics the JVM would leave; a ConstantValue is where statics start. A
+ * call to another class, an exception and a loop that never ends stop the run.
+ */
+
+#include "Fixture.h"
+
+using namespace Test;
+
+namespace {
+    const Interpreter::Static* static_of(const ClassFile& f, const Interpreter& run, const std::string_view name) {
+        for (const auto& s : run.Statics()) {
+            if (Utf8At(f, f.Fields[s.Field].NameIndex) == name) { return &s; }
+        }
+        return nullptr;
+    }
+
+    bool is_int(const Interpreter::Static* s, const int64_t v) {
+        return s && s->Current.Type == Constant::Kind::Int && s->Current.Bits == v;
+    }
+
+    void runs() {
+        Support::ClassBuilder b("test/Init", "java/lang/Object");
+        const U2 sum = b.FieldRef("test/Init", "Sum", "I");
+        const U2 big = b.FieldRef("test/Init", "Big", "J");
+        const U2 len = b.FieldRef("test/Init", "Len", "I");
+        const U2 hash = b.FieldRef("test/Init", "Hash", "I");
+        const U2 array = b.FieldRef("test/Init", "Array", "[I");
+        const U2 hello = b.String("hello"), hi = b.String("hi");
+        const U2 length = b.MethodRef("java/lang/String", "length", "()I");
+        const U2 hash_code = b.MethodRef("java/lang/String", "hashCode", "()I");
+        b.AddField(0x0009, "Sum", "I");
+        b.AddField(0x0009, "Big", "J");
+        b.AddField(0x0009, "Len", "I");
+        b.AddField(0x0009, "Hash", "I");
+        b.AddField(0x0009, "Array", "[I");
+        const U2 fixed = b.Integer(42);
+        b.AddField(0x0019, "Fixed", "I", {b.Attribute("ConstantValue", {Hi(fixed), Lo(fixed)})});
+        // for (int i = 1; i <= 10; i++) Sum += i * i; Big = 1L << 40; Len = "hello".length();
+        // Hash = "hi".hashCode(); Array = new int[3]; Array[1] = 7;
+        b.AddMethod(0x0008, "<clinit>", "()V", {b.Code(4, 1, {
+            OP_ICONST_1,                                   // 0
+            OP_ISTORE_0,                                   // 1
+            OP_ILOAD_0,                                    // 2: frame [int]
+            OP_BIPUSH, 10,                                 // 3
+            OP_IF_ICMPGT, Hi(24 - 5), Lo(24 - 5),          // 5
+            OP_GETSTATIC, Hi(sum), Lo(sum),                // 8
+            OP_ILOAD_0,                                    // 11
+            OP_ILOAD_0,                                    // 12
+            OP_IMUL,                                       // 13
+            OP_IADD,                                       // 14
+            OP_PUTSTATIC, Hi(sum), Lo(sum),                // 15
+            OP_IINC, 0, 1,                                 // 18
+            OP_GOTO, Hi(2 - 21), Lo(2 - 21),               // 21
+            OP_LCONST_1,                                   // 24: frame [int]
+            OP_BIPUSH, 40,                                 // 25
+            OP_LSHL,                                       // 27
+            OP_PUTSTATIC, Hi(big), Lo(big),                // 28
+            OP_LDC, Lo(hello),                             // 31
+            OP_INVOKEVIRTUAL, Hi(length), Lo(length),      // 33
+            OP_PUTSTATIC, Hi(len), Lo(len),                // 36
+            OP_LDC, Lo(hi),                                // 39
+            OP_INVOKEVIRTUAL, Hi(hash_code), Lo(hash_code), // 41
+            OP_PUTSTATIC, Hi(hash), Lo(hash),              // 44
+            OP_ICONST_3,                                   // 47
+            OP_NEWARRAY, 10,                               // 48: int
+            OP_DUP,                                        // 50
+            OP_ICONST_1,                                   // 51
+            OP_BIPUSH, 7,                                  // 52
+            OP_IASTORE,                                    // 54
+            OP_PUTSTATIC, Hi(array), Lo(array),            // 55
+            OP_RETURN,                                     // 58
+        })});
+        const auto f = Read(b.Build());
+
+        Interpreter run(f);
+        const auto* fixed_static = static_of(f, run, "Fixed");
+        EXPECT(is_int(fixed_static, 42) && fixed_static->Final);
+        EXPECT(is_int(static_of(f, run, "Sum"), 0));
+        EXPECT(run.Run(DecodedOf(f, "<clinit>")));
+        EXPECT(is_int(static_of(f, run, "Sum"), 385));
+        const auto* l = static_of(f, run, "Big");
+        EXPECT(l && l->Current.Type == Constant::Kind::Long && l->Current.Bits == int64_t{1} << 40);
+        EXPECT(is_int(static_of(f, run, "Len"), 5));
+        EXPECT(is_int(static_of(f, run, "Hash"), 'h' * 31 + 'i'));
+        const auto* a = static_of(f, run, "Array");
+        EXPECT(a && a->Current.Type == Constant::Kind::Array);
+        if (a && a->Current.Type == Constant::Kind::Array) {
+            const auto& elements = run.ArrayAt(a->Current).Elements;
+            EXPECT(elements.size() == 3 && elements[0].Bits == 0 && elements[1].Bits == 7);
+        }
+        EXPECT(is_int(fixed_static, 42) && fixed_static->Current == fixed_static->Initial);
+    }
+
+    void stops() {
+        Support::ClassBuilder b("test/Stop", "java/lang/Object");
+        const U2 other = b.MethodRef("test/Other", "f", "()V");
+        // Other.f();
+        b.AddMethod(0x0008, "call", "()V", {b.Code(0, 0, {
+            OP_INVOKESTATIC, Hi(other), Lo(other),         // 0
+            OP_RETURN,                                     // 3
+        })});
+        // 1 / 0
+        b.AddMethod(0x0008, "divide", "()V", {b.Code(2, 0, {
+            OP_ICONST_1,                                   // 0
+            OP_ICONST_0,                                   // 1
+            OP_IDIV,                                       // 2
+            OP_POP,                                        // 3
+            OP_RETURN,                                     // 4
+        })});
+        // for (;;);
+        b.AddMethod(0x0008, "spin", "()V", {b.Code(0, 0, {
+            OP_GOTO, 0, 0,                                 // 0: frame []
+        })});
+        const auto f = Read(b.Build());
+
+        for (const char* name : {"call", "divide", "spin"}) {
+            Interpreter run(f);
+            EXPECT(!run.Run(DecodedOf(f, name)));
+        }
+    }
+}
+
+int main() {
+    runs();
+    stops();
+    return Failures();
+}
@@ -0,0 +1,83 @@
+/*
+ * LayOutColdPaths: an outlined path takes a reference as the LocalVariableTable declares it, not as the
+ * frames have it; a path reading a local that only ever holds null stays in its method.
+ */
+
+#include <filesystem>
+#include "Patch/Layout.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+int main() {
+    Support::ClassBuilder b("test/Cold", "java/lang/Object");
+    const U2 iae = b.Class("java/lang/IllegalArgumentException");
+    const U2 init = b.MethodRef("java/lang/IllegalArgumentException", "<init>", "(Ljava/lang/String;)V");
+    const U2 to_string = b.MethodRef("java/lang/Object", "toString", "()Ljava/lang/String;");
+    const U2 result = b.FieldRef("test/Cold", "Result", "I");
+    const U2 cs = b.Utf8("cs"), cs_type = b.Utf8("Ljava/lang/CharSequence;");
+    b.AddField(0x0009, "Result", "I");
+    // CharSequence cs = s; if (n < 0) throw new IllegalArgumentException(cs.toString()); Result = n;
+    b.AddMethod(0x0009, "check", "(Ljava/lang/String;I)V", {b.Code(3, 3, {
+        OP_ALOAD_0,                                  // 0
+        OP_ASTORE_2,                                 // 1
+        OP_ILOAD_1,                                  // 2
+        OP_IFGE, Hi(20 - 3), Lo(20 - 3),             // 3
+        OP_ALOAD_2,                                  // 6
+        OP_POP,                                      // 7
+        OP_NEW, Hi(iae), Lo(iae),                    // 8
+        OP_DUP,                                      // 11
+        OP_ALOAD_2,                                  // 12
+        OP_INVOKEVIRTUAL, Hi(to_string), Lo(to_string), // 13
+        OP_INVOKESPECIAL, Hi(init), Lo(init),        // 16
+        OP_ATHROW,                                   // 19
+        OP_ILOAD_1,                                  // 20: frame [String, int, String]
+        OP_PUTSTATIC, Hi(result), Lo(result),        // 21
+        OP_RETURN,                                   // 24
+    }, {b.Attribute("LocalVariableTable", {0, 1, 0, 2, 0, 23, Hi(cs), Lo(cs), Hi(cs_type), Lo(cs_type), 0, 2})})});
+    // Object o = null; if (n < 0) throw new IllegalArgumentException(o.toString()); Result = n;
+    b.AddMethod(0x0009, "nulls", "(I)V", {b.Code(3, 2, {
+        OP_ACONST_NULL,                              // 0
+        OP_ASTORE_1,                                 // 1
+        OP_ILOAD_0,                                  // 2
+        OP_IFGE, Hi(20 - 3), Lo(20 - 3),             // 3
+        OP_ALOAD_1,                                  // 6
+        OP_POP,                                      // 7
+        OP_NEW, Hi(iae), Lo(iae),                    // 8
+        OP_DUP,                                      // 11
+        OP_ALOAD_1,                                  // 12
+        OP_INVOKEVIRTUAL, Hi(to_string), Lo(to_string), // 13
+        OP_INVOKESPECIAL, Hi(init), Lo(init),        // 16
+        OP_ATHROW,                                   // 19
+        OP_ILOAD_0,                                  // 20: frame [int, null]
+        OP_PUTSTATIC, Hi(result), Lo(result),        // 21
+        OP_RETURN,                                   // 24
+    })});
+
+    ClassHierarchy h;
+    auto f = Input(b, h);
+    ExpectVerifies(f, h);
+
+    // both run, and never throw
+    const auto path = std::filesystem::temp_directory_path() / "LayoutTest.prof";
+    if (auto* out = std::fopen(path.string().c_str(), "w")) {
+        std::fputs("method test/Cold check (Ljava/lang/String;I)V 10\n"
+                   "branch test/Cold check (Ljava/lang/String;I)V 3 10 0\n"
+                   "method test/Cold nulls (I)V 10\n"
+                   "branch test/Cold nulls (I)V 3 10 0\n", out);
+        std::fclose(out);
+    }
+    ExecutionProfile profile;
+    profile.Load(path.string().c_str());
+    std::filesystem::remove(path);
+
+    Patch::LayOutColdPaths(f, h, profile, 10);
+    f = RoundTrip(f);
+    ExpectVerifies(f, h);
+    const auto* cold = MethodOf(f, "check$cold0");
+    EXPECT(cold && Utf8At(f, cold->DescriptorIndex) == "(Ljava/lang/CharSequence;)Ljava/lang/Throwable;");
+    EXPECT(Calls(f, DecodedOf(f, "check"), "check$cold0") == 1);
+    EXPECT(!MethodOf(f, "nulls$cold0"));
+    EXPECT(Calls(f, DecodedOf(f, "nulls"), "toString") == 1);
+    return Failures();
+}
@@ -0,0 +1,166 @@
+/*
+ * LowerInvokeDynamic: a string concatenation lowered takes the BootstrapMethods attribute and the
+ * InvokeDynamic entries with it; a lambda in a method whose frames cannot be computed again leaves the
+ * class as it was, with nothing generated for it; generated classes and bridges take names not taken yet.
+ */
+
+#include "Patch/LowerIndy.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+namespace {
+    constexpr U1 REF_INVOKE_STATIC = 6;
+
+    // the BootstrapMethods attribute of one method per entry of bsms: its handle, then its arguments
+    std::vector<U1> bootstrap_methods(const std::vector<std::vector<U2>>& bsms) {
+        std::vector<U1> info{Hi(static_cast<int>(bsms.size())), Lo(static_cast<int>(bsms.size()))};
+        for (auto& b : bsms) {
+            const int n = static_cast<int>(b.size()) - 1;
+            info.insert(info.end(), {Hi(b[0]), Lo(b[0]), Hi(n), Lo(n)});
+            for (int i = 1; i <= n; i++) { info.insert(info.end(), {Hi(b[i]), Lo(b[i])}); }
+        }
+        return info;
+    }
+
+    bool has_attribute(const ClassFile& f, const std::string_view name) {
+        for (auto& a : f.Attributes) {
+            if (Utf8At(f, a.AttributeNameIndex) == name) { return true; }
+        }
+        return false;
+    }
+
+    int invoke_dynamic_entries(const ClassFile& f) {
+        int n = 0;
+        for (auto& e : f.ConstantPool) { n += e && e->Tag == CPoolTags::InvokeDynamic; }
+        return n;
+    }
+
+    void concat() {
+        Support::ClassBuilder b("test/Concat", "java/lang/Object");
+        const U2 bsm = b.MethodHandle(REF_INVOKE_STATIC, b.MethodRef("java/lang/invoke/StringConcatFactory",
+            "makeConcatWithConstants", "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;"
+            "Ljava/lang/invoke/MethodType;Ljava/lang/String;[Ljava/lang/Object;)Ljava/lang/invoke/CallSite;"));
+        const U2 indy = b.InvokeDynamic(0, "makeConcatWithConstants", "(I)Ljava/lang/String;");
+        b.AddAttribute(b.Attribute("BootstrapMethods", bootstrap_methods({{bsm, b.String("n=\1")}})));
+        // return "n=" + n;
+        b.AddMethod(0x0009, "show", "(I)Ljava/lang/String;", {b.Code(1, 1, {
+            OP_ILOAD_0,                                  // 0
+            OP_INVOKEDYNAMIC, Hi(indy), Lo(indy), 0, 0,  // 1
+            OP_ARETURN,                                  // 6
+        })});
+
+        ClassHierarchy h;
+        auto f = Input(b, h);
+        ExpectVerifies(f, h);
+
+        EXPECT(Patch::LowerInvokeDynamic(f, h, nullptr) == 1);
+        f = RoundTrip(f);
+        ExpectVerifies(f, h);
+        EXPECT(Count(DecodedOf(f, "show"), OP_INVOKEDYNAMIC) == 0);
+        EXPECT(Calls(f, DecodedOf(f, "show"), "append") == 2);
+        EXPECT(!has_attribute(f, "BootstrapMethods"));
+        EXPECT(invoke_dynamic_entries(f) == 0);
+    }
+
+    void lambda() {
+        Support::ClassBuilder b("test/Pick", "java/lang/Object");
+        const U2 bsm = b.MethodHandle(REF_INVOKE_STATIC, b.MethodRef("java/lang/invoke/LambdaMetafactory",
+            "metafactory", "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;Ljava/lang/invoke/MethodType;"
+            "Ljava/lang/invoke/MethodType;Ljava/lang/invoke/MethodHandle;Ljava/lang/invoke/MethodType;)"
+            "Ljava/lang/invoke/CallSite;"));
+        const U2 run = b.MethodType("()V");
+        const U2 pick_impl = b.MethodHandle(REF_INVOKE_STATIC, b.MethodRef("test/Pick", "lambda$pick$0", "()V"));
+        const U2 make_impl = b.MethodHandle(REF_INVOKE_STATIC, b.MethodRef("test/Pick", "lambda$make$1", "()V"));
+        const U2 pick_indy = b.InvokeDynamic(0, "run", "()Ljava/lang/Runnable;");
+        const U2 make_indy = b.InvokeDynamic(1, "run", "()Ljava/lang/Runnable;");
+        b.AddAttribute(b.Attribute("BootstrapMethods",
+                                   bootstrap_methods({{bsm, run, pick_impl, run}, {bsm, run, make_impl, run}})));
+        b.AddMethod(0x100a, "lambda$pick$0", "()V", {b.Code(0, 0, {OP_RETURN})});
+        b.AddMethod(0x100a, "lambda$make$1", "()V", {b.Code(0, 0, {OP_RETURN})});
+        // return () -> {};
+        b.AddMethod(0x0009, "make", "()Ljava/lang/Runnable;", {b.Code(1, 0, {
+            OP_INVOKEDYNAMIC, Hi(make_indy), Lo(make_indy), 0, 0,  // 0
+            OP_ARETURN,                                            // 5
+        })});
+        // Runnable r = () -> {}; Base x = c ? a : b; return x; with A and B (and so what they have in
+        // common) unknown to the hierarchy
+        const U2 a = b.Class("test/A"), c = b.Class("test/B"), base = b.Class("test/Base");
+        b.AddMethod(0x0009, "pick", "(ZLtest/A;Ltest/B;)Ljava/lang/Object;", {b.Code(1, 4, {
+            OP_INVOKEDYNAMIC, Hi(pick_indy), Lo(pick_indy), 0, 0,  // 0
+            OP_POP,                                                // 5
+            OP_ILOAD_0,                                            // 6
+            OP_IFEQ, Hi(14 - 7), Lo(14 - 7),                       // 7
+            OP_ALOAD_1,                                            // 10
+            OP_GOTO, Hi(15 - 11), Lo(15 - 11),                     // 11
+            OP_ALOAD_2,                                            // 14: frame [int, A, B]
+            OP_ASTORE_3,                                           // 15: frame [int, A, B] [Base]
+            OP_ALOAD_3,                                            // 16
+            OP_ARETURN,                                            // 17
+        }, {b.Attribute("StackMapTable", {
+            0, 2,
+            14,                                                    // same_frame
+            255, 0, 0, 0, 3, 1, 7, Hi(a), Lo(a), 7, Hi(c), Lo(c),  // full_frame
+            0, 1, 7, Hi(base), Lo(base),
+        })})});
+
+        ClassHierarchy h;
+        auto f = Read(b.Build());
+        h.AddClassFile(f);
+        const auto before = CodeOf(f, *MethodOf(f, "pick")).Code;
+
+        std::vector<ClassFile> lambdas;
+        EXPECT(Patch::LowerInvokeDynamic(f, h, &lambdas) == 1);
+        f = RoundTrip(f);
+        EXPECT(lambdas.size() == 1);
+        EXPECT(Count(DecodedOf(f, "make"), OP_INVOKEDYNAMIC) == 0);
+        EXPECT(CodeOf(f, *MethodOf(f, "pick")).Code == before);
+        EXPECT(!(MethodOf(f, "lambda$make$1")->AccessFlags & 0x0002));
+        EXPECT(MethodOf(f, "lambda$pick$0")->AccessFlags & 0x0002);
+        // pick still bootstraps its lambda
+        EXPECT(has_attribute(f, "BootstrapMethods"));
+        EXPECT(invoke_dynamic_entries(f) == 2);
+    }
+
+    void renamed() {
+        Support::ClassBuilder b("test/Again", "java/lang/Object");
+        const U2 bsm = b.MethodHandle(REF_INVOKE_STATIC, b.MethodRef("java/lang/invoke/LambdaMetafactory",
+            "metafactory", "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;Ljava/lang/invoke/MethodType;"
+            "Ljava/lang/invoke/MethodType;Ljava/lang/invoke/MethodHandle;Ljava/lang/invoke/MethodType;)"
+            "Ljava/lang/invoke/CallSite;"));
+        const U2 run = b.MethodType("()V");
+        const U2 impl = b.MethodHandle(REF_INVOKE_STATIC, b.MethodRef("test/Again", "helper", "()V"));
+        const U2 indy = b.InvokeDynamic(0, "run", "()Ljava/lang/Runnable;");
+        b.AddAttribute(b.Attribute("BootstrapMethods", bootstrap_methods({{bsm, run, impl, run}})));
+        // private, so called through a bridge; and a bridge from a run before
+        b.AddMethod(0x000a, "helper", "()V", {b.Code(0, 0, {OP_RETURN})});
+        b.AddMethod(0x1008, "access$lambda$0", "()V", {b.Code(0, 0, {OP_RETURN})});
+        // return Again::helper;
+        b.AddMethod(0x0009, "make", "()Ljava/lang/Runnable;", {b.Code(1, 0, {
+            OP_INVOKEDYNAMIC, Hi(indy), Lo(indy), 0, 0,  // 0
+            OP_ARETURN,                                  // 5
+        })});
+
+        ClassHierarchy h;
+        auto f = Input(b, h);
+        // the class generated by a run before is in the batch
+        h.Add(ClassType("test/Again$$Lambda$0"), ClassType("java/lang/Object"), false);
+
+        std::vector<ClassFile> lambdas;
+        EXPECT(Patch::LowerInvokeDynamic(f, h, &lambdas) == 1);
+        f = RoundTrip(f);
+        ExpectVerifies(f, h);
+        EXPECT(lambdas.size() == 1 && ClassNameAt(lambdas[0], lambdas[0].ThisClass) == "test/Again$$Lambda$1");
+        EXPECT(MethodOf(f, "access$lambda$1"));
+        int bridges = 0;
+        for (auto& m : f.Methods) { bridges += Utf8At(f, m.NameIndex) == "access$lambda$0"; }
+        EXPECT(bridges == 1);
+    }
+}
+
+int main() {
+    concat();
+    lambda();
+    renamed();
+    return Failures();
+}
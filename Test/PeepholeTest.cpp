@@ -0,0 +1,59 @@
+/*
+ * Peephole: x = x + 1 becomes an iinc, x = x and a constant pushed and popped go, and a goto to a return
+ * becomes the return; the loop they are in keeps frames that verify.
+ */
+
+#include "Patch/Peephole.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+int main() {
+    Support::ClassBuilder b("test/Peep", "java/lang/Object");
+    const U2 result = b.FieldRef("test/Peep", "Result", "I");
+    b.AddField(0x0009, "Result", "I");
+    // int sum = 0; for (int i = 0; i < 10; i = i + 1) { sum += i; sum = sum; } Result = sum;
+    b.AddMethod(0x0009, "run", "()V", {b.Code(2, 2, {
+        OP_ICONST_0,                              // 0
+        OP_ISTORE_0,                              // 1
+        OP_ICONST_0,                              // 2
+        OP_ISTORE_1,                              // 3
+        OP_ILOAD_1,                               // 4: frame [int, int]
+        OP_BIPUSH, 10,                            // 5
+        OP_IF_ICMPGE, Hi(25 - 7), Lo(25 - 7),     // 7
+        OP_ILOAD_0,                               // 10
+        OP_ILOAD_1,                               // 11
+        OP_IADD,                                  // 12
+        OP_ISTORE_0,                              // 13
+        OP_ILOAD_1,                               // 14
+        OP_ICONST_1,                              // 15
+        OP_IADD,                                  // 16
+        OP_ISTORE_1,                              // 17
+        OP_ILOAD_0,                               // 18
+        OP_ISTORE_0,                              // 19
+        OP_ICONST_1,                              // 20
+        OP_POP,                                   // 21
+        OP_GOTO, Hi(4 - 22), Lo(4 - 22),          // 22
+        OP_ILOAD_0,                               // 25: frame [int, int]
+        OP_PUTSTATIC, Hi(result), Lo(result),     // 26
+        OP_GOTO, Hi(32 - 29), Lo(32 - 29),        // 29
+        OP_RETURN,                                // 32: frame [int, int]
+    })});
+
+    ClassHierarchy h;
+    auto f = Input(b, h);
+    ExpectVerifies(f, h);
+    const auto before = DecodedOf(f, "run").Insns.size();
+
+    EXPECT(Patch::Peephole(f, h) == 1);
+    f = RoundTrip(f);
+    ExpectVerifies(f, h);
+    const auto code = DecodedOf(f, "run");
+    EXPECT(Count(code, OP_IINC) == 1);
+    EXPECT(Count(code, OP_POP) == 0);
+    EXPECT(Count(code, OP_GOTO) == 1);
+    EXPECT(code.Insns.size() < before);
+    int64_t sum = 0;
+    EXPECT(RunStatic(f, "run", "Result", sum) && sum == 45);
+    return Failures();
+}
@@ -0,0 +1,151 @@
+/*
+ * Reachability: from main, what it calls and the overrides of what it calls virtually in classes it
+ * reaches are kept, and so are the fields it reads; an override in a class nothing reaches is not.
+ * Keep rules match members by name or by name and descriptor, and classes by prefix. A class with a
+ * supertype outside of the batch keeps the methods the library may call back, and a second class of a
+ * name is reachable with the first and keeps all of its members.
+ */
+
+#include "Analyze/Reachability.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+namespace {
+    // whether the method of cls with name and desc is kept
+    bool kept(const Reachability& r, const int cls, const ClassFile& f, const std::string_view name,
+              const std::string_view desc) {
+        const auto methods = r.KeptMethods(cls);
+        for (size_t k = 0; k < f.Methods.size(); k++) {
+            if (Utf8At(f, f.Methods[k].NameIndex) == name && Utf8At(f, f.Methods[k].DescriptorIndex) == desc) {
+                return methods[k];
+            }
+        }
+        return false;
+    }
+
+    ClassFile constructible(Support::ClassBuilder& b, const std::string& super) {
+        const U2 init = b.MethodRef(super, "<init>", "()V");
+        b.AddMethod(0x0001, "<init>", "()V", {b.Code(1, 1, {
+            OP_ALOAD_0,                                 // 0
+            OP_INVOKESPECIAL, Hi(init), Lo(init),       // 1
+            OP_RETURN,                                  // 4
+        })});
+        return Read(b.Build());
+    }
+
+    void rules() {
+        const auto member = KeepRule::Parse("test/Kept#keep(I)V");
+        EXPECT(member.Class == "test/Kept" && member.Member == "keep(I)V");
+        const auto cls = KeepRule::Parse("test/Pre*");
+        EXPECT(cls.Class == "test/Pre*" && cls.Member.empty());
+        const auto main = KeepRule::Main("test/Main");
+        EXPECT(main.Class == "test/Main" && main.Member == "main([Ljava/lang/String;)V");
+    }
+
+    void walk() {
+        // main: new Impl().run(); Lib l = Used; and unused(), Unused never referred to
+        Support::ClassBuilder m("test/Main", "java/lang/Object");
+        const U2 impl = m.Class("test/Impl");
+        const U2 impl_init = m.MethodRef("test/Impl", "<init>", "()V");
+        const U2 run = m.MethodRef("test/Base", "run", "()V");
+        const U2 used = m.FieldRef("test/Main", "Used", "Ltest/Lib;");
+        m.AddField(0x0009, "Used", "Ltest/Lib;");
+        m.AddField(0x0009, "Unused", "I");
+        m.AddMethod(0x0009, "main", "([Ljava/lang/String;)V", {m.Code(2, 1, {
+            OP_NEW, Hi(impl), Lo(impl),                 // 0
+            OP_DUP,                                     // 3
+            OP_INVOKESPECIAL, Hi(impl_init), Lo(impl_init), // 4
+            OP_INVOKEVIRTUAL, Hi(run), Lo(run),         // 7
+            OP_GETSTATIC, Hi(used), Lo(used),           // 10
+            OP_POP,                                     // 13
+            OP_RETURN,                                  // 14
+        })});
+        m.AddMethod(0x0009, "unused", "()V", {m.Code(0, 0, {OP_RETURN})});
+        const auto main = Read(m.Build());
+
+        Support::ClassBuilder b("test/Base", "java/lang/Object");
+        b.AddMethod(0x0001, "run", "()V", {b.Code(0, 1, {OP_RETURN})});
+        b.AddMethod(0x0001, "helper", "()V", {b.Code(0, 1, {OP_RETURN})});
+        const auto base = constructible(b, "java/lang/Object");
+
+        Support::ClassBuilder i("test/Impl", "test/Base");
+        i.AddMethod(0x0001, "run", "()V", {i.Code(0, 1, {OP_RETURN})});
+        i.AddMethod(0x0001, "stop", "()V", {i.Code(0, 1, {OP_RETURN})});
+        const auto impl_class = constructible(i, "test/Base");
+
+        // overrides run, but is never created
+        Support::ClassBuilder n("test/Never", "test/Base");
+        n.AddMethod(0x0001, "run", "()V", {n.Code(0, 1, {OP_RETURN})});
+        const auto never = constructible(n, "test/Base");
+
+        // the library may call any of its instance methods, as a Thread
+        Support::ClassBuilder l("test/Lib", "java/lang/Thread");
+        l.AddMethod(0x0001, "run", "()V", {l.Code(0, 1, {OP_RETURN})});
+        l.AddMethod(0x0001, "own", "()V", {l.Code(0, 1, {OP_RETURN})});
+        l.AddMethod(0x0009, "util", "()V", {l.Code(0, 0, {OP_RETURN})});
+        const auto lib = Read(l.Build());
+
+        Support::ClassBuilder k("test/Kept", "java/lang/Object");
+        k.AddMethod(0x0009, "keep", "()V", {k.Code(0, 0, {OP_RETURN})});
+        k.AddMethod(0x0009, "keep", "(I)V", {k.Code(0, 1, {OP_RETURN})});
+        k.AddMethod(0x0009, "keeper", "()V", {k.Code(0, 0, {OP_RETURN})});
+        const auto keep = Read(k.Build());
+
+        Support::ClassBuilder p("test/Prefixed", "java/lang/Object");
+        p.AddMethod(0x0009, "any", "()V", {p.Code(0, 0, {OP_RETURN})});
+        p.AddField(0x0009, "Any", "I");
+        const auto prefixed = Read(p.Build());
+
+        Reachability r;
+        const int main_id = r.Add(main), base_id = r.Add(base), impl_id = r.Add(impl_class);
+        const int never_id = r.Add(never), lib_id = r.Add(lib), keep_id = r.Add(keep);
+        const int prefixed_id = r.Add(prefixed);
+        const int copy_id = r.Add(never); // a second test/Never
+        r.Keep(KeepRule::Main("test/Main"));
+        r.Keep(KeepRule::Parse("test/Kept#keep"));
+        r.Keep(KeepRule::Parse("test/Pre*"));
+        r.Run();
+
+        EXPECT(r.IsReachable(main_id));
+        EXPECT(kept(r, main_id, main, "main", "([Ljava/lang/String;)V"));
+        EXPECT(!kept(r, main_id, main, "unused", "()V"));
+        EXPECT(r.KeptFields(main_id) == std::vector<bool>({true, false}));
+
+        EXPECT(r.IsReachable(base_id) && r.IsReachable(impl_id));
+        EXPECT(kept(r, base_id, base, "run", "()V") && kept(r, base_id, base, "<init>", "()V"));
+        EXPECT(!kept(r, base_id, base, "helper", "()V"));
+        EXPECT(kept(r, impl_id, impl_class, "run", "()V") && kept(r, impl_id, impl_class, "<init>", "()V"));
+        EXPECT(!kept(r, impl_id, impl_class, "stop", "()V"));
+
+        EXPECT(!r.IsReachable(never_id));
+        EXPECT(!kept(r, never_id, never, "run", "()V"));
+
+        // reached by the type of Used
+        EXPECT(r.IsReachable(lib_id));
+        EXPECT(kept(r, lib_id, lib, "run", "()V") && kept(r, lib_id, lib, "own", "()V"));
+        EXPECT(!kept(r, lib_id, lib, "util", "()V"));
+
+        EXPECT(r.IsReachable(keep_id));
+        EXPECT(kept(r, keep_id, keep, "keep", "()V") && kept(r, keep_id, keep, "keep", "(I)V"));
+        EXPECT(!kept(r, keep_id, keep, "keeper", "()V"));
+
+        EXPECT(r.IsReachable(prefixed_id));
+        EXPECT(r.KeptMethods(prefixed_id) == std::vector<bool>({true}));
+        EXPECT(r.KeptFields(prefixed_id) == std::vector<bool>({true}));
+
+        // reachable when the first test/Never is, with every member
+        EXPECT(!r.IsReachable(copy_id));
+        EXPECT(r.KeptMethods(copy_id) == std::vector<bool>(never.Methods.size(), true));
+
+        const auto total = r.Total(), now = r.Kept();
+        EXPECT(total.Classes == 8 && now.Classes == 6);
+        EXPECT(now.Methods == 1 + 2 + 2 + 2 + 2 + 1 && now.Fields == 1 + 1);
+    }
+}
+
+int main() {
+    rules();
+    walk();
+    return Failures();
+}
@@ -0,0 +1,76 @@
+/*
+ * ScalarReplace: the field of an object that never escapes, accumulated in a loop, goes to a local the
+ * old frames of the loop do not have.
+ */
+
+#include "Patch/ScalarReplace.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+int main() {
+    Support::ClassBuilder p("test/P", "java/lang/Object");
+    p.AddField(0x0001, "x", "I");
+    const U2 object_init = p.MethodRef("java/lang/Object", "<init>", "()V");
+    const U2 px = p.FieldRef("test/P", "x", "I");
+    // P(int x) { this.x = x; }
+    p.AddMethod(0x0001, "<init>", "(I)V", {p.Code(2, 2, {
+        OP_ALOAD_0,                                  // 0
+        OP_INVOKESPECIAL, Hi(object_init), Lo(object_init), // 1
+        OP_ALOAD_0,                                  // 4
+        OP_ILOAD_1,                                  // 5
+        OP_PUTFIELD, Hi(px), Lo(px),                 // 6
+        OP_RETURN,                                   // 9
+    })});
+
+    Support::ClassBuilder b("test/Sum", "java/lang/Object");
+    const U2 cls = b.Class("test/P");
+    const U2 init = b.MethodRef("test/P", "<init>", "(I)V");
+    const U2 x = b.FieldRef("test/P", "x", "I");
+    const U2 result = b.FieldRef("test/Sum", "Result", "I");
+    b.AddField(0x0009, "Result", "I");
+    // P p = new P(0); for (int i = 0; i < 10; i++) p.x += i; Result = p.x;
+    b.AddMethod(0x0009, "run", "()V", {b.Code(3, 2, {
+        OP_NEW, Hi(cls), Lo(cls),                    // 0
+        OP_DUP,                                      // 3
+        OP_ICONST_0,                                 // 4
+        OP_INVOKESPECIAL, Hi(init), Lo(init),        // 5
+        OP_ASTORE_0,                                 // 8
+        OP_ICONST_0,                                 // 9
+        OP_ISTORE_1,                                 // 10
+        OP_ILOAD_1,                                  // 11: frame [P, int]
+        OP_BIPUSH, 10,                               // 12
+        OP_IF_ICMPGE, Hi(33 - 14), Lo(33 - 14),      // 14
+        OP_ALOAD_0,                                  // 17
+        OP_ALOAD_0,                                  // 18
+        OP_GETFIELD, Hi(x), Lo(x),                   // 19
+        OP_ILOAD_1,                                  // 22
+        OP_IADD,                                     // 23
+        OP_PUTFIELD, Hi(x), Lo(x),                   // 24
+        OP_IINC, 1, 1,                               // 27
+        OP_GOTO, Hi(11 - 30), Lo(11 - 30),           // 30
+        OP_ALOAD_0,                                  // 33: frame [P, int]
+        OP_GETFIELD, Hi(x), Lo(x),                   // 34
+        OP_PUTSTATIC, Hi(result), Lo(result),        // 37
+        OP_RETURN,                                   // 40
+    })});
+
+    ClassHierarchy h;
+    const auto pf = Input(p, h);
+    auto f = Input(b, h);
+    ExpectVerifies(f, h);
+
+    ScalarClasses classes;
+    classes.Add(pf);
+    classes.Add(f);
+    EXPECT(classes.Find("test/P") != nullptr);
+    EXPECT(Patch::ScalarReplace(f, classes, h) == 1);
+    f = RoundTrip(f);
+    ExpectVerifies(f, h);
+    const auto code = DecodedOf(f, "run");
+    EXPECT(Count(code, OP_NEW) == 0);
+    EXPECT(Count(code, OP_GETFIELD) == 0);
+    int64_t sum = 0;
+    EXPECT(RunStatic(f, "run", "Result", sum) && sum == 45);
+    return Failures();
+}
@@ -0,0 +1,53 @@
+/*
+ * RecomputeStackMaps: a method without a table gets frames merging its branches to their common
+ * superclass; a method whose descriptor or code cannot be read keeps what it had, and the others of its
+ * class are still done.
+ */
+
+#include "Fixture.h"
+
+using namespace Test;
+
+int main() {
+    Support::ClassBuilder b("test/Frames", "java/lang/Object");
+    // Number x = c ? a : b; return x;
+    b.AddMethod(0x0009, "pick", "(ZLjava/lang/Integer;Ljava/lang/Long;)Ljava/lang/Number;", {b.Code(1, 4, {
+        OP_ILOAD_0,                                  // 0
+        OP_IFEQ, Hi(8 - 1), Lo(8 - 1),               // 1
+        OP_ALOAD_1,                                  // 4
+        OP_GOTO, Hi(9 - 5), Lo(9 - 5),               // 5
+        OP_ALOAD_2,                                  // 8: frame [int, Integer, Long]
+        OP_ASTORE_3,                                 // 9: frame [int, Integer, Long] [Number]
+        OP_ALOAD_3,                                  // 10
+        OP_ARETURN,                                  // 11
+    })});
+    // a descriptor the initial frame cannot be made of
+    b.AddMethod(0x0009, "broken", "(Ltest/Broken)V", {b.Code(0, 1, {OP_RETURN})});
+    // code with a truncated exception table
+    b.AddMethod(0x0009, "cut", "()V", {b.Attribute("Code", {0, 0, 0, 0, 0, 0, 0, 1, OP_RETURN, 0, 1})});
+
+    ClassHierarchy h;
+    auto f = Read(b.Build());
+    h.AddClassFile(f);
+    const auto broken = CodeOf(f, *MethodOf(f, "broken")).Code;
+
+    int kept = -1;
+    try {
+        kept = RecomputeStackMaps(f, h);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "RecomputeStackMaps threw: %s\n", e.what());
+    }
+    EXPECT(kept == 2);
+    f = RoundTrip(f);
+    const auto* pick = MethodOf(f, "pick");
+    const auto code = CodeOf(f, *pick);
+    EXPECT(code.Attributes.size() == 1);
+    try {
+        VerifyStackMap(f, *pick, code, h);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "pick does not verify: %s\n", e.what());
+        EXPECT(false);
+    }
+    EXPECT(CodeOf(f, *MethodOf(f, "broken")).Code == broken);
+    return Failures();
+}
@@ -0,0 +1,54 @@
+/*
+ * EliminateBoxing: an Integer accumulated in a loop goes to an int local the old frame at the head of
+ * the loop does not have.
+ */
+
+#include "Patch/Unboxing.h"
+#include "Fixture.h"
+
+using namespace Test;
+
+int main() {
+    Support::ClassBuilder b("test/Unbox", "java/lang/Object");
+    const U2 value_of = b.MethodRef("java/lang/Integer", "valueOf", "(I)Ljava/lang/Integer;");
+    const U2 int_value = b.MethodRef("java/lang/Integer", "intValue", "()I");
+    const U2 result = b.FieldRef("test/Unbox", "Result", "I");
+    b.AddField(0x0009, "Result", "I");
+    // Integer acc = 0; for (int i = 0; i < 10; i++) acc = acc + i; Result = acc;
+    b.AddMethod(0x0009, "run", "()V", {b.Code(2, 2, {
+        OP_ICONST_0,                              // 0
+        OP_INVOKESTATIC, Hi(value_of), Lo(value_of), // 1
+        OP_ASTORE_0,                              // 4
+        OP_ICONST_0,                              // 5
+        OP_ISTORE_1,                              // 6
+        OP_ILOAD_1,                               // 7: frame [Integer, int]
+        OP_BIPUSH, 10,                            // 8
+        OP_IF_ICMPGE, Hi(29 - 10), Lo(29 - 10),   // 10
+        OP_ALOAD_0,                               // 13
+        OP_INVOKEVIRTUAL, Hi(int_value), Lo(int_value), // 14
+        OP_ILOAD_1,                               // 17
+        OP_IADD,                                  // 18
+        OP_INVOKESTATIC, Hi(value_of), Lo(value_of), // 19
+        OP_ASTORE_0,                              // 22
+        OP_IINC, 1, 1,                            // 23
+        OP_GOTO, Hi(7 - 26), Lo(7 - 26),          // 26
+        OP_ALOAD_0,                               // 29: frame [Integer, int]
+        OP_INVOKEVIRTUAL, Hi(int_value), Lo(int_value), // 30
+        OP_PUTSTATIC, Hi(result), Lo(result),     // 33
+        OP_RETURN,                                // 36
+    })});
+
+    ClassHierarchy h;
+    auto f = Input(b, h);
+    ExpectVerifies(f, h);
+
+    EXPECT(Patch::EliminateBoxing(f, h) == 1);
+    f = RoundTrip(f);
+    ExpectVerifies(f, h);
+    const auto code = DecodedOf(f, "run");
+    EXPECT(Calls(f, code, "valueOf") == 0);
+    EXPECT(Calls(f, code, "intValue") == 0);
+    int64_t sum = 0;
+    EXPECT(RunStatic(f, "run", "Result", sum) && sum == 45);
+    return Failures();
+}